@@ -0,0 +1,848 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * va-bench: drive the encode and video process samples over a matrix of
+ * codec x resolution x rate control x async depth x session count and
+ * write one consolidated JSON or CSV report.
+ *
+ * Every cell launches <sessions> concurrent instances of the sample binary
+ * and repeats that <repeats> times. Per cell the report carries the
+ * aggregate throughput, the percentiles of the per-session frame time
+ * (session wall time / frames), the CPU time of all sessions and the
+ * largest resident set size seen.
+ *
+ * Usage: va-bench <bench.cfg>, see bench.cfg.template.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define MAX_LEN         1024
+#define MAX_ITEMS       16
+#define MAX_SESSIONS    64
+#define MAX_ARGS        32
+#define MAX_PATH        (2 * MAX_LEN)
+
+enum bench_codec {
+    CODEC_H264,
+    CODEC_HEVC,
+    CODEC_AV1,
+    CODEC_VP9,
+    CODEC_JPEG,
+    CODEC_VPP,
+};
+
+static const struct {
+    const char *name;
+    const char *binary;
+    const char *suffix;
+    int has_rc;         /* honours RC_MODES */
+    int has_async;      /* honours ASYNC_DEPTHS (sync vs. pipelined) */
+    int frames_per_run; /* frames one run encodes, 0 for FRAMES */
+} codec_info[] = {
+    [CODEC_H264] = { "h264", "h264encode",    "264", 1, 1, 0 },
+    [CODEC_HEVC] = { "hevc", "hevcencode",    "265", 1, 1, 0 },
+    [CODEC_AV1]  = { "av1",  "av1encode",     "av1", 1, 1, 0 },
+    [CODEC_VP9]  = { "vp9",  "vp9enc",        "ivf", 1, 0, 0 },
+    [CODEC_JPEG] = { "jpeg", "jpegenc",       "jpg", 0, 0, 1 },
+    [CODEC_VPP]  = { "vpp",  "vppscaling_csc", "nv12", 0, 0, 0 },
+};
+
+#define NUM_CODECS (sizeof(codec_info) / sizeof(codec_info[0]))
+
+struct bench_cell {
+    int codec;
+    int width;
+    int height;
+    const char *rc;
+    int async_depth;
+    int sessions;
+};
+
+struct bench_result {
+    int runs;
+    int failures;
+    int last_status;
+    double wall_sec;            /* summed over the repeats */
+    double cpu_ms;
+    long max_rss_kb;
+    double p50, p90, p99;       /* per-session frame time, ms */
+};
+
+/* bench configuration, filled from the cfg file */
+static int g_codecs[MAX_ITEMS];
+static int g_num_codecs;
+static int g_widths[MAX_ITEMS], g_heights[MAX_ITEMS];
+static int g_num_resolutions;
+static char g_rc_modes[MAX_ITEMS][16];
+static int g_num_rc_modes;
+static int g_async_depths[MAX_ITEMS];
+static int g_num_async_depths;
+static int g_sessions[MAX_ITEMS];
+static int g_num_sessions;
+static int g_frames = 60;
+static int g_repeats = 3;
+static int g_bitrate = 4000000;
+static char g_input[MAX_LEN] = "synthetic";
+static char g_bin_dir[MAX_LEN] = "";
+static char g_work_dir[MAX_LEN] = "/tmp";
+static char g_report[MAX_LEN] = "-";
+static int g_report_csv;
+
+static FILE *g_config_file_fd;
+
+/* Frames one run of <codec> encodes, jpegenc writes a single image */
+static int
+codec_frames(int codec)
+{
+    return codec_info[codec].frames_per_run ? codec_info[codec].frames_per_run : g_frames;
+}
+
+static int8_t
+read_value_string(FILE *fp, const char* field_name, char* value)
+{
+    char strLine[MAX_LEN];
+    char* field = NULL;
+    char* str = NULL;
+    uint16_t i;
+
+    if (!fp || !field_name || !value)  {
+        fprintf(stderr, "Invalid fuction parameters\n");
+        return -1;
+    }
+
+    rewind(fp);
+
+    while (!feof(fp)) {
+        if (!fgets(strLine, MAX_LEN, fp))
+            continue;
+
+        for (i = 0; i < MAX_LEN && strLine[i]; i++)
+            if (strLine[i] != ' ') break;
+
+        if (i == MAX_LEN || strLine[i] == '#' || strLine[i] == '\n')
+            continue;
+
+        field = strtok(&strLine[i], ":");
+        if (strcmp(field, field_name))
+            continue;
+
+        if (!(str = strtok(NULL, "\n")))
+            continue;
+
+        /* skip blank space in string */
+        while (*str == ' ')
+            str++;
+
+        strncpy(value, str, MAX_LEN - 1);
+        value[MAX_LEN - 1] = '\0';
+
+        return 0;
+    }
+
+    return -1;
+}
+
+/* Split a comma separated value in place, returns the number of items */
+static int
+split_list(char *str, char *items[], int max_items)
+{
+    int n = 0;
+    char *tok, *save = NULL;
+
+    for (tok = strtok_r(str, ", \t", &save); tok && n < max_items;
+         tok = strtok_r(NULL, ", \t", &save))
+        items[n++] = tok;
+
+    return n;
+}
+
+static int
+parse_int_list(FILE *fp, const char *field_name, int *values, int def)
+{
+    char str[MAX_LEN];
+    char *items[MAX_ITEMS];
+    int i, n;
+
+    if (read_value_string(fp, field_name, str)) {
+        values[0] = def;
+        return 1;
+    }
+
+    n = split_list(str, items, MAX_ITEMS);
+    for (i = 0; i < n; i++)
+        values[i] = atoi(items[i]);
+
+    return n;
+}
+
+static int
+parse_config(void)
+{
+    char str[MAX_LEN];
+    char *items[MAX_ITEMS];
+    int i, j, n;
+
+    if (read_value_string(g_config_file_fd, "CODECS", str)) {
+        fprintf(stderr, "CODECS is required\n");
+        return -1;
+    }
+    n = split_list(str, items, MAX_ITEMS);
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < (int)NUM_CODECS; j++)
+            if (!strcmp(items[i], codec_info[j].name))
+                break;
+        if (j == (int)NUM_CODECS) {
+            fprintf(stderr, "Unknown codec %s\n", items[i]);
+            return -1;
+        }
+        g_codecs[g_num_codecs++] = j;
+    }
+
+    if (read_value_string(g_config_file_fd, "RESOLUTIONS", str))
+        strcpy(str, "1920x1080");
+    n = split_list(str, items, MAX_ITEMS);
+    for (i = 0; i < n; i++) {
+        if (sscanf(items[i], "%dx%d", &g_widths[i], &g_heights[i]) != 2 ||
+            g_widths[i] <= 0 || g_heights[i] <= 0) {
+            fprintf(stderr, "Invalid resolution %s\n", items[i]);
+            return -1;
+        }
+    }
+    g_num_resolutions = n;
+
+    if (read_value_string(g_config_file_fd, "RC_MODES", str))
+        strcpy(str, "CQP");
+    n = split_list(str, items, MAX_ITEMS);
+    for (i = 0; i < n; i++) {
+        strncpy(g_rc_modes[i], items[i], sizeof(g_rc_modes[i]) - 1);
+        g_rc_modes[i][sizeof(g_rc_modes[i]) - 1] = '\0';
+    }
+    g_num_rc_modes = n;
+
+    g_num_async_depths = parse_int_list(g_config_file_fd, "ASYNC_DEPTHS", g_async_depths, 2);
+    g_num_sessions = parse_int_list(g_config_file_fd, "SESSIONS", g_sessions, 1);
+    for (i = 0; i < g_num_sessions; i++) {
+        if (g_sessions[i] < 1 || g_sessions[i] > MAX_SESSIONS) {
+            fprintf(stderr, "SESSIONS must be in 1..%d\n", MAX_SESSIONS);
+            return -1;
+        }
+    }
+
+    if (!read_value_string(g_config_file_fd, "FRAMES", str))
+        g_frames = atoi(str);
+    if (!read_value_string(g_config_file_fd, "REPEATS", str))
+        g_repeats = atoi(str);
+    if (!read_value_string(g_config_file_fd, "BITRATE", str))
+        g_bitrate = atoi(str);
+    if (g_frames < 1 || g_repeats < 1 || g_bitrate < 1) {
+        fprintf(stderr, "FRAMES, REPEATS and BITRATE must be positive\n");
+        return -1;
+    }
+
+    read_value_string(g_config_file_fd, "INPUT", g_input);
+    read_value_string(g_config_file_fd, "BIN_DIR", g_bin_dir);
+    read_value_string(g_config_file_fd, "WORK_DIR", g_work_dir);
+    read_value_string(g_config_file_fd, "REPORT", g_report);
+    if (!read_value_string(g_config_file_fd, "REPORT_FORMAT", str))
+        g_report_csv = !strcmp(str, "csv");
+
+    return 0;
+}
+
+static double
+now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Write <frames> frames of I420 with a moving gradient, so the encoders
+ * see real motion instead of a static picture.
+ */
+static int
+generate_synthetic_input(const char *path, int width, int height, int frames)
+{
+    int cw = (width + 1) / 2, ch = (height + 1) / 2;
+    unsigned char *line;
+    FILE *fp;
+    int f, x, y;
+
+    fp = fopen(path, "wb");
+    if (!fp) {
+        fprintf(stderr, "Failed to create %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    line = malloc(width);
+    if (!line) {
+        fclose(fp);
+        return -1;
+    }
+
+    for (f = 0; f < frames; f++) {
+        for (y = 0; y < height; y++) {
+            for (x = 0; x < width; x++)
+                line[x] = (unsigned char)((x + y + f * 4) & 0xff);
+            fwrite(line, 1, width, fp);
+        }
+        for (y = 0; y < ch; y++) {
+            for (x = 0; x < cw; x++)
+                line[x] = (unsigned char)(128 + ((x + f) & 0x3f) - 32);
+            fwrite(line, 1, cw, fp);
+        }
+        for (y = 0; y < ch; y++) {
+            for (x = 0; x < cw; x++)
+                line[x] = (unsigned char)(128 + ((y + f) & 0x3f) - 32);
+            fwrite(line, 1, cw, fp);
+        }
+    }
+
+    free(line);
+    if (fclose(fp)) {
+        fprintf(stderr, "Failed to write %s\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Resolve the I420 input for a resolution. "synthetic" generates one file
+ * per resolution and frame count; any other value is a path where "%r" is
+ * replaced by <width>x<height>.
+ */
+static int
+prepare_input(int width, int height, int frames, char *path, size_t size)
+{
+    char res[32];
+    const char *p;
+    size_t len = 0;
+
+    snprintf(res, sizeof(res), "%dx%d", width, height);
+
+    if (!strcmp(g_input, "synthetic")) {
+        struct stat st;
+        off_t expected = (off_t)(width * height + 2 * ((width + 1) / 2) * ((height + 1) / 2)) * frames;
+
+        snprintf(path, size, "%s/va-bench-%s-%d.i420", g_work_dir, res, frames);
+        if (!stat(path, &st) && st.st_size == expected)
+            return 0;
+
+        return generate_synthetic_input(path, width, height, frames);
+    }
+
+    for (p = g_input; *p && len + 1 < size; p++) {
+        if (p[0] == '%' && p[1] == 'r') {
+            len += snprintf(path + len, size - len, "%s", res);
+            if (len >= size)
+                return -1;
+            p++;
+        } else
+            path[len++] = *p;
+    }
+    path[len] = '\0';
+
+    if (access(path, R_OK)) {
+        fprintf(stderr, "Input %s is not readable\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int
+vp9_rc_mode(const char *rc)
+{
+    if (!strcmp(rc, "CQP"))
+        return 0;
+    if (!strcmp(rc, "CBR"))
+        return 1;
+    if (!strcmp(rc, "VBR"))
+        return 2;
+    return -1;
+}
+
+/* The video process sample is driven by a cfg file, write one per cell */
+static int
+write_vpp_config(const char *path, const struct bench_cell *cell,
+                 const char *input, const char *output)
+{
+    FILE *fp = fopen(path, "w");
+
+    if (!fp)
+        return -1;
+
+    fprintf(fp, "SRC_FILE_NAME: %s\n", input);
+    fprintf(fp, "SRC_FRAME_WIDTH: %d\n", cell->width);
+    fprintf(fp, "SRC_FRAME_HEIGHT: %d\n", cell->height);
+    fprintf(fp, "SRC_FRAME_FORMAT: NV12\n");
+    fprintf(fp, "SRC_FILE_FORMAT: I420\n");
+    fprintf(fp, "DST_FILE_NAME: %s\n", output);
+    fprintf(fp, "DST_FRAME_WIDTH: %d\n", cell->width);
+    fprintf(fp, "DST_FRAME_HEIGHT: %d\n", cell->height);
+    fprintf(fp, "DST_FRAME_FORMAT: NV12\n");
+    fprintf(fp, "DST_FILE_FORMAT: NV12\n");
+    fprintf(fp, "FRAME_SUM: %d\n", g_frames);
+
+    return fclose(fp) ? -1 : 0;
+}
+
+/*
+ * Build the command line of one session. String storage lives in
+ * <buf>, which has to stay valid until the exec.
+ */
+static int
+build_command(const struct bench_cell *cell, int session, const char *input,
+              char *argv[], char buf[][MAX_PATH])
+{
+    int argc = 0, nbuf = 0;
+    char *output, *tmp;
+
+#define ARG(s)          (argv[argc++] = (char *)(s))
+#define ARGF(...)       (snprintf(buf[nbuf], MAX_PATH, __VA_ARGS__), ARG(buf[nbuf++]))
+
+    if (g_bin_dir[0])
+        ARGF("%s/%s", g_bin_dir, codec_info[cell->codec].binary);
+    else
+        ARG(codec_info[cell->codec].binary);
+
+    output = buf[nbuf++];
+    snprintf(output, MAX_PATH, "%s/va-bench-%d-%d.%s",
+             g_work_dir, (int)getpid(), session, codec_info[cell->codec].suffix);
+
+    switch (cell->codec) {
+    case CODEC_H264:
+    case CODEC_HEVC:
+        ARG("-w");
+        ARGF("%d", cell->width);
+        ARG("-h");
+        ARGF("%d", cell->height);
+        ARG("-n");
+        ARGF("%d", g_frames);
+        ARG("-o");
+        ARG(output);
+        ARG("--srcyuv");
+        ARG(input);
+        ARG("--fourcc");
+        ARG("IYUV");
+        ARG("--rcmode");
+        ARG(cell->rc);
+        ARG("--bitrate");
+        ARGF("%d", g_bitrate);
+        if (cell->async_depth <= 1)
+            ARG("--syncmode");
+        break;
+    case CODEC_AV1:
+        ARG("-n");
+        ARGF("%d", g_frames);
+        ARG("-f");
+        ARG("30");
+        ARG("-o");
+        ARG(output);
+        ARG("--srcyuv");
+        ARG(input);
+        ARG("--fourcc");
+        ARG("IYUV");
+        ARG("--width");
+        ARGF("%d", cell->width);
+        ARG("--height");
+        ARGF("%d", cell->height);
+        ARG("--rcmode");
+        ARG(cell->rc);
+        if (!strcmp(cell->rc, "CQP")) {
+            ARG("--base_q_idx");
+            ARG("128");
+        } else if (!strcmp(cell->rc, "CBR")) {
+            ARG("--target_bitrate");
+            ARGF("%d", g_bitrate);
+        } else {
+            ARG("--vbr_max_bitrate");
+            ARGF("%d", g_bitrate);
+        }
+        if (cell->async_depth <= 1)
+            ARG("--syncmode");
+        break;
+    case CODEC_VP9:
+        ARGF("%d", cell->width);
+        ARGF("%d", cell->height);
+        ARG(input);
+        ARG(output);
+        ARG("--rcmode");
+        ARGF("%d", vp9_rc_mode(cell->rc));
+        ARG("--fb");
+        ARGF("%d", g_bitrate / 1000);
+        ARG("--fn_num");
+        ARGF("%d", g_frames);
+        break;
+    case CODEC_JPEG:
+        ARGF("%d", cell->width);
+        ARGF("%d", cell->height);
+        ARG(input);
+        ARG(output);
+        ARG("0");       /* I420 */
+        ARG("50");
+        break;
+    case CODEC_VPP:
+        tmp = buf[nbuf++];
+        snprintf(tmp, MAX_PATH, "%s/va-bench-%d-%d.cfg", g_work_dir, (int)getpid(), session);
+        if (write_vpp_config(tmp, cell, input, output)) {
+            fprintf(stderr, "Failed to write %s\n", tmp);
+            return -1;
+        }
+        ARG(tmp);
+        break;
+    }
+
+    argv[argc] = NULL;
+
+#undef ARG
+#undef ARGF
+
+    return 0;
+}
+
+static int
+compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static double
+percentile(const double *sorted, int n, int pct)
+{
+    int idx = (int)((int64_t)pct * (n - 1) / 100);
+
+    return n ? sorted[idx] : 0.0;
+}
+
+/*
+ * Run the sessions of one repeat concurrently. Each session's stdout and
+ * stderr go to a log in WORK_DIR so the report stays machine readable.
+ */
+static int
+run_repeat(const struct bench_cell *cell, const char *input,
+           struct bench_result *result, double *frame_ms, int *num_frame_ms)
+{
+    static char buf[MAX_SESSIONS][MAX_ARGS][MAX_PATH];
+    char *argv[MAX_SESSIONS][MAX_ARGS + 1];
+    pid_t pids[MAX_SESSIONS];
+    double start[MAX_SESSIONS];
+    double t0;
+    int i, started = 0, running = 0, ret = 0;
+
+    for (i = 0; i < cell->sessions; i++)
+        if (build_command(cell, i, input, argv[i], buf[i]))
+            return -1;
+
+    memset(pids, 0, sizeof(pids));
+    t0 = now_sec();
+    for (i = 0; i < cell->sessions; i++) {
+        char log[MAX_PATH];
+        pid_t pid;
+
+        snprintf(log, sizeof(log), "%s/va-bench-%d-%d.log", g_work_dir, (int)getpid(), i);
+
+        start[i] = now_sec();
+        pid = fork();
+        if (pid == 0) {
+            int fd = open(log, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+            if (fd >= 0) {
+                dup2(fd, STDOUT_FILENO);
+                dup2(fd, STDERR_FILENO);
+                close(fd);
+            }
+            if (g_bin_dir[0])
+                execv(argv[i][0], argv[i]);
+            else
+                execvp(argv[i][0], argv[i]);
+            fprintf(stderr, "exec %s failed: %s\n", argv[i][0], strerror(errno));
+            _exit(127);
+        }
+        if (pid < 0) {
+            fprintf(stderr, "fork failed: %s\n", strerror(errno));
+            break;
+        }
+        pids[i] = pid;
+        started++;
+        running++;
+    }
+
+    while (running > 0) {
+        struct rusage ru;
+        int status;
+        pid_t pid = wait4(-1, &status, 0, &ru);
+
+        if (pid < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        for (i = 0; i < cell->sessions; i++)
+            if (pids[i] == pid)
+                break;
+        if (i == cell->sessions)
+            continue;
+        running--;
+
+        result->runs++;
+        result->cpu_ms += (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1e3 +
+                          (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e3;
+        if (ru.ru_maxrss > result->max_rss_kb)
+            result->max_rss_kb = ru.ru_maxrss;
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+            result->failures++;
+            result->last_status = WIFEXITED(status) ? WEXITSTATUS(status) : -WTERMSIG(status);
+            continue;
+        }
+
+        frame_ms[(*num_frame_ms)++] = (now_sec() - start[i]) * 1e3 / codec_frames(cell->codec);
+    }
+    result->wall_sec += now_sec() - t0;
+
+    /* sessions that never started count as failed runs of the cell */
+    if (started < cell->sessions) {
+        result->runs += cell->sessions - started;
+        result->failures += cell->sessions - started;
+        result->last_status = -1;
+        ret = -1;
+    }
+
+    for (i = 0; i < cell->sessions; i++) {
+        char path[MAX_PATH];
+
+        snprintf(path, sizeof(path), "%s/va-bench-%d-%d.%s",
+                 g_work_dir, (int)getpid(), i, codec_info[cell->codec].suffix);
+        unlink(path);
+        if (cell->codec == CODEC_VPP) {
+            snprintf(path, sizeof(path), "%s/va-bench-%d-%d.cfg", g_work_dir, (int)getpid(), i);
+            unlink(path);
+        }
+    }
+
+    return ret;
+}
+
+static int
+run_cell(const struct bench_cell *cell, const char *input, struct bench_result *result)
+{
+    double *frame_ms;
+    int n = 0, r;
+
+    memset(result, 0, sizeof(*result));
+
+    frame_ms = calloc((size_t)g_repeats * cell->sessions, sizeof(*frame_ms));
+    if (!frame_ms)
+        return -1;
+
+    for (r = 0; r < g_repeats; r++)
+        if (run_repeat(cell, input, result, frame_ms, &n))
+            break;
+
+    qsort(frame_ms, n, sizeof(*frame_ms), compare_double);
+    result->p50 = percentile(frame_ms, n, 50);
+    result->p90 = percentile(frame_ms, n, 90);
+    result->p99 = percentile(frame_ms, n, 99);
+
+    free(frame_ms);
+    return 0;
+}
+
+static double
+cell_fps(const struct bench_cell *cell, const struct bench_result *result)
+{
+    int ok = result->runs - result->failures;
+
+    return result->wall_sec > 0 ? (double)ok * codec_frames(cell->codec) / result->wall_sec : 0.0;
+}
+
+static void
+report_cell(FILE *fp, const struct bench_cell *cell, const struct bench_result *result, int first)
+{
+    const char *status = result->failures ? "failed" : "ok";
+
+    if (g_report_csv) {
+        fprintf(fp, "%s,%dx%d,%s,%d,%d,%d,%d,%s,%d,%.2f,%.3f,%.3f,%.3f,%.1f,%ld\n",
+                codec_info[cell->codec].name, cell->width, cell->height,
+                cell->rc, cell->async_depth, cell->sessions, codec_frames(cell->codec),
+                result->runs, status, result->last_status, cell_fps(cell, result),
+                result->p50, result->p90, result->p99,
+                result->cpu_ms, result->max_rss_kb);
+        return;
+    }
+
+    fprintf(fp, "%s    {\n", first ? "" : ",\n");
+    fprintf(fp, "      \"codec\": \"%s\",\n", codec_info[cell->codec].name);
+    fprintf(fp, "      \"resolution\": \"%dx%d\",\n", cell->width, cell->height);
+    fprintf(fp, "      \"rc_mode\": \"%s\",\n", cell->rc);
+    fprintf(fp, "      \"async_depth\": %d,\n", cell->async_depth);
+    fprintf(fp, "      \"sessions\": %d,\n", cell->sessions);
+    fprintf(fp, "      \"frames\": %d,\n", codec_frames(cell->codec));
+    fprintf(fp, "      \"runs\": %d,\n", result->runs);
+    fprintf(fp, "      \"status\": \"%s\",\n", status);
+    if (result->failures)
+        fprintf(fp, "      \"exit_status\": %d,\n", result->last_status);
+    fprintf(fp, "      \"fps\": %.2f,\n", cell_fps(cell, result));
+    fprintf(fp, "      \"frame_ms\": { \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f },\n",
+            result->p50, result->p90, result->p99);
+    fprintf(fp, "      \"cpu_ms\": %.1f,\n", result->cpu_ms);
+    fprintf(fp, "      \"max_rss_kb\": %ld\n", result->max_rss_kb);
+    fprintf(fp, "    }");
+}
+
+static void
+print_help(void)
+{
+    printf("The command line usage:\n");
+    printf("    va-bench <bench.cfg>\n\n");
+    printf("Keys of bench.cfg (lists are comma separated):\n");
+    printf("    CODECS:        h264, hevc, av1, vp9, jpeg, vpp\n");
+    printf("    RESOLUTIONS:   <w>x<h> list, default 1920x1080\n");
+    printf("    RC_MODES:      CQP, CBR, VBR, ... default CQP\n");
+    printf("    ASYNC_DEPTHS:  1 runs h264/hevc/av1 with --syncmode, default 2\n");
+    printf("    SESSIONS:      concurrent sessions per cell, default 1\n");
+    printf("    FRAMES:        frames per session, default 60, jpeg encodes 1\n");
+    printf("    REPEATS:       runs per cell, default 3\n");
+    printf("    BITRATE:       bits per second for CBR/VBR, default 4000000\n");
+    printf("    INPUT:         synthetic or an I420 file, %%r expands to <w>x<h>\n");
+    printf("    BIN_DIR:       directory of the sample binaries, default $PATH\n");
+    printf("    WORK_DIR:      scratch directory, default /tmp\n");
+    printf("    REPORT:        report file, default - (stdout)\n");
+    printf("    REPORT_FORMAT: json or csv, default json\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct bench_cell cell;
+    struct bench_result result;
+    char input[MAX_PATH];
+    FILE *report;
+    int c, r, m, a, s, first = 1, failed = 0;
+
+    if (argc != 2 || !strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")) {
+        print_help();
+        return -1;
+    }
+
+    if (NULL == (g_config_file_fd = fopen(argv[1], "r"))) {
+        fprintf(stderr, "Open configure file %s failed!\n", argv[1]);
+        return -1;
+    }
+
+    if (parse_config()) {
+        fclose(g_config_file_fd);
+        return -1;
+    }
+    fclose(g_config_file_fd);
+
+    if (!strcmp(g_report, "-"))
+        report = stdout;
+    else if (NULL == (report = fopen(g_report, "w"))) {
+        fprintf(stderr, "Open report file %s failed!\n", g_report);
+        return -1;
+    }
+
+    if (g_report_csv)
+        fprintf(report, "codec,resolution,rc_mode,async_depth,sessions,frames,runs,"
+                "status,exit_status,fps,frame_ms_p50,frame_ms_p90,frame_ms_p99,"
+                "cpu_ms,max_rss_kb\n");
+    else
+        fprintf(report, "{\n  \"cells\": [\n");
+
+    for (r = 0; r < g_num_resolutions; r++) {
+        for (c = 0; c < g_num_codecs; c++) {
+            int codec = g_codecs[c];
+            /* axes a sample has no knob for collapse to a single cell */
+            int num_rc = codec_info[codec].has_rc ? g_num_rc_modes : 1;
+            int num_async = codec_info[codec].has_async ? g_num_async_depths : 1;
+
+            if (prepare_input(g_widths[r], g_heights[r], codec_frames(codec),
+                              input, sizeof(input))) {
+                failed = 1;
+                continue;
+            }
+
+            for (m = 0; m < num_rc; m++) {
+                if (codec == CODEC_VP9 && vp9_rc_mode(g_rc_modes[m]) < 0)
+                    continue;
+
+                for (a = 0; a < num_async; a++) {
+                    for (s = 0; s < g_num_sessions; s++) {
+                        cell.codec = codec;
+                        cell.width = g_widths[r];
+                        cell.height = g_heights[r];
+                        cell.rc = codec_info[codec].has_rc ? g_rc_modes[m] : "n/a";
+                        cell.async_depth = codec_info[codec].has_async ? g_async_depths[a] : 1;
+                        cell.sessions = g_sessions[s];
+
+                        if (report != stdout)
+                            printf("%s %dx%d rc %s async %d sessions %d\n",
+                                   codec_info[codec].name, cell.width, cell.height,
+                                   cell.rc, cell.async_depth, cell.sessions);
+
+                        if (run_cell(&cell, input, &result)) {
+                            failed = 1;
+                            continue;
+                        }
+                        if (result.failures)
+                            failed = 1;
+
+                        report_cell(report, &cell, &result, first);
+                        first = 0;
+                        fflush(report);
+                    }
+                }
+            }
+        }
+    }
+
+    if (!g_report_csv)
+        fprintf(report, "\n  ]\n}\n");
+
+    if (report != stdout)
+        fclose(report);
+
+    return failed;
+}
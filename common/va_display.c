@@ -54,7 +54,7 @@ static const VADisplayHooks *g_display_hooks_available[] = {
 #endif
     NULL};
 
-static const char *g_display_name;
+const char *g_display_name;
 const char *g_device_name;
 
 static const char *
@@ -152,7 +152,7 @@ va_open_display(void)
             continue;
         if (!g_display_hooks->open_display)
             continue;
-        printf("Trying display: %s\n", g_display_hooks->name);
+        fprintf(stderr, "Trying display: %s\n", g_display_hooks->name);
         va_dpy = g_display_hooks->open_display();
     }
 
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef TESTVAAPI_test_dmabuf_h
+#define TESTVAAPI_test_dmabuf_h
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/udmabuf.h>)
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/udmabuf.h>
+#define TEST_HAVE_UDMABUF 1
+#endif
+#endif
+
+#include <va/va.h>
+#include <va/va_drmcommon.h>
+
+namespace VAAPI
+{
+
+// A page aligned memfd turned into a dma-buf by /dev/udmabuf. This is what
+// the dma-buf tests import, so they run on any kernel with the udmabuf
+// module, GPU or not. valid() is false when udmabuf is not available.
+class UDmaBuf
+{
+public:
+    explicit UDmaBuf(size_t size)
+        : m_fd(-1)
+        , m_memfd(-1)
+        , m_ptr(NULL)
+        , m_size(0)
+    {
+#ifdef TEST_HAVE_UDMABUF
+        const size_t page = sysconf(_SC_PAGESIZE);
+        const int dev = open("/dev/udmabuf", O_RDWR | O_CLOEXEC);
+        if (dev < 0)
+            return;
+
+        m_size = (size + page - 1) / page * page;
+        m_memfd = memfd_create("test-dmabuf", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (m_memfd >= 0 && !ftruncate(m_memfd, m_size)
+            && !fcntl(m_memfd, F_ADD_SEALS, F_SEAL_SHRINK)) {
+            struct udmabuf_create create;
+            memset(&create, 0, sizeof(create));
+            create.memfd = m_memfd;
+            create.flags = UDMABUF_FLAGS_CLOEXEC;
+            create.size = m_size;
+            m_fd = ioctl(dev, UDMABUF_CREATE, &create);
+        }
+        close(dev);
+
+        if (m_fd >= 0) {
+            void* ptr = mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                             m_memfd, 0);
+            m_ptr = ptr == MAP_FAILED ? NULL : static_cast<uint8_t*>(ptr);
+        }
+#else
+        (void)size;
+#endif
+    }
+
+    ~UDmaBuf()
+    {
+#ifdef TEST_HAVE_UDMABUF
+        if (m_ptr)
+            munmap(m_ptr, m_size);
+        if (m_fd >= 0)
+            close(m_fd);
+        if (m_memfd >= 0)
+            close(m_memfd);
+#endif
+    }
+
+    bool valid() const
+    {
+        return m_ptr != NULL;
+    }
+
+    int fd() const
+    {
+        return m_fd;
+    }
+
+    uint8_t* data() const
+    {
+        return m_ptr;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+#ifdef TEST_HAVE_UDMABUF
+    // Import the buffer as a linear NV12 surface of <width>x<height> with
+    // both planes at <pitch>
+    VAStatus importNV12(VADisplay display, uint32_t width, uint32_t height,
+                        uint32_t pitch, VASurfaceID& surface) const
+    {
+        VADRMPRIMESurfaceDescriptor desc;
+        memset(&desc, 0, sizeof(desc));
+        desc.fourcc = VA_FOURCC_NV12;
+        desc.width = width;
+        desc.height = height;
+        desc.num_objects = 1;
+        desc.objects[0].fd = m_fd;
+        desc.objects[0].size = m_size;
+        desc.objects[0].drm_format_modifier = 0; // linear
+        desc.num_layers = 1;
+        desc.layers[0].drm_format = VA_FOURCC_NV12;
+        desc.layers[0].num_planes = 2;
+        desc.layers[0].offset[1] = pitch * height;
+        desc.layers[0].pitch[0] = pitch;
+        desc.layers[0].pitch[1] = pitch;
+
+        VASurfaceAttrib attribs[2];
+        attribs[0].type = VASurfaceAttribMemoryType;
+        attribs[0].flags = VA_SURFACE_ATTRIB_SETTABLE;
+        attribs[0].value.type = VAGenericValueTypeInteger;
+        attribs[0].value.value.i = VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2;
+        attribs[1].type = VASurfaceAttribExternalBufferDescriptor;
+        attribs[1].flags = VA_SURFACE_ATTRIB_SETTABLE;
+        attribs[1].value.type = VAGenericValueTypePointer;
+        attribs[1].value.value.p = &desc;
+
+        return vaCreateSurfaces(display, VA_RT_FORMAT_YUV420, width, height,
+                                &surface, 1, attribs, 2);
+    }
+#endif
+
+private:
+    UDmaBuf(const UDmaBuf&);
+    UDmaBuf& operator=(const UDmaBuf&);
+
+    int m_fd;
+    int m_memfd;
+    uint8_t* m_ptr;
+    size_t m_size;
+};
+
+} // namespace VAAPI
+
+#endif
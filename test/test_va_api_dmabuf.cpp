@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test_va_api_fixture.h"
+#include "test_dmabuf.h"
+
+namespace VAAPI
+{
+
+class VAAPIDmaBuf
+    : public VAAPIFixtureSharedDisplay
+{
+protected:
+    // Create a VideoProc config and check the driver lists <memType> among
+    // the surface memory types, skips the test otherwise
+    bool supportsMemoryType(uint32_t memType)
+    {
+        if (!isSupported(VAProfileNone, VAEntrypointVideoProc)) {
+            skipTest(VAProfileNone, VAEntrypointVideoProc);
+            return false;
+        }
+
+        createConfig(VAProfileNone, VAEntrypointVideoProc);
+
+        SurfaceAttributes attribs;
+        querySurfaceAttributes(attribs);
+        const auto match = std::find_if(attribs.begin(), attribs.end(),
+        [](const VASurfaceAttrib & a) {
+            return a.type == VASurfaceAttribMemoryType;
+        });
+        if (match == attribs.end() || !(match->value.value.i & memType)) {
+            destroyConfig();
+            skipTest("memory type not supported by the driver");
+            return false;
+        }
+
+        return true;
+    }
+};
+
+#ifdef TEST_HAVE_UDMABUF
+
+TEST_F(VAAPIDmaBuf, ImportUDmaBuf)
+{
+    const uint32_t width = 64, height = 64, pitch = 64;
+
+    UDmaBuf buffer(pitch * height * 3 / 2);
+    if (!buffer.valid()) {
+        skipTest("/dev/udmabuf not available");
+        return;
+    }
+    if (!supportsMemoryType(VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2))
+        return;
+
+    for (size_t i = 0; i < buffer.size(); i++)
+        buffer.data()[i] = (uint8_t)(i * 7);
+
+    VASurfaceID surface = VA_INVALID_SURFACE;
+    ASSERT_STATUS(buffer.importNV12(m_vaDisplay, width, height, pitch, surface));
+    ASSERT_ID(surface);
+
+    // the driver must see the pages the CPU wrote, if it lets us look
+    VAImage image;
+    if (vaDeriveImage(m_vaDisplay, surface, &image) == VA_STATUS_SUCCESS) {
+        void* data = NULL;
+        ASSERT_STATUS(vaMapBuffer(m_vaDisplay, image.buf, &data));
+        const uint8_t* pixels = static_cast<const uint8_t*>(data);
+        for (uint32_t row = 0; row < height; row++) {
+            EXPECT_EQ(0, memcmp(pixels + image.offsets[0] + row * image.pitches[0],
+                                buffer.data() + row * pitch, width))
+                    << "luma row " << row;
+        }
+        EXPECT_STATUS(vaUnmapBuffer(m_vaDisplay, image.buf));
+        EXPECT_STATUS(vaDestroyImage(m_vaDisplay, image.image_id));
+    }
+
+    EXPECT_STATUS(vaDestroySurfaces(m_vaDisplay, &surface, 1));
+    destroyConfig();
+}
+
+#endif // TEST_HAVE_UDMABUF
+
+TEST_F(VAAPIDmaBuf, ExportSurface)
+{
+    if (!supportsMemoryType(VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2))
+        return;
+
+    Surfaces surfaces(1, VA_INVALID_SURFACE);
+    createSurfaces(surfaces, VA_RT_FORMAT_YUV420, Resolution(64, 64));
+    ASSERT_ID(surfaces.front());
+
+    VADRMPRIMESurfaceDescriptor desc;
+    memset(&desc, 0, sizeof(desc));
+    const VAStatus status = vaExportSurfaceHandle(m_vaDisplay, surfaces.front(),
+                            VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2,
+                            VA_EXPORT_SURFACE_READ_ONLY | VA_EXPORT_SURFACE_COMPOSED_LAYERS,
+                            &desc);
+    if (status == VA_STATUS_ERROR_UNIMPLEMENTED
+        || status == VA_STATUS_ERROR_UNSUPPORTED_MEMORY_TYPE) {
+        destroySurfaces(surfaces);
+        destroyConfig();
+        skipTest("vaExportSurfaceHandle not supported by the driver");
+        return;
+    }
+    ASSERT_STATUS(status);
+
+    EXPECT_GE(desc.num_objects, 1u);
+    EXPECT_EQ(1u, desc.num_layers);
+    EXPECT_GE(desc.width, 64u);
+    EXPECT_GE(desc.height, 64u);
+    for (uint32_t i = 0; i < desc.num_objects; i++) {
+        EXPECT_GE(desc.objects[i].fd, 0);
+        EXPECT_GT(desc.objects[i].size, 0u);
+        close(desc.objects[i].fd);
+    }
+
+    destroySurfaces(surfaces);
+    destroyConfig();
+}
+
+} // namespace VAAPI
@@ -50,10 +50,10 @@ VAStatus VAAPIFixtureSharedDisplay::s_initStatus = VA_STATUS_SUCCESS;
 VAAPIFixture::VAAPIFixture()
     : ::testing::Test::Test()
     , m_vaDisplay(NULL)
-    , m_drmHandle(-1)
     , m_configID(VA_INVALID_ID)
     , m_contextID(VA_INVALID_ID)
     , m_bufferID(VA_INVALID_ID)
+    , m_drmHandle(-1)
     , m_skip("")
 {
     // If we do not copy the value and use the same pointer returned by getenv to restore the value
@@ -101,14 +101,14 @@ protected:
     // VAAPIFixture.
     VADisplay m_vaDisplay;
 
-private:
-    std::string m_restoreDriverName;
-    int m_drmHandle;
-
     VAConfigID m_configID;
     VAContextID m_contextID;
     VABufferID m_bufferID;
 
+private:
+    std::string m_restoreDriverName;
+    int m_drmHandle;
+
     std::string m_skip;
 };
 
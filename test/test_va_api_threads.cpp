@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test_va_api_fixture.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <thread>
+
+namespace VAAPI
+{
+
+// Stress the driver from 1..64 threads sharing one display. Every thread
+// runs the same create/use/destroy sequence; besides checking that all
+// calls succeed, the aggregate throughput is compared with the single
+// thread run of the same operation. Serialization inside the driver keeps
+// the throughput flat, a lock convoy makes it collapse. Since wall clock
+// numbers depend on the machine load, a thread count below 50% of the single
+// thread throughput is only logged as a possible convoy by default; when
+// VA_STRESS_CONVOY_RATIO is set, a thread count whose throughput drops below
+// that percentage of the single thread throughput fails.
+// VA_STRESS_ITERATIONS sets the calls per thread, 200 by default.
+
+enum StressOperation {
+    StressBuffers,  // vaCreateBuffer/vaMapBuffer/vaUnmapBuffer/vaDestroyBuffer
+    StressSurfaces, // vaCreateSurfaces/vaDeriveImage/vaDestroySurfaces
+};
+
+inline std::ostream&
+operator<<(std::ostream& os, const StressOperation& op)
+{
+    return os << (op == StressBuffers ? "Buffers" : "Surfaces");
+}
+
+static const std::vector<unsigned> g_stressThreads = {
+    1, 2, 4, 8, 16, 32, 64,
+};
+
+typedef ::testing::WithParamInterface<std::tuple<StressOperation, unsigned>>
+        StressParamInterface;
+
+class VAAPIThreadStress
+    : public VAAPIFixtureSharedDisplay
+    , public StressParamInterface
+{
+public:
+    VAAPIThreadStress()
+        : operation(::testing::get<0>(GetParam()))
+        , numThreads(::testing::get<1>(GetParam()))
+    { }
+
+protected:
+    const StressOperation& operation;
+    const unsigned& numThreads;
+
+    // aggregate ops/s of the single thread run, per operation
+    static std::map<StressOperation, double> s_singleThread;
+
+    static int getEnvInt(const char* name, int def)
+    {
+        const char* value = getenv(name);
+        return value ? atoi(value) : def;
+    }
+
+    // Run <op> <iterations> times on each of <numThreads> threads released
+    // together, returns the aggregate ops/s or a negative value if any call
+    // failed (the first failing status is stored in <failure>).
+    double runThreads(const std::function<VAStatus ()>& op, int iterations,
+                      VAStatus& failure)
+    {
+        std::atomic<unsigned> ready(0);
+        std::atomic<bool> start(false);
+        std::atomic<int> failed(0);
+        std::atomic<VAStatus> firstFailure(VA_STATUS_SUCCESS);
+        std::vector<std::thread> threads;
+
+        for (unsigned i = 0; i < numThreads; i++) {
+            threads.emplace_back([&]() {
+                ready++;
+                while (!start)
+                    std::this_thread::yield();
+
+                for (int n = 0; n < iterations; n++) {
+                    const VAStatus status = op();
+                    if (status != VA_STATUS_SUCCESS) {
+                        VAStatus expected = VA_STATUS_SUCCESS;
+                        firstFailure.compare_exchange_strong(expected, status);
+                        failed++;
+                        break;
+                    }
+                }
+            });
+        }
+
+        while (ready < numThreads)
+            std::this_thread::yield();
+
+        const auto begin = std::chrono::steady_clock::now();
+        start = true;
+        for (auto& thread : threads)
+            thread.join();
+        const auto end = std::chrono::steady_clock::now();
+
+        failure = firstFailure;
+        if (failed)
+            return -1.0;
+
+        const double seconds = std::chrono::duration<double>(end - begin).count();
+        return (double)numThreads * iterations / std::max(seconds, 1e-9);
+    }
+
+    void report(double opsPerSec)
+    {
+        std::ostringstream oss;
+        oss << operation << " threads " << numThreads << ": "
+            << (uint64_t)opsPerSec << " ops/s, "
+            << (uint64_t)(opsPerSec / numThreads) << " ops/s per thread";
+        std::cout << "[ STRESS  ] " << oss.str() << std::endl;
+        RecordProperty("ops_per_sec", std::to_string((uint64_t)opsPerSec));
+
+        if (numThreads == 1) {
+            s_singleThread[operation] = opsPerSec;
+            return;
+        }
+
+        // needs the single thread run of the same operation, which is
+        // missing when the suite is filtered
+        const auto single = s_singleThread.find(operation);
+        if (single == s_singleThread.end())
+            return;
+
+        // always reported, only fails the test when the ratio is set
+        const int percent = (int)(opsPerSec * 100 / std::max(single->second, 1e-9));
+        RecordProperty("single_thread_percent", std::to_string(percent));
+        if (percent < 50) {
+            std::cout << "[ STRESS  ] possible lock convoy: " << numThreads
+                      << " threads at " << percent << "% of single-thread" << std::endl;
+        }
+
+        if (!getenv("VA_STRESS_CONVOY_RATIO"))
+            return;
+
+        const double ratio = getEnvInt("VA_STRESS_CONVOY_RATIO", 0) / 100.0;
+        EXPECT_GE(opsPerSec, single->second * ratio)
+                << "possible lock convoy: " << numThreads << " threads reach "
+                << (uint64_t)opsPerSec << " ops/s, single thread "
+                << (uint64_t)single->second << " ops/s";
+    }
+};
+
+std::map<StressOperation, double> VAAPIThreadStress::s_singleThread;
+
+TEST_P(VAAPIThreadStress, Throughput)
+{
+    const int iterations = getEnvInt("VA_STRESS_ITERATIONS", 200);
+    const Resolution resolution(352, 288);
+    VAStatus failure = VA_STATUS_SUCCESS;
+    double opsPerSec;
+
+    if (operation == StressBuffers) {
+        // buffers need a context, the video processing one needs no
+        // codec specific setup
+        if (!isSupported(VAProfileNone, VAEntrypointVideoProc)) {
+            skipTest(VAProfileNone, VAEntrypointVideoProc);
+            return;
+        }
+
+        createConfig(VAProfileNone, VAEntrypointVideoProc);
+        doCreateContext(resolution);
+        ASSERT_FALSE(HasFailure());
+
+        const VAContextID context = m_contextID;
+        opsPerSec = runThreads([&]() {
+            VABufferID buffer;
+            void* data;
+            VAStatus status = vaCreateBuffer(m_vaDisplay, context,
+                                             VAProcPipelineParameterBufferType,
+                                             sizeof(VAProcPipelineParameterBuffer),
+                                             1, NULL, &buffer);
+            if (status != VA_STATUS_SUCCESS)
+                return status;
+
+            status = vaMapBuffer(m_vaDisplay, buffer, &data);
+            if (status == VA_STATUS_SUCCESS) {
+                memset(data, 0, sizeof(VAProcPipelineParameterBuffer));
+                status = vaUnmapBuffer(m_vaDisplay, buffer);
+            }
+
+            const VAStatus destroyStatus = vaDestroyBuffer(m_vaDisplay, buffer);
+            return status != VA_STATUS_SUCCESS ? status : destroyStatus;
+        }, iterations, failure);
+
+        doDestroyContext();
+        destroyConfig();
+    } else {
+        // vaDeriveImage is optional, only stress it where it works
+        Surfaces surfaces(1, VA_INVALID_SURFACE);
+        createSurfaces(surfaces, VA_RT_FORMAT_YUV420, resolution);
+        ASSERT_FALSE(HasFailure());
+
+        VAImage image;
+        const bool derive = vaDeriveImage(m_vaDisplay, surfaces.front(),
+                                          &image) == VA_STATUS_SUCCESS;
+        if (derive) {
+            EXPECT_STATUS(vaDestroyImage(m_vaDisplay, image.image_id));
+        }
+        destroySurfaces(surfaces);
+
+        opsPerSec = runThreads([&]() {
+            VASurfaceID surface;
+            VAStatus status = vaCreateSurfaces(m_vaDisplay, VA_RT_FORMAT_YUV420,
+                                               resolution.width,
+                                               resolution.height,
+                                               &surface, 1, NULL, 0);
+            if (status != VA_STATUS_SUCCESS)
+                return status;
+
+            if (derive) {
+                VAImage derived;
+                status = vaDeriveImage(m_vaDisplay, surface, &derived);
+                if (status == VA_STATUS_SUCCESS)
+                    status = vaDestroyImage(m_vaDisplay, derived.image_id);
+            }
+
+            const VAStatus destroyStatus = vaDestroySurfaces(m_vaDisplay,
+                                           &surface, 1);
+            return status != VA_STATUS_SUCCESS ? status : destroyStatus;
+        }, iterations, failure);
+    }
+
+    EXPECT_STATUS(failure) << "with " << numThreads << " threads";
+    if (opsPerSec >= 0.0)
+        report(opsPerSec);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    ThreadStress, VAAPIThreadStress,
+    ::testing::Combine(::testing::Values(StressBuffers, StressSurfaces),
+                       ::testing::ValuesIn(g_stressThreads)));
+
+} // namespace VAAPI
@@ -0,0 +1,603 @@
+/*
+ * Copyright (C) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+// Performance regression tests. Every supported profile/entrypoint/RT format
+// combination times surface, context and buffer creation, buffer map/unmap
+// and vaDeriveImage and compares the median per-call latency against a
+// JSON baseline. The suite is controlled through the environment:
+//
+//   VA_PERF_BASELINE=<file>   baseline to compare against
+//   VA_PERF_OUTPUT=<file>     write this run's results, usable as a baseline
+//   VA_PERF_THRESHOLD=<pct>   allowed slowdown in percent, default 25
+//   VA_PERF_MIN_DELTA=<us>    ignore slowdowns below this, default 2
+//   VA_PERF_ITERATIONS=<n>    timed calls per case, default 100
+//
+// Without VA_PERF_BASELINE the tests only measure, which is what CI does on
+// the null backend to produce a baseline for the lab.
+//
+// The Handoff tests time the three ways a frame in CPU memory reaches a
+// VideoProc surface, per frame size: copying it into a derived image,
+// wrapping it as a user pointer surface and importing it as a dma-buf.
+
+#include "test_va_api_fixture.h"
+#include "test_dmabuf.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <vector>
+
+namespace VAAPI
+{
+
+static double getEnvDouble(const char* name, double def)
+{
+    const char* value = getenv(name);
+
+    return value ? atof(value) : def;
+}
+
+// Measurements of the whole run, keyed by
+// "<profile>/<entrypoint>/<rt format>/<operation>"
+class PerfResults
+{
+public:
+    static PerfResults& instance()
+    {
+        static PerfResults results;
+        return results;
+    }
+
+    bool loadBaseline(const std::string& path)
+    {
+        std::ifstream in(path.c_str());
+        if (!in)
+            return false;
+
+        std::stringstream ss;
+        ss << in.rdbuf();
+        const std::string json = ss.str();
+
+        // The baseline is the flat document written by save(), so a key
+        // scanner is enough: every "key": value pair is either the vendor
+        // string or a latency.
+        size_t pos = 0;
+        while ((pos = json.find('"', pos)) != std::string::npos) {
+            const size_t end = json.find('"', pos + 1);
+            if (end == std::string::npos)
+                break;
+            const std::string key = json.substr(pos + 1, end - pos - 1);
+
+            size_t value = json.find_first_not_of(" \t\r\n", end + 1);
+            if (value == std::string::npos || json[value] != ':') {
+                pos = end + 1;
+                continue;
+            }
+            value = json.find_first_not_of(" \t\r\n", value + 1);
+            if (value == std::string::npos)
+                break;
+
+            if (json[value] == '"') {
+                const size_t valueEnd = json.find('"', value + 1);
+                if (valueEnd == std::string::npos)
+                    break;
+                if (key == "vendor")
+                    m_baselineVendor = json.substr(value + 1, valueEnd - value - 1);
+                pos = valueEnd + 1;
+            } else if (json[value] == '{') {
+                pos = value + 1;
+            } else {
+                char* numberEnd = NULL;
+                const double us = strtod(json.c_str() + value, &numberEnd);
+                m_baseline[key] = us;
+                pos = numberEnd - json.c_str();
+            }
+        }
+
+        return true;
+    }
+
+    bool save(const std::string& path) const
+    {
+        std::ofstream out(path.c_str());
+        if (!out)
+            return false;
+
+        out << "{\n  \"vendor\": \"" << m_vendor << "\",\n  \"results\": {";
+        const char* sep = "\n";
+        for (const auto& result : m_results) {
+            out << sep << "    \"" << result.first << "\": "
+                << std::fixed << std::setprecision(3) << result.second;
+            sep = ",\n";
+        }
+        out << "\n  }\n}\n";
+
+        return out.good();
+    }
+
+    void setVendor(const std::string& vendor)
+    {
+        // keep the document well formed whatever the driver reports
+        m_vendor.clear();
+        for (const char c : vendor)
+            if (c != '"' && c != '\\' && (unsigned char)c >= 0x20)
+                m_vendor += c;
+    }
+
+    // The baseline only applies to the driver it was recorded with
+    bool hasBaseline() const
+    {
+        return !m_baseline.empty() && m_baselineVendor == m_vendor;
+    }
+
+    const std::string& baselineVendor() const
+    {
+        return m_baselineVendor;
+    }
+
+    bool baseline(const std::string& key, double& us) const
+    {
+        const auto match = m_baseline.find(key);
+        if (match == m_baseline.end())
+            return false;
+        us = match->second;
+        return true;
+    }
+
+    void record(const std::string& key, double us)
+    {
+        m_results[key] = us;
+    }
+
+private:
+    std::string m_vendor;
+    std::string m_baselineVendor;
+    std::map<std::string, double> m_baseline;
+    std::map<std::string, double> m_results;
+};
+
+class PerfEnvironment : public ::testing::Environment
+{
+public:
+    virtual void SetUp()
+    {
+        const char* path = getenv("VA_PERF_BASELINE");
+        if (path && !PerfResults::instance().loadBaseline(path))
+            std::cout << "[ PERF    ] cannot read baseline " << path << std::endl;
+    }
+
+    virtual void TearDown()
+    {
+        const char* path = getenv("VA_PERF_OUTPUT");
+        if (path && !PerfResults::instance().save(path))
+            std::cout << "[ PERF    ] cannot write " << path << std::endl;
+    }
+};
+
+static ::testing::Environment* const perfEnvironment =
+    ::testing::AddGlobalTestEnvironment(new PerfEnvironment);
+
+static int perfIterations()
+{
+    return std::max(1, (int)getEnvDouble("VA_PERF_ITERATIONS", 100));
+}
+
+static void perfSetVendor(VADisplay display)
+{
+    static bool vendorSet = false;
+    if (vendorSet || !display)
+        return;
+
+    const char* vendor = vaQueryVendorString(display);
+    PerfResults::instance().setVendor(vendor ? vendor : "");
+    vendorSet = true;
+
+    const PerfResults& results = PerfResults::instance();
+    if (!results.baselineVendor().empty() && !results.hasBaseline())
+        std::cout << "[ PERF    ] baseline was recorded with \""
+                  << results.baselineVendor()
+                  << "\", not comparing" << std::endl;
+}
+
+// Time <op> <iterations> times after a short warm up and return the
+// median latency in microseconds, or a negative value if <op> failed.
+static double timeOperation(int iterations, const std::function<VAStatus ()>& op)
+{
+    std::vector<double> samples;
+    samples.reserve(iterations);
+
+    for (int i = 0; i < 3; i++) {
+        if (op() != VA_STATUS_SUCCESS)
+            return -1.0;
+    }
+
+    for (int i = 0; i < iterations; i++) {
+        const auto start = std::chrono::steady_clock::now();
+        const VAStatus status = op();
+        const auto end = std::chrono::steady_clock::now();
+        if (status != VA_STATUS_SUCCESS)
+            return -1.0;
+        samples.push_back(
+            std::chrono::duration<double, std::micro>(end - start).count());
+    }
+
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+// Record <us> under <key> and compare it against the baseline
+static void checkLatency(const std::string& key, const std::string& operation,
+                         double us)
+{
+    EXPECT_GE(us, 0.0) << key << " failed";
+    if (us < 0.0)
+        return;
+
+    PerfResults& results = PerfResults::instance();
+    results.record(key, us);
+    ::testing::Test::RecordProperty(operation, std::to_string(us));
+
+    double base;
+    if (!results.hasBaseline() || !results.baseline(key, base))
+        return;
+
+    const double threshold = getEnvDouble("VA_PERF_THRESHOLD", 25.0);
+    const double minDelta = getEnvDouble("VA_PERF_MIN_DELTA", 2.0);
+
+    EXPECT_TRUE(us <= base * (1.0 + threshold / 100.0) || us - base < minDelta)
+            << key << " regressed: " << us << "us vs. baseline "
+            << base << "us (threshold " << threshold << "%)";
+}
+
+typedef ::testing::WithParamInterface<std::tuple<VAProfile, VAEntrypoint,
+        uint32_t>> PerfParamInterface;
+
+class VAAPIPerf
+    : public VAAPIFixtureSharedDisplay
+    , public PerfParamInterface
+{
+public:
+    VAAPIPerf()
+        : profile(::testing::get<0>(GetParam()))
+        , entrypoint(::testing::get<1>(GetParam()))
+        , format(::testing::get<2>(GetParam()))
+        , iterations(perfIterations())
+    { }
+
+protected:
+    const VAProfile& profile;
+    const VAEntrypoint& entrypoint;
+    const uint32_t& format;
+    const int iterations;
+
+    virtual void SetUp()
+    {
+        VAAPIFixtureSharedDisplay::SetUp();
+        perfSetVendor(m_vaDisplay);
+    }
+
+    double timeOperation(const std::function<VAStatus ()>& op)
+    {
+        return VAAPI::timeOperation(iterations, op);
+    }
+
+    void check(const std::string& operation, double us)
+    {
+        std::ostringstream key;
+        key << vaProfileStr(profile) << "/" << vaEntrypointStr(entrypoint)
+            << "/0x" << std::hex << std::setw(8) << std::setfill('0') << format
+            << "/" << operation;
+
+        checkLatency(key.str(), operation, us);
+    }
+};
+
+static VABufferType perfBufferType(const VAEntrypoint& entrypoint)
+{
+    switch (entrypoint) {
+    case VAEntrypointVideoProc:
+        return VAProcPipelineParameterBufferType;
+    case VAEntrypointEncSlice:
+    case VAEntrypointEncSliceLP:
+    case VAEntrypointEncPicture:
+        return VAEncCodedBufferType;
+    default:
+        return VASliceDataBufferType;
+    }
+}
+
+TEST_P(VAAPIPerf, Latency)
+{
+    if (!isSupported(profile, entrypoint)) {
+        skipTest(profile, entrypoint);
+        return;
+    }
+
+    ConfigAttributes supported;
+    getConfigAttributes(profile, entrypoint, supported);
+    const auto rtFormat = std::find_if(supported.begin(), supported.end(),
+    [](const VAConfigAttrib & a) {
+        return a.type == VAConfigAttribRTFormat;
+    });
+    if (rtFormat == supported.end() || !(rtFormat->value & format)) {
+        std::ostringstream oss;
+        oss << profile << " / " << entrypoint << " / RT format 0x"
+            << std::hex << format << " not supported on this hardware";
+        skipTest(oss.str());
+        return;
+    }
+
+    const ConfigAttributes attribs(
+        1, {/*type :*/ VAConfigAttribRTFormat, /*value :*/ format });
+    createConfig(profile, entrypoint, attribs);
+
+    Resolution minRes, maxRes;
+    getMinMaxSurfaceResolution(minRes, maxRes);
+    Resolution resolution(1920, 1080);
+    if (!resolution.isWithin(minRes, maxRes))
+        resolution = minRes;
+    ASSERT_FALSE(HasFailure());
+
+    // surface creation
+    check("CreateSurfaces", timeOperation([&]() {
+        VASurfaceID surface;
+        VAStatus status = vaCreateSurfaces(m_vaDisplay, format,
+                                           resolution.width, resolution.height,
+                                           &surface, 1, NULL, 0);
+        if (status == VA_STATUS_SUCCESS)
+            status = vaDestroySurfaces(m_vaDisplay, &surface, 1);
+        return status;
+    }));
+
+    Surfaces surfaces(1, VA_INVALID_SURFACE);
+    createSurfaces(surfaces, format, resolution);
+    ASSERT_ID(surfaces.front());
+
+    // context creation, with the surface as render target
+    check("CreateContext", timeOperation([&]() {
+        VAContextID context;
+        VAStatus status = vaCreateContext(m_vaDisplay, m_configID,
+                                          resolution.width, resolution.height,
+                                          VA_PROGRESSIVE, surfaces.data(),
+                                          surfaces.size(), &context);
+        if (status == VA_STATUS_SUCCESS)
+            status = vaDestroyContext(m_vaDisplay, context);
+        return status;
+    }));
+
+    ASSERT_STATUS(vaCreateContext(m_vaDisplay, m_configID, resolution.width,
+                                  resolution.height, VA_PROGRESSIVE,
+                                  surfaces.data(), surfaces.size(),
+                                  &m_contextID));
+
+    // buffer creation and map/unmap of the buffer a pipeline submits most
+    const VABufferType bufferType = perfBufferType(entrypoint);
+    const unsigned bufferSize = bufferType == VAProcPipelineParameterBufferType
+                                ? sizeof(VAProcPipelineParameterBuffer)
+                                : resolution.width * resolution.height;
+
+    check("CreateBuffer", timeOperation([&]() {
+        VABufferID buffer;
+        VAStatus status = vaCreateBuffer(m_vaDisplay, m_contextID, bufferType,
+                                         bufferSize, 1, NULL, &buffer);
+        if (status == VA_STATUS_SUCCESS)
+            status = vaDestroyBuffer(m_vaDisplay, buffer);
+        return status;
+    }));
+
+    createBuffer(bufferType, bufferSize);
+    ASSERT_ID(m_bufferID);
+
+    check("MapBuffer", timeOperation([&]() {
+        void* data;
+        VAStatus status = vaMapBuffer(m_vaDisplay, m_bufferID, &data);
+        if (status == VA_STATUS_SUCCESS)
+            status = vaUnmapBuffer(m_vaDisplay, m_bufferID);
+        return status;
+    }));
+
+    // vaDeriveImage is optional, e.g. for tiled or compressed surfaces
+    const double deriveImage = timeOperation([&]() {
+        VAImage image;
+        VAStatus status = vaDeriveImage(m_vaDisplay, surfaces.front(), &image);
+        if (status == VA_STATUS_SUCCESS)
+            status = vaDestroyImage(m_vaDisplay, image.image_id);
+        return status;
+    });
+    if (deriveImage >= 0.0)
+        check("DeriveImage", deriveImage);
+
+    destroyBuffer();
+    doDestroyContext();
+    m_contextID = VA_INVALID_ID;
+    destroySurfaces(surfaces);
+    destroyConfig();
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Perf, VAAPIPerf,
+    ::testing::Combine(::testing::ValuesIn(g_vaProfiles),
+                       ::testing::ValuesIn(g_vaEntrypoints),
+                       ::testing::ValuesIn(g_vaRTFormats)));
+
+class VAAPIPerfHandoff
+    : public VAAPIFixtureSharedDisplay
+    , public ::testing::WithParamInterface<Resolution>
+{
+public:
+    VAAPIPerfHandoff()
+        : resolution(GetParam())
+        , iterations(perfIterations())
+    { }
+
+protected:
+    const Resolution& resolution;
+    const int iterations;
+
+    virtual void SetUp()
+    {
+        VAAPIFixtureSharedDisplay::SetUp();
+        perfSetVendor(m_vaDisplay);
+    }
+
+    void check(const std::string& operation, double us)
+    {
+        std::ostringstream key;
+        key << "Handoff/" << resolution << "/" << operation;
+
+        checkLatency(key.str(), operation, us);
+    }
+};
+
+// All handoffs move a linear NV12 frame with the pitch equal to the width
+TEST_P(VAAPIPerfHandoff, Latency)
+{
+    if (!isSupported(VAProfileNone, VAEntrypointVideoProc)) {
+        skipTest(VAProfileNone, VAEntrypointVideoProc);
+        return;
+    }
+
+    createConfig(VAProfileNone, VAEntrypointVideoProc);
+
+    Resolution minRes, maxRes;
+    getMinMaxSurfaceResolution(minRes, maxRes);
+    if (!resolution.isWithin(minRes, maxRes)) {
+        destroyConfig();
+        skipTest("resolution not supported by the driver");
+        return;
+    }
+
+    SurfaceAttributes attribs;
+    querySurfaceAttributes(attribs);
+    ASSERT_FALSE(HasFailure());
+    const auto memTypes = std::find_if(attribs.begin(), attribs.end(),
+    [](const VASurfaceAttrib & a) {
+        return a.type == VASurfaceAttribMemoryType;
+    });
+    const uint32_t supportedMemTypes =
+        memTypes == attribs.end() ? 0 : memTypes->value.value.i;
+
+    const uint32_t pitch = resolution.width;
+    const size_t frameSize = (size_t)pitch * resolution.height * 3 / 2;
+    const size_t pageSize = 4096;
+    std::vector<uint8_t> frame(frameSize + pageSize, 0x80);
+    uint8_t* const pixels = reinterpret_cast<uint8_t*>(
+                                ((uintptr_t)frame.data() + pageSize - 1) & ~(uintptr_t)(pageSize - 1));
+
+    // copy in: the frame is written into a driver allocated surface
+    Surfaces surfaces(1, VA_INVALID_SURFACE);
+    createSurfaces(surfaces, VA_RT_FORMAT_YUV420, resolution);
+    ASSERT_ID(surfaces.front());
+
+    const double copyIn = timeOperation(iterations, [&]() {
+        VAImage image;
+        void* data = NULL;
+        VAStatus status = vaDeriveImage(m_vaDisplay, surfaces.front(), &image);
+        if (status != VA_STATUS_SUCCESS)
+            return status;
+        status = vaMapBuffer(m_vaDisplay, image.buf, &data);
+        if (status == VA_STATUS_SUCCESS) {
+            uint8_t* dst = static_cast<uint8_t*>(data);
+            for (uint32_t row = 0; row < resolution.height; row++)
+                memcpy(dst + image.offsets[0] + row * image.pitches[0],
+                       pixels + row * pitch, resolution.width);
+            for (uint32_t row = 0; row < resolution.height / 2; row++)
+                memcpy(dst + image.offsets[1] + row * image.pitches[1],
+                       pixels + (resolution.height + row) * pitch, resolution.width);
+            status = vaUnmapBuffer(m_vaDisplay, image.buf);
+        }
+        vaDestroyImage(m_vaDisplay, image.image_id);
+        return status;
+    });
+    // vaDeriveImage is optional, e.g. for tiled or compressed surfaces
+    if (copyIn >= 0.0)
+        check("CopyIn", copyIn);
+    destroySurfaces(surfaces);
+
+    // user pointer: the frame memory itself becomes the surface
+    if (supportedMemTypes & VA_SURFACE_ATTRIB_MEM_TYPE_USER_PTR) {
+        check("UserPtr", timeOperation(iterations, [&]() {
+            uintptr_t buffer = (uintptr_t)pixels;
+            VASurfaceAttribExternalBuffers external;
+            memset(&external, 0, sizeof(external));
+            external.pixel_format = VA_FOURCC_NV12;
+            external.width = resolution.width;
+            external.height = resolution.height;
+            external.data_size = frameSize;
+            external.num_planes = 2;
+            external.pitches[0] = external.pitches[1] = pitch;
+            external.offsets[1] = pitch * resolution.height;
+            external.buffers = &buffer;
+            external.num_buffers = 1;
+
+            VASurfaceAttrib userPtr[2];
+            userPtr[0].type = VASurfaceAttribMemoryType;
+            userPtr[0].flags = VA_SURFACE_ATTRIB_SETTABLE;
+            userPtr[0].value.type = VAGenericValueTypeInteger;
+            userPtr[0].value.value.i = VA_SURFACE_ATTRIB_MEM_TYPE_USER_PTR;
+            userPtr[1].type = VASurfaceAttribExternalBufferDescriptor;
+            userPtr[1].flags = VA_SURFACE_ATTRIB_SETTABLE;
+            userPtr[1].value.type = VAGenericValueTypePointer;
+            userPtr[1].value.value.p = &external;
+
+            VASurfaceID surface;
+            VAStatus status = vaCreateSurfaces(m_vaDisplay, VA_RT_FORMAT_YUV420,
+                                               resolution.width, resolution.height,
+                                               &surface, 1, userPtr, 2);
+            if (status == VA_STATUS_SUCCESS)
+                status = vaDestroySurfaces(m_vaDisplay, &surface, 1);
+            return status;
+        }));
+    }
+
+#ifdef TEST_HAVE_UDMABUF
+    // dma-buf: the frame lives in a udmabuf the driver imports
+    UDmaBuf buffer(frameSize);
+    if (buffer.valid() && (supportedMemTypes & VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2)) {
+        memcpy(buffer.data(), pixels, frameSize);
+        check("DmaBuf", timeOperation(iterations, [&]() {
+            VASurfaceID surface;
+            VAStatus status = buffer.importNV12(m_vaDisplay, resolution.width,
+                                                resolution.height, pitch, surface);
+            if (status == VA_STATUS_SUCCESS)
+                status = vaDestroySurfaces(m_vaDisplay, &surface, 1);
+            return status;
+        }));
+    }
+#endif
+
+    destroyConfig();
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Perf, VAAPIPerfHandoff,
+    ::testing::Values(Resolution(640, 480), Resolution(1280, 720),
+                      Resolution(1920, 1080), Resolution(3840, 2160)));
+
+} // namespace VAAPI
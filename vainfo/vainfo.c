@@ -26,13 +26,20 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
+#include <sys/stat.h>
 #if !defined(_WIN32)
 #include <unistd.h>
+#include <utime.h>
+#else
+#include <sys/utime.h>
+#define utime _utime
 #endif
 #include <getopt.h>
 #include <va/va_str.h>
 
 #include "va_display.h"
+#include "vainfo_bench.h"
 
 #define CHECK_VASTATUS(va_status,func, ret)                             \
 if (va_status != VA_STATUS_SUCCESS) {                                   \
@@ -41,6 +48,16 @@ if (va_status != VA_STATUS_SUCCESS) {                                   \
     goto error;                                                         \
 }
 static int show_all_opt = 0;
+static int json_opt = 0;
+static const char *cache_path = NULL;
+static long cache_ttl = 3600;
+static int bench_opt = 0;
+static int bench_threads = 4;
+static int bench_iterations = 200;
+
+/* --display and --device as consumed by va_init_display_args() */
+extern const char *g_display_name;
+extern const char *g_device_name;
 
 static void
 usage_exit(const char *program)
@@ -50,6 +67,14 @@ usage_exit(const char *program)
     fprintf(stdout, "\t--help print this message\n\n");
     fprintf(stdout, "Usage: %s [options]\n", program);
     fprintf(stdout, "  -a, --all                              Show all supported attributes\n");
+    fprintf(stdout, "  -j, --json                             Dump the full capability matrix as JSON\n");
+    fprintf(stdout, "  -c, --cache <path>                     Serve the JSON capability matrix from <path>,\n");
+    fprintf(stdout, "                                         regenerating it when the driver, display or device changes\n");
+    fprintf(stdout, "      --cache-ttl <seconds>              Serve the cache without loading the driver while\n");
+    fprintf(stdout, "                                         it is younger than <seconds> (default 3600)\n");
+    fprintf(stdout, "  -b, --bench                            Measure per-call latency of the VA entry points as JSON\n");
+    fprintf(stdout, "      --bench-threads <n>                Run every case on 1, 2, 4 .. <n> threads (default 4)\n");
+    fprintf(stdout, "      --bench-iterations <n>             Calls per thread and case (default 200)\n");
     va_print_display_options(stdout);
 
     exit(0);
@@ -64,13 +89,19 @@ parse_args(const char *name, int argc, char **argv)
     static struct option long_options[] = {
         {"help", no_argument, 0,     'h'},
         {"all",  no_argument, 0,     'a'},
+        {"json", no_argument, 0,     'j'},
+        {"cache", required_argument, 0, 'c'},
+        {"cache-ttl", required_argument, 0, 't'},
+        {"bench", no_argument, 0,    'b'},
+        {"bench-threads", required_argument, 0, 'n'},
+        {"bench-iterations", required_argument, 0, 'i'},
         { NULL,  0,           NULL,   0 }
     };
 
     va_init_display_args(&argc, argv);
 
     while ((c = getopt_long(argc, argv,
-                            "a",
+                            "ajc:b",
                             long_options,
                             &option_index)) != -1) {
 
@@ -78,12 +109,35 @@ parse_args(const char *name, int argc, char **argv)
         case 'a':
             show_all_opt = 1;
             break;
+        case 'j':
+            json_opt = 1;
+            break;
+        case 'c':
+            cache_path = optarg;
+            break;
+        case 't':
+            cache_ttl = atol(optarg);
+            break;
+        case 'b':
+            bench_opt = 1;
+            break;
+        case 'n':
+            bench_threads = atoi(optarg);
+            break;
+        case 'i':
+            bench_iterations = atoi(optarg);
+            break;
         case 'h':
         default:
             usage_exit(name);
             break;
         }
     }
+
+    if (json_opt + !!cache_path + bench_opt > 1) {
+        fprintf(stderr, "%s: --json, --cache and --bench can not be combined\n", name);
+        exit(1);
+    }
 }
 
 static int show_config_attributes(VADisplay va_dpy, VAProfile profile, VAEntrypoint entrypoint)
@@ -496,6 +550,324 @@ static int show_config_attributes(VADisplay va_dpy, VAProfile profile, VAEntrypo
     return 0;
 }
 
+static const char *surface_attrib_type_str(VASurfaceAttribType type)
+{
+    switch (type) {
+    case VASurfaceAttribNone:                       return "VASurfaceAttribNone";
+    case VASurfaceAttribPixelFormat:                return "VASurfaceAttribPixelFormat";
+    case VASurfaceAttribMinWidth:                   return "VASurfaceAttribMinWidth";
+    case VASurfaceAttribMaxWidth:                   return "VASurfaceAttribMaxWidth";
+    case VASurfaceAttribMinHeight:                  return "VASurfaceAttribMinHeight";
+    case VASurfaceAttribMaxHeight:                  return "VASurfaceAttribMaxHeight";
+    case VASurfaceAttribMemoryType:                 return "VASurfaceAttribMemoryType";
+    case VASurfaceAttribExternalBufferDescriptor:   return "VASurfaceAttribExternalBufferDescriptor";
+    case VASurfaceAttribUsageHint:                  return "VASurfaceAttribUsageHint";
+    default:                                        return "<unknown>";
+    }
+}
+
+/* Append "<key>": "<value>", with <value> escaped as a JSON string */
+static size_t json_append_string(char *buf, size_t size, size_t len,
+                                 const char *key, const char *value)
+{
+    const unsigned char *p;
+
+    len += snprintf(buf + len, size - len, "  \"%s\": \"", key);
+    for (p = (const unsigned char *)value; *p && len + 8 < size; p++) {
+        if (*p == '"' || *p == '\\')
+            len += snprintf(buf + len, size - len, "\\%c", *p);
+        else if (*p < 0x20)
+            len += snprintf(buf + len, size - len, "\\u%04x", *p);
+        else
+            buf[len++] = *p;
+    }
+    if (len + 4 < size)
+        len += snprintf(buf + len, size - len, "\",\n");
+
+    return len;
+}
+
+/* The first lines name the display and device the dump describes, they
+ * are known before the driver is loaded */
+static size_t format_json_selection(char *buf, size_t size)
+{
+    size_t len;
+
+    len = snprintf(buf, size, "{\n");
+    len = json_append_string(buf, size, len, "display", g_display_name ? g_display_name : "default");
+    return json_append_string(buf, size, len, "device", g_device_name ? g_device_name : "default");
+}
+
+/* The leading lines of every JSON dump identify the display, device and
+ * driver it was taken from, so a cache file can be re-validated without
+ * parsing the document.
+ */
+static void format_json_header(char *buf, size_t size, const char *vendor,
+                               int major_version, int minor_version)
+{
+    size_t len;
+
+    len = format_json_selection(buf, size);
+    len = json_append_string(buf, size, len, "vendor", vendor ? vendor : "<unknown>");
+    snprintf(buf + len, size - len, "  \"va_version\": \"%d.%d\",\n",
+             major_version, minor_version);
+}
+
+/* Returns a malloc'ed list the caller frees, or NULL when the pair has no config */
+static VASurfaceAttrib *query_surface_attributes(VADisplay va_dpy, VAProfile profile, VAEntrypoint entrypoint,
+        unsigned int *num_attribs)
+{
+    VAStatus va_status;
+    VAConfigID config_id;
+    VASurfaceAttrib *attrib_list = NULL;
+
+    *num_attribs = 0;
+    va_status = vaCreateConfig(va_dpy, profile, entrypoint, NULL, 0, &config_id);
+    if (va_status != VA_STATUS_SUCCESS)
+        return NULL;
+
+    va_status = vaQuerySurfaceAttributes(va_dpy, config_id, NULL, num_attribs);
+    if (va_status == VA_STATUS_SUCCESS && *num_attribs > 0) {
+        attrib_list = malloc(*num_attribs * sizeof(VASurfaceAttrib));
+        if (attrib_list)
+            va_status = vaQuerySurfaceAttributes(va_dpy, config_id, attrib_list, num_attribs);
+    }
+
+    if (va_status != VA_STATUS_SUCCESS) {
+        free(attrib_list);
+        attrib_list = NULL;
+        *num_attribs = 0;
+    }
+
+    vaDestroyConfig(va_dpy, config_id);
+    return attrib_list;
+}
+
+static void json_print_entrypoint(FILE *fp, VADisplay va_dpy, VAProfile profile, VAEntrypoint entrypoint)
+{
+    VAConfigAttrib attrib_list[VAConfigAttribTypeMax];
+    VASurfaceAttrib *surf_attribs;
+    unsigned int num_surf_attribs;
+    int max_width = -1, max_height = -1;
+    unsigned int i;
+    int n;
+
+    for (i = 0; i < VAConfigAttribTypeMax; i++)
+        attrib_list[i].type = i;
+
+    if (vaGetConfigAttributes(va_dpy, profile, entrypoint,
+                              attrib_list, VAConfigAttribTypeMax) != VA_STATUS_SUCCESS) {
+        for (i = 0; i < VAConfigAttribTypeMax; i++)
+            attrib_list[i].value = VA_ATTRIB_NOT_SUPPORTED;
+    }
+
+    surf_attribs = query_surface_attributes(va_dpy, profile, entrypoint, &num_surf_attribs);
+
+    /* prefer the codec limit, fall back to the surface limit */
+    if (attrib_list[VAConfigAttribMaxPictureWidth].value != VA_ATTRIB_NOT_SUPPORTED)
+        max_width = attrib_list[VAConfigAttribMaxPictureWidth].value;
+    if (attrib_list[VAConfigAttribMaxPictureHeight].value != VA_ATTRIB_NOT_SUPPORTED)
+        max_height = attrib_list[VAConfigAttribMaxPictureHeight].value;
+    for (i = 0; i < num_surf_attribs; i++) {
+        if (surf_attribs[i].type == VASurfaceAttribMaxWidth && max_width < 0)
+            max_width = surf_attribs[i].value.value.i;
+        else if (surf_attribs[i].type == VASurfaceAttribMaxHeight && max_height < 0)
+            max_height = surf_attribs[i].value.value.i;
+    }
+
+    fprintf(fp, "        {\n");
+    fprintf(fp, "          \"entrypoint\": \"%s\",\n", vaEntrypointStr(entrypoint));
+    fprintf(fp, "          \"max_width\": %d,\n", max_width);
+    fprintf(fp, "          \"max_height\": %d,\n", max_height);
+
+    fprintf(fp, "          \"config_attributes\": {");
+    for (i = 0, n = 0; i < VAConfigAttribTypeMax; i++) {
+        if (attrib_list[i].value == VA_ATTRIB_NOT_SUPPORTED)
+            continue;
+        fprintf(fp, "%s\n            \"%s\": %u", n++ ? "," : "",
+                vaConfigAttribTypeStr(attrib_list[i].type), attrib_list[i].value);
+    }
+    fprintf(fp, "%s},\n", n ? "\n          " : "");
+
+    fprintf(fp, "          \"surface_attributes\": [");
+    for (i = 0, n = 0; i < num_surf_attribs; i++) {
+        VASurfaceAttrib *attrib = &surf_attribs[i];
+
+        if (attrib->flags == VA_SURFACE_ATTRIB_NOT_SUPPORTED)
+            continue;
+
+        fprintf(fp, "%s\n            {\"type\": \"%s\", \"flags\": %u, \"value\": ",
+                n++ ? "," : "", surface_attrib_type_str(attrib->type), attrib->flags);
+
+        if (attrib->type == VASurfaceAttribPixelFormat &&
+            attrib->value.type == VAGenericValueTypeInteger) {
+            uint32_t fourcc = attrib->value.value.i;
+            fprintf(fp, "\"%c%c%c%c\"}", fourcc & 0xff, (fourcc >> 8) & 0xff,
+                    (fourcc >> 16) & 0xff, (fourcc >> 24) & 0xff);
+        } else if (attrib->value.type == VAGenericValueTypeInteger) {
+            fprintf(fp, "%d}", attrib->value.value.i);
+        } else if (attrib->value.type == VAGenericValueTypeFloat) {
+            fprintf(fp, "%f}", attrib->value.value.f);
+        } else {
+            fprintf(fp, "null}");
+        }
+    }
+    fprintf(fp, "%s]\n", n ? "\n          " : "");
+    fprintf(fp, "        }");
+
+    free(surf_attribs);
+}
+
+static int dump_capabilities_json(FILE *fp, VADisplay va_dpy, const char *vendor,
+                                  int major_version, int minor_version)
+{
+    VAStatus va_status;
+    VAProfile *profile_list = NULL;
+    VAEntrypoint *entrypoints = NULL;
+    char header[1024];
+    int num_profiles, num_entrypoint, i, j, n;
+    int ret_val = 0;
+
+    entrypoints = malloc(vaMaxNumEntrypoints(va_dpy) * sizeof(VAEntrypoint));
+    profile_list = malloc(vaMaxNumProfiles(va_dpy) * sizeof(VAProfile));
+    if (!entrypoints || !profile_list) {
+        fprintf(stderr, "Failed to allocate memory for profile/entrypoint list\n");
+        ret_val = 5;
+        goto error;
+    }
+
+    va_status = vaQueryConfigProfiles(va_dpy, profile_list, &num_profiles);
+    CHECK_VASTATUS(va_status, "vaQueryConfigProfiles", 6);
+
+    format_json_header(header, sizeof(header), vendor, major_version, minor_version);
+    fputs(header, fp);
+#ifndef ANDROID
+    fprintf(fp, "  \"libva_version\": \"%s\",\n", LIBVA_VERSION_S);
+#endif
+    fprintf(fp, "  \"profiles\": [");
+
+    for (i = 0, n = 0; i < num_profiles; i++) {
+        va_status = vaQueryConfigEntrypoints(va_dpy, profile_list[i], entrypoints,
+                                             &num_entrypoint);
+        if (va_status == VA_STATUS_ERROR_UNSUPPORTED_PROFILE)
+            continue;
+
+        CHECK_VASTATUS(va_status, "vaQueryConfigEntrypoints", 4);
+
+        fprintf(fp, "%s\n    {\n      \"profile\": \"%s\",\n      \"entrypoints\": [\n",
+                n++ ? "," : "", vaProfileStr(profile_list[i]));
+        for (j = 0; j < num_entrypoint; j++) {
+            json_print_entrypoint(fp, va_dpy, profile_list[i], entrypoints[j]);
+            fprintf(fp, "%s\n", j + 1 < num_entrypoint ? "," : "");
+        }
+        fprintf(fp, "      ]\n    }");
+    }
+    fprintf(fp, "%s]\n}\n", n ? "\n  " : "");
+
+error:
+    free(entrypoints);
+    free(profile_list);
+
+    return ret_val;
+}
+
+static int cache_is_fresh(const char *path)
+{
+    struct stat st;
+
+    if (stat(path, &st) != 0)
+        return 0;
+
+    return difftime(time(NULL), st.st_mtime) < cache_ttl;
+}
+
+static int cache_print(const char *path)
+{
+    char buf[4096];
+    size_t n;
+    FILE *fp = fopen(path, "rb");
+
+    if (!fp)
+        return -1;
+
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        fwrite(buf, 1, n, stdout);
+
+    fclose(fp);
+    return 0;
+}
+
+/* Returns 1 if the cache starts with <expected> */
+static int cache_starts_with(const char *path, const char *expected)
+{
+    char cached[1024];
+    size_t len = strlen(expected);
+    FILE *fp;
+
+    fp = fopen(path, "rb");
+    if (!fp)
+        return 0;
+    if (fread(cached, 1, len, fp) != len) {
+        fclose(fp);
+        return 0;
+    }
+    fclose(fp);
+
+    return memcmp(expected, cached, len) == 0;
+}
+
+/* Compare the identifying header of the cache against the live driver */
+static int cache_matches_driver(const char *path, const char *vendor,
+                                int major_version, int minor_version)
+{
+    char expected[1024];
+
+    format_json_header(expected, sizeof(expected), vendor, major_version, minor_version);
+    return cache_starts_with(path, expected);
+}
+
+/* Compare the display and device of the cache against the command line */
+static int cache_matches_selection(const char *path)
+{
+    char expected[1024];
+
+    format_json_selection(expected, sizeof(expected));
+    return cache_starts_with(path, expected);
+}
+
+static int cache_update(const char *path, VADisplay va_dpy, const char *vendor,
+                        int major_version, int minor_version)
+{
+    char tmp_path[1024];
+    FILE *fp;
+    int ret_val;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    fp = fopen(tmp_path, "wb");
+    if (!fp) {
+        fprintf(stderr, "Failed to open cache file %s\n", tmp_path);
+        return 7;
+    }
+
+    ret_val = dump_capabilities_json(fp, va_dpy, vendor, major_version, minor_version);
+    fclose(fp);
+    if (ret_val) {
+        remove(tmp_path);
+        return ret_val;
+    }
+
+#if defined(_WIN32)
+    remove(path);
+#endif
+    if (rename(tmp_path, path) != 0) {
+        fprintf(stderr, "Failed to replace cache file %s\n", path);
+        remove(tmp_path);
+        return 7;
+    }
+
+    return 0;
+}
+
 int main(int argc, const char* argv[])
 {
     VADisplay va_dpy;
@@ -516,6 +888,12 @@ int main(int argc, const char* argv[])
 
     parse_args(name, argc, (char **)argv);
 
+    /* A recent cache of the same display and device is served without
+     * loading the driver at all */
+    if (cache_path && cache_is_fresh(cache_path) && cache_matches_selection(cache_path) &&
+        !cache_print(cache_path))
+        return 0;
+
     va_dpy = va_open_display();
     if (NULL == va_dpy) {
         fprintf(stderr, "%s: vaGetDisplay() failed\n", name);
@@ -525,6 +903,35 @@ int main(int argc, const char* argv[])
     va_status = vaInitialize(va_dpy, &major_version, &minor_version);
     CHECK_VASTATUS(va_status, "vaInitialize", 3);
 
+    if (cache_path) {
+        driver = vaQueryVendorString(va_dpy);
+        if (cache_matches_driver(cache_path, driver, major_version, minor_version)) {
+            /* same driver, mark the cache as validated again */
+            utime(cache_path, NULL);
+        } else {
+            ret_val = cache_update(cache_path, va_dpy, driver, major_version, minor_version);
+            if (ret_val)
+                goto error;
+        }
+        ret_val = cache_print(cache_path) ? 7 : 0;
+        goto error;
+    }
+
+    if (bench_opt) {
+        char header[1024];
+
+        driver = vaQueryVendorString(va_dpy);
+        format_json_header(header, sizeof(header), driver, major_version, minor_version);
+        ret_val = vainfo_bench(stdout, va_dpy, header, bench_threads, bench_iterations);
+        goto error;
+    }
+
+    if (json_opt) {
+        driver = vaQueryVendorString(va_dpy);
+        ret_val = dump_capabilities_json(stdout, va_dpy, driver, major_version, minor_version);
+        goto error;
+    }
+
     printf("%s: VA-API version: %d.%d",
            name, major_version, minor_version);
 #ifdef ANDROID
@@ -0,0 +1,541 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Per-call latency micro-benchmark of the driver entry points, see
+ * "vainfo --bench". Every case runs the same call in a tight loop from
+ * 1..N threads sharing one display and reports the latency distribution
+ * as JSON so results of two driver builds can be diffed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "vainfo_bench.h"
+
+#if defined(_WIN32)
+
+int vainfo_bench(FILE *fp, VADisplay va_dpy, const char *json_header,
+                 int max_threads, int iterations)
+{
+    fprintf(stderr, "--bench is not supported on this platform\n");
+    return 1;
+}
+
+#else
+
+#include <pthread.h>
+
+enum bench_kind {
+    BENCH_CREATE_SURFACES,
+    BENCH_CREATE_BUFFER,
+    BENCH_MAP_BUFFER,
+    BENCH_UNMAP_BUFFER,
+    BENCH_DERIVE_IMAGE,
+    BENCH_GET_IMAGE,
+    BENCH_PUT_IMAGE,
+    BENCH_SYNC_SURFACE,
+    BENCH_CREATE_CONFIG,
+    BENCH_CREATE_CONTEXT,
+};
+
+struct bench_case {
+    enum bench_kind kind;
+    const char *op;
+    const char *params;
+    uint32_t fourcc;
+    uint32_t rt_format;
+    uint32_t width;
+    uint32_t height;
+    VABufferType buffer_type;
+    uint32_t buffer_size;
+};
+
+#define NV12_1080P_SIZE (1920 * 1080 * 3 / 2)
+
+static const struct bench_case bench_cases[] = {
+    { BENCH_CREATE_SURFACES, "vaCreateSurfaces", "NV12 352x288",   VA_FOURCC_NV12, VA_RT_FORMAT_YUV420,      352,  288, 0, 0 },
+    { BENCH_CREATE_SURFACES, "vaCreateSurfaces", "NV12 1920x1080", VA_FOURCC_NV12, VA_RT_FORMAT_YUV420,      1920, 1080, 0, 0 },
+    { BENCH_CREATE_SURFACES, "vaCreateSurfaces", "NV12 3840x2160", VA_FOURCC_NV12, VA_RT_FORMAT_YUV420,      3840, 2160, 0, 0 },
+    { BENCH_CREATE_SURFACES, "vaCreateSurfaces", "P010 1920x1080", VA_FOURCC_P010, VA_RT_FORMAT_YUV420_10,   1920, 1080, 0, 0 },
+    { BENCH_CREATE_SURFACES, "vaCreateSurfaces", "P010 3840x2160", VA_FOURCC_P010, VA_RT_FORMAT_YUV420_10,   3840, 2160, 0, 0 },
+    { BENCH_CREATE_SURFACES, "vaCreateSurfaces", "YUY2 1920x1080", VA_FOURCC_YUY2, VA_RT_FORMAT_YUV422,      1920, 1080, 0, 0 },
+    { BENCH_CREATE_SURFACES, "vaCreateSurfaces", "ARGB 1920x1080", VA_FOURCC_ARGB, VA_RT_FORMAT_RGB32,       1920, 1080, 0, 0 },
+    { BENCH_CREATE_SURFACES, "vaCreateSurfaces", "ARGB 3840x2160", VA_FOURCC_ARGB, VA_RT_FORMAT_RGB32,       3840, 2160, 0, 0 },
+    {
+        BENCH_CREATE_BUFFER, "vaCreateBuffer", "VAProcPipelineParameterBufferType", 0, 0, 0, 0,
+        VAProcPipelineParameterBufferType, sizeof(VAProcPipelineParameterBuffer)
+    },
+    {
+        BENCH_CREATE_BUFFER, "vaCreateBuffer", "VAProcFilterParameterBufferType", 0, 0, 0, 0,
+        VAProcFilterParameterBufferType, sizeof(VAProcFilterParameterBuffer)
+    },
+    {
+        BENCH_CREATE_BUFFER, "vaCreateBuffer", "VAImageBufferType 1920x1080 NV12", 0, 0, 0, 0,
+        VAImageBufferType, NV12_1080P_SIZE
+    },
+    {
+        BENCH_MAP_BUFFER, "vaMapBuffer", "VAProcPipelineParameterBufferType", 0, 0, 0, 0,
+        VAProcPipelineParameterBufferType, sizeof(VAProcPipelineParameterBuffer)
+    },
+    {
+        BENCH_MAP_BUFFER, "vaMapBuffer", "VAImageBufferType 1920x1080 NV12", 0, 0, 0, 0,
+        VAImageBufferType, NV12_1080P_SIZE
+    },
+    {
+        BENCH_UNMAP_BUFFER, "vaUnmapBuffer", "VAProcPipelineParameterBufferType", 0, 0, 0, 0,
+        VAProcPipelineParameterBufferType, sizeof(VAProcPipelineParameterBuffer)
+    },
+    {
+        BENCH_UNMAP_BUFFER, "vaUnmapBuffer", "VAImageBufferType 1920x1080 NV12", 0, 0, 0, 0,
+        VAImageBufferType, NV12_1080P_SIZE
+    },
+    { BENCH_DERIVE_IMAGE,    "vaDeriveImage",    "NV12 1920x1080", VA_FOURCC_NV12, VA_RT_FORMAT_YUV420,      1920, 1080, 0, 0 },
+    { BENCH_DERIVE_IMAGE,    "vaDeriveImage",    "P010 1920x1080", VA_FOURCC_P010, VA_RT_FORMAT_YUV420_10,   1920, 1080, 0, 0 },
+    { BENCH_GET_IMAGE,       "vaGetImage",       "NV12 352x288",   VA_FOURCC_NV12, VA_RT_FORMAT_YUV420,      352,  288, 0, 0 },
+    { BENCH_GET_IMAGE,       "vaGetImage",       "NV12 1920x1080", VA_FOURCC_NV12, VA_RT_FORMAT_YUV420,      1920, 1080, 0, 0 },
+    { BENCH_PUT_IMAGE,       "vaPutImage",       "NV12 352x288",   VA_FOURCC_NV12, VA_RT_FORMAT_YUV420,      352,  288, 0, 0 },
+    { BENCH_PUT_IMAGE,       "vaPutImage",       "NV12 1920x1080", VA_FOURCC_NV12, VA_RT_FORMAT_YUV420,      1920, 1080, 0, 0 },
+    { BENCH_SYNC_SURFACE,    "vaSyncSurface",    "idle NV12 1920x1080", VA_FOURCC_NV12, VA_RT_FORMAT_YUV420, 1920, 1080, 0, 0 },
+    { BENCH_CREATE_CONFIG,   "vaCreateConfig",   "VAProfileNone/VAEntrypointVideoProc", 0, 0, 0, 0, 0, 0 },
+    { BENCH_CREATE_CONTEXT,  "vaCreateContext",  "VAProfileNone/VAEntrypointVideoProc 1920x1080", VA_FOURCC_NV12, VA_RT_FORMAT_YUV420, 1920, 1080, 0, 0 },
+};
+
+struct bench_shared {
+    VADisplay va_dpy;
+    VAConfigID config_id;
+    VAContextID context_id;
+    const struct bench_case *bc;
+    int iterations;
+    pthread_barrier_t barrier;
+
+    /* threads wait here until all of them were created: 1 runs the case,
+     * -1 returns at once because a pthread_create() failed */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int start;
+};
+
+struct bench_thread {
+    struct bench_shared *shared;
+    pthread_t thread;
+    uint64_t *samples;
+    int num_samples;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    VAStatus status;
+};
+
+static uint64_t
+bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static VAStatus
+bench_create_surface(VADisplay va_dpy, const struct bench_case *bc, VASurfaceID *surface)
+{
+    VASurfaceAttrib attrib;
+
+    attrib.type = VASurfaceAttribPixelFormat;
+    attrib.flags = VA_SURFACE_ATTRIB_SETTABLE;
+    attrib.value.type = VAGenericValueTypeInteger;
+    attrib.value.value.i = bc->fourcc;
+
+    return vaCreateSurfaces(va_dpy, bc->rt_format, bc->width, bc->height,
+                            surface, 1, &attrib, 1);
+}
+
+static unsigned int
+bench_bits_per_pixel(uint32_t fourcc)
+{
+    switch (fourcc) {
+    case VA_FOURCC_P010:
+        return 24;
+    case VA_FOURCC_YUY2:
+        return 16;
+    case VA_FOURCC_ARGB:
+        return 32;
+    default:
+        return 12;
+    }
+}
+
+static VAStatus
+bench_create_image(VADisplay va_dpy, const struct bench_case *bc, VAImage *image)
+{
+    VAImageFormat format;
+
+    memset(&format, 0, sizeof(format));
+    format.fourcc = bc->fourcc;
+    format.byte_order = VA_LSB_FIRST;
+    format.bits_per_pixel = bench_bits_per_pixel(bc->fourcc);
+
+    return vaCreateImage(va_dpy, &format, bc->width, bc->height, image);
+}
+
+/* Run one case on the calling thread and record the latency of every timed call */
+static VAStatus
+bench_run_case(struct bench_thread *t)
+{
+    const struct bench_case *bc = t->shared->bc;
+    VADisplay va_dpy = t->shared->va_dpy;
+    VASurfaceID surface = VA_INVALID_SURFACE;
+    VABufferID buffer = VA_INVALID_ID;
+    VAImage image;
+    VAStatus va_status = VA_STATUS_SUCCESS;
+    uint64_t t0 = 0, t1 = 0;
+    void *data;
+    int i;
+
+    image.image_id = VA_INVALID_ID;
+
+    /* per-thread resources that the timed loop operates on */
+    switch (bc->kind) {
+    case BENCH_DERIVE_IMAGE:
+    case BENCH_SYNC_SURFACE:
+    case BENCH_CREATE_CONTEXT:
+        va_status = bench_create_surface(va_dpy, bc, &surface);
+        break;
+    case BENCH_GET_IMAGE:
+    case BENCH_PUT_IMAGE:
+        va_status = bench_create_surface(va_dpy, bc, &surface);
+        if (va_status == VA_STATUS_SUCCESS)
+            va_status = bench_create_image(va_dpy, bc, &image);
+        break;
+    case BENCH_MAP_BUFFER:
+    case BENCH_UNMAP_BUFFER:
+        va_status = vaCreateBuffer(va_dpy, t->shared->context_id, bc->buffer_type,
+                                   bc->buffer_size, 1, NULL, &buffer);
+        break;
+    default:
+        break;
+    }
+
+    pthread_barrier_wait(&t->shared->barrier);
+    t->start_ns = bench_now_ns();
+
+    for (i = 0; va_status == VA_STATUS_SUCCESS && i < t->shared->iterations; i++) {
+        VASurfaceID tmp_surface;
+        VABufferID tmp_buffer;
+        VAConfigID tmp_config;
+        VAContextID tmp_context;
+        VAImage tmp_image;
+
+        switch (bc->kind) {
+        case BENCH_CREATE_SURFACES:
+            t0 = bench_now_ns();
+            va_status = bench_create_surface(va_dpy, bc, &tmp_surface);
+            t1 = bench_now_ns();
+            if (va_status == VA_STATUS_SUCCESS)
+                vaDestroySurfaces(va_dpy, &tmp_surface, 1);
+            break;
+        case BENCH_CREATE_BUFFER:
+            t0 = bench_now_ns();
+            va_status = vaCreateBuffer(va_dpy, t->shared->context_id, bc->buffer_type,
+                                       bc->buffer_size, 1, NULL, &tmp_buffer);
+            t1 = bench_now_ns();
+            if (va_status == VA_STATUS_SUCCESS)
+                vaDestroyBuffer(va_dpy, tmp_buffer);
+            break;
+        case BENCH_MAP_BUFFER:
+            t0 = bench_now_ns();
+            va_status = vaMapBuffer(va_dpy, buffer, &data);
+            t1 = bench_now_ns();
+            if (va_status == VA_STATUS_SUCCESS)
+                vaUnmapBuffer(va_dpy, buffer);
+            break;
+        case BENCH_UNMAP_BUFFER:
+            va_status = vaMapBuffer(va_dpy, buffer, &data);
+            if (va_status != VA_STATUS_SUCCESS)
+                break;
+            t0 = bench_now_ns();
+            va_status = vaUnmapBuffer(va_dpy, buffer);
+            t1 = bench_now_ns();
+            break;
+        case BENCH_DERIVE_IMAGE:
+            t0 = bench_now_ns();
+            va_status = vaDeriveImage(va_dpy, surface, &tmp_image);
+            t1 = bench_now_ns();
+            if (va_status == VA_STATUS_SUCCESS)
+                vaDestroyImage(va_dpy, tmp_image.image_id);
+            break;
+        case BENCH_GET_IMAGE:
+            t0 = bench_now_ns();
+            va_status = vaGetImage(va_dpy, surface, 0, 0, bc->width, bc->height, image.image_id);
+            t1 = bench_now_ns();
+            break;
+        case BENCH_PUT_IMAGE:
+            t0 = bench_now_ns();
+            va_status = vaPutImage(va_dpy, surface, image.image_id, 0, 0, bc->width, bc->height,
+                                   0, 0, bc->width, bc->height);
+            t1 = bench_now_ns();
+            break;
+        case BENCH_SYNC_SURFACE:
+            t0 = bench_now_ns();
+            va_status = vaSyncSurface(va_dpy, surface);
+            t1 = bench_now_ns();
+            break;
+        case BENCH_CREATE_CONFIG:
+            t0 = bench_now_ns();
+            va_status = vaCreateConfig(va_dpy, VAProfileNone, VAEntrypointVideoProc,
+                                       NULL, 0, &tmp_config);
+            t1 = bench_now_ns();
+            if (va_status == VA_STATUS_SUCCESS)
+                vaDestroyConfig(va_dpy, tmp_config);
+            break;
+        case BENCH_CREATE_CONTEXT:
+            t0 = bench_now_ns();
+            va_status = vaCreateContext(va_dpy, t->shared->config_id, bc->width, bc->height,
+                                        VA_PROGRESSIVE, &surface, 1, &tmp_context);
+            t1 = bench_now_ns();
+            if (va_status == VA_STATUS_SUCCESS)
+                vaDestroyContext(va_dpy, tmp_context);
+            break;
+        default:
+            va_status = VA_STATUS_ERROR_UNIMPLEMENTED;
+            break;
+        }
+
+        if (va_status == VA_STATUS_SUCCESS)
+            t->samples[t->num_samples++] = t1 - t0;
+    }
+
+    t->end_ns = bench_now_ns();
+
+    if (image.image_id != VA_INVALID_ID)
+        vaDestroyImage(va_dpy, image.image_id);
+    if (surface != VA_INVALID_SURFACE)
+        vaDestroySurfaces(va_dpy, &surface, 1);
+    if (buffer != VA_INVALID_ID)
+        vaDestroyBuffer(va_dpy, buffer);
+
+    return va_status;
+}
+
+static void *
+bench_thread_func(void *arg)
+{
+    struct bench_thread *t = (struct bench_thread *)arg;
+    struct bench_shared *shared = t->shared;
+    int start;
+
+    pthread_mutex_lock(&shared->lock);
+    while (!shared->start)
+        pthread_cond_wait(&shared->cond, &shared->lock);
+    start = shared->start;
+    pthread_mutex_unlock(&shared->lock);
+
+    if (start > 0)
+        t->status = bench_run_case(t);
+    return NULL;
+}
+
+static int
+compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static double
+percentile_us(const uint64_t *sorted, int n, int pct)
+{
+    return sorted[(int64_t)(n - 1) * pct / 100] / 1000.0;
+}
+
+static void
+bench_print_result(FILE *fp, const struct bench_case *bc, int num_threads,
+                   struct bench_thread *threads, int first)
+{
+    uint64_t *all, sum = 0, start = UINT64_MAX, end = 0;
+    VAStatus va_status = VA_STATUS_SUCCESS;
+    int i, j, n = 0;
+
+    for (i = 0; i < num_threads; i++) {
+        n += threads[i].num_samples;
+        if (threads[i].status != VA_STATUS_SUCCESS)
+            va_status = threads[i].status;
+    }
+
+    fprintf(fp, "%s\n    {\"op\": \"%s\", \"params\": \"%s\", \"threads\": %d",
+            first ? "" : ",", bc->op, bc->params, num_threads);
+
+    all = n ? malloc(n * sizeof(uint64_t)) : NULL;
+    if (va_status != VA_STATUS_SUCCESS || !all) {
+        fprintf(fp, ", \"error\": \"%s\"}", vaErrorStr(va_status));
+        free(all);
+        return;
+    }
+
+    for (i = 0, n = 0; i < num_threads; i++) {
+        for (j = 0; j < threads[i].num_samples; j++) {
+            all[n++] = threads[i].samples[j];
+            sum += threads[i].samples[j];
+        }
+        if (threads[i].start_ns < start)
+            start = threads[i].start_ns;
+        if (threads[i].end_ns > end)
+            end = threads[i].end_ns;
+    }
+    qsort(all, n, sizeof(uint64_t), compare_u64);
+
+    fprintf(fp, ", \"calls\": %d, \"ops_per_sec\": %.1f, \"mean_us\": %.3f"
+            ", \"min_us\": %.3f, \"p50_us\": %.3f, \"p90_us\": %.3f"
+            ", \"p99_us\": %.3f, \"max_us\": %.3f}",
+            n, end > start ? n * 1e9 / (end - start) : 0.0, sum / 1000.0 / n,
+            all[0] / 1000.0, percentile_us(all, n, 50), percentile_us(all, n, 90),
+            percentile_us(all, n, 99), all[n - 1] / 1000.0);
+
+    free(all);
+}
+
+int vainfo_bench(FILE *fp, VADisplay va_dpy, const char *json_header,
+                 int max_threads, int iterations)
+{
+    struct bench_shared shared;
+    struct bench_thread *threads;
+    VASurfaceID render_target = VA_INVALID_SURFACE;
+    VAStatus va_status;
+    size_t c;
+    int num_threads, num_created, i, first = 1, ret = 0;
+    const struct bench_case render_target_case = {
+        BENCH_CREATE_SURFACES, NULL, NULL, VA_FOURCC_NV12, VA_RT_FORMAT_YUV420, 1920, 1080, 0, 0
+    };
+
+    if (max_threads < 1)
+        max_threads = 1;
+    if (iterations < 1)
+        iterations = 1;
+
+    memset(&shared, 0, sizeof(shared));
+    shared.va_dpy = va_dpy;
+    shared.iterations = iterations;
+    shared.config_id = VA_INVALID_ID;
+    shared.context_id = VA_INVALID_ID;
+    pthread_mutex_init(&shared.lock, NULL);
+    pthread_cond_init(&shared.cond, NULL);
+
+    /* buffers and contexts need a VPP config, the cases that rely on them
+     * report the error when the driver has no VideoProc entrypoint */
+    va_status = vaCreateConfig(va_dpy, VAProfileNone, VAEntrypointVideoProc,
+                               NULL, 0, &shared.config_id);
+    if (va_status == VA_STATUS_SUCCESS) {
+        va_status = bench_create_surface(va_dpy, &render_target_case, &render_target);
+        if (va_status == VA_STATUS_SUCCESS)
+            vaCreateContext(va_dpy, shared.config_id, 1920, 1080, VA_PROGRESSIVE,
+                            &render_target, 1, &shared.context_id);
+    }
+
+    threads = calloc(max_threads, sizeof(struct bench_thread));
+    if (!threads) {
+        ret = 5;
+        goto out;
+    }
+    for (i = 0; i < max_threads; i++) {
+        threads[i].samples = malloc(iterations * sizeof(uint64_t));
+        if (!threads[i].samples) {
+            ret = 5;
+            goto out;
+        }
+    }
+
+    fputs(json_header, fp);
+    fprintf(fp, "  \"iterations\": %d,\n  \"results\": [", iterations);
+
+    for (c = 0; c < sizeof(bench_cases) / sizeof(bench_cases[0]); c++) {
+        shared.bc = &bench_cases[c];
+
+        /* 1, 2, 4, ... threads, always finishing with max_threads */
+        for (num_threads = 1; ; num_threads *= 2) {
+            if (num_threads > max_threads)
+                num_threads = max_threads;
+
+            pthread_barrier_init(&shared.barrier, NULL, num_threads);
+            shared.start = 0;
+
+            for (num_created = 0; num_created < num_threads; num_created++) {
+                threads[num_created].shared = &shared;
+                threads[num_created].num_samples = 0;
+                threads[num_created].status = VA_STATUS_SUCCESS;
+                if (pthread_create(&threads[num_created].thread, NULL, bench_thread_func,
+                                   &threads[num_created]))
+                    break;
+            }
+
+            pthread_mutex_lock(&shared.lock);
+            shared.start = num_created == num_threads ? 1 : -1;
+            pthread_cond_broadcast(&shared.cond);
+            pthread_mutex_unlock(&shared.lock);
+
+            for (i = 0; i < num_created; i++)
+                pthread_join(threads[i].thread, NULL);
+
+            pthread_barrier_destroy(&shared.barrier);
+
+            if (num_created < num_threads) {
+                fprintf(stderr, "Failed to create benchmark thread %d of %d\n",
+                        num_created + 1, num_threads);
+                ret = 5;
+                goto out;
+            }
+
+            bench_print_result(fp, shared.bc, num_threads, threads, first);
+            first = 0;
+            fflush(fp);
+
+            if (num_threads == max_threads)
+                break;
+        }
+    }
+    fprintf(fp, "\n  ]\n}\n");
+
+out:
+    if (threads) {
+        for (i = 0; i < max_threads; i++)
+            free(threads[i].samples);
+        free(threads);
+    }
+
+    if (shared.context_id != VA_INVALID_ID)
+        vaDestroyContext(va_dpy, shared.context_id);
+    if (render_target != VA_INVALID_SURFACE)
+        vaDestroySurfaces(va_dpy, &render_target, 1);
+    if (shared.config_id != VA_INVALID_ID)
+        vaDestroyConfig(va_dpy, shared.config_id);
+    pthread_cond_destroy(&shared.cond);
+    pthread_mutex_destroy(&shared.lock);
+
+    return ret;
+}
+
+#endif
@@ -30,11 +30,17 @@
 #include <string.h>
 #include <stdint.h>
 #include <iostream>
+#include <algorithm>
+#include <vector>
 #include <time.h>
 #include <assert.h>
 #include <va/va.h>
 #include <va/va_vpp.h>
 #include "va_display.h"
+#include "vpp_config.h"
+#include "vpp_dmabuf.h"
+#include "vpp_file_input.h"
+#include "vpp_stream.h"
 
 #ifndef VA_FOURCC_I420
 #define VA_FOURCC_I420 0x30323449
@@ -63,13 +69,16 @@ typedef struct _SurfInfo {
     void        *pBuf;
     uint8_t     *pBufBase;
     uintptr_t   ptrb;
+    VASurfaceAttribExternalBuffers layout;  /* CPU and DMABUF surfaces */
+    VPPDmaBuf   dmabuf;                     /* DMABUF surfaces, or the exported VA surface */
+    uint32_t    exported;
 } SurfInfo;
 
 static SurfInfo g_src;
 static SurfInfo g_dst;
 
 static VAConfigID  config_id = 0;
-static FILE* g_config_file_fd = NULL;
+static VPPConfig *g_config = NULL;
 static char g_config_file_name[MAX_LEN];
 
 static VASurfaceID g_in_surface_id = VA_INVALID_ID;
@@ -84,7 +93,14 @@ static uint32_t g_dst_file_fourcc = VA_FOURCC('Y', 'V', '1', '2');
     }
 
 static uint32_t g_frame_count = 0;
-static uint32_t g_copy_method = 0; //0 blance, 1 perf. 2 power_saving
+static uint32_t g_copy_method = 0; //VA_EXEC_MODE_*: 0 default, 1 power saving, 2 perf
+
+/* 0 off, 1 read frames straight into the user pointer surface, 2 also
+ * allow wrapping the mapped file as the surface */
+static uint32_t g_src_zero_copy = 0;
+static VPPFileInput g_src_input;
+/* the driver refused to wrap the mapping, frames are copied out of it */
+static bool g_src_map_rejected = false;
 
 static int8_t
 parse_memtype_format(char *str, uint32_t *dst_memtype)
@@ -95,9 +111,11 @@ parse_memtype_format(char *str, uint32_t *dst_memtype)
         tmemtype = VA_SURFACE_ATTRIB_MEM_TYPE_VA;
     } else if (!strcmp(str, "CPU")) {
         tmemtype = VA_SURFACE_ATTRIB_MEM_TYPE_USER_PTR;
+    } else if (!strcmp(str, "DMABUF")) {
+        tmemtype = VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2;
     } else {
         printf("Not supported format: %s! Currently only support following format: %s\n",
-               str, "VA,CPU");
+               str, "VA,CPU,DMABUF");
         assert(0);
     }
     if (dst_memtype)
@@ -105,65 +123,6 @@ parse_memtype_format(char *str, uint32_t *dst_memtype)
     return 0;
 }
 
-static int8_t
-read_value_string(FILE *fp, const char* field_name, char* value)
-{
-    char strLine[MAX_LEN];
-    char* field = NULL;
-    char* str = NULL;
-    uint16_t i;
-
-    if (!fp || !field_name || !value)  {
-        printf("Invalid fuction parameters\n");
-        return -1;
-    }
-
-    rewind(fp);
-
-    while (!feof(fp)) {
-        if (!fgets(strLine, MAX_LEN, fp))
-            continue;
-
-        for (i = 0; i < MAX_LEN && strLine[i]; i++)
-            if (strLine[i] != ' ') break;
-
-        if (i == MAX_LEN || strLine[i] == '#' || strLine[i] == '\n')
-            continue;
-
-        field = strtok(&strLine[i], ":");
-        if (strncmp(field, field_name, strlen(field_name)))
-            continue;
-
-        if (!(str = strtok(NULL, ":")))
-            continue;
-
-        /* skip blank space in string */
-        while (*str == ' ')
-            str++;
-
-        *(str + strlen(str) - 1) = '\0';
-        strcpy(value, str);
-
-        return 0;
-    }
-
-    return -1;
-}
-
-static int8_t
-read_value_uint32(FILE* fp, const char* field_name, uint32_t* value)
-{
-    char str[MAX_LEN];
-
-    if (read_value_string(fp, field_name, str)) {
-        printf("Failed to find integer field: %s", field_name);
-        return -1;
-    }
-
-    *value = (uint32_t)atoi(str);
-    return 0;
-}
-
 static VAStatus
 create_surface(VASurfaceID * p_surface_id, SurfInfo &surf)
 {
@@ -183,9 +142,10 @@ create_surface(VASurfaceID * p_surface_id, SurfInfo &surf)
                                      1,
                                      &surface_attrib,
                                      1);
-    } else if (surf.memtype == VA_SURFACE_ATTRIB_MEM_TYPE_USER_PTR) {
+    } else if (surf.memtype == VA_SURFACE_ATTRIB_MEM_TYPE_USER_PTR ||
+               surf.memtype == VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2) {
         VASurfaceAttrib surfaceAttrib[3];
-        VASurfaceAttribExternalBuffers extBuffer;
+        VASurfaceAttribExternalBuffers &extBuffer = surf.layout;
         uint32_t base_addr_align = 0x1000;
         uint32_t size = 0;
         surfaceAttrib[0].flags = VA_SURFACE_ATTRIB_SETTABLE;
@@ -230,7 +190,23 @@ create_surface(VASurfaceID * p_surface_id, SurfInfo &surf)
             std::cout << surf.fourCC << "format doesn't support!" << endl;
             return VA_STATUS_ERROR_UNSUPPORTED_RT_FORMAT;
         }
-        if (!surf.pBuf && !surf.pBufBase) {
+        if (surf.memtype == VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2) {
+            /* same linear layout as the CPU surface, but handed over as a
+             * dma-buf: the driver imports the pages instead of pinning
+             * user memory */
+            if (vpp_dmabuf_alloc(size, &surf.dmabuf))
+                return VA_STATUS_ERROR_ALLOCATION_FAILED;
+            surf.pBufBase = surf.dmabuf.ptr;
+
+            extBuffer.pixel_format = surf.fourCC;
+            extBuffer.width = surf.width;
+            extBuffer.height = surf.height;
+            extBuffer.data_size = surf.dmabuf.size;
+
+            va_status = vpp_dmabuf_create_surface(va_dpy, &surf.dmabuf, surf.format,
+                                                  &extBuffer, p_surface_id);
+            CHECK_VASTATUS(va_status, "vpp_dmabuf_create_surface");
+        } else if (!surf.pBuf && !surf.pBufBase) {
             surf.pBuf = malloc(size + base_addr_align);
             surf.pBufBase = (uint8_t*)((((uint64_t)(surf.pBuf) + base_addr_align - 1) / base_addr_align) * base_addr_align);
 
@@ -252,6 +228,123 @@ create_surface(VASurfaceID * p_surface_id, SurfInfo &surf)
     return va_status;
 }
 
+/* Wrap <ptr>, a frame in the layout of <surf>, as a new user pointer
+ * surface */
+static VAStatus
+wrap_user_frame(SurfInfo &surf, uint8_t *ptr, VASurfaceID *p_surface_id)
+{
+    VASurfaceAttribExternalBuffers extBuffer = surf.layout;
+    VASurfaceAttrib surfaceAttrib[3];
+    uintptr_t buffer = (uintptr_t)ptr;
+
+    surfaceAttrib[0].flags = VA_SURFACE_ATTRIB_SETTABLE;
+    surfaceAttrib[0].type = VASurfaceAttribPixelFormat;
+    surfaceAttrib[0].value.type = VAGenericValueTypeInteger;
+    surfaceAttrib[0].value.value.i = surf.fourCC;
+
+    surfaceAttrib[1].flags = VA_SURFACE_ATTRIB_SETTABLE;
+    surfaceAttrib[1].type = VASurfaceAttribMemoryType;
+    surfaceAttrib[1].value.type = VAGenericValueTypeInteger;
+    surfaceAttrib[1].value.value.i = VA_SURFACE_ATTRIB_MEM_TYPE_USER_PTR;
+
+    surfaceAttrib[2].flags = VA_SURFACE_ATTRIB_SETTABLE;
+    surfaceAttrib[2].type = VASurfaceAttribExternalBufferDescriptor;
+    surfaceAttrib[2].value.type = VAGenericValueTypePointer;
+    surfaceAttrib[2].value.value.p = (void *)&extBuffer;
+
+    extBuffer.num_buffers = 1;
+    extBuffer.buffers = &buffer;
+
+    return vaCreateSurfaces(va_dpy, surf.format, surf.width, surf.height, p_surface_id, 1, surfaceAttrib, 3);
+}
+
+/* Zero copy upload of frame <frame>: either wrap the mapped file as the
+ * input surface or read the frame straight into the surface memory */
+static VAStatus
+upload_frame_zero_copy(uint32_t frame)
+{
+    VAStatus va_status;
+    uint8_t *ptr;
+
+    va_status = vaSyncSurface(va_dpy, g_in_surface_id);
+    CHECK_VASTATUS(va_status, "vaSyncSurface");
+
+    if (g_src_input.mode == VPP_FILE_INPUT_MMAP) {
+        if (!(ptr = vpp_file_input_frame(&g_src_input, frame)))
+            return VA_STATUS_ERROR_OPERATION_FAILED;
+
+        if (!g_src_map_rejected) {
+            vaDestroySurfaces(va_dpy, &g_in_surface_id, 1);
+            va_status = wrap_user_frame(g_src, ptr, &g_in_surface_id);
+            if (va_status == VA_STATUS_SUCCESS)
+                return va_status;
+
+            printf("Wrapping the mapped input failed: %s, copying frames instead\n",
+                   vaErrorStr(va_status));
+            g_src_map_rejected = true;
+            va_status = wrap_user_frame(g_src, g_src.pBufBase, &g_in_surface_id);
+            CHECK_VASTATUS(va_status, "vaCreateSurfaces");
+        }
+        memcpy(g_src.pBufBase, ptr, g_src_input.frame_size);
+        return VA_STATUS_SUCCESS;
+    }
+
+    if (vpp_file_input_read(&g_src_input, frame, g_src.pBufBase))
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+
+    return VA_STATUS_SUCCESS;
+}
+
+/* Read one NV12 frame straight into a linear buffer laid out by
+ * <offsets>/<pitches>, no staging copy */
+static VAStatus
+load_linear_nv12(FILE *fp, const VPPDmaBuf *buf, uint8_t *base,
+                 const uint32_t *offsets, const uint32_t *pitches,
+                 uint32_t width, uint32_t height)
+{
+    VAStatus va_status = VA_STATUS_SUCCESS;
+    uint32_t row;
+
+    if (vpp_dmabuf_begin_cpu_access(buf, 1))
+        printf("DMA-BUF sync for write failed\n");
+
+    for (row = 0; row < height && va_status == VA_STATUS_SUCCESS; row++) {
+        if (fread(base + offsets[0] + row * pitches[0], width, 1, fp) != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
+    }
+    for (row = 0; row < height / 2 && va_status == VA_STATUS_SUCCESS; row++) {
+        if (fread(base + offsets[1] + row * pitches[1], width, 1, fp) != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
+    }
+
+    vpp_dmabuf_end_cpu_access(buf, 1);
+    return va_status;
+}
+
+static VAStatus
+store_linear_nv12(FILE *fp, const VPPDmaBuf *buf, const uint8_t *base,
+                  const uint32_t *offsets, const uint32_t *pitches,
+                  uint32_t width, uint32_t height)
+{
+    VAStatus va_status = VA_STATUS_SUCCESS;
+    uint32_t row;
+
+    if (vpp_dmabuf_begin_cpu_access(buf, 0))
+        printf("DMA-BUF sync for read failed\n");
+
+    for (row = 0; row < height && va_status == VA_STATUS_SUCCESS; row++) {
+        if (fwrite(base + offsets[0] + row * pitches[0], width, 1, fp) != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
+    }
+    for (row = 0; row < height / 2 && va_status == VA_STATUS_SUCCESS; row++) {
+        if (fwrite(base + offsets[1] + row * pitches[1], width, 1, fp) != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
+    }
+
+    vpp_dmabuf_end_cpu_access(buf, 0);
+    return va_status;
+}
+
 /* Load frame to surface*/
 static VAStatus
 upload_frame_to_surface(FILE *fp,
@@ -272,6 +365,13 @@ upload_frame_to_surface(FILE *fp,
     va_status = vaSyncSurface(va_dpy, surface_id);
     CHECK_VASTATUS(va_status, "vaSyncSurface");
 
+    if (g_src.memtype == VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2) {
+        /* the surface is our own dma-buf, fill it in place */
+        return load_linear_nv12(fp, &g_src.dmabuf, g_src.pBufBase,
+                                g_src.layout.offsets, g_src.layout.pitches,
+                                g_src.width, g_src.height);
+    }
+
     va_status = vaDeriveImage(va_dpy, surface_id, &surface_image);
     CHECK_VASTATUS(va_status, "vaDeriveImage");
 
@@ -289,9 +389,9 @@ upload_frame_to_surface(FILE *fp,
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
         y_src = newImageBuffer;
         u_src = newImageBuffer + surface_image.width * surface_image.height;
@@ -319,9 +419,9 @@ upload_frame_to_surface(FILE *fp,
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
         y_src = newImageBuffer;
         u_src = newImageBuffer + surface_image.width * surface_image.height;
@@ -355,7 +455,7 @@ upload_frame_to_surface(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -377,6 +477,13 @@ store_surface_to_file(FILE *fp,
     va_status = vaSyncSurface(va_dpy, surface_id);
     CHECK_VASTATUS(va_status, "vaSyncSurface");
 
+    if (g_dst.memtype == VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2 || g_dst.exported) {
+        /* read back through the dma-buf mapping, no derive/map round trip */
+        return store_linear_nv12(fp, &g_dst.dmabuf, g_dst.dmabuf.ptr,
+                                 g_dst.layout.offsets, g_dst.layout.pitches,
+                                 g_dst.width, g_dst.height);
+    }
+
     va_status = vaDeriveImage(va_dpy, surface_id, &surface_image);
     CHECK_VASTATUS(va_status, "vaDeriveImage");
 
@@ -426,9 +533,9 @@ store_surface_to_file(FILE *fp,
                 }
 
                 /* write frame to file */
-                do {
-                    n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
-                } while (n_items != 1);
+                n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
+                if (n_items != 1)
+                    va_status = VA_STATUS_ERROR_OPERATION_FAILED;
             } else if (surface_image.format.fourcc == VA_FOURCC_RGBP) {
                 uint32_t y_size = surface_image.width * surface_image.height;
                 newImageBuffer = (unsigned char*)malloc(y_size * 3);
@@ -452,9 +559,9 @@ store_surface_to_file(FILE *fp,
                     v_src += surface_image.pitches[0];
                 }
 
-                do {
-                    n_items = fwrite(newImageBuffer, y_size * 3, 1, fp);
-                } while (n_items != 1);
+                n_items = fwrite(newImageBuffer, y_size * 3, 1, fp);
+                if (n_items != 1)
+                    va_status = VA_STATUS_ERROR_OPERATION_FAILED;
             }
         } else { // usrptr surface.
             if (surface_image.format.fourcc == VA_FOURCC_NV12) {
@@ -464,18 +571,18 @@ store_surface_to_file(FILE *fp,
                 assert(newImageBuffer);
                 memcpy(newImageBuffer, g_dst.pBufBase, (y_size * 3 / 2));
 
-                do {
-                    n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
-                } while (n_items != 1);
+                n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
+                if (n_items != 1)
+                    va_status = VA_STATUS_ERROR_OPERATION_FAILED;
             } else if (surface_image.format.fourcc == VA_FOURCC_RGBP) {
                 uint32_t y_size = surface_image.height * surface_image.pitches[0];
                 newImageBuffer = (unsigned char*)malloc(y_size * 3);
                 assert(newImageBuffer);
                 memcpy(newImageBuffer, g_dst.pBufBase, (y_size * 3));
 
-                do {
-                    n_items = fwrite(newImageBuffer, y_size * 3, 1, fp);
-                } while (n_items != 1);
+                n_items = fwrite(newImageBuffer, y_size * 3, 1, fp);
+                if (n_items != 1)
+                    va_status = VA_STATUS_ERROR_OPERATION_FAILED;
             }
         }
     } else {
@@ -491,7 +598,7 @@ store_surface_to_file(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -510,7 +617,7 @@ video_frame_process(VASurfaceID in_surface_id,
     src_obj.object.surface_id = in_surface_id;
     dst_obj.obj_type = VACopyObjectSurface;
     dst_obj.object.surface_id = out_surface_id;
-    option.bits.va_copy_mode = g_copy_method; // VA_COPY_MODE_BALANCE;
+    option.bits.va_copy_mode = g_copy_method; // VA_EXEC_MODE_*
 
     va_status = vaCopy(va_dpy, &dst_obj, &src_obj, option);
 #else
@@ -573,6 +680,26 @@ vpp_context_create()
     va_status = create_surface(&g_out_surface_id, g_dst);
     CHECK_VASTATUS(va_status, "vaCreateSurfaces for output");
 
+    if (g_dst.exported) {
+        VADRMPRIMESurfaceDescriptor desc;
+
+        /* export once, the mapping follows every later copy into the surface */
+        va_status = vpp_dmabuf_export_surface(va_dpy, g_out_surface_id, &g_dst.dmabuf, &desc);
+        if (va_status == VA_STATUS_SUCCESS && desc.num_layers == 1 &&
+            desc.layers[0].drm_format == VA_FOURCC_NV12) {
+            g_dst.layout.offsets[0] = desc.layers[0].offset[0];
+            g_dst.layout.offsets[1] = desc.layers[0].offset[1];
+            g_dst.layout.pitches[0] = desc.layers[0].pitch[0];
+            g_dst.layout.pitches[1] = desc.layers[0].pitch[1];
+            std::cout << "output surface exported as linear DMA-BUF, pitch = " << g_dst.layout.pitches[0] << endl;
+        } else {
+            std::cout << "output surface can not be exported as linear NV12 DMA-BUF, fall back to vaDeriveImage" << endl;
+            if (va_status == VA_STATUS_SUCCESS)
+                vpp_dmabuf_free(&g_dst.dmabuf);
+            g_dst.exported = 0;
+        }
+    }
+
     va_status = vaCreateConfig(va_dpy,
                                VAProfileNone,
                                VAEntrypointVideoProc,
@@ -607,6 +734,8 @@ vpp_context_destroy()
 
     _FREE(g_src.pBuf);
     _FREE(g_dst.pBuf);
+    vpp_dmabuf_free(&g_src.dmabuf);
+    vpp_dmabuf_free(&g_dst.dmabuf);
 }
 
 static int8_t
@@ -660,37 +789,44 @@ static int8_t
 parse_basic_parameters()
 {
     char str[MAX_LEN];
+    uint32_t export_surface = 0;
     memset(&g_src, 0, sizeof(g_src));
     memset(&g_dst, 0, sizeof(g_dst));
+    g_src.dmabuf.fd = g_src.dmabuf.memfd = -1;
+    g_dst.dmabuf.fd = g_dst.dmabuf.memfd = -1;
 
     /* Read src frame file information */
-    read_value_string(g_config_file_fd, "SRC_FILE_NAME", g_src.name);
-    read_value_uint32(g_config_file_fd, "SRC_FRAME_WIDTH", &g_src.width);
-    read_value_uint32(g_config_file_fd, "SRC_FRAME_HEIGHT", &g_src.height);
-    read_value_string(g_config_file_fd, "SRC_FRAME_FORMAT", str);
+    vpp_config_get_string(g_config, "SRC_FILE_NAME", g_src.name);
+    vpp_config_get_uint32(g_config, "SRC_FRAME_WIDTH", &g_src.width);
+    vpp_config_get_uint32(g_config, "SRC_FRAME_HEIGHT", &g_src.height);
+    vpp_config_get_string(g_config, "SRC_FRAME_FORMAT", str);
     parse_fourcc_and_format(str, &g_src.fourCC, &g_src.format);
-    read_value_string(g_config_file_fd, "SRC_SURFACE_MEMORY_TYPE", str);
+    vpp_config_get_string(g_config, "SRC_SURFACE_MEMORY_TYPE", str);
     parse_memtype_format(str, &g_src.memtype);
-    read_value_uint32(g_config_file_fd, "SRC_SURFACE_CPU_ALIGN_SIZE", &g_src.alignsize);
+    vpp_config_get_uint32(g_config, "SRC_SURFACE_CPU_ALIGN_SIZE", &g_src.alignsize);
 
     /* Read dst frame file information */
-    read_value_string(g_config_file_fd, "DST_FILE_NAME", g_dst.name);
-    read_value_uint32(g_config_file_fd, "DST_FRAME_WIDTH", &g_dst.width);
-    read_value_uint32(g_config_file_fd, "DST_FRAME_HEIGHT", &g_dst.height);
-    read_value_string(g_config_file_fd, "DST_FRAME_FORMAT", str);
+    vpp_config_get_string(g_config, "DST_FILE_NAME", g_dst.name);
+    vpp_config_get_uint32(g_config, "DST_FRAME_WIDTH", &g_dst.width);
+    vpp_config_get_uint32(g_config, "DST_FRAME_HEIGHT", &g_dst.height);
+    vpp_config_get_string(g_config, "DST_FRAME_FORMAT", str);
     parse_fourcc_and_format(str, &g_dst.fourCC, &g_dst.format);
-    read_value_string(g_config_file_fd, "DST_SURFACE_MEMORY_TYPE", str);
+    vpp_config_get_string(g_config, "DST_SURFACE_MEMORY_TYPE", str);
     parse_memtype_format(str, &g_dst.memtype);
-    read_value_uint32(g_config_file_fd, "DST_SURFACE_CPU_ALIGN_SIZE", &g_dst.alignsize);
+    vpp_config_get_uint32(g_config, "DST_SURFACE_CPU_ALIGN_SIZE", &g_dst.alignsize);
+    if (!vpp_config_get_uint32(g_config, "DST_SURFACE_EXPORT", &export_surface))
+        g_dst.exported = export_surface && g_dst.memtype == VA_SURFACE_ATTRIB_MEM_TYPE_VA;
 
-    read_value_string(g_config_file_fd, "SRC_FILE_FORMAT", str);
+    vpp_config_get_string(g_config, "SRC_FILE_FORMAT", str);
     parse_fourcc_and_format(str, &g_src_file_fourcc, NULL);
 
-    read_value_string(g_config_file_fd, "DST_FILE_FORMAT", str);
+    vpp_config_get_string(g_config, "DST_FILE_FORMAT", str);
     parse_fourcc_and_format(str, &g_dst_file_fourcc, NULL);
 
-    read_value_uint32(g_config_file_fd, "FRAME_SUM", &g_frame_count);
-    read_value_uint32(g_config_file_fd, "COPY_METHOD", &g_copy_method);
+    vpp_config_get_uint32(g_config, "FRAME_SUM", &g_frame_count);
+    vpp_config_get_uint32(g_config, "COPY_METHOD", &g_copy_method);
+    if (vpp_config_get_uint32(g_config, "SRC_ZERO_COPY", &g_src_zero_copy))
+        g_src_zero_copy = 0;
 
     if (g_src.width != g_dst.width ||
         g_src.height != g_dst.height) {
@@ -703,10 +839,19 @@ parse_basic_parameters()
         return -1;
     }
 
+    if ((g_src.memtype == VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2 ||
+         g_dst.memtype == VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2) &&
+        g_src.fourCC != VA_FOURCC_NV12) {
+        std::cout << "DMABUF surfaces only support NV12!" << endl;
+        return -1;
+    }
+
     std::cout << "=========Media Copy=========" << endl;
 
     if (g_src.memtype == VA_SURFACE_ATTRIB_MEM_TYPE_VA) {
         std::cout << "copy from 2D tile surface to ";
+    } else if (g_src.memtype == VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2) {
+        std::cout << "copy from imported DMA-BUF linear surface to ";
     } else {
         if (g_src.alignsize == 1 || !(g_src.width % g_src.alignsize))
             std::cout << "copy from 1D linear surface to ";
@@ -716,22 +861,268 @@ parse_basic_parameters()
 
     if (g_dst.memtype == VA_SURFACE_ATTRIB_MEM_TYPE_VA) {
         std::cout << "2D tile surface." << endl;
+    } else if (g_dst.memtype == VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2) {
+        std::cout << "imported DMA-BUF linear surface." << endl;
     } else {
         if (g_dst.alignsize == 1 || !(g_dst.width % g_dst.alignsize))
             std::cout << "1D linear surface." << endl;
         else
             std::cout << "2D linear surface with pitch_align " << g_dst.alignsize << endl;
     }
-    std::cout << "prefer hw engine is " << g_copy_method << ". notification, 0: blanance(vebox), 1: perf(EU), 2 powersaving(blt)" << endl;
+    std::cout << "prefer hw engine is " << g_copy_method << ". notification, 0: default(vebox), 1: powersaving(blt), 2: perf(EU)" << endl;
 
     return 0;
 }
 
+/* --bench: sweep memory types, frame sizes, formats and copy modes */
+typedef struct _BenchStats {
+    double p50;     /* us */
+    double p90;
+    double p99;
+} BenchStats;
+
+static const struct {
+    uint32_t width;
+    uint32_t height;
+} g_bench_sizes[] = {
+    { 208, 208 },       /* ~64 KB NV12 */
+    { 640, 480 },
+    { 1280, 720 },
+    { 1920, 1080 },
+    { 3840, 2160 },
+    { 7680, 4320 },
+};
+
+static const struct {
+    uint32_t fourcc;
+    const char *name;
+} g_bench_formats[] = {
+    { VA_FOURCC_NV12, "NV12" },
+    { VA_FOURCC_RGBP, "RGBP" },
+};
+
+static const uint32_t g_bench_memtypes[][2] = {
+    { VA_SURFACE_ATTRIB_MEM_TYPE_VA, VA_SURFACE_ATTRIB_MEM_TYPE_VA },
+    { VA_SURFACE_ATTRIB_MEM_TYPE_VA, VA_SURFACE_ATTRIB_MEM_TYPE_USER_PTR },
+    { VA_SURFACE_ATTRIB_MEM_TYPE_USER_PTR, VA_SURFACE_ATTRIB_MEM_TYPE_VA },
+    { VA_SURFACE_ATTRIB_MEM_TYPE_USER_PTR, VA_SURFACE_ATTRIB_MEM_TYPE_USER_PTR },
+};
+
+static const struct {
+    uint32_t mode;
+    const char *name;
+} g_bench_modes[] = {
+    { VA_EXEC_MODE_DEFAULT, "default" },
+    { VA_EXEC_MODE_PERFORMANCE, "perf" },
+    { VA_EXEC_MODE_POWER_SAVING, "power" },
+};
+
+static double
+bench_now_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void
+bench_stats(std::vector<double> &samples, BenchStats *stats)
+{
+    std::sort(samples.begin(), samples.end());
+    stats->p50 = samples[samples.size() * 50 / 100];
+    stats->p90 = samples[samples.size() * 90 / 100];
+    stats->p99 = samples[samples.size() * 99 / 100];
+}
+
+static const char *
+bench_memtype_name(uint32_t memtype)
+{
+    return memtype == VA_SURFACE_ATTRIB_MEM_TYPE_VA ? "VA" : "CPU";
+}
+
+static uint32_t
+bench_frame_bytes(uint32_t fourcc, uint32_t width, uint32_t height)
+{
+    return fourcc == VA_FOURCC_RGBP ? width * height * 3 : width * height * 3 / 2;
+}
+
+/* CPU baseline: memcpy of the same number of bytes between two buffers
+ * that do not fit in the cache together beyond the small sizes */
+static void
+bench_memcpy(uint32_t bytes, uint32_t iterations, BenchStats *stats)
+{
+    std::vector<uint8_t> src(bytes, 0x80), dst(bytes);
+    std::vector<double> samples;
+    uint32_t i;
+
+    for (i = 0; i < 3; i++)
+        memcpy(dst.data(), src.data(), bytes);
+
+    for (i = 0; i < iterations; i++) {
+        double start = bench_now_us();
+        memcpy(dst.data(), src.data(), bytes);
+        samples.push_back(bench_now_us() - start);
+    }
+
+    bench_stats(samples, stats);
+}
+
+/* Time <iterations> vaCopy calls from <src> to <dst> including the wait
+ * for completion. Returns -1 if any surface or copy is not supported */
+static int
+bench_copy(SurfInfo &src, SurfInfo &dst, uint32_t iterations, BenchStats *stats)
+{
+    VASurfaceID src_id = VA_INVALID_ID, dst_id = VA_INVALID_ID;
+    std::vector<double> samples;
+    int ret = -1;
+    uint32_t i;
+
+    /* create_surface() exits on user pointer failures, the caller only
+     * asks for memory types the driver reports */
+    if (create_surface(&src_id, src) != VA_STATUS_SUCCESS ||
+        create_surface(&dst_id, dst) != VA_STATUS_SUCCESS)
+        goto out;
+
+    for (i = 0; i < 3; i++) {
+        if (video_frame_process(src_id, dst_id) != VA_STATUS_SUCCESS ||
+            vaSyncSurface(va_dpy, dst_id) != VA_STATUS_SUCCESS)
+            goto out;
+    }
+
+    for (i = 0; i < iterations; i++) {
+        double start = bench_now_us();
+        if (video_frame_process(src_id, dst_id) != VA_STATUS_SUCCESS ||
+            vaSyncSurface(va_dpy, dst_id) != VA_STATUS_SUCCESS)
+            goto out;
+        samples.push_back(bench_now_us() - start);
+    }
+
+    bench_stats(samples, stats);
+    ret = 0;
+
+out:
+    if (src_id != VA_INVALID_ID)
+        vaDestroySurfaces(va_dpy, &src_id, 1);
+    if (dst_id != VA_INVALID_ID)
+        vaDestroySurfaces(va_dpy, &dst_id, 1);
+    _FREE(src.pBuf);
+    _FREE(dst.pBuf);
+    src.pBufBase = dst.pBufBase = NULL;
+
+    return ret;
+}
+
+/* Memory types the VPP config accepts for surfaces */
+static uint32_t
+bench_supported_memtypes()
+{
+    VAConfigID bench_config;
+    VASurfaceAttrib *attribs;
+    uint32_t num_attribs = 0, memtypes = VA_SURFACE_ATTRIB_MEM_TYPE_VA, i;
+
+    if (vaCreateConfig(va_dpy, VAProfileNone, VAEntrypointVideoProc, NULL, 0,
+                       &bench_config) != VA_STATUS_SUCCESS)
+        return memtypes;
+
+    if (vaQuerySurfaceAttributes(va_dpy, bench_config, NULL, &num_attribs) == VA_STATUS_SUCCESS &&
+        (attribs = (VASurfaceAttrib *)calloc(num_attribs, sizeof(VASurfaceAttrib)))) {
+        if (vaQuerySurfaceAttributes(va_dpy, bench_config, attribs, &num_attribs) == VA_STATUS_SUCCESS) {
+            for (i = 0; i < num_attribs; i++) {
+                if (attribs[i].type == VASurfaceAttribMemoryType)
+                    memtypes |= attribs[i].value.value.i;
+            }
+        }
+        free(attribs);
+    }
+    vaDestroyConfig(va_dpy, bench_config);
+
+    return memtypes;
+}
+
+static int
+run_bench(uint32_t iterations)
+{
+    uint32_t memtypes, s, f, m, mode;
+    int32_t major_ver, minor_ver;
+    BenchStats cpu, gpu;
+    VAStatus va_status;
+
+    va_dpy = va_open_display();
+    va_status = vaInitialize(va_dpy, &major_ver, &minor_ver);
+    CHECK_VASTATUS(va_status, "vaInitialize");
+    memtypes = bench_supported_memtypes();
+
+    printf("%-6s %-11s %10s %-8s %-8s %9s %9s %9s %8s %8s %7s\n",
+           "format", "size", "bytes", "src->dst", "mode",
+           "p50(us)", "p90(us)", "p99(us)", "GB/s", "cpu GB/s", "speedup");
+
+    for (s = 0; s < sizeof(g_bench_sizes) / sizeof(g_bench_sizes[0]); s++) {
+        for (f = 0; f < sizeof(g_bench_formats) / sizeof(g_bench_formats[0]); f++) {
+            uint32_t width = g_bench_sizes[s].width, height = g_bench_sizes[s].height;
+            uint32_t bytes = bench_frame_bytes(g_bench_formats[f].fourcc, width, height);
+            char size[32];
+
+            snprintf(size, sizeof(size), "%ux%u", width, height);
+            bench_memcpy(bytes, iterations, &cpu);
+
+            for (m = 0; m < sizeof(g_bench_memtypes) / sizeof(g_bench_memtypes[0]); m++) {
+                char dir[16];
+
+                snprintf(dir, sizeof(dir), "%s->%s", bench_memtype_name(g_bench_memtypes[m][0]),
+                         bench_memtype_name(g_bench_memtypes[m][1]));
+
+                if ((g_bench_memtypes[m][0] & memtypes) != g_bench_memtypes[m][0] ||
+                    (g_bench_memtypes[m][1] & memtypes) != g_bench_memtypes[m][1]) {
+                    printf("%-6s %-11s %10u %-8s memory type not supported\n",
+                           g_bench_formats[f].name, size, bytes, dir);
+                    continue;
+                }
+
+                for (mode = 0; mode < sizeof(g_bench_modes) / sizeof(g_bench_modes[0]); mode++) {
+                    SurfInfo src, dst;
+
+                    memset(&src, 0, sizeof(src));
+                    src.width = width;
+                    src.height = height;
+                    src.fourCC = g_bench_formats[f].fourcc;
+                    src.format = g_bench_formats[f].fourcc == VA_FOURCC_RGBP ?
+                                 VA_RT_FORMAT_RGBP : VA_RT_FORMAT_YUV420;
+                    src.alignsize = 64;
+                    src.dmabuf.fd = src.dmabuf.memfd = -1;
+                    dst = src;
+                    src.memtype = g_bench_memtypes[m][0];
+                    dst.memtype = g_bench_memtypes[m][1];
+                    g_copy_method = g_bench_modes[mode].mode;
+
+                    if (bench_copy(src, dst, iterations, &gpu)) {
+                        printf("%-6s %-11s %10u %-8s %-8s not supported\n",
+                               g_bench_formats[f].name, size, bytes, dir, g_bench_modes[mode].name);
+                        continue;
+                    }
+
+                    printf("%-6s %-11s %10u %-8s %-8s %9.1f %9.1f %9.1f %8.2f %8.2f %6.2fx\n",
+                           g_bench_formats[f].name, size, bytes, dir, g_bench_modes[mode].name,
+                           gpu.p50, gpu.p90, gpu.p99, bytes / gpu.p50 / 1e3,
+                           bytes / cpu.p50 / 1e3, cpu.p50 / gpu.p50);
+                }
+            }
+        }
+    }
+
+    vaTerminate(va_dpy);
+    va_close_display(va_dpy);
+    return 0;
+}
+
 static void
 print_help()
 {
     printf("The app is used to test the scaling and csc feature.\n");
     printf("Cmd Usage: ./vacopy process_copy.cfg\n");
+    printf("           ./vacopy --bench [iterations]\n");
+    printf("--bench sweeps VA/CPU memory types, frame sizes from 64 KB to 8K, formats and copy modes,\n");
+    printf("        reporting per copy latency percentiles and GB/s against a CPU memcpy of the same size.\n");
     printf("The configure file process_copy.cfg is used to configure the para.\n");
     printf("You can refer process_copy.cfg.template for each para meaning and create the configure file.\n");
 }
@@ -740,6 +1131,9 @@ int32_t main(int32_t argc, char *argv[])
     VAStatus va_status;
     uint32_t i;
 
+    if (argc >= 2 && argc <= 3 && !strcmp(argv[1], "--bench"))
+        return run_bench(argc == 3 ? std::max(1, atoi(argv[2])) : 50);
+
     if (argc != 2 || !strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")) {
         print_help();
         return -1;
@@ -749,11 +1143,18 @@ int32_t main(int32_t argc, char *argv[])
     strncpy(g_config_file_name, argv[1], MAX_LEN);
     g_config_file_name[MAX_LEN - 1] = '\0';
 
-    if (NULL == (g_config_file_fd = fopen(g_config_file_name, "r"))) {
+    if (NULL == (g_config = vpp_config_open(g_config_file_name))) {
         printf("Open configure file %s failed!\n", g_config_file_name);
         assert(0);
     }
 
+    /* frames on stdout, diagnostics on stderr */
+    if (vpp_config_has_value(g_config, "DST_FILE_NAME", "-") &&
+        vpp_stream_reserve_stdout()) {
+        printf("Failed to move the diagnostics to stderr\n");
+        assert(0);
+    }
+
     /* Parse basic parameters */
     if (parse_basic_parameters()) {
         printf("Parse parameters in configure file error\n");
@@ -766,14 +1167,35 @@ int32_t main(int32_t argc, char *argv[])
         assert(0);
     }
 
+    g_src_input.fd = -1;
+    if (g_src_zero_copy) {
+        if (g_src.memtype != VA_SURFACE_ATTRIB_MEM_TYPE_USER_PTR ||
+            g_src_file_fourcc != g_src.fourCC ||
+            !vpp_file_input_layout_matches(&g_src.layout)) {
+            std::cout << "zero copy input needs a CPU source surface without pitch padding in the file format, disabled" << endl;
+            g_src_zero_copy = 0;
+        } else if (vpp_stream_is_pipe(g_src.name)) {
+            std::cout << "zero copy input needs a regular SRC_FILE_NAME, disabled" << endl;
+            g_src_zero_copy = 0;
+        } else if (vpp_file_input_open(g_src.name,
+                                       vpp_file_input_frame_size(g_src.fourCC, g_src.width, g_src.height),
+                                       g_src_zero_copy > 1, &g_src_input)) {
+            printf("Open SRC_FILE_NAME: %s failed, please specify it in config file: %s !\n",
+                   g_src.name, g_config_file_name);
+            assert(0);
+        } else {
+            std::cout << "zero copy input via " << vpp_file_input_mode_name(g_src_input.mode) << endl;
+        }
+    }
+
     /* Video frame fetch, process and store */
-    if (NULL == (g_src.fd = fopen(g_src.name, "r"))) {
+    if (!g_src_zero_copy && NULL == (g_src.fd = vpp_stream_open(g_src.name, "r"))) {
         printf("Open SRC_FILE_NAME: %s failed, please specify it in config file: %s !\n",
                g_src.name, g_config_file_name);
         assert(0);
     }
 
-    if (NULL == (g_dst.fd = fopen(g_dst.name, "w"))) {
+    if (NULL == (g_dst.fd = vpp_stream_open(g_dst.name, "w"))) {
         printf("Open DST_FILE_NAME: %s failed, please specify it in config file: %s !\n",
                g_dst.name, g_config_file_name);
         assert(0);
@@ -786,7 +1208,16 @@ int32_t main(int32_t argc, char *argv[])
     clock_gettime(CLOCK_MONOTONIC, &Pre_time);
 
     for (i = 0; i < g_frame_count; i ++) {
-        upload_frame_to_surface(g_src.fd, g_in_surface_id);
+        if (!g_src_zero_copy) {
+            if (upload_frame_to_surface(g_src.fd, g_in_surface_id) != VA_STATUS_SUCCESS) {
+                if (!feof(g_src.fd))
+                    printf("Read frame %d from %s failed\n", i, g_src.name);
+                break;
+            }
+        } else if (upload_frame_zero_copy(i) != VA_STATUS_SUCCESS) {
+            printf("Read frame %d from %s failed\n", i, g_src.name);
+            break;
+        }
         if (VA_STATUS_SUCCESS != video_frame_process(g_in_surface_id, g_out_surface_id)) {
             std::cout << "***vaCopy failed***" << std::endl;
         }
@@ -802,7 +1233,7 @@ int32_t main(int32_t argc, char *argv[])
     }
 
     printf("Finish processing, performance: \n");
-    printf("%d frames processed in: %d ms, ave time = %d ms\n", g_frame_count, duration, duration / g_frame_count);
+    printf("%d frames processed in: %d ms, ave time = %d ms\n", i, duration, i ? duration / i : 0);
 
     if (g_src.fd)
         fclose(g_src.fd);
@@ -810,10 +1241,11 @@ int32_t main(int32_t argc, char *argv[])
     if (g_dst.fd)
         fclose(g_dst.fd);
 
-    if (g_config_file_fd)
-        fclose(g_config_file_fd);
+    vpp_config_close(g_config);
 
     vpp_context_destroy();
+    /* after the surface wrapping the mapping is gone */
+    vpp_file_input_close(&g_src_input);
 
     return 0;
 }
@@ -31,12 +31,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <stdint.h>
 #include <sys/time.h>
 #include <assert.h>
+#include <pthread.h>
 #include <va/va.h>
 #include <va/va_vpp.h>
 #include "va_display.h"
+#include "vpp_config.h"
+#include "vpp_contexts.h"
+#include "vpp_hbd.h"
+#include "vpp_history.h"
+#include "vpp_pipeline.h"
+#include "vpp_stream.h"
+#include "vpp_writer.h"
 
 #define BLEND_ON        0
 
@@ -45,6 +54,7 @@
 #endif
 
 #define MAX_LEN   1024
+#define MAX_OUTPUTS 8
 
 #define CHECK_VASTATUS(va_status,func)                                      \
   if (va_status != VA_STATUS_SUCCESS) {                                     \
@@ -55,17 +65,15 @@
 static VADisplay va_dpy = NULL;
 static VAContextID context_id = 0;
 static VAConfigID  config_id = 0;
-static VAProcFilterType g_filter_type = VAProcFilterNone;
-static VASurfaceID g_in_surface_id = VA_INVALID_ID;
-static VASurfaceID g_out_surface_id = VA_INVALID_ID;
+/* Input surfaces, input frame N is in surface N % size. The ring is larger
+ * than the pipeline depth when the first pass reads reference frames */
+static VPPHistory g_history;
 
-static FILE* g_config_file_fd = NULL;
+static VPPConfig *g_config = NULL;
 static FILE* g_src_file_fd = NULL;
-static FILE* g_dst_file_fd = NULL;
 
 static char g_config_file_name[MAX_LEN];
 static char g_src_file_name[MAX_LEN];
-static char g_dst_file_name[MAX_LEN];
 static char g_filter_type_name[MAX_LEN];
 
 static uint32_t g_in_pic_width = 352;
@@ -85,103 +93,190 @@ static uint8_t g_blending_min_luma = 1;
 static uint8_t g_blending_max_luma = 254;
 
 static uint32_t g_frame_count = 0;
+/* 2 when every input frame is deinterlaced into one output frame per field */
+static uint32_t g_field_count = 1;
+/* output frame of the whole stream this context starts at with --contexts,
+ * keyframe schedules are looked up by stream frame */
+static uint32_t g_first_output_frame = 0;
+static uint32_t g_pipeline_depth = 1;
+static uint32_t g_writer_buffers = 2;
+
+/* Frame rate conversion (FRC_INPUT_FPS, FRC_OUTPUT_FPS), the output frame
+ * count follows the output rate and input frames are repeated or dropped */
+typedef struct _VPPFrameRate {
+    uint32_t num;
+    uint32_t den;
+} VPPFrameRate;
+
+static VPPFrameRate g_frc_input_rate;
+static VPPFrameRate g_frc_output_rate;
+
+/* Every input frame is processed into OUTPUT_COUNT outputs. Output 0 is the
+ * DST_* output, the others are renditions of it with their own size and file
+ * (DST_FILE_NAME_<n>, DST_FRAME_WIDTH_<n>, DST_FRAME_HEIGHT_<n>). Output 0 is
+ * stored by the pipeline writer, each other output by a writer thread of its
+ * own so that the N file writes overlap. Storing only downloads the surface
+ * into a buffer of the output's VPPWriter, the file write itself runs on the
+ * writer thread */
+typedef struct _VPPOutput {
+    char file_name[MAX_LEN];
+    FILE *fp;
+    VPPWriter *writer;
+    uint32_t width;
+    uint32_t height;
+    VASurfaceID surface_id[VPP_PIPELINE_MAX_DEPTH];
+    VARectangle region;
+    /* last pass submitted once per output when additional outputs can not
+     * be used */
+    VABufferID pipeline_param_buf_id;
+
+    pthread_t thread;
+    uint32_t jobs_done;
+    float store_time;
+} VPPOutput;
+
+static VPPOutput g_outputs[MAX_OUTPUTS];
+static uint32_t g_output_count = 1;
+static bool g_use_additional_outputs = false;
+static VASurfaceID g_additional_output_ids[MAX_OUTPUTS - 1];
+
+/* Job handed from the pipeline writer to the output writer threads */
+static pthread_mutex_t g_writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_writer_cond = PTHREAD_COND_INITIALIZER;
+static uint32_t g_writer_jobs = 0;
+static uint32_t g_writer_slot = 0;
+static uint32_t g_writer_pending = 0;
+static int g_writer_error = 0;
+static bool g_writer_exit = false;
+
+/* Filter chain in FILTER_TYPE order. Filter and pipeline parameter buffers
+ * live as long as the context, a filter buffer is only rewritten when its
+ * parameters change */
+typedef struct _VPPFilter {
+    VAProcFilterType type;
+    union {
+        VAProcFilterParameterBuffer base;
+        VAProcFilterParameterBufferDeinterlacing deinterlacing;
+        VAProcFilterParameterBufferColorBalance color_balance[VAProcColorBalanceCount];
+    } param;
+    uint32_t param_size;
+} VPPFilter;
+
+/* Consecutive filters the driver accepts in one pipeline buffer */
+typedef struct _VPPPass {
+    uint32_t first_filter;
+    uint32_t num_filters;
+    uint32_t num_forward_references;
+    uint32_t num_backward_references;
+    VABufferID pipeline_param_buf_id;
+} VPPPass;
+
+static VPPFilter g_filters[VAProcFilterCount];
+static bool g_filter_scheduled[VAProcFilterCount];
+static VABufferID g_filter_param_buf_ids[VAProcFilterCount];
+static uint32_t g_filter_count = 0;
+static VPPPass g_passes[VAProcFilterCount];
+static uint32_t g_pass_count = 0;
+static VASurfaceID g_pass_surface_id[2] = { VA_INVALID_ID, VA_INVALID_ID };
+static uint32_t g_pass_surface_count = 0;
+static VARectangle g_surface_region;
+static VARectangle g_output_region;
+#if BLEND_ON
+static VABlendState g_blend_state;
+#endif
 
-static int8_t
-read_value_string(FILE *fp, const char* field_name, char* value)
+static float
+adjust_to_range(VAProcFilterValueRange *range, float value)
 {
-    char strLine[MAX_LEN];
-    char* field;
-    char* str;
-    uint16_t i;
-
-    if (!fp || !field_name || !value)  {
-        printf("Invalid fuction parameters\n");
-        return -1;
-    }
-
-    rewind(fp);
-
-    while (!feof(fp)) {
-        if (!fgets(strLine, MAX_LEN, fp))
-            continue;
-
-        for (i = 0; i < MAX_LEN && strLine[i]; i++)
-            if (strLine[i] != ' ') break;
-
-        if (i == MAX_LEN || strLine[i] == '#' || strLine[i] == '\n')
-            continue;
-
-        field = strtok(&strLine[i], ":");
-        if (strncmp(field, field_name, strlen(field_name)))
-            continue;
-
-        if (!(str = strtok(NULL, ":")))
-            continue;
-
-        /* skip blank space in string */
-        while (*str == ' ')
-            str++;
-
-        *(str + strlen(str) - 1) = '\0';
-        strcpy(value, str);
-
-        return 0;
+    if (value < range->min_value || value > range->max_value) {
+        printf("Value: %f exceed range: (%f ~ %f), force to use default: %f \n",
+               value, range->min_value, range->max_value, range->default_value);
+        return range->default_value;
     }
 
-    return -1;
+    return value;
 }
 
-static int8_t
-read_value_uint8(FILE* fp, const char* field_name, uint8_t* value)
+/* Create the buffer of filter <index> on first use; later calls only map
+ * and rewrite it when <param> differs from what the buffer already holds */
+static VAStatus
+filter_param_buffer_update(uint32_t index, const void *param,
+                           uint32_t size, uint32_t num_elements)
 {
-    char str[MAX_LEN];
+    VAStatus va_status = VA_STATUS_SUCCESS;
+    VPPFilter *filter = &g_filters[index];
+    VABufferID *buf_id = &g_filter_param_buf_ids[index];
+    uint32_t total_size = size * num_elements;
+    void *data = NULL;
+
+    assert(total_size <= sizeof(filter->param));
+
+    if (*buf_id != VA_INVALID_ID && total_size == filter->param_size) {
+        if (!memcmp(&filter->param, param, total_size))
+            return va_status;
+
+        va_status = vaMapBuffer(va_dpy, *buf_id, &data);
+        CHECK_VASTATUS(va_status, "vaMapBuffer");
+        memcpy(data, param, total_size);
+        va_status = vaUnmapBuffer(va_dpy, *buf_id);
+        CHECK_VASTATUS(va_status, "vaUnmapBuffer");
+    } else {
+        if (*buf_id != VA_INVALID_ID)
+            vaDestroyBuffer(va_dpy, *buf_id);
 
-    if (read_value_string(fp, field_name, str)) {
-        printf("Failed to find integer field: %s", field_name);
-        return -1;
+        va_status = vaCreateBuffer(va_dpy, context_id,
+                                   VAProcFilterParameterBufferType, size, num_elements,
+                                   (void *)param, buf_id);
+        CHECK_VASTATUS(va_status, "vaCreateBuffer");
     }
 
-    *value = (uint8_t)atoi(str);
-    return 0;
+    memcpy(&filter->param, param, total_size);
+    filter->param_size = total_size;
+
+    return va_status;
 }
 
-static int8_t
-read_value_uint32(FILE* fp, const char* field_name, uint32_t* value)
+/* Input frame shown by output <frame>. With frame rate conversion that is
+ * the last input frame starting at or before the output frame, so input
+ * frames repeat when converting up (24 to 60 fps gives the 3:2 cadence
+ * 0 0 0 1 1 2 2 2 3 3 ...) and are dropped when converting down */
+static uint32_t
+input_frame_of(uint32_t frame)
 {
-    char str[MAX_LEN];
-
-    if (read_value_string(fp, field_name, str)) {
-        printf("Failed to find integer field: %s", field_name);
-        return -1;
-    }
+    if (!g_frc_output_rate.num)
+        return frame / g_field_count;
 
-    *value = (uint32_t)atoi(str);
-    return 0;
+    return (uint64_t)frame * g_frc_input_rate.num * g_frc_output_rate.den /
+           ((uint64_t)g_frc_input_rate.den * g_frc_output_rate.num);
 }
 
-static int8_t
-read_value_float(FILE *fp, const char* field_name, float* value)
+/* Output frames needed to show the FRAME_SUM input frames */
+static uint32_t
+output_frame_count()
 {
-    char str[MAX_LEN];
-    if (read_value_string(fp, field_name, str)) {
-        printf("Failed to find float field: %s \n", field_name);
-        return -1;
-    }
+    uint64_t num, den;
 
-    *value = atof(str);
-    return 0;
+    if (!g_frc_output_rate.num)
+        return g_frame_count * g_field_count;
+
+    num = (uint64_t)g_frame_count * g_frc_output_rate.num * g_frc_input_rate.den;
+    den = (uint64_t)g_frc_output_rate.den * g_frc_input_rate.num;
+    return (num + den - 1) / den;
 }
 
-static float
-adjust_to_range(VAProcFilterValueRange *range, float value)
+/* Input frames that <depth> consecutive output frames can show, i.e. how
+ * many input frames the frames in flight keep loaded */
+static uint32_t
+input_frame_span(uint32_t depth)
 {
-    if (value < range->min_value || value > range->max_value) {
-        printf("Value: %f exceed range: (%f ~ %f), force to use default: %f \n",
-               value, range->min_value, range->max_value, range->default_value);
-        return range->default_value;
-    }
+    uint64_t num, den;
 
-    return value;
+    if (!g_frc_output_rate.num)
+        return depth;
+
+    num = (uint64_t)(depth - 1) * g_frc_input_rate.num * g_frc_output_rate.den;
+    den = (uint64_t)g_frc_input_rate.den * g_frc_output_rate.num;
+    return (num + den - 1) / den + 1;
 }
 
 static VAStatus
@@ -282,9 +377,9 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
         y_src = newImageBuffer;
         if (g_src_file_fourcc == VA_FOURCC_I420) {
@@ -383,9 +478,9 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
         y_src = newImageBuffer;
         y_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[0]);
@@ -396,67 +491,17 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
             y_src += surface_image.width * byte_per_pixel;
             y_dst += surface_image.pitches[0];
         }
-    } else if ((surface_image.format.fourcc == VA_FOURCC_P010 &&
-                g_src_file_fourcc == VA_FOURCC_P010) ||
-               (surface_image.format.fourcc == VA_FOURCC_I010 &&
-                g_src_file_fourcc == VA_FOURCC_I010)) {
-        frame_size = surface_image.width * surface_image.height * 3;
+    } else if (vpp_hbd_supported(surface_image.format.fourcc, g_src_file_fourcc)) {
+        frame_size = vpp_hbd_frame_size(g_src_file_fourcc, surface_image.width, surface_image.height);
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
-
-        y_src = newImageBuffer;
-        y_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[0]);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
-        /* plane 0, directly copy */
-        for (row = 0; row < surface_image.height; row++) {
-            memcpy(y_dst, y_src, surface_image.width * 2);
-            y_src += surface_image.width * 2;
-            y_dst += surface_image.pitches[0];
-        }
-
-        /* UV plane */
-        if (surface_image.format.fourcc == VA_FOURCC_I010) {
-            assert(g_src_file_fourcc == VA_FOURCC_I010);
-
-            u_src = newImageBuffer + surface_image.width * surface_image.height * 2;
-            v_src = newImageBuffer + surface_image.width * surface_image.height * 5 / 2;
-
-            u_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[1]);
-            v_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[2]);
-
-            for (row = 0; row < surface_image.height / 2; row++) {
-                memcpy(u_dst, u_src, surface_image.width);
-                memcpy(v_dst, v_src, surface_image.width);
-
-                u_src += surface_image.width;
-                v_src += surface_image.width;
-
-                u_dst += surface_image.pitches[1];
-                v_dst += surface_image.pitches[2];
-            }
-        } else if (surface_image.format.fourcc == VA_FOURCC_P010) {
-            assert(g_src_file_fourcc == VA_FOURCC_P010);
-
-            u_src = newImageBuffer + surface_image.width * surface_image.height * 2;
-            v_src = u_src;
-
-            u_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[1]);
-            v_dst = u_dst;
-
-            for (row = 0; row < surface_image.height / 2; row++) {
-                memcpy(u_dst, u_src, surface_image.width * 2);
-
-                u_src += surface_image.width * 2;
-                v_src = u_src;
-
-                u_dst += surface_image.pitches[1];
-                v_dst = u_dst;
-            }
-        }
+        /* 10/12/16 bit frame, repacked to the surface layout */
+        vpp_hbd_file_to_image(newImageBuffer, g_src_file_fourcc, &surface_image, (uint8_t *)surface_p);
     }  else if ((surface_image.format.fourcc == VA_FOURCC_RGBA &&
                  g_src_file_fourcc == VA_FOURCC_RGBA) ||
                 (surface_image.format.fourcc == VA_FOURCC_RGBX &&
@@ -469,9 +514,9 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
         y_src = newImageBuffer;
         y_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[0]);
@@ -490,9 +535,9 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
         y_src = newImageBuffer;
 
@@ -518,12 +563,12 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 /* Store NV12/YV12/I420 surface to yv12 file */
 static VAStatus
-store_yuv_surface_to_yv12_file(FILE *fp,
+store_yuv_surface_to_yv12_file(VPPWriter *writer,
                                VASurfaceID surface_id)
 {
     VAStatus va_status;
@@ -532,7 +577,7 @@ store_yuv_surface_to_yv12_file(FILE *fp,
     unsigned char *y_src, *u_src, *v_src;
     unsigned char *y_dst, *u_dst, *v_dst;
     uint32_t row, col;
-    int32_t n_items;
+    int ret = 0;
     unsigned char * newImageBuffer = NULL;
 
     va_status = vaDeriveImage(va_dpy, surface_id, &surface_image);
@@ -549,7 +594,7 @@ store_yuv_surface_to_yv12_file(FILE *fp,
         uint32_t y_size = surface_image.width * surface_image.height;
         uint32_t u_size = y_size / 4;
 
-        newImageBuffer = (unsigned char*)malloc(y_size * 3 / 2);
+        newImageBuffer = vpp_writer_acquire(writer, y_size * 3 / 2);
         assert(newImageBuffer);
 
         /* stored as YV12 format */
@@ -607,29 +652,22 @@ store_yuv_surface_to_yv12_file(FILE *fp,
             }
         }
 
-        /* write frame to file */
-        do {
-            n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
-        } while (n_items != 1);
+        /* hand the frame to the writer thread */
+        ret = vpp_writer_submit(writer, newImageBuffer, y_size * 3 / 2);
 
     } else {
         printf("Not supported YUV surface fourcc !!! \n");
         return VA_STATUS_ERROR_INVALID_SURFACE;
     }
 
-    if (newImageBuffer) {
-        free(newImageBuffer);
-        newImageBuffer = NULL;
-    }
-
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return ret ? VA_STATUS_ERROR_OPERATION_FAILED : VA_STATUS_SUCCESS;
 }
 
 static VAStatus
-store_yuv_surface_to_i420_file(FILE *fp,
+store_yuv_surface_to_i420_file(VPPWriter *writer,
                                VASurfaceID surface_id)
 {
     VAStatus va_status;
@@ -638,7 +676,7 @@ store_yuv_surface_to_i420_file(FILE *fp,
     unsigned char *y_src, *u_src, *v_src;
     unsigned char *y_dst, *u_dst, *v_dst;
     uint32_t row, col;
-    int32_t n_items;
+    int ret = 0;
     unsigned char * newImageBuffer = NULL;
 
     va_status = vaDeriveImage(va_dpy, surface_id, &surface_image);
@@ -655,7 +693,7 @@ store_yuv_surface_to_i420_file(FILE *fp,
         uint32_t y_size = surface_image.width * surface_image.height;
         uint32_t u_size = y_size / 4;
 
-        newImageBuffer = (unsigned char*)malloc(y_size * 3 / 2);
+        newImageBuffer = vpp_writer_acquire(writer, y_size * 3 / 2);
         assert(newImageBuffer);
 
         /* stored as YV12 format */
@@ -713,29 +751,22 @@ store_yuv_surface_to_i420_file(FILE *fp,
             }
         }
 
-        /* write frame to file */
-        do {
-            n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
-        } while (n_items != 1);
+        /* hand the frame to the writer thread */
+        ret = vpp_writer_submit(writer, newImageBuffer, y_size * 3 / 2);
 
     } else {
         printf("Not supported YUV surface fourcc !!! \n");
         return VA_STATUS_ERROR_INVALID_SURFACE;
     }
 
-    if (newImageBuffer) {
-        free(newImageBuffer);
-        newImageBuffer = NULL;
-    }
-
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return ret ? VA_STATUS_ERROR_OPERATION_FAILED : VA_STATUS_SUCCESS;
 }
 
 static VAStatus
-store_yuv_surface_to_nv12_file(FILE *fp,
+store_yuv_surface_to_nv12_file(VPPWriter *writer,
                                VASurfaceID surface_id)
 {
     VAStatus va_status;
@@ -744,7 +775,7 @@ store_yuv_surface_to_nv12_file(FILE *fp,
     unsigned char *y_src, *u_src, *v_src;
     unsigned char *y_dst, *u_dst, *v_dst;
     uint32_t row, col;
-    int32_t n_items;
+    int ret = 0;
     unsigned char * newImageBuffer = NULL;
 
     va_status = vaDeriveImage(va_dpy, surface_id, &surface_image);
@@ -760,7 +791,7 @@ store_yuv_surface_to_nv12_file(FILE *fp,
 
         uint32_t y_size = surface_image.width * surface_image.height;
 
-        newImageBuffer = (unsigned char*)malloc(y_size * 3 / 2);
+        newImageBuffer = vpp_writer_acquire(writer, y_size * 3 / 2);
         assert(newImageBuffer);
 
         /* stored as YV12 format */
@@ -814,29 +845,22 @@ store_yuv_surface_to_nv12_file(FILE *fp,
             }
         }
 
-        /* write frame to file */
-        do {
-            n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
-        } while (n_items != 1);
+        /* hand the frame to the writer thread */
+        ret = vpp_writer_submit(writer, newImageBuffer, y_size * 3 / 2);
 
     } else {
         printf("Not supported YUV surface fourcc !!! \n");
         return VA_STATUS_ERROR_INVALID_SURFACE;
     }
 
-    if (newImageBuffer) {
-        free(newImageBuffer);
-        newImageBuffer = NULL;
-    }
-
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return ret ? VA_STATUS_ERROR_OPERATION_FAILED : VA_STATUS_SUCCESS;
 }
 
 static VAStatus
-store_packed_yuv_surface_to_packed_file(FILE *fp,
+store_packed_yuv_surface_to_packed_file(VPPWriter *writer,
                                         VASurfaceID surface_id)
 {
     VAStatus va_status;
@@ -845,7 +869,7 @@ store_packed_yuv_surface_to_packed_file(FILE *fp,
     unsigned char *y_src;
     unsigned char *y_dst;
     uint32_t row;
-    int32_t n_items;
+    int ret = 0;
     unsigned char * newImageBuffer = NULL;
 
     va_status = vaDeriveImage(va_dpy, surface_id, &surface_image);
@@ -861,7 +885,7 @@ store_packed_yuv_surface_to_packed_file(FILE *fp,
         uint32_t byte_per_pixel = (surface_image.format.fourcc == VA_FOURCC_AYUV ? 4 : 2);
         uint32_t frame_size = surface_image.width * surface_image.height * byte_per_pixel;
 
-        newImageBuffer = (unsigned char*)malloc(frame_size);
+        newImageBuffer = vpp_writer_acquire(writer, frame_size);
         assert(newImageBuffer);
         memset(newImageBuffer, 0, frame_size);
 
@@ -877,37 +901,28 @@ store_packed_yuv_surface_to_packed_file(FILE *fp,
             y_dst += surface_image.width * byte_per_pixel;
         }
 
-        /* write frame to file */
-        do {
-            n_items = fwrite(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        /* hand the frame to the writer thread */
+        ret = vpp_writer_submit(writer, newImageBuffer, frame_size);
 
     } else {
         printf("Not supported YUV surface fourcc !!! \n");
         return VA_STATUS_ERROR_INVALID_SURFACE;
     }
 
-    if (newImageBuffer) {
-        free(newImageBuffer);
-        newImageBuffer = NULL;
-    }
-
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return ret ? VA_STATUS_ERROR_OPERATION_FAILED : VA_STATUS_SUCCESS;
 }
 
 static VAStatus
-store_yuv_surface_to_10bit_file(FILE *fp, VASurfaceID surface_id)
+store_yuv_surface_to_10bit_file(VPPWriter *writer, VASurfaceID surface_id)
 {
     VAStatus va_status;
     VAImage surface_image;
     void *surface_p = NULL;
-    unsigned char *y_src, *u_src, *v_src;
-    unsigned char *y_dst, *u_dst, *v_dst;
-    uint32_t row;
-    int32_t n_items;
+    uint32_t frame_size;
+    int ret = 0;
     unsigned char * newImageBuffer = NULL;
 
     va_status = vaDeriveImage(va_dpy, surface_id, &surface_image);
@@ -916,76 +931,28 @@ store_yuv_surface_to_10bit_file(FILE *fp, VASurfaceID surface_id)
     va_status = vaMapBuffer(va_dpy, surface_image.buf, &surface_p);
     CHECK_VASTATUS(va_status, "vaMapBuffer");
 
-    /* store the surface to one 10bit file */
-    uint32_t y_size = surface_image.width * surface_image.height * 2;
-    uint32_t u_size = y_size / 4;
-
-    newImageBuffer = (unsigned char*)malloc(y_size * 3);
+    /* store the surface to one 10/12/16 bit file */
+    frame_size = vpp_hbd_frame_size(g_dst_file_fourcc, surface_image.width, surface_image.height);
+    newImageBuffer = vpp_writer_acquire(writer, frame_size);
     assert(newImageBuffer);
-    y_dst = newImageBuffer;
-
-    y_src = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[0]);
 
-    /* Y plane copy */
-    for (row = 0; row < surface_image.height; row++) {
-        memcpy(y_dst, y_src, surface_image.width * 2);
-        y_src += surface_image.pitches[0];
-        y_dst += surface_image.width * 2;
-    }
-
-    if (surface_image.format.fourcc == VA_FOURCC_I010) {
-        u_dst = newImageBuffer + y_size;
-        v_dst = newImageBuffer + y_size + u_size;
-
-        u_src = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[1]);
-        v_src = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[2]);
-
-        for (row = 0; row < surface_image.height / 2; row++) {
-            memcpy(u_dst, u_src, surface_image.width);
-            memcpy(v_dst, v_src, surface_image.width);
-
-            u_dst += surface_image.width;
-            v_dst += surface_image.width;
-
-            u_src += surface_image.pitches[1];
-            v_src += surface_image.pitches[2];
-        }
-    } else if (surface_image.format.fourcc == VA_FOURCC_P010) {
-        u_dst = newImageBuffer + y_size;
-        v_dst = u_dst;
-
-        u_src = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[1]);
-        v_src = u_src;
-
-        for (row = 0; row < surface_image.height / 2; row++) {
-            memcpy(u_dst, u_src, surface_image.width * 2);
-            u_dst += surface_image.width * 2;
-            u_src += surface_image.pitches[1];
-        }
-    } else {
+    if (vpp_hbd_image_to_file(&surface_image, (uint8_t *)surface_p,
+                              newImageBuffer, g_dst_file_fourcc)) {
         printf("Not supported YUV surface fourcc !!! \n");
-        free(newImageBuffer);
         return VA_STATUS_ERROR_INVALID_SURFACE;
     }
 
-    /* write frame to file */
-    do {
-        n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
-    } while (n_items != 1);
-
-    if (newImageBuffer) {
-        free(newImageBuffer);
-        newImageBuffer = NULL;
-    }
+    /* hand the frame to the writer thread */
+    ret = vpp_writer_submit(writer, newImageBuffer, frame_size);
 
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return ret ? VA_STATUS_ERROR_OPERATION_FAILED : VA_STATUS_SUCCESS;
 }
 
 static VAStatus
-store_rgb_surface_to_rgb_file(FILE *fp, VASurfaceID surface_id)
+store_rgb_surface_to_rgb_file(VPPWriter *writer, VASurfaceID surface_id)
 {
     VAStatus va_status;
     VAImage surface_image;
@@ -993,7 +960,7 @@ store_rgb_surface_to_rgb_file(FILE *fp, VASurfaceID surface_id)
     unsigned char *y_src;
     unsigned char *y_dst;
     uint32_t frame_size, row;
-    int32_t n_items;
+    int ret = 0;
     unsigned char * newImageBuffer = NULL;
 
     va_status = vaDeriveImage(va_dpy, surface_id, &surface_image);
@@ -1003,7 +970,7 @@ store_rgb_surface_to_rgb_file(FILE *fp, VASurfaceID surface_id)
     CHECK_VASTATUS(va_status, "vaMapBuffer");
 
     frame_size = surface_image.width * surface_image.height * 4;
-    newImageBuffer = (unsigned char*)malloc(frame_size);
+    newImageBuffer = vpp_writer_acquire(writer, frame_size);
     assert(newImageBuffer);
     y_dst = newImageBuffer;
 
@@ -1015,24 +982,17 @@ store_rgb_surface_to_rgb_file(FILE *fp, VASurfaceID surface_id)
         y_dst += surface_image.width * 4;
     }
 
-    /* write frame to file */
-    do {
-        n_items = fwrite(newImageBuffer, frame_size, 1, fp);
-    } while (n_items != 1);
-
-    if (newImageBuffer) {
-        free(newImageBuffer);
-        newImageBuffer = NULL;
-    }
+    /* hand the frame to the writer thread */
+    ret = vpp_writer_submit(writer, newImageBuffer, frame_size);
 
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return ret ? VA_STATUS_ERROR_OPERATION_FAILED : VA_STATUS_SUCCESS;
 }
 
 static VAStatus
-store_rgbp_surface_to_rgbp_file(FILE *fp, VASurfaceID surface_id)
+store_rgbp_surface_to_rgbp_file(VPPWriter *writer, VASurfaceID surface_id)
 {
     VAStatus va_status;
     VAImage surface_image;
@@ -1040,7 +1000,7 @@ store_rgbp_surface_to_rgbp_file(FILE *fp, VASurfaceID surface_id)
     unsigned char *y_src;
     unsigned char *y_dst;
     uint32_t frame_size, row;
-    int32_t n_items;
+    int ret = 0;
     unsigned char * newImageBuffer = NULL;
     int i;
 
@@ -1051,7 +1011,7 @@ store_rgbp_surface_to_rgbp_file(FILE *fp, VASurfaceID surface_id)
     CHECK_VASTATUS(va_status, "vaMapBuffer");
 
     frame_size = surface_image.width * surface_image.height * 3;
-    newImageBuffer = (unsigned char*)malloc(frame_size);
+    newImageBuffer = vpp_writer_acquire(writer, frame_size);
     assert(newImageBuffer);
     y_dst = newImageBuffer;
 
@@ -1065,35 +1025,28 @@ store_rgbp_surface_to_rgbp_file(FILE *fp, VASurfaceID surface_id)
         }
     }
 
-    /* write frame to file */
-    do {
-        n_items = fwrite(newImageBuffer, frame_size, 1, fp);
-    } while (n_items != 1);
-
-    if (newImageBuffer) {
-        free(newImageBuffer);
-        newImageBuffer = NULL;
-    }
+    /* hand the frame to the writer thread */
+    ret = vpp_writer_submit(writer, newImageBuffer, frame_size);
 
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return ret ? VA_STATUS_ERROR_OPERATION_FAILED : VA_STATUS_SUCCESS;
 }
 
 static VAStatus
-store_yuv_surface_to_file(FILE *fp,
+store_yuv_surface_to_file(VPPWriter *writer,
                           VASurfaceID surface_id)
 {
     if (g_out_fourcc == VA_FOURCC_YV12 ||
         g_out_fourcc == VA_FOURCC_I420 ||
         g_out_fourcc == VA_FOURCC_NV12) {
         if (g_dst_file_fourcc == VA_FOURCC_YV12)
-            return store_yuv_surface_to_yv12_file(fp, surface_id);
+            return store_yuv_surface_to_yv12_file(writer, surface_id);
         else if (g_dst_file_fourcc == VA_FOURCC_I420)
-            return store_yuv_surface_to_i420_file(fp, surface_id);
+            return store_yuv_surface_to_i420_file(writer, surface_id);
         else if (g_dst_file_fourcc == VA_FOURCC_NV12)
-            return store_yuv_surface_to_nv12_file(fp, surface_id);
+            return store_yuv_surface_to_nv12_file(writer, surface_id);
         else {
             printf("Not supported YUV fourcc for output !!!\n");
             return VA_STATUS_ERROR_INVALID_SURFACE;
@@ -1104,12 +1057,9 @@ store_yuv_surface_to_file(FILE *fp,
                 g_dst_file_fourcc == VA_FOURCC_UYVY) ||
                (g_out_fourcc == VA_FOURCC_AYUV &&
                 g_dst_file_fourcc == VA_FOURCC_AYUV)) {
-        return store_packed_yuv_surface_to_packed_file(fp, surface_id);
-    } else if ((g_out_fourcc == VA_FOURCC_I010 &&
-                g_dst_file_fourcc == VA_FOURCC_I010) ||
-               (g_out_fourcc == VA_FOURCC_P010 &&
-                g_dst_file_fourcc == VA_FOURCC_P010)) {
-        return store_yuv_surface_to_10bit_file(fp, surface_id);
+        return store_packed_yuv_surface_to_packed_file(writer, surface_id);
+    } else if (vpp_hbd_supported(g_out_fourcc, g_dst_file_fourcc)) {
+        return store_yuv_surface_to_10bit_file(writer, surface_id);
     } else if ((g_out_fourcc == VA_FOURCC_RGBA &&
                 g_dst_file_fourcc == VA_FOURCC_RGBA) ||
                (g_out_fourcc == VA_FOURCC_RGBX &&
@@ -1118,10 +1068,10 @@ store_yuv_surface_to_file(FILE *fp,
                 g_dst_file_fourcc == VA_FOURCC_BGRA) ||
                (g_out_fourcc == VA_FOURCC_BGRX &&
                 g_dst_file_fourcc == VA_FOURCC_BGRX)) {
-        return store_rgb_surface_to_rgb_file(fp, surface_id);
+        return store_rgb_surface_to_rgb_file(writer, surface_id);
     } else if (g_out_fourcc == VA_FOURCC_RGBP ||
                g_out_fourcc == VA_FOURCC_BGRP) {
-        return store_rgbp_surface_to_rgbp_file(fp, surface_id);
+        return store_rgbp_surface_to_rgbp_file(writer, surface_id);
     } else {
         printf("Not supported YUV fourcc for output !!!\n");
         return VA_STATUS_ERROR_INVALID_SURFACE;
@@ -1129,39 +1079,41 @@ store_yuv_surface_to_file(FILE *fp,
 }
 
 static VAStatus
-denoise_filter_init(VABufferID *filter_param_buf_id)
+denoise_filter_init(uint32_t index, uint32_t frame)
 {
     VAStatus va_status = VA_STATUS_SUCCESS;
     VAProcFilterParameterBuffer denoise_param;
-    VABufferID denoise_param_buf_id;
     float intensity;
+    static float last_intensity;
+
+    /* caps are queried on the first call only */
+    static VAProcFilterCap denoise_caps;
+    static uint32_t num_denoise_caps = 0;
+    if (!num_denoise_caps) {
+        num_denoise_caps = 1;
+        va_status = vaQueryVideoProcFilterCaps(va_dpy, context_id,
+                                               VAProcFilterNoiseReduction,
+                                               &denoise_caps, &num_denoise_caps);
+        CHECK_VASTATUS(va_status, "vaQueryVideoProcFilterCaps");
+    }
 
-    VAProcFilterCap denoise_caps;
-    uint32_t num_denoise_caps = 1;
-    va_status = vaQueryVideoProcFilterCaps(va_dpy, context_id,
-                                           VAProcFilterNoiseReduction,
-                                           &denoise_caps, &num_denoise_caps);
-    CHECK_VASTATUS(va_status, "vaQueryVideoProcFilterCaps");
-
-    if (read_value_float(g_config_file_fd, "DENOISE_INTENSITY", &intensity)) {
-        printf("Read denoise intensity failed, use default value");
+    if (vpp_config_get_float_at(g_config, "DENOISE_INTENSITY", frame, &intensity)) {
+        if (frame == g_first_output_frame)
+            printf("Read denoise intensity failed, use default value");
         intensity = denoise_caps.range.default_value;
     }
     intensity = adjust_to_range(&denoise_caps.range, intensity);
 
+    memset(&denoise_param, 0, sizeof(denoise_param));
     denoise_param.type  = VAProcFilterNoiseReduction;
     denoise_param.value = intensity;
 
-    printf("Denoise intensity: %f\n", intensity);
+    /* scheduled intensities are reported when they change */
+    if (frame == g_first_output_frame || intensity != last_intensity)
+        printf("Denoise intensity: %f\n", intensity);
+    last_intensity = intensity;
 
-    va_status = vaCreateBuffer(va_dpy, context_id,
-                               VAProcFilterParameterBufferType, sizeof(denoise_param), 1,
-                               &denoise_param, &denoise_param_buf_id);
-    CHECK_VASTATUS(va_status, "vaCreateBuffer");
-
-    *filter_param_buf_id = denoise_param_buf_id;
-
-    return va_status;
+    return filter_param_buffer_update(index, &denoise_param, sizeof(denoise_param), 1);
 }
 
 /*
@@ -1169,45 +1121,36 @@ denoise_filter_init(VABufferID *filter_param_buf_id)
  * If this filter is called, it is enabled by default.
  */
 static VAStatus
-skintone_filter_init(VABufferID *filter_param_buf_id)
+skintone_filter_init(uint32_t index, uint32_t /* frame */)
 {
-    VAStatus va_status = VA_STATUS_SUCCESS;
     VAProcFilterParameterBuffer stde_param;
-    VABufferID stde_param_buf_id;
     uint8_t stde_factor = 0;
 
-    if (read_value_uint8(g_config_file_fd, "STDE_FACTOR", &stde_factor)) {
+    if (vpp_config_get_uint8(g_config, "STDE_FACTOR", &stde_factor)) {
         printf("Read STDE Factor failed, use default value");
         stde_factor = 0;
     }
 
     printf("Applying STDE factor: %d\n", stde_factor);
 
+    memset(&stde_param, 0, sizeof(stde_param));
     stde_param.type  = VAProcFilterSkinToneEnhancement;
     stde_param.value = stde_factor;
 
-    va_status = vaCreateBuffer(va_dpy, context_id,
-                               VAProcFilterParameterBufferType, sizeof(stde_param), 1,
-                               &stde_param, &stde_param_buf_id);
-    CHECK_VASTATUS(va_status, "vaCreateBuffer");
-
-    *filter_param_buf_id = stde_param_buf_id;
-
-    return va_status;
+    return filter_param_buffer_update(index, &stde_param, sizeof(stde_param), 1);
 }
 
 static VAStatus
-deinterlace_filter_init(VABufferID *filter_param_buf_id)
+deinterlace_param_read(VAProcFilterParameterBufferDeinterlacing &deinterlacing_param)
 {
     VAStatus va_status = VA_STATUS_SUCCESS;
-    VAProcFilterParameterBufferDeinterlacing deinterlacing_param;
-    VABufferID deinterlacing_param_buf_id;
     char algorithm_str[MAX_LEN], flags_str[MAX_LEN];
     uint32_t i;
 
     /* read and check whether configured deinterlace algorithm is supported */
+    memset(&deinterlacing_param, 0, sizeof(deinterlacing_param));
     deinterlacing_param.algorithm  = VAProcDeinterlacingBob;
-    if (!read_value_string(g_config_file_fd, "DEINTERLACING_ALGORITHM", algorithm_str)) {
+    if (!vpp_config_get_string(g_config, "DEINTERLACING_ALGORITHM", algorithm_str)) {
         printf("Deinterlacing algorithm in config: %s \n", algorithm_str);
         if (!strcmp(algorithm_str, "VAProcDeinterlacingBob"))
             deinterlacing_param.algorithm  = VAProcDeinterlacingBob;
@@ -1243,7 +1186,7 @@ deinterlace_filter_init(VABufferID *filter_param_buf_id)
 
     /* read and check the deinterlace flags */
     deinterlacing_param.flags = 0;
-    if (!read_value_string(g_config_file_fd, "DEINTERLACING_FLAG", flags_str)) {
+    if (!vpp_config_get_string(g_config, "DEINTERLACING_FLAG", flags_str)) {
         if (strstr(flags_str, "VA_DEINTERLACING_BOTTOM_FIELD_FIRST"))
             deinterlacing_param.flags |= VA_DEINTERLACING_BOTTOM_FIELD_FIRST;
         if (strstr(flags_str, "VA_DEINTERLACING_BOTTOM_FIELD"))
@@ -1254,89 +1197,125 @@ deinterlace_filter_init(VABufferID *filter_param_buf_id)
 
     deinterlacing_param.type  = VAProcFilterDeinterlacing;
 
-    /* create deinterlace fitler buffer */
-    va_status = vaCreateBuffer(va_dpy, context_id,
-                               VAProcFilterParameterBufferType, sizeof(deinterlacing_param), 1,
-                               &deinterlacing_param, &deinterlacing_param_buf_id);
-    CHECK_VASTATUS(va_status, "vaCreateBuffer");
-
-    *filter_param_buf_id = deinterlacing_param_buf_id;
+    if (g_field_count > 1 && (deinterlacing_param.flags & VA_DEINTERLACING_ONE_FIELD)) {
+        printf("DEINTERLACING_FIELD_RATE needs frames with both fields, not VA_DEINTERLACING_ONE_FIELD\n");
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+    }
 
     return va_status;
 }
 
 static VAStatus
-sharpening_filter_init(VABufferID *filter_param_buf_id)
+deinterlace_filter_init(uint32_t index, uint32_t frame)
+{
+    VAStatus va_status;
+    VAProcFilterParameterBufferDeinterlacing deinterlacing_param;
+
+    /* algorithm and flags are read on the first call only */
+    static VAProcFilterParameterBufferDeinterlacing config_param;
+    static bool config_read = false;
+    if (!config_read) {
+        memset(&config_param, 0, sizeof(config_param));
+        va_status = deinterlace_param_read(config_param);
+        CHECK_VASTATUS(va_status, "deinterlace_param_read");
+        config_read = true;
+    }
+
+    /* at field rate output frame <frame> shows the first field of its
+     * input frame when even, the second one when odd */
+    deinterlacing_param = config_param;
+    if (g_field_count > 1) {
+        bool bottom_first = config_param.flags & VA_DEINTERLACING_BOTTOM_FIELD_FIRST;
+
+        deinterlacing_param.flags &= ~VA_DEINTERLACING_BOTTOM_FIELD;
+        if (bottom_first == !(frame % 2))
+            deinterlacing_param.flags |= VA_DEINTERLACING_BOTTOM_FIELD;
+    }
+
+    /* create deinterlace fitler buffer */
+    return filter_param_buffer_update(index, &deinterlacing_param, sizeof(deinterlacing_param), 1);
+}
+
+static VAStatus
+sharpening_filter_init(uint32_t index, uint32_t frame)
 {
     VAStatus va_status;
     VAProcFilterParameterBuffer sharpening_param;
-    VABufferID sharpening_param_buf_id;
     float intensity;
+    static float last_intensity;
+
+    /* caps are queried on the first call only */
+    static VAProcFilterCap sharpening_caps;
+    static uint32_t num_sharpening_caps = 0;
+    if (!num_sharpening_caps) {
+        num_sharpening_caps = 1;
+        va_status = vaQueryVideoProcFilterCaps(va_dpy, context_id,
+                                               VAProcFilterSharpening,
+                                               &sharpening_caps, &num_sharpening_caps);
+        CHECK_VASTATUS(va_status, "vaQueryVideoProcFilterCaps");
+    }
 
-    VAProcFilterCap sharpening_caps;
-    uint32_t num_sharpening_caps = 1;
-    va_status = vaQueryVideoProcFilterCaps(va_dpy, context_id,
-                                           VAProcFilterSharpening,
-                                           &sharpening_caps, &num_sharpening_caps);
-    CHECK_VASTATUS(va_status, "vaQueryVideoProcFilterCaps");
-
-    if (read_value_float(g_config_file_fd, "SHARPENING_INTENSITY", &intensity)) {
-        printf("Read sharpening intensity failed, use default value.");
+    if (vpp_config_get_float_at(g_config, "SHARPENING_INTENSITY", frame, &intensity)) {
+        if (frame == g_first_output_frame)
+            printf("Read sharpening intensity failed, use default value.");
         intensity = sharpening_caps.range.default_value;
     }
 
     intensity = adjust_to_range(&sharpening_caps.range, intensity);
-    printf("Sharpening intensity: %f\n", intensity);
+    if (frame == g_first_output_frame || intensity != last_intensity)
+        printf("Sharpening intensity: %f\n", intensity);
+    last_intensity = intensity;
+    memset(&sharpening_param, 0, sizeof(sharpening_param));
     sharpening_param.value = intensity;
 
     sharpening_param.type  = VAProcFilterSharpening;
 
     /* create sharpening fitler buffer */
-    va_status = vaCreateBuffer(va_dpy, context_id,
-                               VAProcFilterParameterBufferType, sizeof(sharpening_param), 1,
-                               &sharpening_param, &sharpening_param_buf_id);
-
-    *filter_param_buf_id = sharpening_param_buf_id;
-
-    return va_status;
+    return filter_param_buffer_update(index, &sharpening_param, sizeof(sharpening_param), 1);
 }
 
 static VAStatus
-color_balance_filter_init(VABufferID *filter_param_buf_id)
+color_balance_filter_init(uint32_t index, uint32_t frame)
 {
     VAStatus va_status;
-    VAProcFilterParameterBufferColorBalance color_balance_param[4];
-    VABufferID color_balance_param_buf_id;
+    VAProcFilterParameterBufferColorBalance color_balance_param[VAProcColorBalanceCount];
+    const char *names[VAProcColorBalanceCount];
     float value;
     uint32_t i, count;
     int8_t status;
+    bool changed;
+    static float last_values[VAProcColorBalanceCount];
+
+    /* caps are queried on the first call only */
+    static VAProcFilterCapColorBalance color_balance_caps[VAProcColorBalanceCount];
+    static unsigned int num_color_balance_caps = 0;
+    if (!num_color_balance_caps) {
+        num_color_balance_caps = VAProcColorBalanceCount;
+        va_status = vaQueryVideoProcFilterCaps(va_dpy, context_id,
+                                               VAProcFilterColorBalance,
+                                               &color_balance_caps, &num_color_balance_caps);
+        CHECK_VASTATUS(va_status, "vaQueryVideoProcFilterCaps");
+    }
 
-    VAProcFilterCapColorBalance color_balance_caps[VAProcColorBalanceCount];
-    unsigned int num_color_balance_caps = VAProcColorBalanceCount;
-    va_status = vaQueryVideoProcFilterCaps(va_dpy, context_id,
-                                           VAProcFilterColorBalance,
-                                           &color_balance_caps, &num_color_balance_caps);
-    CHECK_VASTATUS(va_status, "vaQueryVideoProcFilterCaps");
-
+    memset(color_balance_param, 0, sizeof(color_balance_param));
     count = 0;
-    printf("Color balance params: ");
     for (i = 0; i < num_color_balance_caps; i++) {
         if (color_balance_caps[i].type == VAProcColorBalanceHue) {
             color_balance_param[count].attrib  = VAProcColorBalanceHue;
-            status = read_value_float(g_config_file_fd, "COLOR_BALANCE_HUE", &value);
-            printf("Hue: ");
+            status = vpp_config_get_float_at(g_config, "COLOR_BALANCE_HUE", frame, &value);
+            names[count] = "Hue";
         } else if (color_balance_caps[i].type == VAProcColorBalanceSaturation) {
             color_balance_param[count].attrib  = VAProcColorBalanceSaturation;
-            status = read_value_float(g_config_file_fd, "COLOR_BALANCE_SATURATION", &value);
-            printf("Saturation: ");
+            status = vpp_config_get_float_at(g_config, "COLOR_BALANCE_SATURATION", frame, &value);
+            names[count] = "Saturation";
         } else if (color_balance_caps[i].type == VAProcColorBalanceBrightness) {
             color_balance_param[count].attrib  = VAProcColorBalanceBrightness;
-            status = read_value_float(g_config_file_fd, "COLOR_BALANCE_BRIGHTNESS", &value);
-            printf("Brightness: ");
+            status = vpp_config_get_float_at(g_config, "COLOR_BALANCE_BRIGHTNESS", frame, &value);
+            names[count] = "Brightness";
         } else if (color_balance_caps[i].type == VAProcColorBalanceContrast) {
             color_balance_param[count].attrib  = VAProcColorBalanceContrast;
-            status = read_value_float(g_config_file_fd, "COLOR_BALANCE_CONTRAST", &value);
-            printf("Contrast: ");
+            status = vpp_config_get_float_at(g_config, "COLOR_BALANCE_CONTRAST", frame, &value);
+            names[count] = "Contrast";
         } else {
             continue;
         }
@@ -1349,18 +1328,27 @@ color_balance_filter_init(VABufferID *filter_param_buf_id)
         color_balance_param[count].value = value;
         color_balance_param[count].type  = VAProcFilterColorBalance;
         count++;
-
-        printf("%4f,  ", value);
     }
-    printf("\n");
 
-    va_status = vaCreateBuffer(va_dpy, context_id,
-                               VAProcFilterParameterBufferType, sizeof(color_balance_param), 4,
-                               color_balance_param, &color_balance_param_buf_id);
+    if (!count) {
+        printf("No color balance attribute is supported by driver !\n");
+        return VA_STATUS_ERROR_UNIMPLEMENTED;
+    }
 
-    *filter_param_buf_id = color_balance_param_buf_id;
+    /* scheduled values are reported when one of them changes */
+    changed = frame == g_first_output_frame;
+    for (i = 0; i < count; i++) {
+        changed |= color_balance_param[i].value != last_values[i];
+        last_values[i] = color_balance_param[i].value;
+    }
+    if (changed) {
+        printf("Color balance params: ");
+        for (i = 0; i < count; i++)
+            printf("%s: %4f,  ", names[i], color_balance_param[i].value);
+        printf("\n");
+    }
 
-    return va_status;
+    return filter_param_buffer_update(index, color_balance_param, sizeof(color_balance_param[0]), count);
 }
 
 #if BLEND_ON
@@ -1375,9 +1363,9 @@ blending_state_init(VABlendState *state)
 
     /* read and check blend state */
     state->flags = 0;
-    if (!read_value_string(g_config_file_fd, "BLENDING_FLAGS", blending_flags_str)) {
+    if (!vpp_config_get_string(g_config, "BLENDING_FLAGS", blending_flags_str)) {
         if (strstr(blending_flags_str, "VA_BLEND_GLOBAL_ALPHA")) {
-            if (read_value_float(g_config_file_fd, "BLENDING_GLOBAL_ALPHA", &global_alpha)) {
+            if (vpp_config_get_float(g_config, "BLENDING_GLOBAL_ALPHA", &global_alpha)) {
                 global_alpha = 1.0  ;
                 printf("Use default global alpha : %4f \n", global_alpha);
             }
@@ -1385,11 +1373,11 @@ blending_state_init(VABlendState *state)
             state->global_alpha = global_alpha;
         }
         if (strstr(blending_flags_str, "VA_BLEND_LUMA_KEY")) {
-            if (read_value_uint8(g_config_file_fd, "BLENDING_MIN_LUMA", &g_blending_min_luma)) {
+            if (vpp_config_get_uint8(g_config, "BLENDING_MIN_LUMA", &g_blending_min_luma)) {
                 g_blending_min_luma = 1;
                 printf("Use default min luma : %3d \n", g_blending_min_luma);
             }
-            if (read_value_uint8(g_config_file_fd, "BLENDING_MAX_LUMA", &g_blending_max_luma)) {
+            if (vpp_config_get_uint8(g_config, "BLENDING_MAX_LUMA", &g_blending_max_luma)) {
                 g_blending_max_luma = 254;
                 printf("Use default max luma : %3d \n", g_blending_max_luma);
             }
@@ -1422,99 +1410,362 @@ blending_state_init(VABlendState *state)
 
 #endif
 
+/* (Re)build the parameters of filter <index> for <frame> */
 static VAStatus
-video_frame_process(VAProcFilterType filter_type,
-                    uint32_t frame_idx,
-                    VASurfaceID in_surface_id,
-                    VASurfaceID out_surface_id)
+filter_init(uint32_t index, uint32_t frame)
 {
-    VAStatus va_status;
-    VAProcPipelineParameterBuffer pipeline_param;
-    VARectangle surface_region, output_region;
-    VABufferID pipeline_param_buf_id = VA_INVALID_ID;
-    VABufferID filter_param_buf_id = VA_INVALID_ID;
-#if BLEND_ON
-    VABlendState state ;
-#endif
-    uint32_t filter_count = 1;
-
-    /* create denoise_filter buffer id */
-    switch (filter_type) {
+    switch (g_filters[index].type) {
     case VAProcFilterNoiseReduction:
-        denoise_filter_init(&filter_param_buf_id);
-        break;
+        return denoise_filter_init(index, frame);
     case VAProcFilterDeinterlacing:
-        deinterlace_filter_init(&filter_param_buf_id);
-        break;
+        return deinterlace_filter_init(index, frame);
     case VAProcFilterSharpening:
-        sharpening_filter_init(&filter_param_buf_id);
-        break;
+        return sharpening_filter_init(index, frame);
     case VAProcFilterColorBalance:
-        color_balance_filter_init(&filter_param_buf_id);
-        break;
+        return color_balance_filter_init(index, frame);
     case VAProcFilterSkinToneEnhancement:
-        skintone_filter_init(&filter_param_buf_id);
-        break;
+        return skintone_filter_init(index, frame);
     default :
-        filter_count = 0;
-        break;
+        return VA_STATUS_SUCCESS;
     }
+}
 
-    /* Fill pipeline buffer */
-    surface_region.x = 0;
-    surface_region.y = 0;
-    surface_region.width = g_in_pic_width;
-    surface_region.height = g_in_pic_height;
-    output_region.x = 0;
-    output_region.y = 0;
-    output_region.width = g_out_pic_width;
-    output_region.height = g_out_pic_height;
+static const char *
+filter_type_name(VAProcFilterType type)
+{
+    switch (type) {
+    case VAProcFilterNoiseReduction:
+        return "VAProcFilterNoiseReduction";
+    case VAProcFilterDeinterlacing:
+        return "VAProcFilterDeinterlacing";
+    case VAProcFilterSharpening:
+        return "VAProcFilterSharpening";
+    case VAProcFilterColorBalance:
+        return "VAProcFilterColorBalance";
+    case VAProcFilterSkinToneEnhancement:
+        return "VAProcFilterSkinToneEnhancement";
+    default:
+        return "VAProcFilterNone";
+    }
+}
 
-    memset(&pipeline_param, 0, sizeof(pipeline_param));
-    pipeline_param.surface = in_surface_id;
-    pipeline_param.surface_region = &surface_region;
-    pipeline_param.output_region = &output_region;
+/* Split the filter chain into passes. As many consecutive filters as the
+ * driver accepts (vaQueryVideoProcPipelineCaps succeeds for the sub chain)
+ * go into one pass, a filter the driver can not chain starts a new one */
+static VAStatus
+vpp_passes_plan()
+{
+    VAStatus va_status;
+    VAProcPipelineCaps pipeline_caps;
+    uint32_t first = 0, i;
+
+    g_pass_count = 0;
+    for (i = 0; i < g_filter_count; i++) {
+        memset(&pipeline_caps, 0, sizeof(pipeline_caps));
+        va_status = vaQueryVideoProcPipelineCaps(va_dpy, context_id,
+                    &g_filter_param_buf_ids[first], i - first + 1,
+                    &pipeline_caps);
+        if (va_status == VA_STATUS_SUCCESS)
+            continue;
+
+        if (i == first) {
+            printf("VPP filter %s can not be used in a pipeline !\n",
+                   filter_type_name(g_filters[i].type));
+            return va_status;
+        }
+
+        printf("Driver can not chain %s after %s, it starts a new pass\n",
+               filter_type_name(g_filters[i].type),
+               filter_type_name(g_filters[i - 1].type));
+        g_passes[g_pass_count].first_filter = first;
+        g_passes[g_pass_count].num_filters = i - first;
+        g_pass_count++;
+        first = i--;
+    }
+
+    /* the last pass also does the scaling and format conversion, it is
+     * submitted without filters when FILTER_TYPE is VAProcFilterNone */
+    g_passes[g_pass_count].first_filter = first;
+    g_passes[g_pass_count].num_filters = g_filter_count - first;
+    g_pass_count++;
+
+    return VA_STATUS_SUCCESS;
+}
+
+/* Query the filter caps and create the filter and pipeline parameter buffers
+ * once, every frame only updates the input surface of the pipeline buffers */
+static VAStatus
+vpp_buffers_create()
+{
+    VAStatus va_status = VA_STATUS_SUCCESS;
+    VAProcPipelineParameterBuffer pipeline_param;
+    uint32_t i;
 
-    pipeline_param.filter_flags = 0;
-    pipeline_param.filters      = &filter_param_buf_id;
-    pipeline_param.num_filters  = filter_count;
+    for (i = 0; i < g_filter_count; i++) {
+        g_filter_param_buf_ids[i] = VA_INVALID_ID;
+
+        va_status = filter_init(i, g_first_output_frame);
+        CHECK_VASTATUS(va_status, "filter init");
+
+        switch (g_filters[i].type) {
+        case VAProcFilterNoiseReduction:
+            g_filter_scheduled[i] = vpp_config_is_scheduled(g_config, "DENOISE_INTENSITY");
+            break;
+        case VAProcFilterSharpening:
+            g_filter_scheduled[i] = vpp_config_is_scheduled(g_config, "SHARPENING_INTENSITY");
+            break;
+        case VAProcFilterColorBalance:
+            g_filter_scheduled[i] = vpp_config_is_scheduled(g_config, "COLOR_BALANCE_HUE") ||
+                                    vpp_config_is_scheduled(g_config, "COLOR_BALANCE_SATURATION") ||
+                                    vpp_config_is_scheduled(g_config, "COLOR_BALANCE_BRIGHTNESS") ||
+                                    vpp_config_is_scheduled(g_config, "COLOR_BALANCE_CONTRAST");
+            break;
+        case VAProcFilterDeinterlacing:
+            /* the field alternates every output frame */
+            g_filter_scheduled[i] = g_field_count > 1;
+            break;
+        default :
+            g_filter_scheduled[i] = false;
+            break;
+        }
+    }
+
+    va_status = vpp_passes_plan();
+    CHECK_VASTATUS(va_status, "vaQueryVideoProcPipelineCaps");
+
+    if (g_pass_count > 1)
+        printf("Filter chain %s is done in %d passes\n", g_filter_type_name, g_pass_count);
+
+    /* Only the first pass reads the input surfaces, so only it gets
+     * reference frames. The ring of input surfaces keeps them alive */
+    for (i = 0; i < g_pass_count; i++) {
+        VPPPass *pass = &g_passes[i];
+        VAProcPipelineCaps pipeline_caps;
+
+        memset(&pipeline_caps, 0, sizeof(pipeline_caps));
+        va_status = vaQueryVideoProcPipelineCaps(va_dpy, context_id,
+                    pass->num_filters ? &g_filter_param_buf_ids[pass->first_filter] : NULL,
+                    pass->num_filters, &pipeline_caps);
+        CHECK_VASTATUS(va_status, "vaQueryVideoProcPipelineCaps");
+
+        if (!pipeline_caps.num_forward_references && !pipeline_caps.num_backward_references)
+            continue;
+
+        if (i) {
+            printf("Pass %d needs %d past / %d future frames, they are only available "
+                   "to the first pass\n", i, pipeline_caps.num_forward_references,
+                   pipeline_caps.num_backward_references);
+            continue;
+        }
+
+        pass->num_forward_references = pipeline_caps.num_forward_references;
+        pass->num_backward_references = pipeline_caps.num_backward_references;
+        printf("Filters reference %d past and %d future frames\n",
+               pass->num_forward_references, pass->num_backward_references);
+    }
+
+    if (g_blending_enabled &&
+        (g_passes[0].num_forward_references || g_passes[0].num_backward_references)) {
+        printf("Blending can not be combined with reference frames\n");
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+    }
+
+    if (vpp_history_init(&g_history, input_frame_span(g_pipeline_depth),
+                         g_passes[0].num_forward_references,
+                         g_passes[0].num_backward_references, g_frame_count))
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    for (i = 0; i < g_history.size; i++) {
+        va_status = create_surface(&g_history.surfaces[i], g_in_pic_width, g_in_pic_height,
+                                   g_in_fourcc, g_in_format);
+        CHECK_VASTATUS(va_status, "vaCreateSurfaces for input");
+    }
+
+    /* The passes before the last one keep the input size and format and
+     * alternate between two intermediate surfaces */
+    g_pass_surface_count = g_pass_count - 1 < 2 ? g_pass_count - 1 : 2;
+    for (i = 0; i < g_pass_surface_count; i++) {
+        va_status = create_surface(&g_pass_surface_id[i], g_in_pic_width, g_in_pic_height,
+                                   g_in_fourcc, g_in_format);
+        CHECK_VASTATUS(va_status, "vaCreateSurfaces for intermediate pass");
+    }
+
+    /* Fill pipeline buffers */
+    g_surface_region.x = 0;
+    g_surface_region.y = 0;
+    g_surface_region.width = g_in_pic_width;
+    g_surface_region.height = g_in_pic_height;
+    g_output_region.x = 0;
+    g_output_region.y = 0;
+    g_output_region.width = g_out_pic_width;
+    g_output_region.height = g_out_pic_height;
 
 #if BLEND_ON
-    /* Blending related state */
-    if (g_blending_enabled) {
-        blending_state_init(&state);
-        pipeline_param.blend_state = &state;
+    if (g_blending_enabled)
+        blending_state_init(&g_blend_state);
+#endif
+
+    /* The other outputs are additional outputs of the last pass when the
+     * driver supports enough of them. They get the output region of output
+     * 0, so renditions of another size submit the last pass once more */
+    if (g_output_count > 1) {
+        VPPPass *pass = &g_passes[g_pass_count - 1];
+        VAProcPipelineCaps pipeline_caps;
+        bool same_size = true;
+
+        for (i = 1; i < g_output_count; i++)
+            same_size = same_size &&
+                        g_outputs[i].width == g_out_pic_width &&
+                        g_outputs[i].height == g_out_pic_height;
+
+        memset(&pipeline_caps, 0, sizeof(pipeline_caps));
+        va_status = vaQueryVideoProcPipelineCaps(va_dpy, context_id,
+                    pass->num_filters ? &g_filter_param_buf_ids[pass->first_filter] : NULL,
+                    pass->num_filters, &pipeline_caps);
+        CHECK_VASTATUS(va_status, "vaQueryVideoProcPipelineCaps");
+
+        g_use_additional_outputs = same_size &&
+                                   pipeline_caps.num_additional_outputs >= g_output_count - 1;
+        printf("%d outputs are rendered %s\n", g_output_count,
+               g_use_additional_outputs ? "in one submit" : "by back to back submits");
     }
+
+    for (i = 0; i < g_pass_count; i++) {
+        VPPPass *pass = &g_passes[i];
+        bool last = (i == g_pass_count - 1);
+
+        memset(&pipeline_param, 0, sizeof(pipeline_param));
+        pipeline_param.surface = VA_INVALID_SURFACE;
+        pipeline_param.surface_region = &g_surface_region;
+        pipeline_param.output_region = last ? &g_output_region : &g_surface_region;
+
+        pipeline_param.filter_flags = 0;
+        pipeline_param.filters      = pass->num_filters ?
+                                      &g_filter_param_buf_ids[pass->first_filter] : NULL;
+        pipeline_param.num_filters  = pass->num_filters;
+
+        /* filled per frame by vpp_history_references */
+        if (pass->num_forward_references) {
+            pipeline_param.forward_references = g_history.forward;
+            pipeline_param.num_forward_references = pass->num_forward_references;
+        }
+        if (pass->num_backward_references) {
+            pipeline_param.backward_references = g_history.backward;
+            pipeline_param.num_backward_references = pass->num_backward_references;
+        }
+
+#if BLEND_ON
+        /* Blending related state */
+        if (g_blending_enabled && last)
+            pipeline_param.blend_state = &g_blend_state;
 #endif
 
-    va_status = vaCreateBuffer(va_dpy,
-                               context_id,
-                               VAProcPipelineParameterBufferType,
-                               sizeof(pipeline_param),
-                               1,
-                               &pipeline_param,
-                               &pipeline_param_buf_id);
-    CHECK_VASTATUS(va_status, "vaCreateBuffer");
+        if (g_use_additional_outputs && last) {
+            pipeline_param.additional_outputs = g_additional_output_ids;
+            pipeline_param.num_additional_outputs = g_output_count - 1;
+        }
+
+        va_status = vaCreateBuffer(va_dpy,
+                                   context_id,
+                                   VAProcPipelineParameterBufferType,
+                                   sizeof(pipeline_param),
+                                   1,
+                                   &pipeline_param,
+                                   &pass->pipeline_param_buf_id);
+        CHECK_VASTATUS(va_status, "vaCreateBuffer");
+    }
+
+    /* pipeline_param still describes the last pass */
+    for (i = 1; i < g_output_count && !g_use_additional_outputs; i++) {
+        pipeline_param.output_region = &g_outputs[i].region;
+
+        va_status = vaCreateBuffer(va_dpy,
+                                   context_id,
+                                   VAProcPipelineParameterBufferType,
+                                   sizeof(pipeline_param),
+                                   1,
+                                   &pipeline_param,
+                                   &g_outputs[i].pipeline_param_buf_id);
+        CHECK_VASTATUS(va_status, "vaCreateBuffer");
+    }
+
+    return va_status;
+}
+
+static VAStatus
+pipeline_param_submit(VABufferID *pipeline_param_buf_id,
+                      VASurfaceID src_surface_id,
+                      VASurfaceID dst_surface_id)
+{
+    VAStatus va_status;
+    VAProcPipelineParameterBuffer *pipeline_param = NULL;
+
+    va_status = vaMapBuffer(va_dpy, *pipeline_param_buf_id, (void **)&pipeline_param);
+    CHECK_VASTATUS(va_status, "vaMapBuffer");
+    pipeline_param->surface = src_surface_id;
+    va_status = vaUnmapBuffer(va_dpy, *pipeline_param_buf_id);
+    CHECK_VASTATUS(va_status, "vaUnmapBuffer");
 
     va_status = vaBeginPicture(va_dpy,
                                context_id,
-                               out_surface_id);
+                               dst_surface_id);
     CHECK_VASTATUS(va_status, "vaBeginPicture");
 
     va_status = vaRenderPicture(va_dpy,
                                 context_id,
-                                &pipeline_param_buf_id,
+                                pipeline_param_buf_id,
                                 1);
     CHECK_VASTATUS(va_status, "vaRenderPicture");
 
     va_status = vaEndPicture(va_dpy, context_id);
     CHECK_VASTATUS(va_status, "vaEndPicture");
 
-    if (filter_param_buf_id != VA_INVALID_ID)
-        vaDestroyBuffer(va_dpy, filter_param_buf_id);
+    return va_status;
+}
 
-    if (pipeline_param_buf_id != VA_INVALID_ID)
-        vaDestroyBuffer(va_dpy, pipeline_param_buf_id);
+static VAStatus
+video_frame_process(uint32_t frame_idx, uint32_t slot)
+{
+    VAStatus va_status = VA_STATUS_SUCCESS;
+    uint32_t input_frame = input_frame_of(frame_idx);
+    VASurfaceID src_surface_id = vpp_history_surface(&g_history, input_frame);
+    VASurfaceID dst_surface_id;
+    uint32_t i;
+
+    vpp_history_references(&g_history, input_frame);
+
+    /* filters with a per frame schedule, the buffer is only rewritten when
+     * the value actually changes */
+    for (i = 0; i < g_filter_count; i++) {
+        if (g_filter_scheduled[i] && frame_idx) {
+            va_status = filter_init(i, g_first_output_frame + frame_idx);
+            CHECK_VASTATUS(va_status, "filter update");
+        }
+    }
+
+    for (i = 0; i + 1 < g_pass_count; i++) {
+        dst_surface_id = g_pass_surface_id[i % 2];
+
+        va_status = pipeline_param_submit(&g_passes[i].pipeline_param_buf_id,
+                                          src_surface_id, dst_surface_id);
+        CHECK_VASTATUS(va_status, "pipeline_param_submit");
+
+        src_surface_id = dst_surface_id;
+    }
+
+    /* the last pass renders every output */
+    for (i = 1; i < g_output_count && g_use_additional_outputs; i++)
+        g_additional_output_ids[i - 1] = g_outputs[i].surface_id[slot];
+
+    va_status = pipeline_param_submit(&g_passes[g_pass_count - 1].pipeline_param_buf_id,
+                                      src_surface_id, g_outputs[0].surface_id[slot]);
+    CHECK_VASTATUS(va_status, "pipeline_param_submit");
+
+    for (i = 1; i < g_output_count && !g_use_additional_outputs; i++) {
+        va_status = pipeline_param_submit(&g_outputs[i].pipeline_param_buf_id,
+                                          src_surface_id, g_outputs[i].surface_id[slot]);
+        CHECK_VASTATUS(va_status, "pipeline_param_submit");
+    }
 
     return va_status;
 }
@@ -1524,6 +1775,7 @@ vpp_context_create()
 {
     VAStatus va_status = VA_STATUS_SUCCESS;
     uint32_t i;
+    uint32_t slot;
     int32_t j;
 
     /* VA driver initialization */
@@ -1567,13 +1819,14 @@ vpp_context_create()
     }
 
     /* Create surface/config/context for VPP pipeline */
-    va_status = create_surface(&g_in_surface_id, g_in_pic_width, g_in_pic_height,
-                               g_in_fourcc, g_in_format);
-    CHECK_VASTATUS(va_status, "vaCreateSurfaces for input");
-
-    va_status = create_surface(&g_out_surface_id, g_out_pic_width, g_out_pic_height,
-                               g_out_fourcc, g_out_format);
-    CHECK_VASTATUS(va_status, "vaCreateSurfaces for output");
+    for (slot = 0; slot < g_pipeline_depth; slot++) {
+        for (i = 0; i < g_output_count; i++) {
+            va_status = create_surface(&g_outputs[i].surface_id[slot],
+                                       g_outputs[i].width, g_outputs[i].height,
+                                       g_out_fourcc, g_out_format);
+            CHECK_VASTATUS(va_status, "vaCreateSurfaces for output");
+        }
+    }
 
     va_status = vaCreateConfig(va_dpy,
                                VAProfileNone,
@@ -1624,14 +1877,14 @@ vpp_context_create()
                                 g_out_pic_width,
                                 g_out_pic_height,
                                 VA_PROGRESSIVE,
-                                &g_out_surface_id,
-                                1,
+                                g_outputs[0].surface_id,
+                                g_pipeline_depth,
                                 &context_id);
     CHECK_VASTATUS(va_status, "vaCreateContext");
 
 
-    /* Validate  whether currect filter is supported */
-    if (g_filter_type != VAProcFilterNone) {
+    /* Validate  whether currect filters are supported */
+    if (g_filter_count) {
         uint32_t supported_filter_num = VAProcFilterCount;
         VAProcFilterType supported_filter_types[VAProcFilterCount];
 
@@ -1642,26 +1895,44 @@ vpp_context_create()
 
         CHECK_VASTATUS(va_status, "vaQueryVideoProcFilters");
 
-        for (i = 0; i < supported_filter_num; i++) {
-            if (supported_filter_types[i] == g_filter_type)
-                break;
-        }
+        for (j = 0; j < (int32_t)g_filter_count; j++) {
+            for (i = 0; i < supported_filter_num; i++) {
+                if (supported_filter_types[i] == g_filters[j].type)
+                    break;
+            }
 
-        if (i == supported_filter_num) {
-            printf("VPP filter type %s is not supported by driver !\n", g_filter_type_name);
-            assert(0);
+            if (i == supported_filter_num) {
+                printf("VPP filter type %s is not supported by driver !\n",
+                       filter_type_name(g_filters[j].type));
+                assert(0);
+            }
         }
     }
 
+    va_status = vpp_buffers_create();
+    CHECK_VASTATUS(va_status, "vpp_buffers_create");
+
     return va_status;
 }
 
 static void
 vpp_context_destroy()
 {
+    uint32_t i;
+
     /* Release resource */
-    vaDestroySurfaces(va_dpy, &g_in_surface_id, 1);
-    vaDestroySurfaces(va_dpy, &g_out_surface_id, 1);
+    for (i = 0; i < g_pass_count; i++)
+        vaDestroyBuffer(va_dpy, g_passes[i].pipeline_param_buf_id);
+    for (i = 0; i < g_filter_count; i++)
+        vaDestroyBuffer(va_dpy, g_filter_param_buf_ids[i]);
+    if (g_pass_surface_count)
+        vaDestroySurfaces(va_dpy, g_pass_surface_id, g_pass_surface_count);
+    vaDestroySurfaces(va_dpy, g_history.surfaces, g_history.size);
+    for (i = 0; i < g_output_count; i++) {
+        if (g_outputs[i].pipeline_param_buf_id != VA_INVALID_ID)
+            vaDestroyBuffer(va_dpy, g_outputs[i].pipeline_param_buf_id);
+        vaDestroySurfaces(va_dpy, g_outputs[i].surface_id, g_pipeline_depth);
+    }
     vaDestroyContext(va_dpy, context_id);
     vaDestroyConfig(va_dpy, config_id);
 
@@ -1717,6 +1988,8 @@ parse_fourcc_and_format(char *str, uint32_t *fourcc, uint32_t *format)
     } else if (!strcmp(str, "BGRP")) {
         tfourcc = VA_FOURCC_BGRP;
         tformat = VA_RT_FORMAT_RGBP;
+    } else if ((tfourcc = vpp_hbd_fourcc(str, &tformat))) {
+        /* P012, P016, Y210, Y212, Y216, Y410, Y412, Y416 and planar files */
     } else {
         printf("Not supported format: %s! Currently only support following format: %s\n",
                str, "YV12, I420, NV12, YUY2(YUYV), UYVY, AYUV, P010, I010, RGBA, RGBX, BGRA, "
@@ -1733,63 +2006,208 @@ parse_fourcc_and_format(char *str, uint32_t *fourcc, uint32_t *format)
     return 0;
 }
 
+/* "<fps>" or "<num>/<den>" like 30000/1001 */
+static int8_t
+parse_frame_rate(const char *str, VPPFrameRate *rate)
+{
+    unsigned long num, den = 1;
+    char *end;
+
+    /* whole string only, "23.976" must not silently become 23 fps */
+    num = strtoul(str, &end, 10);
+    if (end == str)
+        return -1;
+    if (*end == '/') {
+        str = end + 1;
+        den = strtoul(str, &end, 10);
+        if (end == str)
+            return -1;
+    }
+    while (isspace((unsigned char)*end))
+        end++;
+    if (*end || !num || !den || num > 100000 || den > 100000)
+        return -1;
+
+    rate->num = num;
+    rate->den = den;
+    return 0;
+}
+
 static int8_t
 parse_basic_parameters()
 {
     char str[MAX_LEN];
+    char *token;
+    uint32_t i;
 
     /* Read src frame file information */
-    read_value_string(g_config_file_fd, "SRC_FILE_NAME", g_src_file_name);
-    read_value_uint32(g_config_file_fd, "SRC_FRAME_WIDTH", &g_in_pic_width);
-    read_value_uint32(g_config_file_fd, "SRC_FRAME_HEIGHT", &g_in_pic_height);
-    read_value_string(g_config_file_fd, "SRC_FRAME_FORMAT", str);
+    vpp_config_get_string(g_config, "SRC_FILE_NAME", g_src_file_name);
+    vpp_config_get_uint32(g_config, "SRC_FRAME_WIDTH", &g_in_pic_width);
+    vpp_config_get_uint32(g_config, "SRC_FRAME_HEIGHT", &g_in_pic_height);
+    vpp_config_get_string(g_config, "SRC_FRAME_FORMAT", str);
     parse_fourcc_and_format(str, &g_in_fourcc, &g_in_format);
 
     /* Read dst frame file information */
-    read_value_string(g_config_file_fd, "DST_FILE_NAME", g_dst_file_name);
-    read_value_uint32(g_config_file_fd, "DST_FRAME_WIDTH", &g_out_pic_width);
-    read_value_uint32(g_config_file_fd, "DST_FRAME_HEIGHT", &g_out_pic_height);
-    read_value_string(g_config_file_fd, "DST_FRAME_FORMAT", str);
+    vpp_config_get_string(g_config, "DST_FILE_NAME", g_outputs[0].file_name);
+    vpp_config_get_uint32(g_config, "DST_FRAME_WIDTH", &g_out_pic_width);
+    vpp_config_get_uint32(g_config, "DST_FRAME_HEIGHT", &g_out_pic_height);
+    vpp_config_get_string(g_config, "DST_FRAME_FORMAT", str);
     parse_fourcc_and_format(str, &g_out_fourcc, &g_out_format);
 
-    read_value_string(g_config_file_fd, "SRC_FILE_FORMAT", str);
+    vpp_config_get_string(g_config, "SRC_FILE_FORMAT", str);
     parse_fourcc_and_format(str, &g_src_file_fourcc, NULL);
 
-    read_value_string(g_config_file_fd, "DST_FILE_FORMAT", str);
+    vpp_config_get_string(g_config, "DST_FILE_FORMAT", str);
     parse_fourcc_and_format(str, &g_dst_file_fourcc, NULL);
 
-    read_value_uint32(g_config_file_fd, "FRAME_SUM", &g_frame_count);
+    vpp_config_get_uint32(g_config, "FRAME_SUM", &g_frame_count);
 
-    /* Read filter type */
-    if (read_value_string(g_config_file_fd, "FILTER_TYPE", g_filter_type_name)) {
+    /* Read filter chain, the filters are applied in the listed order */
+    if (vpp_config_get_string(g_config, "FILTER_TYPE", g_filter_type_name)) {
         printf("Read filter type error !\n");
         assert(0);
     }
 
-    if (!strcmp(g_filter_type_name, "VAProcFilterNoiseReduction"))
-        g_filter_type = VAProcFilterNoiseReduction;
-    else if (!strcmp(g_filter_type_name, "VAProcFilterDeinterlacing"))
-        g_filter_type = VAProcFilterDeinterlacing;
-    else if (!strcmp(g_filter_type_name, "VAProcFilterSharpening"))
-        g_filter_type = VAProcFilterSharpening;
-    else if (!strcmp(g_filter_type_name, "VAProcFilterColorBalance"))
-        g_filter_type = VAProcFilterColorBalance;
-    else if (!strcmp(g_filter_type_name, "VAProcFilterSkinToneEnhancement"))
-        g_filter_type = VAProcFilterSkinToneEnhancement;
-    else if (!strcmp(g_filter_type_name, "VAProcFilterNone"))
-        g_filter_type = VAProcFilterNone;
-    else {
-        printf("Unsupported filter type :%s \n", g_filter_type_name);
-        return -1;
+    strcpy(str, g_filter_type_name);
+    g_filter_count = 0;
+    for (token = strtok(str, ", "); token; token = strtok(NULL, ", ")) {
+        VAProcFilterType filter_type;
+
+        if (!strcmp(token, "VAProcFilterNoiseReduction"))
+            filter_type = VAProcFilterNoiseReduction;
+        else if (!strcmp(token, "VAProcFilterDeinterlacing"))
+            filter_type = VAProcFilterDeinterlacing;
+        else if (!strcmp(token, "VAProcFilterSharpening"))
+            filter_type = VAProcFilterSharpening;
+        else if (!strcmp(token, "VAProcFilterColorBalance"))
+            filter_type = VAProcFilterColorBalance;
+        else if (!strcmp(token, "VAProcFilterSkinToneEnhancement"))
+            filter_type = VAProcFilterSkinToneEnhancement;
+        else if (!strcmp(token, "VAProcFilterNone"))
+            continue;
+        else {
+            printf("Unsupported filter type :%s \n", token);
+            return -1;
+        }
+
+        for (i = 0; i < g_filter_count; i++) {
+            if (g_filters[i].type == filter_type) {
+                printf("Filter type %s is listed more than once\n", token);
+                return -1;
+            }
+        }
+        g_filters[g_filter_count++].type = filter_type;
     }
 
     /* Check whether blending is enabled */
-    if (read_value_uint8(g_config_file_fd, "BLENDING_ENABLED", &g_blending_enabled))
+    if (vpp_config_get_uint8(g_config, "BLENDING_ENABLED", &g_blending_enabled))
         g_blending_enabled = 0;
 
     if (g_blending_enabled)
         printf("Blending will be done \n");
 
+    /* Optional, one output frame per field when deinterlacing */
+    if (!vpp_config_get_string(g_config, "DEINTERLACING_FIELD_RATE", str) && atoi(str)) {
+        for (i = 0; i < g_filter_count; i++) {
+            if (g_filters[i].type == VAProcFilterDeinterlacing)
+                break;
+        }
+        if (i == g_filter_count) {
+            printf("DEINTERLACING_FIELD_RATE needs VAProcFilterDeinterlacing in FILTER_TYPE\n");
+            return -1;
+        }
+        if (g_blending_enabled) {
+            printf("DEINTERLACING_FIELD_RATE can not be combined with blending\n");
+            return -1;
+        }
+        g_field_count = 2;
+    }
+
+    /* Optional, frame rate conversion, both rates are needed */
+    if (!vpp_config_get_string(g_config, "FRC_INPUT_FPS", str) ||
+        !vpp_config_get_string(g_config, "FRC_OUTPUT_FPS", str)) {
+        if (vpp_config_get_string(g_config, "FRC_INPUT_FPS", str) ||
+            parse_frame_rate(str, &g_frc_input_rate) ||
+            vpp_config_get_string(g_config, "FRC_OUTPUT_FPS", str) ||
+            parse_frame_rate(str, &g_frc_output_rate)) {
+            printf("Frame rate conversion needs FRC_INPUT_FPS and FRC_OUTPUT_FPS as "
+                   "integer <fps> or <num>/<den>, e.g. 24000/1001 for 23.976 fps\n");
+            return -1;
+        }
+        if (g_field_count > 1) {
+            printf("FRC_OUTPUT_FPS can not be combined with DEINTERLACING_FIELD_RATE\n");
+            return -1;
+        }
+        if (g_blending_enabled) {
+            printf("FRC_OUTPUT_FPS can not be combined with blending\n");
+            return -1;
+        }
+        printf("Frame rate conversion will be done: from %.3f fps to %.3f fps, %d input "
+               "frames give %d output frames\n",
+               (double)g_frc_input_rate.num / g_frc_input_rate.den,
+               (double)g_frc_output_rate.num / g_frc_output_rate.den,
+               g_frame_count, output_frame_count());
+    }
+
+    /* Optional, number of frames in flight between upload, process and store */
+    if (!vpp_config_get_string(g_config, "PIPELINE_DEPTH", str)) {
+        g_pipeline_depth = (uint32_t)atoi(str);
+        if (g_pipeline_depth < 1 || g_pipeline_depth > VPP_PIPELINE_MAX_DEPTH) {
+            printf("PIPELINE_DEPTH must be in [1, %d]\n", VPP_PIPELINE_MAX_DEPTH);
+            return -1;
+        }
+    }
+
+    /* Optional, host buffers per output between surface download and file write */
+    if (!vpp_config_get_string(g_config, "WRITER_BUFFERS", str)) {
+        g_writer_buffers = (uint32_t)atoi(str);
+        if (g_writer_buffers < 1 || g_writer_buffers > VPP_WRITER_MAX_BUFFERS) {
+            printf("WRITER_BUFFERS must be in [1, %d]\n", VPP_WRITER_MAX_BUFFERS);
+            return -1;
+        }
+    }
+
+    /* Optional, renditions of every frame besides the DST_* output */
+    if (!vpp_config_get_string(g_config, "OUTPUT_COUNT", str)) {
+        g_output_count = (uint32_t)atoi(str);
+        if (g_output_count < 1 || g_output_count > MAX_OUTPUTS) {
+            printf("OUTPUT_COUNT must be in [1, %d]\n", MAX_OUTPUTS);
+            return -1;
+        }
+    }
+
+    if (g_output_count > 1 && g_blending_enabled) {
+        printf("Blending can not be combined with more than one output\n");
+        return -1;
+    }
+
+    g_outputs[0].width = g_out_pic_width;
+    g_outputs[0].height = g_out_pic_height;
+    for (i = 1; i < g_output_count; i++) {
+        char field[32];
+        int8_t ret;
+
+        snprintf(field, sizeof(field), "DST_FILE_NAME_%d", i);
+        ret = vpp_config_get_string(g_config, field, g_outputs[i].file_name);
+        snprintf(field, sizeof(field), "DST_FRAME_WIDTH_%d", i);
+        ret |= vpp_config_get_uint32(g_config, field, &g_outputs[i].width);
+        snprintf(field, sizeof(field), "DST_FRAME_HEIGHT_%d", i);
+        ret |= vpp_config_get_uint32(g_config, field, &g_outputs[i].height);
+        if (ret) {
+            printf("Output %d needs DST_FILE_NAME_%d, DST_FRAME_WIDTH_%d and DST_FRAME_HEIGHT_%d\n",
+                   i, i, i, i);
+            return -1;
+        }
+    }
+
+    for (i = 0; i < g_output_count; i++) {
+        g_outputs[i].region.x = 0;
+        g_outputs[i].region.y = 0;
+        g_outputs[i].region.width = g_outputs[i].width;
+        g_outputs[i].region.height = g_outputs[i].height;
+        g_outputs[i].pipeline_param_buf_id = VA_INVALID_ID;
+    }
+
     if (g_in_pic_width != g_out_pic_width ||
         g_in_pic_height != g_out_pic_height)
         printf("Scaling will be done : from %4d x %4d to %4d x %4d \n",
@@ -1803,29 +2221,217 @@ parse_basic_parameters()
     return 0;
 }
 
-int32_t main(int32_t argc, char *argv[])
+static int
+history_load(uint32_t /* frame */, VASurfaceID surface)
+{
+    if (upload_yuv_frame_to_yuv_surface(g_src_file_fd, surface) == VA_STATUS_SUCCESS)
+        return 0;
+
+    return feof(g_src_file_fd) ? 1 : -1;
+}
+
+static int
+pipeline_read(uint32_t frame, uint32_t slot)
 {
+    /* without references the input ring has one surface per slot */
+    if (g_blending_enabled) {
+        construct_nv12_mask_surface(g_history.surfaces[slot], g_blending_min_luma, g_blending_max_luma);
+        if (upload_yuv_frame_to_yuv_surface(g_src_file_fd, g_outputs[0].surface_id[slot]) ==
+            VA_STATUS_SUCCESS)
+            return 0;
+
+        /* a short read at the end of the input ends the pipeline */
+        return feof(g_src_file_fd) ? 1 : -1;
+    }
+
+    /* at field rate the second field and with frame rate conversion a
+     * repeated frame reuse the loaded input frame, a dropped one is loaded
+     * on the way to the next frame shown */
+    return vpp_history_advance(&g_history, input_frame_of(frame), history_load);
+}
+
+static VAStatus
+pipeline_process(uint32_t frame, uint32_t slot)
+{
+    return video_frame_process(frame, slot);
+}
+
+static int
+output_store(VPPOutput *output, uint32_t slot)
+{
+    struct timeval start_time, end_time;
     VAStatus va_status;
+
+    gettimeofday(&start_time, NULL);
+    va_status = store_yuv_surface_to_file(output->writer, output->surface_id[slot]);
+    gettimeofday(&end_time, NULL);
+
+    output->store_time += (end_time.tv_sec - start_time.tv_sec) +
+                          (end_time.tv_usec - start_time.tv_usec) / 1000000.0;
+
+    return va_status == VA_STATUS_SUCCESS ? 0 : -1;
+}
+
+/* Stores output <arg> for every job posted by pipeline_write */
+static void *
+output_writer(void *arg)
+{
+    VPPOutput *output = (VPPOutput *)arg;
+    uint32_t slot;
+    int ret;
+
+    pthread_mutex_lock(&g_writer_lock);
+    for (;;) {
+        while (!g_writer_exit && output->jobs_done == g_writer_jobs)
+            pthread_cond_wait(&g_writer_cond, &g_writer_lock);
+        if (output->jobs_done == g_writer_jobs)
+            break;
+
+        slot = g_writer_slot;
+        pthread_mutex_unlock(&g_writer_lock);
+
+        ret = output_store(output, slot);
+
+        pthread_mutex_lock(&g_writer_lock);
+        output->jobs_done++;
+        if (ret < 0)
+            g_writer_error = 1;
+        g_writer_pending--;
+        pthread_cond_broadcast(&g_writer_cond);
+    }
+    pthread_mutex_unlock(&g_writer_lock);
+
+    return NULL;
+}
+
+static void
+output_writers_stop(uint32_t count)
+{
     uint32_t i;
 
-    if (argc != 2) {
-        printf("Input error! please specify the configure file \n");
-        return -1;
+    pthread_mutex_lock(&g_writer_lock);
+    g_writer_exit = true;
+    pthread_cond_broadcast(&g_writer_cond);
+    pthread_mutex_unlock(&g_writer_lock);
+
+    for (i = 1; i < count; i++)
+        pthread_join(g_outputs[i].thread, NULL);
+}
+
+static int
+output_writers_start()
+{
+    uint32_t i;
+
+    for (i = 1; i < g_output_count; i++) {
+        if (pthread_create(&g_outputs[i].thread, NULL, output_writer, &g_outputs[i])) {
+            printf("Failed to create the writer thread of output %d\n", i);
+            output_writers_stop(i);
+            return -1;
+        }
     }
 
-    /* Parse the configure file for video process*/
-    strncpy(g_config_file_name, argv[1], MAX_LEN);
-    g_config_file_name[MAX_LEN - 1] = '\0';
+    return 0;
+}
 
-    if (NULL == (g_config_file_fd = fopen(g_config_file_name, "r"))) {
-        printf("Open configure file %s failed!\n", g_config_file_name);
-        assert(0);
+static int
+pipeline_write(uint32_t /* frame */, uint32_t slot)
+{
+    int ret;
+
+    if (g_output_count == 1)
+        return output_store(&g_outputs[0], slot);
+
+    /* hand the other outputs to their writer threads and store output 0
+     * meanwhile */
+    pthread_mutex_lock(&g_writer_lock);
+    g_writer_slot = slot;
+    g_writer_pending = g_output_count - 1;
+    g_writer_jobs++;
+    pthread_cond_broadcast(&g_writer_cond);
+    pthread_mutex_unlock(&g_writer_lock);
+
+    ret = output_store(&g_outputs[0], slot);
+
+    pthread_mutex_lock(&g_writer_lock);
+    while (g_writer_pending)
+        pthread_cond_wait(&g_writer_cond, &g_writer_lock);
+    if (g_writer_error)
+        ret = -1;
+    pthread_mutex_unlock(&g_writer_lock);
+
+    return ret;
+}
+
+/* Cadence and throughput of a frame rate conversion run over
+ * <output_frames> written frames */
+static void
+frc_report(uint32_t output_frames, float duration)
+{
+    uint32_t shown = 0, frame;
+
+    for (frame = 0; frame < output_frames; frame++) {
+        if (!frame || input_frame_of(frame) != input_frame_of(frame - 1))
+            shown++;
     }
 
-    /* Parse basic parameters */
-    if (parse_basic_parameters()) {
-        printf("Parse parameters in configure file error\n");
-        assert(0);
+    if (duration <= 0)
+        duration = 1e-6;
+
+    printf("Frame rate conversion: %d input frames loaded, %d output frames, "
+           "%d repeated, %d dropped \n", g_history.loaded, output_frames,
+           output_frames - shown, g_history.loaded - shown);
+    printf("Throughput: %.2f output frames/s (%.2f input frames/s) \n",
+           output_frames / duration, g_history.loaded / duration);
+}
+
+/* Bytes of one SRC_FILE_FORMAT frame, 0 if unknown */
+static size_t
+src_file_frame_size()
+{
+    size_t luma = (size_t)g_in_pic_width * g_in_pic_height;
+
+    switch (g_src_file_fourcc) {
+    case VA_FOURCC_YV12:
+    case VA_FOURCC_I420:
+    case VA_FOURCC_NV12:
+        return luma * 3 / 2;
+    case VA_FOURCC_YUY2:
+    case VA_FOURCC_UYVY:
+        return luma * 2;
+    case VA_FOURCC_RGBP:
+    case VA_FOURCC_BGRP:
+        return luma * 3;
+    case VA_FOURCC_AYUV:
+    case VA_FOURCC_RGBA:
+    case VA_FOURCC_RGBX:
+    case VA_FOURCC_BGRA:
+    case VA_FOURCC_BGRX:
+        return luma * 4;
+    default:
+        return vpp_hbd_frame_size(g_src_file_fourcc, g_in_pic_width, g_in_pic_height);
+    }
+}
+
+/* One VPP context over the input frames of <range>. With more than one
+ * context each writes DST_FILE_NAME.<index> */
+static int32_t
+context_run(const VPPContextRange *range)
+{
+    VAStatus va_status;
+    VPPPipelineOps pipeline_ops = { pipeline_read, pipeline_process, pipeline_write };
+    VPPWriterStats writer_stats[MAX_OUTPUTS];
+    int32_t frame_count;
+    uint32_t i;
+
+    if (range->count > 1) {
+        g_frame_count = range->frame_count;
+        g_first_output_frame = range->first_frame * g_field_count;
+        for (i = 0; i < g_output_count; i++) {
+            size_t len = strlen(g_outputs[i].file_name);
+
+            snprintf(g_outputs[i].file_name + len, MAX_LEN - len, ".%d", range->index);
+        }
     }
 
     va_status = vpp_context_create();
@@ -1834,51 +2440,157 @@ int32_t main(int32_t argc, char *argv[])
         assert(0);
     }
 
+    /* the history of a context starts at its first frame, the real
+     * neighbours before it belong to the previous context */
+    if (range->count > 1 &&
+        (g_passes[0].num_forward_references || g_passes[0].num_backward_references)) {
+        printf("--contexts can not be combined with filters that reference other frames\n");
+        vpp_context_destroy();
+        return -1;
+    }
+
     /* Video frame fetch, process and store */
-    if (NULL == (g_src_file_fd = fopen(g_src_file_name, "r"))) {
+    if (NULL == (g_src_file_fd = vpp_stream_open(g_src_file_name, "r"))) {
         printf("Open SRC_FILE_NAME: %s failed, please specify it in config file: %s !\n",
                g_src_file_name, g_config_file_name);
         assert(0);
     }
 
-    if (NULL == (g_dst_file_fd = fopen(g_dst_file_name, "w"))) {
-        printf("Open DST_FILE_NAME: %s failed, please specify it in config file: %s !\n",
-               g_dst_file_name, g_config_file_name);
+    if (range->first_frame) {
+        size_t frame_size = src_file_frame_size();
+
+        if (!frame_size ||
+            fseeko(g_src_file_fd, (off_t)frame_size * range->first_frame, SEEK_SET)) {
+            printf("Context %d can not seek to input frame %d\n", range->index,
+                   range->first_frame);
+            return -1;
+        }
+    }
+
+    for (i = 0; i < g_output_count; i++) {
+        if (NULL == (g_outputs[i].fp = vpp_stream_open(g_outputs[i].file_name, "w"))) {
+            printf("Open DST_FILE_NAME: %s failed, please specify it in config file: %s !\n",
+                   g_outputs[i].file_name, g_config_file_name);
+            assert(0);
+        }
+
+        if (NULL == (g_outputs[i].writer = vpp_writer_create(g_outputs[i].fp, g_writer_buffers))) {
+            printf("Create writer for %s failed\n", g_outputs[i].file_name);
+            assert(0);
+        }
+    }
+
+    if (output_writers_start()) {
+        printf("output writers start failed \n");
         assert(0);
     }
 
+    vpp_contexts_ready();
+
     printf("\nStart to process, processing type is %s ...\n", g_filter_type_name);
     struct timeval start_time, end_time;
     gettimeofday(&start_time, NULL);
 
-    for (i = 0; i < g_frame_count; i ++) {
-        if (g_blending_enabled) {
-            construct_nv12_mask_surface(g_in_surface_id, g_blending_min_luma, g_blending_max_luma);
-            upload_yuv_frame_to_yuv_surface(g_src_file_fd, g_out_surface_id);
-        } else {
-            upload_yuv_frame_to_yuv_surface(g_src_file_fd, g_in_surface_id);
-        }
+    frame_count = vpp_pipeline_run(g_pipeline_depth, output_frame_count(), &pipeline_ops);
+    output_writers_stop(g_output_count);
+
+    /* the run is done once the last frame is on disk */
+    for (i = 0; i < g_output_count; i++) {
+        if (vpp_writer_destroy(g_outputs[i].writer, &writer_stats[i]))
+            frame_count = -1;
+    }
 
-        video_frame_process(g_filter_type, i, g_in_surface_id, g_out_surface_id);
-        store_yuv_surface_to_file(g_dst_file_fd, g_out_surface_id);
+    if (frame_count < 0) {
+        printf("video frame process failed\n");
+        assert(0);
     }
 
     gettimeofday(&end_time, NULL);
     float duration = (end_time.tv_sec - start_time.tv_sec) +
                      (end_time.tv_usec - start_time.tv_usec) / 1000000.0;
     printf("Finish processing, performance: \n");
-    printf("%d frames processed in: %f s, ave time = %.6fs \n", g_frame_count, duration, duration / g_frame_count);
+    printf("%d frames processed in: %f s, ave time = %.6fs \n", frame_count, duration,
+           frame_count ? duration / frame_count : 0);
+    if (g_frc_output_rate.num)
+        frc_report(frame_count, duration);
 
     if (g_src_file_fd)
         fclose(g_src_file_fd);
 
-    if (g_dst_file_fd)
-        fclose(g_dst_file_fd);
-
-    if (g_config_file_fd)
-        fclose(g_config_file_fd);
+    for (i = 0; i < g_output_count; i++) {
+        VPPOutput *output = &g_outputs[i];
+        VPPWriterStats *stats = &writer_stats[i];
+        float store_time = output->store_time > 0 ? output->store_time : 1e-6;
+        double write_time = stats->write_time > 0 ? stats->write_time : 1e-6;
+
+        printf("Output %d %s (%d x %d): download time %f s, %.2f fps \n",
+               i, output->file_name, output->width, output->height, output->store_time,
+               frame_count / store_time);
+        printf("    writer: %u frames, %.2f MB in %f s, %.2f MB/s, backlog max %u of %u, "
+               "download stalled %f s \n",
+               stats->frames, stats->bytes / (1024.0 * 1024), stats->write_time,
+               stats->bytes / write_time / (1024 * 1024), stats->max_backlog,
+               stats->num_buffers, stats->stall_time);
+        fclose(output->fp);
+    }
 
     vpp_context_destroy();
 
+    return frame_count;
+}
+
+int32_t main(int32_t argc, char *argv[])
+{
+    int contexts;
+
+    contexts = vpp_contexts_parse_args(&argc, argv);
+    if (contexts < 0 || argc != 2) {
+        printf("Input error! please specify the configure file: vavpp [--contexts N] <config>, "
+               "N in [1, %d]\n", VPP_CONTEXTS_MAX);
+        return -1;
+    }
+
+    /* Parse the configure file for video process*/
+    strncpy(g_config_file_name, argv[1], MAX_LEN);
+    g_config_file_name[MAX_LEN - 1] = '\0';
+
+    if (NULL == (g_config = vpp_config_open(g_config_file_name))) {
+        printf("Open configure file %s failed!\n", g_config_file_name);
+        assert(0);
+    }
+
+    /* frames on stdout, diagnostics on stderr */
+    if (vpp_config_has_value(g_config, "DST_FILE_NAME", "-") &&
+        vpp_stream_reserve_stdout()) {
+        printf("Failed to move the diagnostics to stderr\n");
+        assert(0);
+    }
+
+    /* Parse basic parameters */
+    if (parse_basic_parameters()) {
+        printf("Parse parameters in configure file error\n");
+        assert(0);
+    }
+
+    /* each context seeks to its share of the input and writes its own files */
+    if (contexts > 1 && (vpp_stream_is_pipe(g_src_file_name) ||
+                         vpp_config_has_value(g_config, "DST_FILE_NAME", "-"))) {
+        printf("--contexts needs a regular SRC_FILE_NAME and no DST_FILE_NAME on stdout\n");
+        return -1;
+    }
+
+    /* the cadence depends on the position in the whole stream */
+    if (contexts > 1 && g_frc_output_rate.num) {
+        printf("--contexts can not be combined with FRC_OUTPUT_FPS\n");
+        return -1;
+    }
+
+    if (vpp_contexts_run(contexts, g_frame_count, context_run)) {
+        printf("video frame process failed\n");
+        assert(0);
+    }
+
+    vpp_config_close(g_config);
+
     return 0;
 }
@@ -28,12 +28,23 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <stdint.h>
 #include <time.h>
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <va/va.h>
 #include <va/va_vpp.h>
 #include "va_display.h"
+#include "vpp_config.h"
+#include "vpp_hbd.h"
+#include "vpp_lut3d.h"
+#include "vpp_stream.h"
 
 #ifndef VA_FOURCC_I420
 #define VA_FOURCC_I420 0x30323449
@@ -62,7 +73,7 @@ static VASurfaceID g_out_surface_id = VA_INVALID_ID;
 static VASurfaceID g_inter_surface_id = VA_INVALID_ID;
 static VASurfaceID g_3dlut_surface_id = VA_INVALID_ID;
 
-static FILE* g_config_file_fd = NULL;
+static VPPConfig *g_config = NULL;
 static FILE* g_src_file_fd = NULL;
 static FILE* g_dst_file_fd = NULL;
 
@@ -89,81 +100,26 @@ static char g_3dlut_file_name[MAX_LEN];
 static uint16_t g_3dlut_seg_size = 65;
 static uint16_t g_3dlut_mul_size = 128;
 static uint32_t g_3dlut_channel_mapping = 1;
+static bool g_3dlut_seg_size_set = false;
 
-#if VA_CHECK_VERSION(1, 12, 0)
-
-static int8_t
-read_value_string(FILE *fp, const char* field_name, char* value)
-{
-    char strLine[MAX_LEN];
-    char* field = NULL;
-    char* str = NULL;
-    uint16_t i;
-
-    if (!fp || !field_name || !value)  {
-        printf("Invalid fuction parameters\n");
-        return -1;
-    }
-
-    rewind(fp);
-
-    while (!feof(fp)) {
-        if (!fgets(strLine, MAX_LEN, fp))
-            continue;
-
-        for (i = 0; i < MAX_LEN && strLine[i]; i++)
-            if (strLine[i] != ' ') break;
-
-        if (i == MAX_LEN || strLine[i] == '#' || strLine[i] == '\n')
-            continue;
-
-        field = strtok(&strLine[i], ":");
-        if (strncmp(field, field_name, strlen(field_name)))
-            continue;
-
-        if (!(str = strtok(NULL, ":")))
-            continue;
-
-        /* skip blank space in string */
-        while (*str == ' ')
-            str++;
-
-        *(str + strlen(str) - 1) = '\0';
-        strcpy(value, str);
-
-        return 0;
-    }
-
-    return -1;
-}
-
-static int8_t
-read_value_uint32(FILE* fp, const char* field_name, uint32_t* value)
-{
-    char str[MAX_LEN];
+/* .cube input: baked LUTs are cached in <dir>/<name>-<size>-<hash>.3dlut */
+static bool g_3dlut_is_cube = false;
+static char g_3dlut_cache_dir[MAX_LEN];
+static VPPLut3D g_3dlut_cube;
 
-    if (read_value_string(fp, field_name, str)) {
-        printf("Failed to find integer field: %s", field_name);
-        return -1;
-    }
+/* LUT data in the driver layout, a file mapping or a malloc'ed bake. A user
+ * pointer LUT surface is created on top of it, so it outlives the surface */
+static uint8_t *g_3dlut_data = NULL;
+static size_t g_3dlut_data_size = 0;
+static bool g_3dlut_data_mapped = false;
 
-    *value = (uint32_t)atoi(str);
-    return 0;
-}
+/* CPU reference of the 3DLUT pass, VPP_LUT3D_TRILINEAR/TETRAHEDRAL or 0 */
+static int g_3dlut_cpu_method = 0;
+static double g_gpu_time = 0, g_cpu_time = 0, g_cpu_sq_err = 0;
+static uint32_t g_cpu_max_diff = 0;
+static uint64_t g_cpu_samples = 0;
 
-static int8_t
-read_value_uint16(FILE* fp, const char* field_name, uint16_t* value)
-{
-    char str[MAX_LEN];
-
-    if (read_value_string(fp, field_name, str)) {
-        printf("Failed to find integer field: %s", field_name);
-        return -1;
-    }
-
-    *value = (uint16_t)atoi(str);
-    return 0;
-}
+#if VA_CHECK_VERSION(1, 12, 0)
 
 /* Load yuv frame to NV12/YV12/I420 surface*/
 static VAStatus
@@ -199,9 +155,9 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
         y_src = newImageBuffer;
         if (g_src_file_fourcc == VA_FOURCC_I420) {
@@ -296,9 +252,9 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
         y_src = newImageBuffer;
         y_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[0]);
@@ -309,67 +265,17 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
             y_src += surface_image.width * 2;
             y_dst += surface_image.pitches[0];
         }
-    } else if ((surface_image.format.fourcc == VA_FOURCC_P010 &&
-                g_src_file_fourcc == VA_FOURCC_P010) ||
-               (surface_image.format.fourcc == VA_FOURCC_I010 &&
-                g_src_file_fourcc == VA_FOURCC_I010)) {
-        frame_size = surface_image.width * surface_image.height * 3;
+    } else if (vpp_hbd_supported(surface_image.format.fourcc, g_src_file_fourcc)) {
+        frame_size = vpp_hbd_frame_size(g_src_file_fourcc, surface_image.width, surface_image.height);
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
-
-        y_src = newImageBuffer;
-        y_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[0]);
-
-        /* plane 0, directly copy */
-        for (row = 0; row < surface_image.height; row++) {
-            memcpy(y_dst, y_src, surface_image.width * 2);
-            y_src += surface_image.width * 2;
-            y_dst += surface_image.pitches[0];
-        }
-
-        /* UV plane */
-        if (surface_image.format.fourcc == VA_FOURCC_I010) {
-            assert(g_src_file_fourcc == VA_FOURCC_I010);
-
-            u_src = newImageBuffer + surface_image.width * surface_image.height * 2;
-            v_src = newImageBuffer + surface_image.width * surface_image.height * 5 / 2;
-
-            u_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[1]);
-            v_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[2]);
-
-            for (row = 0; row < surface_image.height / 2; row++) {
-                memcpy(u_dst, u_src, surface_image.width);
-                memcpy(v_dst, v_src, surface_image.width);
-
-                u_src += surface_image.width;
-                v_src += surface_image.width;
-
-                u_dst += surface_image.pitches[1];
-                v_dst += surface_image.pitches[2];
-            }
-        } else if (surface_image.format.fourcc == VA_FOURCC_P010) {
-            assert(g_src_file_fourcc == VA_FOURCC_P010);
-
-            u_src = newImageBuffer + surface_image.width * surface_image.height * 2;
-            v_src = u_src;
-
-            u_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[1]);
-            v_dst = u_dst;
-
-            for (row = 0; row < surface_image.height / 2; row++) {
-                memcpy(u_dst, u_src, surface_image.width * 2);
-
-                u_src += surface_image.width * 2;
-                v_src = u_src;
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
-                u_dst += surface_image.pitches[1];
-                v_dst = u_dst;
-            }
-        }
+        /* 10/12/16 bit frame, repacked to the surface layout */
+        vpp_hbd_file_to_image(newImageBuffer, g_src_file_fourcc, &surface_image, (uint8_t *)surface_p);
     }  else if ((surface_image.format.fourcc == VA_FOURCC_RGBA &&
                  g_src_file_fourcc == VA_FOURCC_RGBA) ||
                 (surface_image.format.fourcc == VA_FOURCC_RGBX &&
@@ -382,9 +288,9 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
         y_src = newImageBuffer;
         y_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[0]);
@@ -408,7 +314,7 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 /* Store NV12/YV12/I420 surface to yv12 file */
@@ -504,9 +410,9 @@ store_yuv_surface_to_yv12_file(FILE *fp,
         }
 
         /* write frame to file */
-        do {
-            n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
-        } while (n_items != 1);
+        n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     } else {
         printf("Not supported YUV surface fourcc !!! \n");
@@ -521,7 +427,7 @@ store_yuv_surface_to_yv12_file(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -616,9 +522,9 @@ store_yuv_surface_to_i420_file(FILE *fp,
         }
 
         /* write frame to file */
-        do {
-            n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
-        } while (n_items != 1);
+        n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     } else {
         printf("Not supported YUV surface fourcc !!! \n");
@@ -633,7 +539,7 @@ store_yuv_surface_to_i420_file(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -723,9 +629,9 @@ store_yuv_surface_to_nv12_file(FILE *fp,
         }
 
         /* write frame to file */
-        do {
-            n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
-        } while (n_items != 1);
+        n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     } else {
         printf("Not supported YUV surface fourcc !!! \n");
@@ -740,7 +646,7 @@ store_yuv_surface_to_nv12_file(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -786,9 +692,9 @@ store_packed_yuv_surface_to_packed_file(FILE *fp,
         }
 
         /* write frame to file */
-        do {
-            n_items = fwrite(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fwrite(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     } else {
         printf("Not supported YUV surface fourcc !!! \n");
@@ -803,7 +709,7 @@ store_packed_yuv_surface_to_packed_file(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -812,13 +718,7 @@ store_yuv_surface_to_10bit_file(FILE *fp, VASurfaceID surface_id)
     VAStatus va_status;
     VAImage surface_image;
     void *surface_p = NULL;
-    unsigned char *y_src = NULL;
-    unsigned char *u_src = NULL;
-    unsigned char *v_src = NULL;
-    unsigned char *y_dst = NULL;
-    unsigned char *u_dst = NULL;
-    unsigned char *v_dst = NULL;
-    uint32_t row;
+    uint32_t frame_size;
     int32_t n_items;
     unsigned char * newImageBuffer = NULL;
     va_status = vaSyncSurface(va_dpy, surface_id);
@@ -830,62 +730,22 @@ store_yuv_surface_to_10bit_file(FILE *fp, VASurfaceID surface_id)
     va_status = vaMapBuffer(va_dpy, surface_image.buf, &surface_p);
     CHECK_VASTATUS(va_status, "vaMapBuffer");
 
-    /* store the surface to one 10bit file */
-    uint32_t y_size = surface_image.width * surface_image.height * 2;
-    uint32_t u_size = y_size / 4;
-
-    newImageBuffer = (unsigned char*)malloc(y_size * 3);
+    /* store the surface to one 10/12/16 bit file */
+    frame_size = vpp_hbd_frame_size(g_dst_file_fourcc, surface_image.width, surface_image.height);
+    newImageBuffer = (unsigned char*)malloc(frame_size);
     assert(newImageBuffer);
-    y_dst = newImageBuffer;
-
-    y_src = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[0]);
-
-    /* Y plane copy */
-    for (row = 0; row < surface_image.height; row++) {
-        memcpy(y_dst, y_src, surface_image.width * 2);
-        y_src += surface_image.pitches[0];
-        y_dst += surface_image.width * 2;
-    }
-
-    if (surface_image.format.fourcc == VA_FOURCC_I010) {
-        u_dst = newImageBuffer + y_size;
-        v_dst = newImageBuffer + y_size + u_size;
-
-        u_src = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[1]);
-        v_src = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[2]);
-
-        for (row = 0; row < surface_image.height / 2; row++) {
-            memcpy(u_dst, u_src, surface_image.width);
-            memcpy(v_dst, v_src, surface_image.width);
-
-            u_dst += surface_image.width;
-            v_dst += surface_image.width;
 
-            u_src += surface_image.pitches[1];
-            v_src += surface_image.pitches[2];
-        }
-    } else if (surface_image.format.fourcc == VA_FOURCC_P010) {
-        u_dst = newImageBuffer + y_size;
-        v_dst = u_dst;
-
-        u_src = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[1]);
-        v_src = u_src;
-
-        for (row = 0; row < surface_image.height / 2; row++) {
-            memcpy(u_dst, u_src, surface_image.width * 2);
-            u_dst += surface_image.width * 2;
-            u_src += surface_image.pitches[1];
-        }
-    } else {
+    if (vpp_hbd_image_to_file(&surface_image, (uint8_t *)surface_p,
+                              newImageBuffer, g_dst_file_fourcc)) {
         printf("Not supported YUV surface fourcc !!! \n");
         free(newImageBuffer);
         return VA_STATUS_ERROR_INVALID_SURFACE;
     }
 
     /* write frame to file */
-    do {
-        n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
-    } while (n_items != 1);
+    n_items = fwrite(newImageBuffer, frame_size, 1, fp);
+    if (n_items != 1)
+        va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     if (newImageBuffer) {
         free(newImageBuffer);
@@ -895,7 +755,7 @@ store_yuv_surface_to_10bit_file(FILE *fp, VASurfaceID surface_id)
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -932,9 +792,9 @@ store_rgb_surface_to_rgb_file(FILE *fp, VASurfaceID surface_id)
     }
 
     /* write frame to file */
-    do {
-        n_items = fwrite(newImageBuffer, frame_size, 1, fp);
-    } while (n_items != 1);
+    n_items = fwrite(newImageBuffer, frame_size, 1, fp);
+    if (n_items != 1)
+        va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     if (newImageBuffer) {
         free(newImageBuffer);
@@ -944,7 +804,7 @@ store_rgb_surface_to_rgb_file(FILE *fp, VASurfaceID surface_id)
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -969,16 +829,13 @@ store_yuv_surface_to_file(FILE *fp,
                (g_out_fourcc == VA_FOURCC_UYVY &&
                 g_dst_file_fourcc == VA_FOURCC_UYVY)) {
         return store_packed_yuv_surface_to_packed_file(fp, surface_id);
-    } else if ((g_out_fourcc == VA_FOURCC_I010 &&
-                g_dst_file_fourcc == VA_FOURCC_I010) ||
-               (g_out_fourcc == VA_FOURCC_P010 &&
-                g_dst_file_fourcc == VA_FOURCC_P010)) {
+    } else if (vpp_hbd_supported(g_out_fourcc, g_dst_file_fourcc)) {
         return store_yuv_surface_to_10bit_file(fp, surface_id);
     } else if ((g_out_fourcc == VA_FOURCC_RGBA &&
                 g_dst_file_fourcc == VA_FOURCC_RGBA) ||
                (g_out_fourcc == VA_FOURCC_RGBX &&
                 g_dst_file_fourcc == VA_FOURCC_RGBX) ||
-               (g_out_fourcc == VA_FOURCC_RGBA &&
+               (g_out_fourcc == VA_FOURCC_BGRA &&
                 g_dst_file_fourcc == VA_FOURCC_BGRA) ||
                (g_out_fourcc == VA_FOURCC_BGRX &&
                 g_dst_file_fourcc == VA_FOURCC_BGRX)) {
@@ -989,15 +846,17 @@ store_yuv_surface_to_file(FILE *fp,
     }
 }
 
+/* Copy the LUT data row by row, the surface pitch may be larger than a row */
 static VAStatus
-upload_data_to_3dlut(FILE *fp,
+upload_data_to_3dlut(const uint8_t *data, size_t size,
                      VASurfaceID &surface_id)
 {
     VAStatus va_status;
     VAImage surface_image;
     void *surface_p = NULL;
-    uint32_t frame_size, lut3d_size;
-    unsigned char * newImageBuffer = NULL;
+    uint8_t *dst;
+    size_t row_size, n;
+    uint32_t row;
     va_status = vaSyncSurface(va_dpy, surface_id);
     CHECK_VASTATUS(va_status, "vaSyncSurface");
 
@@ -1007,33 +866,149 @@ upload_data_to_3dlut(FILE *fp,
     va_status = vaMapBuffer(va_dpy, surface_image.buf, &surface_p);
     CHECK_VASTATUS(va_status, "vaMapBuffer");
 
-    if (surface_image.format.fourcc == VA_FOURCC_RGBA  && fp) {
+    if (surface_image.format.fourcc == VA_FOURCC_RGBA) {
         /* 3DLUT surface is allocated to 32 bit RGB */
-        frame_size = surface_image.width * surface_image.height * 4;
-        newImageBuffer = (unsigned char*)malloc(frame_size);
-        assert(newImageBuffer);
+        row_size = surface_image.width * 4;
+        dst = (uint8_t *)surface_p + surface_image.offsets[0];
+        for (row = 0; row < surface_image.height && size; row++) {
+            n = size < row_size ? size : row_size;
+            memcpy(dst, data, n);
+            dst += surface_image.pitches[0];
+            data += n;
+            size -= n;
+        }
+        printf("upload_data_to_3dlut: 3DLUT surface width %d, height %d, pitch %d, 3dlut data size: %zu\n",
+               surface_image.width, surface_image.height, surface_image.pitches[0], g_3dlut_data_size);
+    }
 
-        fseek(fp, 0L, SEEK_END);
-        lut3d_size = ftell(fp);
-        rewind(fp);
+    vaUnmapBuffer(va_dpy, surface_image.buf);
+    vaDestroyImage(va_dpy, surface_image.image_id);
+
+    return VA_STATUS_SUCCESS;
+}
 
-        uint32_t real_size = (frame_size > lut3d_size) ? lut3d_size : frame_size;
+static void
+lut3d_data_free()
+{
+    if (g_3dlut_data_mapped)
+        munmap(g_3dlut_data, g_3dlut_data_size);
+    else
+        free(g_3dlut_data);
+
+    g_3dlut_data = NULL;
+    g_3dlut_data_size = 0;
+    g_3dlut_data_mapped = false;
+}
 
-        if (fread(newImageBuffer, real_size, 1, fp) != 0) {
-            memcpy(surface_p, newImageBuffer, real_size);
-            printf("upload_data_to_3dlut: 3DLUT surface width %d, height %d, pitch %d, frame size %d, 3dlut file size: %d\n", surface_image.width, surface_image.height, surface_image.pitches[0], frame_size, lut3d_size);
-        }
+/* Map a LUT file as the LUT data. The mapping is private and writable, a
+ * driver may want a writable user pointer, pages are only copied if it
+ * really writes */
+static int
+lut3d_data_map(const char *file_name)
+{
+    struct stat st;
+    void *ptr;
+    int fd;
+
+    fd = open(file_name, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) || st.st_size == 0) {
+        printf("Open 3DLUT file %s failed\n", file_name);
+        if (fd >= 0)
+            close(fd);
+        return -1;
     }
 
-    if (newImageBuffer)  {
-        free(newImageBuffer);
-        newImageBuffer = NULL;
+    ptr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        printf("Map 3DLUT file %s failed: %s\n", file_name, strerror(errno));
+        return -1;
     }
 
-    vaUnmapBuffer(va_dpy, surface_image.buf);
-    vaDestroyImage(va_dpy, surface_image.image_id);
+    g_3dlut_data = (uint8_t *)ptr;
+    g_3dlut_data_size = st.st_size;
+    g_3dlut_data_mapped = true;
+    return 0;
+}
 
-    return VA_STATUS_SUCCESS;
+/* Turn the .cube file into LUT data of the selected driver geometry. The
+ * bake is cached next to the .cube (or in 3DLUT_CACHE_DIR) under a name
+ * carrying the geometry and a hash of the .cube bytes and the layout, so a
+ * later run maps it directly and an edited .cube never hits a stale bake */
+static int
+lut3d_cube_ingest()
+{
+    uint16_t stride[3] = { g_3dlut_seg_size, g_3dlut_seg_size, g_3dlut_mul_size };
+    size_t size = vpp_lut3d_baked_size(g_3dlut_seg_size, stride);
+    char cache_name[MAX_LEN * 2 + 64], tmp_name[MAX_LEN * 2 + 80];
+    const char *base, *layout = "RGBA16 r*s1+g*s2+b v1";
+    uint64_t hash;
+    struct stat st;
+    void *baked = NULL;
+    bool written = false;
+    FILE *fp;
+
+    if (lut3d_data_map(g_3dlut_file_name))
+        return -1;
+
+    hash = vpp_lut3d_hash(VPP_LUT3D_HASH_INIT, g_3dlut_data, g_3dlut_data_size);
+    hash = vpp_lut3d_hash(hash, layout, strlen(layout));
+    hash = vpp_lut3d_hash(hash, stride, sizeof(stride));
+    lut3d_data_free();
+
+    base = strrchr(g_3dlut_file_name, '/');
+    base = base ? base + 1 : g_3dlut_file_name;
+    if (g_3dlut_cache_dir[0])
+        snprintf(cache_name, sizeof(cache_name), "%s/%.*s-%dx%dx%d-%016llx.3dlut",
+                 g_3dlut_cache_dir, (int)(strlen(base) - 5), base,
+                 g_3dlut_seg_size, g_3dlut_seg_size, g_3dlut_mul_size,
+                 (unsigned long long)hash);
+    else
+        snprintf(cache_name, sizeof(cache_name), "%.*s-%dx%dx%d-%016llx.3dlut",
+                 (int)(strlen(g_3dlut_file_name) - 5), g_3dlut_file_name,
+                 g_3dlut_seg_size, g_3dlut_seg_size, g_3dlut_mul_size,
+                 (unsigned long long)hash);
+
+    /* the CPU reference works on the .cube table itself */
+    if (g_3dlut_cpu_method && vpp_lut3d_load_cube(g_3dlut_file_name, &g_3dlut_cube))
+        return -1;
+
+    if (!stat(cache_name, &st) && (size_t)st.st_size == size) {
+        printf("3DLUT cache hit: %s\n", cache_name);
+        return lut3d_data_map(cache_name);
+    }
+
+    if (!g_3dlut_cube.table && vpp_lut3d_load_cube(g_3dlut_file_name, &g_3dlut_cube))
+        return -1;
+
+    /* page aligned, so the bake can back a user pointer surface as well */
+    if (posix_memalign(&baked, sysconf(_SC_PAGESIZE), size)) {
+        printf("Allocate %zu bytes for the 3DLUT failed\n", size);
+        return -1;
+    }
+    vpp_lut3d_bake(&g_3dlut_cube, g_3dlut_seg_size, stride, (uint16_t *)baked);
+    if (!g_3dlut_cpu_method)
+        vpp_lut3d_free(&g_3dlut_cube);
+
+    /* written under a temporary name, a concurrent run never maps half a file */
+    snprintf(tmp_name, sizeof(tmp_name), "%s.%d", cache_name, (int)getpid());
+    if ((fp = fopen(tmp_name, "wb"))) {
+        written = fwrite(baked, size, 1, fp) == 1;
+        written = !fclose(fp) && written;
+    }
+
+    if (written && !rename(tmp_name, cache_name)) {
+        printf("3DLUT %s baked to %s\n", g_3dlut_file_name, cache_name);
+        free(baked);
+        return lut3d_data_map(cache_name);
+    }
+
+    printf("Write 3DLUT cache %s failed, the bake is not cached\n", cache_name);
+    unlink(tmp_name);
+    g_3dlut_data = (uint8_t *)baked;
+    g_3dlut_data_size = size;
+    g_3dlut_data_mapped = false;
+    return 0;
 }
 
 static VAStatus
@@ -1059,53 +1034,141 @@ create_surface(VASurfaceID * p_surface_id,
     return va_status;
 }
 
+/* Pick the LUT geometry from the driver caps. A .cube is resampled to any
+ * size the driver offers, 3DLUT_SEG_SIZE if it is set and the largest one
+ * otherwise, a binary LUT has to match one of the caps as it is */
 static VAStatus
-lut3D_filter_init(VABufferID &filter_param_buf_id)
+lut3d_caps_select()
 {
     VAStatus va_status;
-    VAProcFilterParameterBuffer3DLUT lut3d_param;
-    VABufferID lut3d_param_buf_id;
-    uint32_t num_caps = 10;
-    bool bSupported = false;
+    uint32_t num_caps = 10, best, index;
+    VAProcFilterCap3DLUT caps[10];
 
-    VAProcFilterCap3DLUT caps[num_caps];
-    memset(&caps, 0, sizeof(VAProcFilterCap3DLUT)*num_caps);
+    memset(&caps, 0, sizeof(caps));
     va_status = vaQueryVideoProcFilterCaps(va_dpy, context_id,
                                            VAProcFilter3DLUT,
                                            (void *)caps, &num_caps);
     CHECK_VASTATUS(va_status, "vaQueryVideoProcFilterCaps");
     printf("vaQueryVideoProcFilterCaps num_caps %d\n", num_caps);
 
-    /* check if the input parameters are supported */
-    for (uint32_t index = 0; index < num_caps; index++) {
-        // check lut_size and lut_stride
-        if ((caps[index].lut_size = g_3dlut_seg_size) &&
-            (caps[index].lut_stride[0] == g_3dlut_seg_size) &&
-            (caps[index].lut_stride[1] == g_3dlut_seg_size) &&
-            (caps[index].lut_stride[2] == g_3dlut_mul_size)) {
-            bSupported = true;
+    best = num_caps;
+    for (index = 0; index < num_caps; index++) {
+        /* the LUT data is laid out for square r/g planes */
+        if (caps[index].lut_stride[0] != caps[index].lut_size ||
+            caps[index].lut_stride[1] != caps[index].lut_size ||
+            caps[index].lut_stride[2] < caps[index].lut_size)
+            continue;
+
+        if (g_3dlut_is_cube && !g_3dlut_seg_size_set) {
+            if (best == num_caps || caps[index].lut_size > caps[best].lut_size)
+                best = index;
+        } else if (caps[index].lut_size == g_3dlut_seg_size &&
+                   (g_3dlut_is_cube || caps[index].lut_stride[2] == g_3dlut_mul_size)) {
+            best = index;
         }
     }
 
-    if (bSupported) {
-        lut3d_param.type  = VAProcFilter3DLUT;
-        lut3d_param.lut_surface   = g_3dlut_surface_id;
-        lut3d_param.lut_size      = g_3dlut_seg_size;
-        lut3d_param.lut_stride[0] = g_3dlut_seg_size;
-        lut3d_param.lut_stride[1] = g_3dlut_seg_size;
-        lut3d_param.lut_stride[2] = g_3dlut_mul_size;
-        lut3d_param.bit_depth     = 16;
-        lut3d_param.num_channel   = 4;
-        lut3d_param.channel_mapping = g_3dlut_channel_mapping;
-
-        /* create 3dlut fitler buffer */
-        va_status = vaCreateBuffer(va_dpy, context_id,
-                                   VAProcFilterParameterBufferType, sizeof(lut3d_param), 1,
-                                   &lut3d_param, &lut3d_param_buf_id);
-
-        filter_param_buf_id = lut3d_param_buf_id;
+    if (best == num_caps) {
+        if (g_3dlut_is_cube)
+            printf("3DLUT size %d is not supported by the driver\n", g_3dlut_seg_size);
+        else
+            printf("3DLUT size %d x %d x %d is not supported by the driver\n",
+                   g_3dlut_seg_size, g_3dlut_seg_size, g_3dlut_mul_size);
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
     }
 
+    g_3dlut_seg_size = caps[best].lut_size;
+    g_3dlut_mul_size = caps[best].lut_stride[2];
+    printf("3DLUT geometry: size %d, stride %d x %d x %d\n", g_3dlut_seg_size,
+           g_3dlut_seg_size, g_3dlut_seg_size, g_3dlut_mul_size);
+    return VA_STATUS_SUCCESS;
+}
+
+/* Create the LUT surface on the LUT data. A complete LUT is wrapped as a
+ * user pointer surface and used in place, otherwise (or if the driver
+ * refuses the user pointer) it is copied into a driver allocated surface */
+static VAStatus
+lut3d_surface_create()
+{
+    VAStatus va_status;
+    VASurfaceAttrib surface_attrib[3];
+    VASurfaceAttribExternalBuffers ext_buffer;
+    uint32_t width = g_3dlut_seg_size * g_3dlut_mul_size;
+    uint32_t height = g_3dlut_seg_size * 2;
+    size_t lut3d_size = (size_t)width * height * 4;
+    uintptr_t buffer = (uintptr_t)g_3dlut_data;
+
+    if (g_3dlut_data_size >= lut3d_size) {
+        memset(&ext_buffer, 0, sizeof(ext_buffer));
+        ext_buffer.pixel_format = VA_FOURCC_RGBA;
+        ext_buffer.width = width;
+        ext_buffer.height = height;
+        ext_buffer.data_size = lut3d_size;
+        ext_buffer.num_planes = 1;
+        ext_buffer.pitches[0] = width * 4;
+        ext_buffer.offsets[0] = 0;
+        ext_buffer.buffers = &buffer;
+        ext_buffer.num_buffers = 1;
+        ext_buffer.flags = 0;
+
+        surface_attrib[0].type = VASurfaceAttribPixelFormat;
+        surface_attrib[0].flags = VA_SURFACE_ATTRIB_SETTABLE;
+        surface_attrib[0].value.type = VAGenericValueTypeInteger;
+        surface_attrib[0].value.value.i = VA_FOURCC_RGBA;
+
+        surface_attrib[1].type = VASurfaceAttribMemoryType;
+        surface_attrib[1].flags = VA_SURFACE_ATTRIB_SETTABLE;
+        surface_attrib[1].value.type = VAGenericValueTypeInteger;
+        surface_attrib[1].value.value.i = VA_SURFACE_ATTRIB_MEM_TYPE_USER_PTR;
+
+        surface_attrib[2].type = VASurfaceAttribExternalBufferDescriptor;
+        surface_attrib[2].flags = VA_SURFACE_ATTRIB_SETTABLE;
+        surface_attrib[2].value.type = VAGenericValueTypePointer;
+        surface_attrib[2].value.value.p = (void *)&ext_buffer;
+
+        va_status = vaCreateSurfaces(va_dpy, VA_RT_FORMAT_RGB32, width, height,
+                                     &g_3dlut_surface_id, 1, surface_attrib, 3);
+        if (va_status == VA_STATUS_SUCCESS) {
+            printf("3DLUT surface uses the %zu bytes of LUT data in place\n", lut3d_size);
+            return va_status;
+        }
+        printf("User pointer 3DLUT surface failed (%s), copying the LUT\n",
+               vaErrorStr(va_status));
+    } else {
+        printf("3DLUT data of %zu bytes is smaller than the %zu byte LUT surface\n",
+               g_3dlut_data_size, lut3d_size);
+    }
+
+    va_status = create_surface(&g_3dlut_surface_id, width, height,
+                               VA_FOURCC_RGBA, VA_RT_FORMAT_RGB32);
+    CHECK_VASTATUS(va_status, "vaCreateSurfaces for 3dlut.");
+
+    return upload_data_to_3dlut(g_3dlut_data, g_3dlut_data_size, g_3dlut_surface_id);
+}
+
+static VAStatus
+lut3D_filter_init(VABufferID &filter_param_buf_id)
+{
+    VAStatus va_status;
+    VAProcFilterParameterBuffer3DLUT lut3d_param;
+
+    /* the geometry was checked against the caps in lut3d_caps_select() */
+    memset(&lut3d_param, 0, sizeof(lut3d_param));
+    lut3d_param.type  = VAProcFilter3DLUT;
+    lut3d_param.lut_surface   = g_3dlut_surface_id;
+    lut3d_param.lut_size      = g_3dlut_seg_size;
+    lut3d_param.lut_stride[0] = g_3dlut_seg_size;
+    lut3d_param.lut_stride[1] = g_3dlut_seg_size;
+    lut3d_param.lut_stride[2] = g_3dlut_mul_size;
+    lut3d_param.bit_depth     = 16;
+    lut3d_param.num_channel   = 4;
+    lut3d_param.channel_mapping = g_3dlut_channel_mapping;
+
+    /* create 3dlut fitler buffer */
+    va_status = vaCreateBuffer(va_dpy, context_id,
+                               VAProcFilterParameterBufferType, sizeof(lut3d_param), 1,
+                               &lut3d_param, &filter_param_buf_id);
+
     return va_status;
 }
 
@@ -1120,7 +1183,8 @@ video_frame_process_3dlut(VASurfaceID in_surface_id,
     VABufferID filter_param_buf_id = VA_INVALID_ID;
 
     /*Create 3DLUT Filter*/
-    lut3D_filter_init(filter_param_buf_id);
+    va_status = lut3D_filter_init(filter_param_buf_id);
+    CHECK_VASTATUS(va_status, "vaCreateBuffer for 3dlut");
 
     /* Fill pipeline buffer */
     surface_region.x = 0;
@@ -1238,6 +1302,108 @@ video_frame_process_scaling(VASurfaceID in_surface_id,
     return va_status;
 }
 
+static double
+lut3d_time_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* Byte offsets of R, G and B in a 32 bit RGB pixel, false for the formats
+ * the CPU reference does not handle */
+static bool
+lut3d_fourcc_offsets(uint32_t fourcc, uint32_t offsets[3])
+{
+    uint32_t r_offset;
+
+    if (fourcc == VA_FOURCC_RGBA || fourcc == VA_FOURCC_RGBX)
+        r_offset = 0;
+    else if (fourcc == VA_FOURCC_BGRA || fourcc == VA_FOURCC_BGRX)
+        r_offset = 2;
+    else
+        return false;
+
+    if (offsets) {
+        offsets[0] = r_offset;
+        offsets[1] = 1;
+        offsets[2] = 2 - r_offset;
+    }
+    return true;
+}
+
+/* Apply the .cube on the CPU to the input of the 3DLUT pass and compare the
+ * result with the GPU output, the errors add up to the PSNR of the run */
+static VAStatus
+lut3d_cpu_reference(VASurfaceID in_surface_id, VASurfaceID out_surface_id)
+{
+    VAStatus va_status;
+    VAImage in_image, out_image;
+    void *in_p = NULL, *out_p = NULL;
+    uint32_t in_offsets[3], out_offsets[3];
+    uint32_t row, col, c, diff, max_diff = 0;
+    uint8_t *ref, *ref_row, *out_row;
+    double start, sq_err = 0;
+
+    lut3d_fourcc_offsets(g_in_fourcc, in_offsets);
+    lut3d_fourcc_offsets(g_out_fourcc, out_offsets);
+
+    va_status = vaSyncSurface(va_dpy, out_surface_id);
+    CHECK_VASTATUS(va_status, "vaSyncSurface");
+
+    va_status = vaDeriveImage(va_dpy, in_surface_id, &in_image);
+    CHECK_VASTATUS(va_status, "vaDeriveImage");
+
+    va_status = vaMapBuffer(va_dpy, in_image.buf, &in_p);
+    CHECK_VASTATUS(va_status, "vaMapBuffer");
+
+    va_status = vaDeriveImage(va_dpy, out_surface_id, &out_image);
+    CHECK_VASTATUS(va_status, "vaDeriveImage");
+
+    va_status = vaMapBuffer(va_dpy, out_image.buf, &out_p);
+    CHECK_VASTATUS(va_status, "vaMapBuffer");
+
+    ref = (uint8_t *)malloc(g_in_pic_width * g_in_pic_height * 4);
+    assert(ref);
+
+    /* the reference keeps the channel order of the input */
+    start = lut3d_time_ms();
+    vpp_lut3d_apply_rgb32(&g_3dlut_cube, g_3dlut_cpu_method,
+                          (uint8_t *)in_p + in_image.offsets[0], in_image.pitches[0],
+                          ref, g_in_pic_width * 4, g_in_pic_width, g_in_pic_height,
+                          in_offsets[0], in_offsets[1], in_offsets[2]);
+    g_cpu_time += lut3d_time_ms() - start;
+
+    for (row = 0; row < g_in_pic_height; row++) {
+        ref_row = ref + row * g_in_pic_width * 4;
+        out_row = (uint8_t *)out_p + out_image.offsets[0] + row * out_image.pitches[0];
+        for (col = 0; col < g_in_pic_width; col++) {
+            for (c = 0; c < 3; c++) {
+                diff = abs(ref_row[col * 4 + in_offsets[c]] - out_row[col * 4 + out_offsets[c]]);
+                sq_err += diff * diff;
+                if (diff > max_diff)
+                    max_diff = diff;
+            }
+        }
+    }
+
+    printf("3DLUT CPU reference: max diff %d, mean square error %.3f\n", max_diff,
+           sq_err / (g_in_pic_width * g_in_pic_height * 3.0));
+    g_cpu_sq_err += sq_err;
+    g_cpu_samples += (uint64_t)g_in_pic_width * g_in_pic_height * 3;
+    if (max_diff > g_cpu_max_diff)
+        g_cpu_max_diff = max_diff;
+
+    free(ref);
+    vaUnmapBuffer(va_dpy, out_image.buf);
+    vaDestroyImage(va_dpy, out_image.image_id);
+    vaUnmapBuffer(va_dpy, in_image.buf);
+    vaDestroyImage(va_dpy, in_image.image_id);
+
+    return VA_STATUS_SUCCESS;
+}
+
 static VAStatus
 vpp_context_create()
 {
@@ -1300,23 +1466,6 @@ vpp_context_create()
                                g_out_fourcc, g_out_format);
     CHECK_VASTATUS(va_status, "vaCreateSurfaces for output");
 
-    if (g_pipeline_sequence != VA_SCALING_ONLY) {
-        uint32_t lut3d_size = g_3dlut_seg_size * g_3dlut_seg_size * g_3dlut_mul_size * (16 / 8) * 4;
-        printf("3dlut file name: %s, 3dlut size: %d\n", g_3dlut_file_name, lut3d_size);
-        /* create 3dlut surface and fill it with the data in 3dlut file */
-        va_status = create_surface(&g_3dlut_surface_id, g_3dlut_seg_size * g_3dlut_mul_size, g_3dlut_seg_size * 2,
-                                   VA_FOURCC_RGBA, VA_RT_FORMAT_RGB32);
-        CHECK_VASTATUS(va_status, "vaCreateSurfaces for 3dlut.");
-        /* fill 3dlut with the 3dlut file data */
-        FILE *lut3d_file = NULL;
-        lut3d_file = fopen(g_3dlut_file_name, "rb");
-        upload_data_to_3dlut(lut3d_file, g_3dlut_surface_id);
-        if (lut3d_file) {
-            fclose(lut3d_file);
-            lut3d_file = NULL;
-        }
-    }
-
     va_status = vaCreateConfig(va_dpy,
                                VAProfileNone,
                                VAEntrypointVideoProc,
@@ -1334,6 +1483,23 @@ vpp_context_create()
                                 1,
                                 &context_id);
     CHECK_VASTATUS(va_status, "vaCreateContext");
+
+    if (g_pipeline_sequence != VA_SCALING_ONLY) {
+        /* the LUT geometry comes from the filter caps of the context */
+        va_status = lut3d_caps_select();
+        if (va_status != VA_STATUS_SUCCESS)
+            return va_status;
+
+        uint32_t lut3d_size = g_3dlut_seg_size * g_3dlut_seg_size * g_3dlut_mul_size * (16 / 8) * 4;
+        printf("3dlut file name: %s, 3dlut size: %d\n", g_3dlut_file_name, lut3d_size);
+        if (g_3dlut_is_cube ? lut3d_cube_ingest() : lut3d_data_map(g_3dlut_file_name))
+            return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+        /* create 3dlut surface on the 3dlut data */
+        va_status = lut3d_surface_create();
+        CHECK_VASTATUS(va_status, "vaCreateSurfaces for 3dlut.");
+    }
+
     return va_status;
 }
 
@@ -1351,6 +1517,9 @@ vpp_context_destroy()
     if (g_pipeline_sequence != VA_SCALING_ONLY) {
         printf("vaDestroySurfaces 3dlut surface for Scaling!\n");
         vaDestroySurfaces(va_dpy, &g_3dlut_surface_id, 1);
+        /* a user pointer surface is gone, its memory can go too */
+        lut3d_data_free();
+        vpp_lut3d_free(&g_3dlut_cube);
     }
     printf("vaDestroyContext!\n");
     vaDestroyContext(va_dpy, context_id);
@@ -1385,12 +1554,18 @@ parse_fourcc_and_format(char *str, uint32_t *fourcc, uint32_t *format)
         tfourcc = VA_FOURCC('I', '0', '1', '0');
     } else if (!strcmp(str, "RGBA")) {
         tfourcc = VA_FOURCC_RGBA;
+        tformat = VA_RT_FORMAT_RGB32;
     } else if (!strcmp(str, "RGBX")) {
         tfourcc = VA_FOURCC_RGBX;
+        tformat = VA_RT_FORMAT_RGB32;
     } else if (!strcmp(str, "BGRA")) {
         tfourcc = VA_FOURCC_BGRA;
+        tformat = VA_RT_FORMAT_RGB32;
     } else if (!strcmp(str, "BGRX")) {
         tfourcc = VA_FOURCC_BGRX;
+        tformat = VA_RT_FORMAT_RGB32;
+    } else if ((tfourcc = vpp_hbd_fourcc(str, &tformat))) {
+        /* P012, P016, Y210, Y212, Y216, Y410, Y412, Y416 and planar files */
     } else {
         printf("Not supported format: %s! Currently only support following format: %s\n",
                str, "YV12, I420, NV12, YUY2(YUYV), UYVY, P010, I010, RGBA, RGBX, BGRA or BGRX");
@@ -1412,45 +1587,86 @@ parse_basic_parameters()
     char str[MAX_LEN];
 
     /* Read src frame file information */
-    read_value_string(g_config_file_fd, "SRC_FILE_NAME", g_src_file_name);
-    read_value_uint32(g_config_file_fd, "SRC_FRAME_WIDTH", &g_in_pic_width);
-    read_value_uint32(g_config_file_fd, "SRC_FRAME_HEIGHT", &g_in_pic_height);
-    read_value_string(g_config_file_fd, "SRC_FRAME_FORMAT", str);
+    vpp_config_get_string(g_config, "SRC_FILE_NAME", g_src_file_name);
+    vpp_config_get_uint32(g_config, "SRC_FRAME_WIDTH", &g_in_pic_width);
+    vpp_config_get_uint32(g_config, "SRC_FRAME_HEIGHT", &g_in_pic_height);
+    vpp_config_get_string(g_config, "SRC_FRAME_FORMAT", str);
     parse_fourcc_and_format(str, &g_in_fourcc, &g_in_format);
 
     /* Read dst frame file information */
-    read_value_string(g_config_file_fd, "DST_FILE_NAME", g_dst_file_name);
-    read_value_uint32(g_config_file_fd, "DST_FRAME_WIDTH", &g_out_pic_width);
-    read_value_uint32(g_config_file_fd, "DST_FRAME_HEIGHT", &g_out_pic_height);
-    read_value_string(g_config_file_fd, "DST_FRAME_FORMAT", str);
+    vpp_config_get_string(g_config, "DST_FILE_NAME", g_dst_file_name);
+    vpp_config_get_uint32(g_config, "DST_FRAME_WIDTH", &g_out_pic_width);
+    vpp_config_get_uint32(g_config, "DST_FRAME_HEIGHT", &g_out_pic_height);
+    vpp_config_get_string(g_config, "DST_FRAME_FORMAT", str);
     parse_fourcc_and_format(str, &g_out_fourcc, &g_out_format);
 
-    read_value_string(g_config_file_fd, "SRC_FILE_FORMAT", str);
+    vpp_config_get_string(g_config, "SRC_FILE_FORMAT", str);
     parse_fourcc_and_format(str, &g_src_file_fourcc, NULL);
 
-    read_value_string(g_config_file_fd, "DST_FILE_FORMAT", str);
+    vpp_config_get_string(g_config, "DST_FILE_FORMAT", str);
     parse_fourcc_and_format(str, &g_dst_file_fourcc, NULL);
 
-    read_value_uint32(g_config_file_fd, "FRAME_SUM", &g_frame_count);
+    vpp_config_get_uint32(g_config, "FRAME_SUM", &g_frame_count);
 
-    read_value_uint32(g_config_file_fd, "3DLUT_SCALING", &g_pipeline_sequence);
+    vpp_config_get_uint32(g_config, "3DLUT_SCALING", &g_pipeline_sequence);
 
-    if (read_value_string(g_config_file_fd, "3DLUT_FILE_NAME", g_3dlut_file_name)) {
+    if (vpp_config_get_string(g_config, "3DLUT_FILE_NAME", g_3dlut_file_name)) {
         printf("Read 3DLUT file failed, exit.");
     }
 
-    if (read_value_uint16(g_config_file_fd, "3DLUT_SEG_SIZE", &g_3dlut_seg_size)) {
-        printf("Read segment_size failed, exit.");
+    /* a .cube is resampled to the driver LUT size, see lut3d_caps_select() */
+    size_t name_len = strlen(g_3dlut_file_name);
+    g_3dlut_is_cube = name_len > 5 &&
+                      !strcasecmp(g_3dlut_file_name + name_len - 5, ".cube");
+
+    if (vpp_config_get_uint16(g_config, "3DLUT_SEG_SIZE", &g_3dlut_seg_size)) {
+        if (!g_3dlut_is_cube)
+            printf("Read segment_size failed, exit.");
+    } else {
+        g_3dlut_seg_size_set = true;
     }
 
-    if (read_value_uint16(g_config_file_fd, "3DLUT_MUL_SIZE", &g_3dlut_mul_size)) {
+    if (vpp_config_get_uint16(g_config, "3DLUT_MUL_SIZE", &g_3dlut_mul_size) &&
+        !g_3dlut_is_cube) {
         printf("Read multiple_size failed, exit.");
     }
 
-    if (read_value_uint32(g_config_file_fd, "3DLUT_CHANNEL_MAPPING", &g_3dlut_channel_mapping)) {
+    if (vpp_config_get_uint32(g_config, "3DLUT_CHANNEL_MAPPING", &g_3dlut_channel_mapping)) {
         printf("Read channel_mapping failed, exit.");
     }
 
+    vpp_config_get_string(g_config, "3DLUT_CACHE_DIR", g_3dlut_cache_dir);
+
+    if (!vpp_config_get_string(g_config, "3DLUT_CPU_REFERENCE", str)) {
+        if (!strcmp(str, "TRILINEAR"))
+            g_3dlut_cpu_method = VPP_LUT3D_TRILINEAR;
+        else if (!strcmp(str, "TETRAHEDRAL"))
+            g_3dlut_cpu_method = VPP_LUT3D_TETRAHEDRAL;
+        else if (strcmp(str, "NONE"))
+            printf("Unknown 3DLUT_CPU_REFERENCE %s, the CPU reference is off\n", str);
+    }
+
+    if (g_3dlut_cpu_method) {
+        const char *reason = NULL;
+
+        if (!g_3dlut_is_cube)
+            reason = "it needs a .cube 3DLUT_FILE_NAME";
+        else if (g_pipeline_sequence != VA_3DLUT_SCALING)
+            reason = "it only covers the 3DLUT->Scaling pipeline";
+        else if (g_in_pic_width != g_out_pic_width || g_in_pic_height != g_out_pic_height)
+            reason = "it does not scale";
+        else if (g_3dlut_channel_mapping != VA_3DLUT_CHANNEL_RGB_RGB)
+            reason = "it only maps RGB to RGB";
+        else if (!lut3d_fourcc_offsets(g_in_fourcc, NULL) ||
+                 !lut3d_fourcc_offsets(g_out_fourcc, NULL))
+            reason = "it needs RGBA, RGBX, BGRA or BGRX surfaces";
+
+        if (reason) {
+            printf("3DLUT CPU reference disabled: %s\n", reason);
+            g_3dlut_cpu_method = 0;
+        }
+    }
+
     if (g_in_pic_width != g_out_pic_width ||
         g_in_pic_height != g_out_pic_height)
         printf("Scaling will be done : from %4d x %4d to %4d x %4d \n",
@@ -1477,6 +1693,7 @@ int32_t main(int32_t argc, char *argv[])
 {
     VAStatus va_status;
     uint32_t i;
+    double start, mse;
 
     if (argc != 2 || !strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")) {
         print_help();
@@ -1487,11 +1704,18 @@ int32_t main(int32_t argc, char *argv[])
     strncpy(g_config_file_name, argv[1], MAX_LEN);
     g_config_file_name[MAX_LEN - 1] = '\0';
 
-    if (NULL == (g_config_file_fd = fopen(g_config_file_name, "r"))) {
+    if (NULL == (g_config = vpp_config_open(g_config_file_name))) {
         printf("Open configure file %s failed!\n", g_config_file_name);
         assert(0);
     }
 
+    /* frames on stdout, diagnostics on stderr */
+    if (vpp_config_has_value(g_config, "DST_FILE_NAME", "-") &&
+        vpp_stream_reserve_stdout()) {
+        printf("Failed to move the diagnostics to stderr\n");
+        assert(0);
+    }
+
     /* Parse basic parameters */
     if (parse_basic_parameters()) {
         printf("Parse parameters in configure file error\n");
@@ -1505,23 +1729,32 @@ int32_t main(int32_t argc, char *argv[])
     }
 
     /* Video frame fetch, process and store */
-    if (NULL == (g_src_file_fd = fopen(g_src_file_name, "r"))) {
+    if (NULL == (g_src_file_fd = vpp_stream_open(g_src_file_name, "r"))) {
         printf("Open SRC_FILE_NAME: %s failed, please specify it in config file: %s !\n",
                g_src_file_name, g_config_file_name);
         assert(0);
     }
 
-    if (NULL == (g_dst_file_fd = fopen(g_dst_file_name, "w"))) {
+    if (NULL == (g_dst_file_fd = vpp_stream_open(g_dst_file_name, "w"))) {
         printf("Open DST_FILE_NAME: %s failed, please specify it in config file: %s !\n",
                g_dst_file_name, g_config_file_name);
         assert(0);
     }
 
     for (i = 0; i < g_frame_count; i ++) {
-        upload_yuv_frame_to_yuv_surface(g_src_file_fd, g_in_surface_id);
+        if (upload_yuv_frame_to_yuv_surface(g_src_file_fd, g_in_surface_id) != VA_STATUS_SUCCESS) {
+            if (!feof(g_src_file_fd))
+                printf("Read frame %d from %s failed\n", i, g_src_file_name);
+            break;
+        }
         if (g_pipeline_sequence == VA_3DLUT_SCALING) {
             printf("process frame #%d in VA_3DLUT_SCALING\n", i);
+            start = lut3d_time_ms();
             video_frame_process_3dlut(g_in_surface_id, g_out_surface_id);
+            vaSyncSurface(va_dpy, g_out_surface_id);
+            g_gpu_time += lut3d_time_ms() - start;
+            if (g_3dlut_cpu_method)
+                lut3d_cpu_reference(g_in_surface_id, g_out_surface_id);
         } else if (g_pipeline_sequence == VA_SCALING_3DLUT) {
             printf("process frame #%d in VA_SCALING_3DLUT\n", i);
             video_frame_process_scaling(g_in_surface_id, g_inter_surface_id);
@@ -1535,14 +1768,30 @@ int32_t main(int32_t argc, char *argv[])
         store_yuv_surface_to_file(g_dst_file_fd, g_out_surface_id);
     }
 
+    /* the input may end before FRAME_SUM */
+    g_frame_count = i;
+
+    if (g_pipeline_sequence == VA_3DLUT_SCALING && g_frame_count)
+        printf("3DLUT GPU: %.3f ms/frame\n", g_gpu_time / g_frame_count);
+
+    if (g_3dlut_cpu_method && g_cpu_samples) {
+        mse = g_cpu_sq_err / g_cpu_samples;
+        printf("3DLUT CPU %s reference: %.3f ms/frame, max diff %d, ",
+               g_3dlut_cpu_method == VPP_LUT3D_TRILINEAR ? "trilinear" : "tetrahedral",
+               g_cpu_time / g_frame_count, g_cpu_max_diff);
+        if (mse > 0)
+            printf("PSNR %.2f dB\n", 10 * log10(255.0 * 255.0 / mse));
+        else
+            printf("bit exact\n");
+    }
+
     if (g_src_file_fd)
         fclose(g_src_file_fd);
 
     if (g_dst_file_fd)
         fclose(g_dst_file_fd);
 
-    if (g_config_file_fd)
-        fclose(g_config_file_fd);
+    vpp_config_close(g_config);
 
     vpp_context_destroy();
 
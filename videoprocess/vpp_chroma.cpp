@@ -0,0 +1,451 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL INTEL AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <va/va.h>
+#include <va/va_vpp.h>
+
+#include "vpp_chroma.h"
+
+typedef float v4f __attribute__((vector_size(16)));
+
+#define CHROMA_TAPS 4
+
+/* Taps of one axis: output sample i reads CHROMA_TAPS input samples from
+ * start[i] on, weighted by coefs[i * CHROMA_TAPS ...]. An axis where both
+ * grids and sitings match is an identity and skipped. */
+typedef struct _ChromaAxis {
+    uint32_t src_len;
+    uint32_t dst_len;
+    bool identity;
+    int32_t *start;
+    float *coefs;
+} ChromaAxis;
+
+struct _VPPChroma {
+    uint32_t width, height;
+    int src_subsampling;
+    int dst_subsampling;
+    uint32_t src_size[2];       /* chroma planes before and after */
+    uint32_t dst_size[2];
+
+    ChromaAxis axes[2];         /* horizontal, vertical */
+    float *src_plane;
+    float *tmp;                 /* output of the horizontal pass */
+    float *dst_plane;
+    float *row;                 /* input row with replicated edges */
+};
+
+/* Luma samples per chroma sample along x (axis 0) or y (axis 1) */
+static uint32_t
+chroma_factor(int subsampling, int axis)
+{
+    if (subsampling == VPP_CHROMA_444)
+        return 1;
+    if (axis == 0)
+        return 2;
+    return subsampling == VPP_CHROMA_420 ? 2 : 1;
+}
+
+/* Position of chroma sample 0 in luma samples */
+static double
+chroma_offset(uint8_t siting, uint32_t factor, int axis)
+{
+    if (factor == 1)
+        return 0;
+
+    if (axis == 0)
+        return (siting & VA_CHROMA_SITING_HORIZONTAL_CENTER) ? (factor - 1) / 2.0 : 0;
+
+    switch (siting & VA_CHROMA_SITING_VERTICAL_BOTTOM) {
+    case VA_CHROMA_SITING_VERTICAL_TOP:
+        return 0;
+    case VA_CHROMA_SITING_VERTICAL_BOTTOM:
+        return factor - 1;
+    default:
+        return (factor - 1) / 2.0;
+    }
+}
+
+int
+vpp_chroma_subsampling(uint32_t fourcc)
+{
+    switch (fourcc) {
+    case VA_FOURCC_NV12:
+    case VA_FOURCC_I420:
+    case VA_FOURCC_YV12:
+        return VPP_CHROMA_420;
+    case VA_FOURCC_YUY2:
+    case VA_FOURCC_UYVY:
+    case VA_FOURCC_422H:
+        return VPP_CHROMA_422;
+    case VA_FOURCC_444P:
+        return VPP_CHROMA_444;
+    default:
+        return -1;
+    }
+}
+
+int
+vpp_chroma_frame(VPPChromaFrame *frame, uint32_t fourcc, uint32_t width, uint32_t height,
+                 uint8_t siting, uint8_t *data, const uint32_t offsets[3],
+                 const uint32_t pitches[3])
+{
+    /* byte offset and step of Y, U and V; plane 0 for packed formats */
+    uint32_t planes[3] = { 0, 1, 2 }, offs[3] = { 0, 0, 0 }, steps[3] = { 1, 1, 1 };
+    uint32_t i;
+
+    frame->subsampling = vpp_chroma_subsampling(fourcc);
+    if (frame->subsampling < 0)
+        return -1;
+
+    switch (fourcc) {
+    case VA_FOURCC_NV12:
+        planes[2] = 1;
+        offs[2] = 1;
+        steps[1] = steps[2] = 2;
+        break;
+    case VA_FOURCC_YV12:
+        planes[1] = 2;
+        planes[2] = 1;
+        break;
+    case VA_FOURCC_YUY2:
+    case VA_FOURCC_UYVY:
+        planes[1] = planes[2] = 0;
+        offs[0] = fourcc == VA_FOURCC_YUY2 ? 0 : 1;
+        offs[1] = fourcc == VA_FOURCC_YUY2 ? 1 : 0;
+        offs[2] = offs[1] + 2;
+        steps[0] = 2;
+        steps[1] = steps[2] = 4;
+        break;
+    default:
+        break;
+    }
+
+    frame->width = width;
+    frame->height = height;
+    frame->siting = siting;
+    for (i = 0; i < 3; i++) {
+        frame->planes[i] = data + offsets[planes[i]] + offs[i];
+        frame->pitches[i] = pitches[planes[i]];
+        frame->steps[i] = steps[i];
+    }
+    return 0;
+}
+
+/* Taps for output sample i at i * dst_factor + dst_offset from the input
+ * samples at j * src_factor + src_offset, all in luma samples */
+static int
+axis_init(ChromaAxis *axis, uint32_t src_len, uint32_t src_factor, double src_offset,
+          uint32_t dst_len, uint32_t dst_factor, double dst_offset)
+{
+    double width = src_factor > dst_factor ? src_factor : dst_factor;
+    double pos, x, sum;
+    float *coefs;
+    int32_t first;
+    uint32_t i, k;
+
+    axis->src_len = src_len;
+    axis->dst_len = dst_len;
+    axis->identity = src_factor == dst_factor && src_offset == dst_offset;
+    if (axis->identity)
+        return 0;
+
+    axis->start = (int32_t *)malloc(dst_len * sizeof(int32_t));
+    axis->coefs = (float *)calloc((size_t)dst_len * CHROMA_TAPS, sizeof(float));
+    if (!axis->start || !axis->coefs)
+        return -1;
+
+    /* the triangle is open at +-width, so at most 4 input samples are in */
+    for (i = 0; i < dst_len; i++) {
+        pos = (double)i * dst_factor + dst_offset;
+        first = (int32_t)floor((pos - width - src_offset) / src_factor) + 1;
+        coefs = axis->coefs + (size_t)i * CHROMA_TAPS;
+
+        sum = 0;
+        for (k = 0; k < CHROMA_TAPS; k++) {
+            x = fabs(((int32_t)k + first) * (double)src_factor + src_offset - pos);
+            coefs[k] = x < width ? (float)(1 - x / width) : 0;
+            sum += coefs[k];
+        }
+        for (k = 0; k < CHROMA_TAPS; k++)
+            coefs[k] = (float)(coefs[k] / sum);
+        axis->start[i] = first;
+    }
+    return 0;
+}
+
+VPPChroma *
+vpp_chroma_create(uint32_t width, uint32_t height, int src_subsampling, uint8_t src_siting,
+                  int dst_subsampling, uint8_t dst_siting)
+{
+    VPPChroma *chroma;
+    uint32_t src_factor, dst_factor;
+    int axis, ret = 0;
+
+    chroma = (VPPChroma *)calloc(1, sizeof(VPPChroma));
+    if (!chroma)
+        return NULL;
+
+    chroma->width = width;
+    chroma->height = height;
+    chroma->src_subsampling = src_subsampling;
+    chroma->dst_subsampling = dst_subsampling;
+
+    for (axis = 0; axis < 2; axis++) {
+        uint32_t len = axis ? height : width;
+
+        src_factor = chroma_factor(src_subsampling, axis);
+        dst_factor = chroma_factor(dst_subsampling, axis);
+        chroma->src_size[axis] = (len + src_factor - 1) / src_factor;
+        chroma->dst_size[axis] = (len + dst_factor - 1) / dst_factor;
+        ret |= axis_init(&chroma->axes[axis],
+                         chroma->src_size[axis], src_factor,
+                         chroma_offset(src_siting, src_factor, axis),
+                         chroma->dst_size[axis], dst_factor,
+                         chroma_offset(dst_siting, dst_factor, axis));
+    }
+
+    chroma->src_plane = (float *)malloc((size_t)chroma->src_size[0] * chroma->src_size[1] *
+                                        sizeof(float));
+    chroma->tmp = (float *)malloc((size_t)chroma->dst_size[0] * chroma->src_size[1] *
+                                  sizeof(float));
+    chroma->dst_plane = (float *)malloc((size_t)chroma->dst_size[0] * chroma->dst_size[1] *
+                                        sizeof(float));
+    chroma->row = (float *)malloc((chroma->src_size[0] + 2 * (CHROMA_TAPS + 1)) * sizeof(float));
+
+    if (ret || !chroma->src_plane || !chroma->tmp || !chroma->dst_plane || !chroma->row) {
+        vpp_chroma_destroy(chroma);
+        return NULL;
+    }
+    return chroma;
+}
+
+void
+vpp_chroma_destroy(VPPChroma *chroma)
+{
+    int axis;
+
+    if (!chroma)
+        return;
+
+    for (axis = 0; axis < 2; axis++) {
+        free(chroma->axes[axis].start);
+        free(chroma->axes[axis].coefs);
+    }
+    free(chroma->src_plane);
+    free(chroma->tmp);
+    free(chroma->dst_plane);
+    free(chroma->row);
+    free(chroma);
+}
+
+static inline v4f
+load4(const float *p)
+{
+    v4f v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void
+store4(float *p, v4f v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+/* One input row through the horizontal taps into <dst> */
+static void
+resample_row(const ChromaAxis *axis, float *row, const float *src, float *dst)
+{
+    const uint32_t pad = CHROMA_TAPS + 1;
+    v4f acc;
+    uint32_t i;
+
+    for (i = 0; i < pad; i++) {
+        row[i] = src[0];
+        row[pad + axis->src_len + i] = src[axis->src_len - 1];
+    }
+    memcpy(row + pad, src, axis->src_len * sizeof(float));
+
+    for (i = 0; i < axis->dst_len; i++) {
+        acc = load4(axis->coefs + (size_t)i * CHROMA_TAPS) *
+              load4(row + pad + axis->start[i]);
+        dst[i] = acc[0] + acc[1] + acc[2] + acc[3];
+    }
+}
+
+/* Accumulate <coef> times <src> into <dst> */
+static void
+row_madd(float *dst, const float *src, float coef, uint32_t n, bool first)
+{
+    uint32_t i = 0;
+
+    if (first) {
+        for (; i + 4 <= n; i += 4)
+            store4(dst + i, load4(src + i) * coef);
+        for (; i < n; i++)
+            dst[i] = src[i] * coef;
+    } else {
+        for (; i + 4 <= n; i += 4)
+            store4(dst + i, load4(dst + i) + load4(src + i) * coef);
+        for (; i < n; i++)
+            dst[i] += src[i] * coef;
+    }
+}
+
+/* chroma->src_plane through both passes into chroma->dst_plane */
+static void
+resample_plane(VPPChroma *chroma)
+{
+    const ChromaAxis *h = &chroma->axes[0], *v = &chroma->axes[1];
+    uint32_t src_height = chroma->src_size[1];
+    uint32_t width = chroma->dst_size[0];
+    const float *src = chroma->src_plane;
+    uint32_t y, k;
+    int32_t row;
+    bool first;
+
+    if (!h->identity) {
+        for (y = 0; y < src_height; y++)
+            resample_row(h, chroma->row, chroma->src_plane + (size_t)y * chroma->src_size[0],
+                         chroma->tmp + (size_t)y * width);
+        src = chroma->tmp;
+    }
+
+    if (v->identity) {
+        memcpy(chroma->dst_plane, src, (size_t)width * src_height * sizeof(float));
+        return;
+    }
+
+    for (y = 0; y < v->dst_len; y++) {
+        first = true;
+        for (k = 0; k < CHROMA_TAPS; k++) {
+            float coef = v->coefs[(size_t)y * CHROMA_TAPS + k];
+
+            if (coef == 0)
+                continue;
+            row = v->start[y] + (int32_t)k;
+            row = row < 0 ? 0 : row >= (int32_t)src_height ? src_height - 1 : row;
+            row_madd(chroma->dst_plane + (size_t)y * width, src + (size_t)row * width,
+                     coef, width, first);
+            first = false;
+        }
+    }
+}
+
+static void
+plane_gather(const uint8_t *data, uint32_t pitch, uint32_t step,
+             float *dst, uint32_t width, uint32_t height)
+{
+    uint32_t x, y;
+
+    for (y = 0; y < height; y++) {
+        const uint8_t *in = data + (size_t)y * pitch;
+
+        for (x = 0; x < width; x++)
+            *dst++ = in[(size_t)x * step];
+    }
+}
+
+static void
+plane_scatter(const float *src, uint8_t *data, uint32_t pitch, uint32_t step,
+              uint32_t width, uint32_t height)
+{
+    uint32_t x, y;
+    float value;
+
+    for (y = 0; y < height; y++) {
+        uint8_t *out = data + (size_t)y * pitch;
+
+        for (x = 0; x < width; x++) {
+            value = *src++ + 0.5f;
+            out[(size_t)x * step] = value <= 0 ? 0 : value >= 255 ? 255 : (uint8_t)value;
+        }
+    }
+}
+
+void
+vpp_chroma_run(VPPChroma *chroma, const VPPChromaFrame *src, const VPPChromaFrame *dst)
+{
+    uint32_t x, y, i;
+
+    /* luma goes through as is */
+    for (y = 0; y < chroma->height; y++) {
+        const uint8_t *in = src->planes[0] + (size_t)y * src->pitches[0];
+        uint8_t *out = dst->planes[0] + (size_t)y * dst->pitches[0];
+
+        if (src->steps[0] == 1 && dst->steps[0] == 1) {
+            memcpy(out, in, chroma->width);
+            continue;
+        }
+        for (x = 0; x < chroma->width; x++)
+            out[(size_t)x * dst->steps[0]] = in[(size_t)x * src->steps[0]];
+    }
+
+    for (i = 1; i < 3; i++) {
+        plane_gather(src->planes[i], src->pitches[i], src->steps[i], chroma->src_plane,
+                     chroma->src_size[0], chroma->src_size[1]);
+        resample_plane(chroma);
+        plane_scatter(chroma->dst_plane, dst->planes[i], dst->pitches[i], dst->steps[i],
+                      chroma->dst_size[0], chroma->dst_size[1]);
+    }
+}
+
+void
+vpp_chroma_compare(const VPPChromaFrame *a, const VPPChromaFrame *b,
+                   double sq_err[3], uint64_t samples[3])
+{
+    uint32_t width, height, x, y, i;
+    uint64_t sum;
+    int32_t d;
+
+    for (i = 0; i < 3; i++) {
+        width = a->width;
+        height = a->height;
+        if (i) {
+            width = (width + chroma_factor(a->subsampling, 0) - 1) /
+                    chroma_factor(a->subsampling, 0);
+            height = (height + chroma_factor(a->subsampling, 1) - 1) /
+                     chroma_factor(a->subsampling, 1);
+        }
+
+        sum = 0;
+        for (y = 0; y < height; y++) {
+            const uint8_t *pa = a->planes[i] + (size_t)y * a->pitches[i];
+            const uint8_t *pb = b->planes[i] + (size_t)y * b->pitches[i];
+
+            for (x = 0; x < width; x++) {
+                d = pa[(size_t)x * a->steps[i]] - pb[(size_t)x * b->steps[i]];
+                sum += d * d;
+            }
+        }
+        sq_err[i] += sum;
+        samples[i] += (uint64_t)width * height;
+    }
+}
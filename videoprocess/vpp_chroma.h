@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL INTEL AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef VPP_CHROMA_H
+#define VPP_CHROMA_H
+
+#include <stdint.h>
+
+/*
+ * CPU reference chroma resampler for vppchromasitting.
+ *
+ * Converts the chroma of 8 bit YUV frames between 4:2:0, 4:2:2 and 4:4:4
+ * for any pair of VA_CHROMA_SITING_* locations; luma is copied. Chroma
+ * sample positions are taken in luma samples: horizontally left or center,
+ * vertically top, center or bottom of the luma samples they cover. Unknown
+ * siting is left / center, the MPEG-2 default. Each output sample
+ * interpolates the input samples linearly by distance, the triangle is as
+ * wide as the coarser of the two grids, so scaling down averages (1 2 1 or
+ * 1 3 3 1) and a siting change on the same grid is a half sample shift.
+ *
+ * Like vpp_scale, every chroma plane is gathered into floats, goes through
+ * a horizontal pass and a vertical pass of at most 4 taps and is stored
+ * back with rounding; the inner loops work on float vectors of the compiler
+ * vector extension.
+ */
+
+enum {
+    VPP_CHROMA_420 = 0,
+    VPP_CHROMA_422 = 1,
+    VPP_CHROMA_444 = 2,
+};
+
+/* Y, U and V of a frame: first sample, bytes per row and bytes from one
+ * sample to the next (2 for NV12 chroma, 4 for YUY2 chroma) */
+typedef struct _VPPChromaFrame {
+    uint32_t width;
+    uint32_t height;
+    int subsampling;
+    uint8_t siting;
+    uint8_t *planes[3];
+    uint32_t pitches[3];
+    uint32_t steps[3];
+} VPPChromaFrame;
+
+typedef struct _VPPChroma VPPChroma;
+
+/* VPP_CHROMA_* of NV12, I420, YV12, YUY2, UYVY, 422H and 444P, -1 for
+ * other formats */
+int
+vpp_chroma_subsampling(uint32_t fourcc);
+
+/* Describe a <fourcc> frame at <data> with the plane <offsets> and <pitches>
+ * of a VAImage. Returns -1 for formats vpp_chroma_subsampling rejects */
+int
+vpp_chroma_frame(VPPChromaFrame *frame, uint32_t fourcc, uint32_t width, uint32_t height,
+                 uint8_t siting, uint8_t *data, const uint32_t offsets[3],
+                 const uint32_t pitches[3]);
+
+/* Resampler for <width> x <height> frames, NULL if out of memory */
+VPPChroma *
+vpp_chroma_create(uint32_t width, uint32_t height, int src_subsampling, uint8_t src_siting,
+                  int dst_subsampling, uint8_t dst_siting);
+
+void
+vpp_chroma_destroy(VPPChroma *chroma);
+
+/* Resample <src> into <dst>, both in the size, subsampling and siting of
+ * the resampler */
+void
+vpp_chroma_run(VPPChroma *chroma, const VPPChromaFrame *src, const VPPChromaFrame *dst);
+
+/* Add the squared differences of Y, U and V of two frames with the same
+ * size and subsampling to <sq_err> and their sample counts to <samples> */
+void
+vpp_chroma_compare(const VPPChromaFrame *a, const VPPChromaFrame *b,
+                   double sq_err[3], uint64_t samples[3]);
+
+#endif /* VPP_CHROMA_H */
@@ -0,0 +1,413 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL INTEL AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vpp_config.h"
+
+typedef struct _VPPConfigKeyFrame {
+    uint32_t frame;
+    float value;
+} VPPConfigKeyFrame;
+
+typedef struct _VPPConfigEntry {
+    char *name;
+    char *value;
+    uint32_t line;
+
+    /* per frame schedule, sorted by frame */
+    VPPConfigKeyFrame *key_frames;
+    uint32_t num_key_frames;
+} VPPConfigEntry;
+
+struct _VPPConfig {
+    VPPConfigEntry *entries;    /* sorted by name, then line */
+    uint32_t num_entries;
+};
+
+static char *
+trim(char *str)
+{
+    char *end;
+
+    while (*str == ' ' || *str == '\t')
+        str++;
+
+    end = str + strlen(str);
+    while (end > str && (end[-1] == ' ' || end[-1] == '\t' ||
+                         end[-1] == '\n' || end[-1] == '\r'))
+        end--;
+    *end = '\0';
+
+    return str;
+}
+
+static int
+compare_entries(const void *a, const void *b)
+{
+    const VPPConfigEntry *ea = (const VPPConfigEntry *)a;
+    const VPPConfigEntry *eb = (const VPPConfigEntry *)b;
+    int ret = strcmp(ea->name, eb->name);
+
+    if (ret)
+        return ret;
+    return ea->line < eb->line ? -1 : (ea->line > eb->line);
+}
+
+static int
+compare_key_frames(const void *a, const void *b)
+{
+    const VPPConfigKeyFrame *ka = (const VPPConfigKeyFrame *)a;
+    const VPPConfigKeyFrame *kb = (const VPPConfigKeyFrame *)b;
+
+    return ka->frame < kb->frame ? -1 : (ka->frame > kb->frame);
+}
+
+/* Parse "value@frame[, value@frame ...]", leaves <entry> unscheduled if
+ * <entry>->value is anything else */
+static void
+parse_schedule(VPPConfigEntry *entry)
+{
+    VPPConfigKeyFrame *key_frames;
+    uint32_t count = 1, n = 0;
+    const char *p;
+    char *end;
+
+    if (!strchr(entry->value, '@'))
+        return;
+
+    for (p = entry->value; *p; p++)
+        if (*p == ',')
+            count++;
+
+    key_frames = (VPPConfigKeyFrame *)calloc(count, sizeof(VPPConfigKeyFrame));
+    if (!key_frames)
+        return;
+
+    p = entry->value;
+    while (n < count) {
+        key_frames[n].value = strtof(p, &end);
+        if (end == p || *end != '@')
+            break;
+        p = end + 1;
+        key_frames[n].frame = (uint32_t)strtoul(p, &end, 10);
+        if (end == p)
+            break;
+        n++;
+
+        while (*end == ' ' || *end == '\t')
+            end++;
+        if (*end != ',')
+            break;
+        p = end + 1;
+    }
+
+    if (n != count || *end != '\0') {
+        printf("Invalid schedule for field %s: %s\n", entry->name, entry->value);
+        free(key_frames);
+        return;
+    }
+
+    qsort(key_frames, count, sizeof(VPPConfigKeyFrame), compare_key_frames);
+    entry->key_frames = key_frames;
+    entry->num_key_frames = count;
+}
+
+VPPConfig *
+vpp_config_open(const char *file_name)
+{
+    char line[VPP_CONFIG_MAX_LEN];
+    VPPConfig *config;
+    VPPConfigEntry *entries = NULL, *entry;
+    uint32_t capacity = 0, line_number = 0;
+    char *name, *value, *colon;
+    FILE *fp;
+
+    if (!file_name || !(fp = fopen(file_name, "r")))
+        return NULL;
+
+    config = (VPPConfig *)calloc(1, sizeof(VPPConfig));
+    if (!config) {
+        fclose(fp);
+        return NULL;
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+        line_number++;
+
+        name = trim(line);
+        if (*name == '\0' || *name == '#')
+            continue;
+
+        if (!(colon = strchr(name, ':')))
+            continue;
+        *colon = '\0';
+        name = trim(name);
+        value = trim(colon + 1);
+        if (*name == '\0' || *value == '\0')
+            continue;
+
+        if (config->num_entries == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            entries = (VPPConfigEntry *)realloc(config->entries,
+                                                capacity * sizeof(VPPConfigEntry));
+            if (!entries)
+                break;
+            config->entries = entries;
+        }
+
+        entry = &config->entries[config->num_entries];
+        memset(entry, 0, sizeof(*entry));
+        entry->name = strdup(name);
+        entry->value = strdup(value);
+        entry->line = line_number;
+        if (!entry->name || !entry->value) {
+            free(entry->name);
+            free(entry->value);
+            break;
+        }
+        parse_schedule(entry);
+        config->num_entries++;
+    }
+    fclose(fp);
+
+    if (config->num_entries)
+        qsort(config->entries, config->num_entries, sizeof(VPPConfigEntry),
+              compare_entries);
+
+    return config;
+}
+
+void
+vpp_config_close(VPPConfig *config)
+{
+    uint32_t i;
+
+    if (!config)
+        return;
+
+    for (i = 0; i < config->num_entries; i++) {
+        free(config->entries[i].name);
+        free(config->entries[i].value);
+        free(config->entries[i].key_frames);
+    }
+    free(config->entries);
+    free(config);
+}
+
+/* The line named <field_name>, or else the first line whose name starts
+ * with <field_name> */
+static const VPPConfigEntry *
+config_find(const VPPConfig *config, const char *field_name)
+{
+    const VPPConfigEntry *found = NULL;
+    size_t len = strlen(field_name);
+    uint32_t lo = 0, hi, i;
+
+    if (!config)
+        return NULL;
+
+    hi = config->num_entries;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (strcmp(config->entries[mid].name, field_name) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    for (i = lo; i < config->num_entries; i++) {
+        const VPPConfigEntry *entry = &config->entries[i];
+
+        if (strncmp(entry->name, field_name, len))
+            break;
+        if (entry->name[len] == '\0')
+            return entry;
+        if (!found || entry->line < found->line)
+            found = entry;
+    }
+
+    return found;
+}
+
+int8_t
+vpp_config_get_string(const VPPConfig *config, const char *field_name, char *value)
+{
+    const VPPConfigEntry *entry;
+    size_t len;
+
+    if (!field_name || !value) {
+        printf("Invalid fuction parameters\n");
+        return -1;
+    }
+
+    if (!(entry = config_find(config, field_name)))
+        return -1;
+
+    /* no strncpy(), callers pass buffers smaller than VPP_CONFIG_MAX_LEN
+     * and must not see them padded */
+    len = strlen(entry->value);
+    if (len > VPP_CONFIG_MAX_LEN - 1)
+        len = VPP_CONFIG_MAX_LEN - 1;
+    memcpy(value, entry->value, len);
+    value[len] = '\0';
+
+    return 0;
+}
+
+static int8_t
+config_get_integer(const VPPConfig *config, const char *field_name, long *value)
+{
+    const VPPConfigEntry *entry = config_find(config, field_name);
+
+    if (!entry) {
+        printf("Failed to find integer field: %s\n", field_name);
+        return -1;
+    }
+
+    *value = atol(entry->value);
+    return 0;
+}
+
+int8_t
+vpp_config_get_uint8(const VPPConfig *config, const char *field_name, uint8_t *value)
+{
+    long v;
+
+    if (config_get_integer(config, field_name, &v))
+        return -1;
+
+    *value = (uint8_t)v;
+    return 0;
+}
+
+int8_t
+vpp_config_get_int16(const VPPConfig *config, const char *field_name, int16_t *value)
+{
+    long v;
+
+    if (config_get_integer(config, field_name, &v))
+        return -1;
+
+    *value = (int16_t)v;
+    return 0;
+}
+
+int8_t
+vpp_config_get_uint16(const VPPConfig *config, const char *field_name, uint16_t *value)
+{
+    long v;
+
+    if (config_get_integer(config, field_name, &v))
+        return -1;
+
+    *value = (uint16_t)v;
+    return 0;
+}
+
+int8_t
+vpp_config_get_uint32(const VPPConfig *config, const char *field_name, uint32_t *value)
+{
+    long v;
+
+    if (config_get_integer(config, field_name, &v))
+        return -1;
+
+    *value = (uint32_t)v;
+    return 0;
+}
+
+int8_t
+vpp_config_get_float(const VPPConfig *config, const char *field_name, float *value)
+{
+    return vpp_config_get_float_at(config, field_name, 0, value);
+}
+
+int8_t
+vpp_config_get_float_at(const VPPConfig *config, const char *field_name,
+                        uint32_t frame, float *value)
+{
+    const VPPConfigEntry *entry = config_find(config, field_name);
+    const VPPConfigKeyFrame *k;
+    uint32_t i;
+
+    if (!entry) {
+        printf("Failed to find float field: %s \n", field_name);
+        return -1;
+    }
+
+    if (!entry->num_key_frames) {
+        *value = atof(entry->value);
+        return 0;
+    }
+
+    k = entry->key_frames;
+    if (frame <= k[0].frame) {
+        *value = k[0].value;
+        return 0;
+    }
+
+    for (i = 1; i < entry->num_key_frames; i++) {
+        if (frame < k[i].frame) {
+            float t = (float)(frame - k[i - 1].frame) / (k[i].frame - k[i - 1].frame);
+
+            *value = k[i - 1].value + t * (k[i].value - k[i - 1].value);
+            return 0;
+        }
+    }
+
+    *value = k[entry->num_key_frames - 1].value;
+    return 0;
+}
+
+int8_t
+vpp_config_is_scheduled(const VPPConfig *config, const char *field_name)
+{
+    const VPPConfigEntry *entry = config_find(config, field_name);
+
+    return entry && entry->num_key_frames;
+}
+
+int8_t
+vpp_config_has_value(const VPPConfig *config, const char *field_prefix,
+                     const char *value)
+{
+    size_t len = strlen(field_prefix);
+    uint32_t i;
+
+    if (!config)
+        return 0;
+
+    for (i = 0; i < config->num_entries; i++) {
+        const VPPConfigEntry *entry = &config->entries[i];
+
+        if (!strncmp(entry->name, field_prefix, len) && !strcmp(entry->value, value))
+            return 1;
+    }
+
+    return 0;
+}
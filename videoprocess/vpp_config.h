@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL INTEL AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef VPP_CONFIG_H
+#define VPP_CONFIG_H
+
+#include <stdint.h>
+
+/*
+ * Configuration file shared by the video process samples.
+ *
+ * The file is read once into a table of "FIELD: value" lines indexed by
+ * field name; '#' starts a comment line. A field matches the first line
+ * whose name equals it or, failing that, starts with it. String values are
+ * at most VPP_CONFIG_MAX_LEN bytes including the terminator.
+ *
+ * Float fields may hold a per frame schedule instead of a single value: a
+ * list of value@frame key frames, e.g. "SHARPENING_INTENSITY: 0@0, 64@100".
+ * The value is interpolated linearly between key frames and held before the
+ * first and after the last one.
+ *
+ * All getters return 0 on success and -1 when the field is missing.
+ */
+
+#define VPP_CONFIG_MAX_LEN 1024
+
+typedef struct _VPPConfig VPPConfig;
+
+/* Returns NULL if the file can not be read */
+VPPConfig *
+vpp_config_open(const char *file_name);
+
+void
+vpp_config_close(VPPConfig *config);
+
+int8_t
+vpp_config_get_string(const VPPConfig *config, const char *field_name, char *value);
+
+int8_t
+vpp_config_get_uint8(const VPPConfig *config, const char *field_name, uint8_t *value);
+
+int8_t
+vpp_config_get_int16(const VPPConfig *config, const char *field_name, int16_t *value);
+
+int8_t
+vpp_config_get_uint16(const VPPConfig *config, const char *field_name, uint16_t *value);
+
+int8_t
+vpp_config_get_uint32(const VPPConfig *config, const char *field_name, uint32_t *value);
+
+/* A scheduled field returns its value at frame 0 */
+int8_t
+vpp_config_get_float(const VPPConfig *config, const char *field_name, float *value);
+
+int8_t
+vpp_config_get_float_at(const VPPConfig *config, const char *field_name,
+                        uint32_t frame, float *value);
+
+/* Returns 1 if the field holds a per frame schedule */
+int8_t
+vpp_config_is_scheduled(const VPPConfig *config, const char *field_name);
+
+/* Returns 1 if any field whose name starts with <field_prefix> holds
+ * exactly <value>, e.g. a "-" in one of DST_FILE_NAME_1..N */
+int8_t
+vpp_config_has_value(const VPPConfig *config, const char *field_prefix,
+                     const char *value);
+
+#endif /* VPP_CONFIG_H */
@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL INTEL AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "vpp_contexts.h"
+
+/*
+ * The children talk to the parent through two pipes. Each child sends a
+ * ready message once set up and a done message with its frames and time
+ * when finished. The parent starts all children by writing one byte per
+ * child to the start pipe, or aborts them by closing it without writing.
+ */
+typedef struct _ContextMessage {
+    uint32_t index;
+    int32_t frames;             /* CONTEXT_READY, or the result of run */
+    double time;                /* ms from the common start to done */
+} ContextMessage;
+
+#define CONTEXT_READY -2
+
+/* set in the children only */
+static int g_message_fd = -1;
+static int g_start_fd = -1;
+static uint32_t g_index = 0;
+static double g_start_time = 0;
+
+static double
+time_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int
+message_send(int32_t frames, double time)
+{
+    ContextMessage message;
+
+    message.index = g_index;
+    message.frames = frames;
+    message.time = time;
+
+    /* smaller than PIPE_BUF, so the messages of the children do not mix */
+    return write(g_message_fd, &message, sizeof(message)) == sizeof(message) ? 0 : -1;
+}
+
+int
+vpp_contexts_parse_args(int *argc, char **argv)
+{
+    int count = 1;
+    int i, j;
+
+    for (i = 1; i < *argc; i++) {
+        if (strcmp(argv[i], "--contexts"))
+            continue;
+
+        if (i + 1 == *argc)
+            return -1;
+        count = atoi(argv[i + 1]);
+        if (count < 1 || count > VPP_CONTEXTS_MAX)
+            return -1;
+
+        for (j = i; j + 2 < *argc; j++)
+            argv[j] = argv[j + 2];
+        *argc -= 2;
+        argv[*argc] = NULL;
+        break;
+    }
+
+    return count;
+}
+
+void
+vpp_contexts_ready()
+{
+    char start;
+
+    if (g_message_fd < 0)
+        return;
+
+    /* a closed start pipe means another context failed its setup */
+    if (message_send(CONTEXT_READY, 0) || read(g_start_fd, &start, 1) != 1)
+        _exit(1);
+
+    g_start_time = time_ms();
+}
+
+static void
+context_child(uint32_t index, uint32_t count, uint32_t frame_count,
+              int32_t (*run)(const VPPContextRange *range))
+{
+    VPPContextRange range;
+    int32_t frames;
+
+    range.index = index;
+    range.count = count;
+    range.first_frame = (uint64_t)frame_count * index / count;
+    range.frame_count = (uint64_t)frame_count * (index + 1) / count - range.first_frame;
+
+    frames = run(&range);
+    message_send(frames, time_ms() - g_start_time);
+    fflush(stdout);
+    _exit(frames < 0 ? 1 : 0);
+}
+
+/* Wait for <count> ready messages. Returns -1 once a child exits before */
+static int
+contexts_wait_ready(int fd, uint32_t count)
+{
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    ContextMessage message;
+    uint32_t ready = 0;
+    int status;
+
+    while (ready < count) {
+        if (poll(&pfd, 1, 100) > 0) {
+            if (read(fd, &message, sizeof(message)) != sizeof(message) ||
+                message.frames != CONTEXT_READY)
+                return -1;
+            ready++;
+        } else if (waitpid(-1, &status, WNOHANG) > 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int
+vpp_contexts_run(uint32_t count, uint32_t frame_count,
+                 int32_t (*run)(const VPPContextRange *range))
+{
+    ContextMessage results[VPP_CONTEXTS_MAX];
+    ContextMessage message;
+    pid_t pids[VPP_CONTEXTS_MAX];
+    int message_pipe[2], start_pipe[2];
+    uint32_t i, done = 0, started = 0;
+    int32_t total = 0;
+    double start_time, duration;
+    int ret = 0, status;
+    char start = 1;
+
+    if (count <= 1) {
+        VPPContextRange range = { 0, 1, 0, frame_count };
+
+        return run(&range) < 0 ? -1 : 0;
+    }
+
+    if (count > VPP_CONTEXTS_MAX || frame_count < count) {
+        printf("%d contexts need at least as many input frames and at most %d contexts, "
+               "got %d frames\n", count, VPP_CONTEXTS_MAX, frame_count);
+        return -1;
+    }
+
+    if (pipe(message_pipe)) {
+        printf("Failed to create the context pipes\n");
+        return -1;
+    }
+    if (pipe(start_pipe)) {
+        printf("Failed to create the context pipes\n");
+        close(message_pipe[0]);
+        close(message_pipe[1]);
+        return -1;
+    }
+
+    /* the children inherit the stdio buffers */
+    fflush(stdout);
+
+    for (i = 0; i < count; i++) {
+        pids[i] = fork();
+        if (pids[i] < 0) {
+            printf("Failed to start context %d\n", i);
+            ret = -1;
+            break;
+        }
+        if (!pids[i]) {
+            close(message_pipe[0]);
+            close(start_pipe[1]);
+            g_message_fd = message_pipe[1];
+            g_start_fd = start_pipe[0];
+            g_index = i;
+            context_child(i, count, frame_count, run);
+        }
+        started++;
+    }
+    close(message_pipe[1]);
+    close(start_pipe[0]);
+
+    if (!ret && contexts_wait_ready(message_pipe[0], count)) {
+        printf("A context failed its setup, stopping all %d contexts\n", count);
+        ret = -1;
+    }
+
+    /* every child takes one start byte, closing the pipe instead aborts them */
+    start_time = time_ms();
+    for (i = 0; !ret && i < count; i++) {
+        if (write(start_pipe[1], &start, 1) != 1)
+            ret = -1;
+    }
+    close(start_pipe[1]);
+
+    while (!ret && read(message_pipe[0], &message, sizeof(message)) == sizeof(message)) {
+        if (message.index >= count || message.frames < 0) {
+            ret = -1;
+            break;
+        }
+        results[message.index] = message;
+        total += message.frames;
+        done++;
+    }
+    duration = time_ms() - start_time;
+    close(message_pipe[0]);
+
+    for (i = 0; i < started; i++) {
+        if (waitpid(pids[i], &status, 0) != pids[i] ||
+            !WIFEXITED(status) || WEXITSTATUS(status))
+            ret = -1;
+    }
+
+    if (ret || done != count) {
+        printf("%d of %d contexts failed\n", count - done, count);
+        return -1;
+    }
+
+    printf("\n%d contexts done: \n", count);
+    for (i = 0; i < count; i++) {
+        double time = results[i].time > 0 ? results[i].time : 1e-3;
+
+        printf("  context %d: %d frames in %.3f s, %.2f fps \n", i, results[i].frames,
+               time / 1000, results[i].frames * 1000 / time);
+    }
+    if (duration <= 0)
+        duration = 1e-3;
+    printf("Aggregate: %d frames in %.3f s, %.2f fps over %d contexts, %.2f fps per context \n",
+           total, duration / 1000, total * 1000 / duration, count,
+           total * 1000 / duration / count);
+
+    return 0;
+}
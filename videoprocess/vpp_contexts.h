@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL INTEL AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef VPP_CONTEXTS_H
+#define VPP_CONTEXTS_H
+
+#include <stdint.h>
+
+/*
+ * Multi context throughput mode shared by the video process samples.
+ *
+ * "--contexts N" runs N independent copies of a sample, each with its own
+ * VA display, context and surface ring, over disjoint frame ranges of the
+ * input. The samples keep their state in globals, so every context is a
+ * child process of its own. Each context signals once its setup is done and
+ * all of them start processing together; the aggregate rate is the frames
+ * of all contexts over the wall time from that common start to the last
+ * context done, i.e. how many concurrent VPP streams the node sustains.
+ */
+
+#define VPP_CONTEXTS_MAX 64
+
+typedef struct _VPPContextRange {
+    uint32_t index;             /* context, 0 .. count - 1 */
+    uint32_t count;             /* contexts running */
+    uint32_t first_frame;       /* first input frame of the context */
+    uint32_t frame_count;       /* input frames of the context */
+} VPPContextRange;
+
+/* Take "--contexts N" out of <argc>/<argv>. Returns N, 1 without the option
+ * or -1 if N is not in [1, VPP_CONTEXTS_MAX] */
+int
+vpp_contexts_parse_args(int *argc, char **argv);
+
+/* Split <frame_count> input frames over <count> contexts and call <run> for
+ * each. <run> returns the frames it processed or -1, it calls
+ * vpp_contexts_ready() between its setup and the processing. A single
+ * context runs in the calling process. Returns 0 if every context succeeded */
+int
+vpp_contexts_run(uint32_t count, uint32_t frame_count,
+                 int32_t (*run)(const VPPContextRange *range));
+
+/* Report the setup of the calling context done and wait for the common
+ * start. Returns at once for a single context */
+void
+vpp_contexts_ready();
+
+#endif /* VPP_CONTEXTS_H */
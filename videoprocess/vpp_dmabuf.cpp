@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL INTEL AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/udmabuf.h>) && __has_include(<linux/dma-buf.h>)
+#include <linux/udmabuf.h>
+#include <linux/dma-buf.h>
+#define HAVE_UDMABUF 1
+#endif
+#endif
+
+#include "vpp_dmabuf.h"
+
+/* the few DRM formats the samples hand over, see drm_fourcc.h */
+#define DRM_FOURCC(a, b, c, d) VA_FOURCC(a, b, c, d)
+#define DRM_FORMAT_MOD_LINEAR 0ULL
+
+static uint32_t
+drm_format_from_fourcc(uint32_t fourcc)
+{
+    switch (fourcc) {
+    case VA_FOURCC_NV12:
+    case VA_FOURCC_P010:
+    case VA_FOURCC_YV12:
+        /* same code in both namespaces */
+        return fourcc;
+    case VA_FOURCC_I420:
+        return DRM_FOURCC('Y', 'U', '1', '2');
+    case VA_FOURCC_YUY2:
+        return DRM_FOURCC('Y', 'U', 'Y', 'V');
+    case VA_FOURCC_ARGB:
+        return DRM_FOURCC('A', 'R', '2', '4');
+    case VA_FOURCC_XRGB:
+        return DRM_FOURCC('X', 'R', '2', '4');
+    default:
+        return 0;
+    }
+}
+
+int
+vpp_dmabuf_alloc(size_t size, VPPDmaBuf *buf)
+{
+#ifdef HAVE_UDMABUF
+    struct udmabuf_create create;
+    long page_size = sysconf(_SC_PAGESIZE);
+    int dev;
+
+    buf->fd = buf->memfd = -1;
+    buf->ptr = NULL;
+    buf->size = (size + page_size - 1) / page_size * page_size;
+
+    dev = open("/dev/udmabuf", O_RDWR | O_CLOEXEC);
+    if (dev < 0) {
+        printf("Open /dev/udmabuf failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    /* udmabuf only accepts memfds that can not shrink */
+    buf->memfd = memfd_create("vpp-dmabuf", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (buf->memfd < 0 ||
+        ftruncate(buf->memfd, buf->size) ||
+        fcntl(buf->memfd, F_ADD_SEALS, F_SEAL_SHRINK)) {
+        printf("Create memfd of %zu bytes failed: %s\n", buf->size, strerror(errno));
+        goto fail;
+    }
+
+    memset(&create, 0, sizeof(create));
+    create.memfd = buf->memfd;
+    create.flags = UDMABUF_FLAGS_CLOEXEC;
+    create.offset = 0;
+    create.size = buf->size;
+    buf->fd = ioctl(dev, UDMABUF_CREATE, &create);
+    if (buf->fd < 0) {
+        printf("UDMABUF_CREATE failed: %s\n", strerror(errno));
+        goto fail;
+    }
+
+    buf->ptr = (uint8_t *)mmap(NULL, buf->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                               buf->memfd, 0);
+    if (buf->ptr == MAP_FAILED) {
+        buf->ptr = NULL;
+        printf("Map memfd failed: %s\n", strerror(errno));
+        goto fail;
+    }
+
+    close(dev);
+    return 0;
+
+fail:
+    close(dev);
+    vpp_dmabuf_free(buf);
+    return -1;
+#else
+    printf("DMA-BUF allocation needs Linux udmabuf support\n");
+    return -1;
+#endif
+}
+
+void
+vpp_dmabuf_free(VPPDmaBuf *buf)
+{
+    if (buf->ptr)
+        munmap(buf->ptr, buf->size);
+    if (buf->fd >= 0)
+        close(buf->fd);
+    if (buf->memfd >= 0)
+        close(buf->memfd);
+
+    buf->ptr = NULL;
+    buf->fd = buf->memfd = -1;
+    buf->size = 0;
+}
+
+#ifdef HAVE_UDMABUF
+static int
+dmabuf_sync(const VPPDmaBuf *buf, uint64_t flags)
+{
+    struct dma_buf_sync sync;
+    int ret;
+
+    sync.flags = flags;
+    do {
+        ret = ioctl(buf->fd, DMA_BUF_IOCTL_SYNC, &sync);
+    } while (ret && (errno == EINTR || errno == EAGAIN));
+
+    return ret;
+}
+#endif
+
+int
+vpp_dmabuf_begin_cpu_access(const VPPDmaBuf *buf, int write)
+{
+#ifdef HAVE_UDMABUF
+    return dmabuf_sync(buf, DMA_BUF_SYNC_START |
+                       (write ? DMA_BUF_SYNC_WRITE : DMA_BUF_SYNC_READ));
+#else
+    return 0;
+#endif
+}
+
+int
+vpp_dmabuf_end_cpu_access(const VPPDmaBuf *buf, int write)
+{
+#ifdef HAVE_UDMABUF
+    return dmabuf_sync(buf, DMA_BUF_SYNC_END |
+                       (write ? DMA_BUF_SYNC_WRITE : DMA_BUF_SYNC_READ));
+#else
+    return 0;
+#endif
+}
+
+VAStatus
+vpp_dmabuf_create_surface(VADisplay dpy, const VPPDmaBuf *buf, uint32_t rt_format,
+                          const VASurfaceAttribExternalBuffers *layout,
+                          VASurfaceID *surface)
+{
+    VADRMPRIMESurfaceDescriptor desc;
+    VASurfaceAttrib attribs[2];
+    uint32_t i;
+
+    memset(&desc, 0, sizeof(desc));
+    desc.fourcc = layout->pixel_format;
+    desc.width = layout->width;
+    desc.height = layout->height;
+    desc.num_objects = 1;
+    desc.objects[0].fd = buf->fd;
+    desc.objects[0].size = buf->size;
+    desc.objects[0].drm_format_modifier = DRM_FORMAT_MOD_LINEAR;
+
+    desc.num_layers = 1;
+    desc.layers[0].drm_format = drm_format_from_fourcc(layout->pixel_format);
+    desc.layers[0].num_planes = layout->num_planes;
+    for (i = 0; i < layout->num_planes; i++) {
+        desc.layers[0].object_index[i] = 0;
+        desc.layers[0].offset[i] = layout->offsets[i];
+        desc.layers[0].pitch[i] = layout->pitches[i];
+    }
+
+    if (!desc.layers[0].drm_format) {
+        printf("Fourcc 0x%08x can not be imported as DMA-BUF\n", layout->pixel_format);
+        return VA_STATUS_ERROR_UNSUPPORTED_RT_FORMAT;
+    }
+
+    attribs[0].type = VASurfaceAttribMemoryType;
+    attribs[0].flags = VA_SURFACE_ATTRIB_SETTABLE;
+    attribs[0].value.type = VAGenericValueTypeInteger;
+    attribs[0].value.value.i = VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2;
+
+    attribs[1].type = VASurfaceAttribExternalBufferDescriptor;
+    attribs[1].flags = VA_SURFACE_ATTRIB_SETTABLE;
+    attribs[1].value.type = VAGenericValueTypePointer;
+    attribs[1].value.value.p = &desc;
+
+    return vaCreateSurfaces(dpy, rt_format, layout->width, layout->height,
+                            surface, 1, attribs, 2);
+}
+
+VAStatus
+vpp_dmabuf_export_surface(VADisplay dpy, VASurfaceID surface, VPPDmaBuf *buf,
+                          VADRMPRIMESurfaceDescriptor *desc)
+{
+    VAStatus va_status;
+    uint32_t i;
+
+    buf->fd = buf->memfd = -1;
+    buf->ptr = NULL;
+    buf->size = 0;
+
+    va_status = vaExportSurfaceHandle(dpy, surface, VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2,
+                                      VA_EXPORT_SURFACE_READ_ONLY |
+                                      VA_EXPORT_SURFACE_COMPOSED_LAYERS,
+                                      desc);
+    if (va_status != VA_STATUS_SUCCESS)
+        return va_status;
+
+    /* keep the first object, a single linear object is all the CPU path
+     * can read */
+    for (i = 1; i < desc->num_objects; i++)
+        close(desc->objects[i].fd);
+
+    buf->fd = desc->objects[0].fd;
+    buf->size = desc->objects[0].size;
+    if (desc->num_objects != 1 ||
+        desc->objects[0].drm_format_modifier != DRM_FORMAT_MOD_LINEAR) {
+        vpp_dmabuf_free(buf);
+        return VA_STATUS_ERROR_UNSUPPORTED_MEMORY_TYPE;
+    }
+
+    buf->ptr = (uint8_t *)mmap(NULL, buf->size, PROT_READ, MAP_SHARED, buf->fd, 0);
+    if (buf->ptr == MAP_FAILED) {
+        buf->ptr = NULL;
+        vpp_dmabuf_free(buf);
+        return VA_STATUS_ERROR_UNSUPPORTED_MEMORY_TYPE;
+    }
+
+    return VA_STATUS_SUCCESS;
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL INTEL AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef VPP_DMABUF_H
+#define VPP_DMABUF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <va/va.h>
+#include <va/va_drmcommon.h>
+
+/*
+ * DMA-BUF helpers shared by the video process samples.
+ *
+ * Imported buffers are memfd memory turned into a dma-buf by /dev/udmabuf,
+ * so the import path works on any Linux system with the udmabuf module and
+ * does not need a GPU allocator. Exported buffers come from
+ * vaExportSurfaceHandle(); they can only be mapped for CPU access when the
+ * driver reports a linear layout.
+ */
+
+typedef struct _VPPDmaBuf {
+    int fd;             /* dma-buf file descriptor */
+    int memfd;          /* backing memfd, -1 for exported buffers */
+    uint8_t *ptr;       /* CPU mapping of the whole buffer, or NULL */
+    size_t size;
+} VPPDmaBuf;
+
+/* Returns 0 on success, -1 if udmabuf is not available */
+int
+vpp_dmabuf_alloc(size_t size, VPPDmaBuf *buf);
+
+void
+vpp_dmabuf_free(VPPDmaBuf *buf);
+
+/* Bracket CPU access to the mapping, <write> selects the access direction */
+int
+vpp_dmabuf_begin_cpu_access(const VPPDmaBuf *buf, int write);
+
+int
+vpp_dmabuf_end_cpu_access(const VPPDmaBuf *buf, int write);
+
+/* Import <buf> as a DRM_PRIME_2 surface. <layout> gives the fourcc, size
+ * and the pitches/offsets of the planes inside <buf> */
+VAStatus
+vpp_dmabuf_create_surface(VADisplay dpy, const VPPDmaBuf *buf, uint32_t rt_format,
+                          const VASurfaceAttribExternalBuffers *layout,
+                          VASurfaceID *surface);
+
+/* Export <surface> as a single composed layer and map it for reading.
+ * Returns VA_STATUS_ERROR_UNSUPPORTED_MEMORY_TYPE for a layout the CPU can
+ * not read linearly, <buf> is left unused then */
+VAStatus
+vpp_dmabuf_export_surface(VADisplay dpy, VASurfaceID surface, VPPDmaBuf *buf,
+                          VADRMPRIMESurfaceDescriptor *desc);
+
+#endif /* VPP_DMABUF_H */
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL INTEL AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "vpp_file_input.h"
+
+/* O_DIRECT transfers must be multiples of the device block size, 512 is
+ * the smallest one in use; a device with larger blocks fails the first
+ * read with EINVAL and the input falls back to READ */
+#define DIRECT_IO_ALIGN 512
+
+size_t
+vpp_file_input_frame_size(uint32_t fourcc, uint32_t width, uint32_t height)
+{
+    size_t luma = (size_t)width * height;
+
+    switch (fourcc) {
+    case VA_FOURCC_NV12:
+    case VA_FOURCC_YV12:
+    case VA_FOURCC_I420:
+        return luma * 3 / 2;
+    case VA_FOURCC_YUY2:
+        return luma * 2;
+    case VA_FOURCC_RGBP:
+        return luma * 3;
+    case VA_FOURCC_ARGB:
+        return luma * 4;
+    default:
+        return 0;
+    }
+}
+
+int
+vpp_file_input_layout_matches(const VASurfaceAttribExternalBuffers *layout)
+{
+    uint32_t w = layout->width, h = layout->height;
+
+    switch (layout->pixel_format) {
+    case VA_FOURCC_NV12:
+        return layout->pitches[0] == w && layout->pitches[1] == w &&
+               layout->offsets[0] == 0 && layout->offsets[1] == w * h;
+    case VA_FOURCC_YV12:
+    case VA_FOURCC_I420:
+        return layout->pitches[0] == w && layout->pitches[1] == w / 2 &&
+               layout->pitches[2] == w / 2 && layout->offsets[0] == 0 &&
+               layout->offsets[1] == w * h &&
+               layout->offsets[2] == w * h + w * h / 4;
+    case VA_FOURCC_YUY2:
+        return layout->pitches[0] == w * 2 && layout->offsets[0] == 0;
+    case VA_FOURCC_ARGB:
+        return layout->pitches[0] == w * 4 && layout->offsets[0] == 0;
+    case VA_FOURCC_RGBP:
+        return layout->pitches[0] == w && layout->pitches[1] == w &&
+               layout->pitches[2] == w && layout->offsets[0] == 0 &&
+               layout->offsets[1] == w * h && layout->offsets[2] == 2 * w * h;
+    default:
+        return 0;
+    }
+}
+
+int
+vpp_file_input_open(const char *file_name, size_t frame_size, int allow_mmap,
+                    VPPFileInput *input)
+{
+    long page_size = sysconf(_SC_PAGESIZE);
+    struct stat st;
+
+    memset(input, 0, sizeof(*input));
+    input->fd = -1;
+    input->frame_size = frame_size;
+
+    if (!frame_size)
+        return -1;
+
+    input->fd = open(file_name, O_RDONLY | O_CLOEXEC);
+    if (input->fd < 0 || fstat(input->fd, &st)) {
+        printf("Open %s failed: %s\n", file_name, strerror(errno));
+        vpp_file_input_close(input);
+        return -1;
+    }
+    input->file_size = st.st_size;
+
+    if (allow_mmap && !(frame_size % page_size) && input->file_size >= frame_size) {
+        /* writable and private: drivers pin user pointers for write, the
+         * pages are copied on write and the file stays untouched */
+        void *map = mmap(NULL, input->file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                         input->fd, 0);
+
+        if (map != MAP_FAILED) {
+            madvise(map, input->file_size, MADV_SEQUENTIAL);
+            input->map = (uint8_t *)map;
+            input->mode = VPP_FILE_INPUT_MMAP;
+            return 0;
+        }
+    }
+
+#ifdef O_DIRECT
+    if (!(frame_size % DIRECT_IO_ALIGN)) {
+        int fd = open(file_name, O_RDONLY | O_CLOEXEC | O_DIRECT);
+
+        /* tmpfs and some network file systems refuse O_DIRECT */
+        if (fd >= 0) {
+            close(input->fd);
+            input->fd = fd;
+            input->mode = VPP_FILE_INPUT_DIRECT;
+            return 0;
+        }
+    }
+#endif
+
+    input->mode = VPP_FILE_INPUT_READ;
+    posix_fadvise(input->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return 0;
+}
+
+void
+vpp_file_input_close(VPPFileInput *input)
+{
+    if (input->map)
+        munmap(input->map, input->file_size);
+    if (input->fd >= 0)
+        close(input->fd);
+
+    input->map = NULL;
+    input->fd = -1;
+}
+
+uint8_t *
+vpp_file_input_frame(const VPPFileInput *input, uint32_t frame)
+{
+    size_t offset = (size_t)frame * input->frame_size;
+
+    if (!input->map || offset + input->frame_size > input->file_size)
+        return NULL;
+
+    return input->map + offset;
+}
+
+static int
+read_full(int fd, uint8_t *dst, size_t size, off_t offset)
+{
+    while (size) {
+        ssize_t n = pread(fd, dst, size, offset);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return n < 0 ? -errno : -1;
+
+        dst += n;
+        offset += n;
+        size -= n;
+    }
+
+    return 0;
+}
+
+int
+vpp_file_input_read(VPPFileInput *input, uint32_t frame, uint8_t *dst)
+{
+    off_t offset = (off_t)frame * input->frame_size;
+    int ret;
+
+    if (input->map || (size_t)offset + input->frame_size > input->file_size)
+        return -1;
+
+    ret = read_full(input->fd, dst, input->frame_size, offset);
+    if (ret == -EINVAL && input->mode == VPP_FILE_INPUT_DIRECT) {
+        /* block size larger than DIRECT_IO_ALIGN, continue buffered */
+        int flags = fcntl(input->fd, F_GETFL);
+
+        if (flags < 0 || fcntl(input->fd, F_SETFL, flags & ~O_DIRECT))
+            return -1;
+        input->mode = VPP_FILE_INPUT_READ;
+        ret = read_full(input->fd, dst, input->frame_size, offset);
+    }
+
+    return ret ? -1 : 0;
+}
+
+const char *
+vpp_file_input_mode_name(VPPFileInputMode mode)
+{
+    switch (mode) {
+    case VPP_FILE_INPUT_MMAP:
+        return "mmap";
+    case VPP_FILE_INPUT_DIRECT:
+        return "O_DIRECT";
+    default:
+        return "read";
+    }
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL INTEL AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef VPP_FILE_INPUT_H
+#define VPP_FILE_INPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <va/va.h>
+
+/*
+ * Raw frame file input for user pointer surfaces.
+ *
+ * When a user pointer surface uses the tight layout of the raw file (no
+ * pitch padding, planes back to back) a frame can reach the surface without
+ * the staging buffer and row copies of the normal upload:
+ *
+ *  - MMAP:   every frame starts on a page boundary, the private file
+ *            mapping itself is wrapped as the surface memory, no copy at
+ *            all; callers copy out of it if the driver refuses the pages
+ *  - DIRECT: the frame is read with O_DIRECT straight into the page aligned
+ *            surface memory, no page cache copy
+ *  - READ:   plain reads straight into the surface memory
+ *
+ * vpp_file_input_open() picks the first mode the file allows.
+ */
+
+typedef enum {
+    VPP_FILE_INPUT_READ = 0,
+    VPP_FILE_INPUT_DIRECT,
+    VPP_FILE_INPUT_MMAP,
+} VPPFileInputMode;
+
+typedef struct _VPPFileInput {
+    int fd;
+    VPPFileInputMode mode;
+    uint8_t *map;           /* whole file in MMAP mode */
+    size_t file_size;
+    size_t frame_size;
+} VPPFileInput;
+
+/* Size in bytes of a tightly packed <fourcc> frame, 0 if the fourcc has no
+ * packed layout here */
+size_t
+vpp_file_input_frame_size(uint32_t fourcc, uint32_t width, uint32_t height);
+
+/* Returns 1 if <layout> places the planes exactly like a packed frame */
+int
+vpp_file_input_layout_matches(const VASurfaceAttribExternalBuffers *layout);
+
+/* <allow_mmap> 0 limits the choice to DIRECT and READ. Returns 0 on
+ * success */
+int
+vpp_file_input_open(const char *file_name, size_t frame_size, int allow_mmap,
+                    VPPFileInput *input);
+
+void
+vpp_file_input_close(VPPFileInput *input);
+
+/* MMAP mode: page aligned start of <frame>, NULL past the end of the file */
+uint8_t *
+vpp_file_input_frame(const VPPFileInput *input, uint32_t frame);
+
+/* DIRECT and READ mode: read <frame> into <dst>, which must be page aligned
+ * and hold frame_size rounded up to a page. Returns 0 on success, -1 past
+ * the end of the file or on error */
+int
+vpp_file_input_read(VPPFileInput *input, uint32_t frame, uint8_t *dst);
+
+const char *
+vpp_file_input_mode_name(VPPFileInputMode mode);
+
+#endif /* VPP_FILE_INPUT_H */
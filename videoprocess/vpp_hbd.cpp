@@ -0,0 +1,490 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL INTEL AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "vpp_hbd.h"
+
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_shufflevector) && __has_builtin(__builtin_convertvector)
+#define HBD_SIMD 1
+#endif
+#endif
+
+enum {
+    HBD_PLANAR,         /* Y, U and V planes */
+    HBD_SEMI_PLANAR,    /* Y plane, UV plane */
+    HBD_YUYV,           /* Y0 U Y1 V */
+    HBD_UYVA,           /* U Y V A */
+    HBD_Y410,           /* 2:10:10:10 A V Y U words */
+};
+
+enum {
+    HBD_420,
+    HBD_422,
+    HBD_444,
+};
+
+typedef struct _HbdFormat {
+    uint32_t fourcc;
+    const char *name;
+    uint32_t rt_format;
+    uint8_t layout;
+    uint8_t chroma;
+    uint8_t depth;
+    bool msb;           /* the value sits in the high bits of a sample */
+} HbdFormat;
+
+static const HbdFormat hbd_formats[] = {
+    { VA_FOURCC_P010, "P010", VA_RT_FORMAT_YUV420_10, HBD_SEMI_PLANAR, HBD_420, 10, true },
+    { VA_FOURCC_P012, "P012", VA_RT_FORMAT_YUV420_12, HBD_SEMI_PLANAR, HBD_420, 12, true },
+    { VA_FOURCC_P016, "P016", VA_RT_FORMAT_YUV420_12, HBD_SEMI_PLANAR, HBD_420, 16, true },
+    { VA_FOURCC_Y210, "Y210", VA_RT_FORMAT_YUV422_10, HBD_YUYV, HBD_422, 10, true },
+    { VA_FOURCC_Y212, "Y212", VA_RT_FORMAT_YUV422_12, HBD_YUYV, HBD_422, 12, true },
+    { VA_FOURCC_Y216, "Y216", VA_RT_FORMAT_YUV422_12, HBD_YUYV, HBD_422, 16, true },
+    { VA_FOURCC_Y410, "Y410", VA_RT_FORMAT_YUV444_10, HBD_Y410, HBD_444, 10, false },
+    { VA_FOURCC_Y412, "Y412", VA_RT_FORMAT_YUV444_12, HBD_UYVA, HBD_444, 12, true },
+    { VA_FOURCC_Y416, "Y416", VA_RT_FORMAT_YUV444_12, HBD_UYVA, HBD_444, 16, true },
+    { VA_FOURCC_I010, "I010", VA_RT_FORMAT_YUV420_10, HBD_PLANAR, HBD_420, 10, false },
+    { VA_FOURCC('I', '0', '1', '2'), "I012", VA_RT_FORMAT_YUV420_12, HBD_PLANAR, HBD_420, 12, false },
+    { VA_FOURCC('I', '0', '1', '6'), "I016", VA_RT_FORMAT_YUV420_12, HBD_PLANAR, HBD_420, 16, false },
+    { VA_FOURCC('I', '2', '1', '0'), "I210", VA_RT_FORMAT_YUV422_10, HBD_PLANAR, HBD_422, 10, false },
+    { VA_FOURCC('I', '2', '1', '2'), "I212", VA_RT_FORMAT_YUV422_12, HBD_PLANAR, HBD_422, 12, false },
+    { VA_FOURCC('I', '2', '1', '6'), "I216", VA_RT_FORMAT_YUV422_12, HBD_PLANAR, HBD_422, 16, false },
+    { VA_FOURCC('I', '4', '1', '0'), "I410", VA_RT_FORMAT_YUV444_10, HBD_PLANAR, HBD_444, 10, false },
+    { VA_FOURCC('I', '4', '1', '2'), "I412", VA_RT_FORMAT_YUV444_12, HBD_PLANAR, HBD_444, 12, false },
+    { VA_FOURCC('I', '4', '1', '6'), "I416", VA_RT_FORMAT_YUV444_12, HBD_PLANAR, HBD_444, 16, false },
+};
+
+/* Planes of a frame, in a file buffer or a mapped image */
+typedef struct _HbdFrame {
+    uint8_t *planes[3];
+    uint32_t pitches[3];
+} HbdFrame;
+
+static const HbdFormat *
+hbd_format(uint32_t fourcc)
+{
+    uint32_t i;
+
+    for (i = 0; i < sizeof(hbd_formats) / sizeof(hbd_formats[0]); i++) {
+        if (hbd_formats[i].fourcc == fourcc)
+            return &hbd_formats[i];
+    }
+    return NULL;
+}
+
+static uint32_t
+hbd_chroma_width(const HbdFormat *format, uint32_t width)
+{
+    return format->chroma == HBD_444 ? width : (width + 1) / 2;
+}
+
+/* Bytes per row and rows of <plane> in a file, returns the plane count */
+static uint32_t
+hbd_plane(const HbdFormat *format, uint32_t width, uint32_t height, uint32_t plane,
+          uint32_t *row_bytes, uint32_t *rows)
+{
+    uint32_t chroma_width = hbd_chroma_width(format, width);
+    uint32_t chroma_height = format->chroma == HBD_420 ? (height + 1) / 2 : height;
+
+    *rows = plane ? chroma_height : height;
+    switch (format->layout) {
+    case HBD_PLANAR:
+        *row_bytes = (plane ? chroma_width : width) * 2;
+        return 3;
+    case HBD_SEMI_PLANAR:
+        *row_bytes = plane ? chroma_width * 4 : width * 2;
+        return 2;
+    case HBD_YUYV:
+        *row_bytes = chroma_width * 8;
+        return 1;
+    case HBD_UYVA:
+        *row_bytes = width * 8;
+        return 1;
+    default:
+        *row_bytes = width * 4;
+        return 1;
+    }
+}
+
+/* Lay out a file frame at <data>, returns its size */
+static size_t
+hbd_file_frame(const HbdFormat *format, uint8_t *data, uint32_t width, uint32_t height,
+               HbdFrame *frame)
+{
+    uint32_t plane, num_planes = 1, row_bytes, rows;
+    size_t size = 0;
+
+    memset(frame, 0, sizeof(*frame));
+    for (plane = 0; plane < num_planes; plane++) {
+        num_planes = hbd_plane(format, width, height, plane, &row_bytes, &rows);
+        if (data)
+            frame->planes[plane] = data + size;
+        frame->pitches[plane] = row_bytes;
+        size += (size_t)row_bytes * rows;
+    }
+    return size;
+}
+
+#ifdef HBD_SIMD
+typedef uint16_t v8u16 __attribute__((vector_size(16)));
+typedef uint16_t v4u16 __attribute__((vector_size(8)));
+typedef uint32_t v4u32 __attribute__((vector_size(16)));
+
+static inline v8u16
+load8(const uint16_t *p)
+{
+    v8u16 v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void
+store8(uint16_t *p, v8u16 v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+#endif
+
+/* dst[i] = src[i] >> rs << ls */
+static void
+row_shift(uint16_t *dst, const uint16_t *src, uint32_t n, int rs, int ls)
+{
+    uint32_t i = 0;
+
+#ifdef HBD_SIMD
+    for (; i + 8 <= n; i += 8)
+        store8(dst + i, load8(src + i) >> rs << ls);
+#endif
+    for (; i < n; i++)
+        dst[i] = src[i] >> rs << ls;
+}
+
+/* a[i] = src[2 * i] << ls, b[i] = src[2 * i + 1] << ls */
+static void
+row_deinterleave(uint16_t *a, uint16_t *b, const uint16_t *src, uint32_t n, int ls)
+{
+    uint32_t i = 0;
+
+#ifdef HBD_SIMD
+    for (; i + 8 <= n; i += 8) {
+        v8u16 lo = load8(src + 2 * i), hi = load8(src + 2 * i + 8);
+
+        store8(a + i, __builtin_shufflevector(lo, hi, 0, 2, 4, 6, 8, 10, 12, 14) << ls);
+        store8(b + i, __builtin_shufflevector(lo, hi, 1, 3, 5, 7, 9, 11, 13, 15) << ls);
+    }
+#endif
+    for (; i < n; i++) {
+        a[i] = src[2 * i] << ls;
+        b[i] = src[2 * i + 1] << ls;
+    }
+}
+
+/* dst[2 * i] = a[i] >> rs << ls, dst[2 * i + 1] = b[i] >> rs << ls */
+static void
+row_interleave(uint16_t *dst, const uint16_t *a, const uint16_t *b, uint32_t n, int rs, int ls)
+{
+    uint32_t i = 0;
+
+#ifdef HBD_SIMD
+    for (; i + 8 <= n; i += 8) {
+        v8u16 va = load8(a + i) >> rs << ls, vb = load8(b + i) >> rs << ls;
+
+        store8(dst + 2 * i, __builtin_shufflevector(va, vb, 0, 8, 1, 9, 2, 10, 3, 11));
+        store8(dst + 2 * i + 8, __builtin_shufflevector(va, vb, 4, 12, 5, 13, 6, 14, 7, 15));
+    }
+#endif
+    for (; i < n; i++) {
+        dst[2 * i] = a[i] >> rs << ls;
+        dst[2 * i + 1] = b[i] >> rs << ls;
+    }
+}
+
+static void
+row_y410_unpack(uint16_t *y, uint16_t *u, uint16_t *v, const uint32_t *src, uint32_t n)
+{
+    uint32_t i = 0;
+
+#ifdef HBD_SIMD
+    for (; i + 4 <= n; i += 4) {
+        v4u32 w;
+        v4u16 vy, vu, vv;
+
+        memcpy(&w, src + i, sizeof(w));
+        vu = __builtin_convertvector(w & 0x3ff, v4u16) << 6;
+        vy = __builtin_convertvector((w >> 10) & 0x3ff, v4u16) << 6;
+        vv = __builtin_convertvector((w >> 20) & 0x3ff, v4u16) << 6;
+        memcpy(u + i, &vu, sizeof(vu));
+        memcpy(y + i, &vy, sizeof(vy));
+        memcpy(v + i, &vv, sizeof(vv));
+    }
+#endif
+    for (; i < n; i++) {
+        u[i] = (src[i] & 0x3ff) << 6;
+        y[i] = ((src[i] >> 10) & 0x3ff) << 6;
+        v[i] = ((src[i] >> 20) & 0x3ff) << 6;
+    }
+}
+
+/* alpha is written opaque */
+static void
+row_y410_pack(uint32_t *dst, const uint16_t *y, const uint16_t *u, const uint16_t *v, uint32_t n)
+{
+    uint32_t i = 0;
+
+#ifdef HBD_SIMD
+    for (; i + 4 <= n; i += 4) {
+        v4u16 vy, vu, vv;
+        v4u32 w;
+
+        memcpy(&vy, y + i, sizeof(vy));
+        memcpy(&vu, u + i, sizeof(vu));
+        memcpy(&vv, v + i, sizeof(vv));
+        w = __builtin_convertvector(vu >> 6, v4u32) |
+            __builtin_convertvector(vy >> 6, v4u32) << 10 |
+            __builtin_convertvector(vv >> 6, v4u32) << 20 | 0xc0000000u;
+        memcpy(dst + i, &w, sizeof(w));
+    }
+#endif
+    for (; i < n; i++)
+        dst[i] = (u[i] >> 6) | (y[i] >> 6) << 10 | (uint32_t)(v[i] >> 6) << 20 | 0xc0000000u;
+}
+
+/* Scratch rows of the conversion, 16 bit samples with the value in the high
+ * bits. Luma has room for the padding pixel of an odd width */
+typedef struct _HbdRows {
+    uint16_t *y, *u, *v, *a;
+    uint16_t *tmp0, *tmp1;
+} HbdRows;
+
+static void
+hbd_unpack_row(const HbdFormat *format, const HbdFrame *frame, uint32_t row,
+               uint32_t width, bool chroma, HbdRows *rows)
+{
+    uint32_t chroma_width = hbd_chroma_width(format, width);
+    uint32_t chroma_row = format->chroma == HBD_420 ? row / 2 : row;
+    const uint16_t *src = (const uint16_t *)(frame->planes[0] + (size_t)row * frame->pitches[0]);
+    const uint16_t *src1 = (const uint16_t *)(frame->planes[1] + (size_t)chroma_row * frame->pitches[1]);
+    const uint16_t *src2 = (const uint16_t *)(frame->planes[2] + (size_t)chroma_row * frame->pitches[2]);
+    int ls = format->msb ? 0 : 16 - format->depth;
+
+    switch (format->layout) {
+    case HBD_PLANAR:
+        row_shift(rows->y, src, width, 0, ls);
+        if (chroma) {
+            row_shift(rows->u, src1, chroma_width, 0, ls);
+            row_shift(rows->v, src2, chroma_width, 0, ls);
+        }
+        break;
+    case HBD_SEMI_PLANAR:
+        row_shift(rows->y, src, width, 0, ls);
+        if (chroma)
+            row_deinterleave(rows->u, rows->v, src1, chroma_width, ls);
+        break;
+    case HBD_YUYV:
+        /* luma on the even samples, U V pairs on the odd ones */
+        row_deinterleave(rows->y, rows->tmp0, src, chroma_width * 2, ls);
+        row_deinterleave(rows->u, rows->v, rows->tmp0, chroma_width, 0);
+        break;
+    case HBD_UYVA:
+        row_deinterleave(rows->tmp0, rows->tmp1, src, width * 2, ls);
+        row_deinterleave(rows->u, rows->v, rows->tmp0, width, 0);
+        row_deinterleave(rows->y, rows->a, rows->tmp1, width, 0);
+        break;
+    default:
+        row_y410_unpack(rows->y, rows->u, rows->v, (const uint32_t *)src, width);
+        break;
+    }
+
+    /* 4:2:2 packs luma in pairs */
+    if (width & 1)
+        rows->y[width] = rows->y[width - 1];
+}
+
+static void
+hbd_pack_row(const HbdFormat *format, HbdFrame *frame, uint32_t row,
+             uint32_t width, bool chroma, HbdRows *rows)
+{
+    uint32_t chroma_width = hbd_chroma_width(format, width);
+    uint32_t chroma_row = format->chroma == HBD_420 ? row / 2 : row;
+    uint16_t *dst = (uint16_t *)(frame->planes[0] + (size_t)row * frame->pitches[0]);
+    uint16_t *dst1 = (uint16_t *)(frame->planes[1] + (size_t)chroma_row * frame->pitches[1]);
+    uint16_t *dst2 = (uint16_t *)(frame->planes[2] + (size_t)chroma_row * frame->pitches[2]);
+    int rs = 16 - format->depth;
+    int ls = format->msb ? rs : 0;
+
+    switch (format->layout) {
+    case HBD_PLANAR:
+        row_shift(dst, rows->y, width, rs, ls);
+        if (chroma) {
+            row_shift(dst1, rows->u, chroma_width, rs, ls);
+            row_shift(dst2, rows->v, chroma_width, rs, ls);
+        }
+        break;
+    case HBD_SEMI_PLANAR:
+        row_shift(dst, rows->y, width, rs, ls);
+        if (chroma)
+            row_interleave(dst1, rows->u, rows->v, chroma_width, rs, ls);
+        break;
+    case HBD_YUYV:
+        row_interleave(rows->tmp0, rows->u, rows->v, chroma_width, 0, 0);
+        row_interleave(dst, rows->y, rows->tmp0, chroma_width * 2, rs, ls);
+        break;
+    case HBD_UYVA:
+        row_interleave(rows->tmp0, rows->u, rows->v, width, 0, 0);
+        row_interleave(rows->tmp1, rows->y, rows->a, width, 0, 0);
+        row_interleave(dst, rows->tmp0, rows->tmp1, width * 2, rs, ls);
+        break;
+    default:
+        row_y410_pack((uint32_t *)dst, rows->y, rows->u, rows->v, width);
+        break;
+    }
+}
+
+static int
+hbd_convert(const HbdFormat *src_format, const HbdFrame *src,
+            const HbdFormat *dst_format, HbdFrame *dst,
+            uint32_t width, uint32_t height)
+{
+    uint32_t plane, num_planes, row_bytes, rows, row;
+    uint16_t *buffer;
+    HbdRows scratch;
+    bool chroma;
+
+    if (src_format == dst_format) {
+        num_planes = hbd_plane(src_format, width, height, 0, &row_bytes, &rows);
+        for (plane = 0; plane < num_planes; plane++) {
+            hbd_plane(src_format, width, height, plane, &row_bytes, &rows);
+            for (row = 0; row < rows; row++)
+                memcpy(dst->planes[plane] + (size_t)row * dst->pitches[plane],
+                       src->planes[plane] + (size_t)row * src->pitches[plane], row_bytes);
+        }
+        return 0;
+    }
+
+    buffer = (uint16_t *)malloc((width + 1) * 8 * sizeof(uint16_t));
+    if (!buffer)
+        return -1;
+
+    scratch.y = buffer;
+    scratch.u = scratch.y + width + 1;
+    scratch.v = scratch.u + width + 1;
+    scratch.a = scratch.v + width + 1;
+    scratch.tmp0 = scratch.a + width + 1;
+    scratch.tmp1 = scratch.tmp0 + 2 * (width + 1);
+
+    /* alpha of formats without one is opaque */
+    for (row = 0; row < width + 1; row++)
+        scratch.a[row] = 0xffff;
+
+    for (row = 0; row < height; row++) {
+        chroma = src_format->chroma != HBD_420 || !(row & 1);
+        hbd_unpack_row(src_format, src, row, width, chroma, &scratch);
+        hbd_pack_row(dst_format, dst, row, width, chroma, &scratch);
+    }
+
+    free(buffer);
+    return 0;
+}
+
+uint32_t
+vpp_hbd_fourcc(const char *name, uint32_t *rt_format)
+{
+    uint32_t i;
+
+    for (i = 0; i < sizeof(hbd_formats) / sizeof(hbd_formats[0]); i++) {
+        if (!strcmp(hbd_formats[i].name, name)) {
+            if (rt_format)
+                *rt_format = hbd_formats[i].rt_format;
+            return hbd_formats[i].fourcc;
+        }
+    }
+    return 0;
+}
+
+bool
+vpp_hbd_supported(uint32_t image_fourcc, uint32_t file_fourcc)
+{
+    const HbdFormat *image_format = hbd_format(image_fourcc);
+    const HbdFormat *file_format = hbd_format(file_fourcc);
+
+    return image_format && file_format && image_format->chroma == file_format->chroma;
+}
+
+size_t
+vpp_hbd_frame_size(uint32_t file_fourcc, uint32_t width, uint32_t height)
+{
+    const HbdFormat *format = hbd_format(file_fourcc);
+    HbdFrame frame;
+
+    return format ? hbd_file_frame(format, NULL, width, height, &frame) : 0;
+}
+
+static void
+hbd_image_frame(const VAImage *image, const uint8_t *image_data, HbdFrame *frame)
+{
+    uint32_t plane;
+
+    for (plane = 0; plane < 3; plane++) {
+        frame->planes[plane] = (uint8_t *)image_data + image->offsets[plane];
+        frame->pitches[plane] = image->pitches[plane];
+    }
+}
+
+int
+vpp_hbd_file_to_image(const uint8_t *src, uint32_t file_fourcc,
+                      const VAImage *image, uint8_t *image_data)
+{
+    HbdFrame src_frame, dst_frame;
+
+    if (!vpp_hbd_supported(image->format.fourcc, file_fourcc))
+        return -1;
+
+    hbd_file_frame(hbd_format(file_fourcc), (uint8_t *)src, image->width, image->height,
+                   &src_frame);
+    hbd_image_frame(image, image_data, &dst_frame);
+    return hbd_convert(hbd_format(file_fourcc), &src_frame,
+                       hbd_format(image->format.fourcc), &dst_frame,
+                       image->width, image->height);
+}
+
+int
+vpp_hbd_image_to_file(const VAImage *image, const uint8_t *image_data,
+                      uint8_t *dst, uint32_t file_fourcc)
+{
+    HbdFrame src_frame, dst_frame;
+
+    if (!vpp_hbd_supported(image->format.fourcc, file_fourcc))
+        return -1;
+
+    hbd_image_frame(image, image_data, &src_frame);
+    hbd_file_frame(hbd_format(file_fourcc), dst, image->width, image->height, &dst_frame);
+    return hbd_convert(hbd_format(image->format.fourcc), &src_frame,
+                       hbd_format(file_fourcc), &dst_frame,
+                       image->width, image->height);
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL INTEL AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef VPP_HBD_H
+#define VPP_HBD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <va/va.h>
+
+/* formats newer than some libva versions */
+#ifndef VA_FOURCC_P012
+#define VA_FOURCC_P012 0x32313050
+#endif
+#ifndef VA_FOURCC_Y212
+#define VA_FOURCC_Y212 0x32313259
+#endif
+#ifndef VA_FOURCC_Y412
+#define VA_FOURCC_Y412 0x32313459
+#endif
+#ifndef VA_FOURCC_I010
+#define VA_FOURCC_I010 0x30313049
+#endif
+
+/*
+ * High bit depth YUV frames for the video process samples.
+ *
+ * Covers the 10, 12 and 16 bit VA formats
+ *  - P010, P012, P016: 4:2:0, Y plane + interleaved UV plane
+ *  - Y210, Y212, Y216: packed 4:2:2, Y0 U Y1 V
+ *  - Y410: packed 4:4:4, one 32 bit word of 2:10:10:10 A V Y U
+ *  - Y412, Y416: packed 4:4:4, U Y V A
+ * with 16 bit samples holding the value in their most significant bits, and
+ * the planar files with the value in the least significant bits
+ *  - I010, I012, I016: 4:2:0 (I010 is a VA surface format as well)
+ *  - I210, I212, I216: 4:2:2
+ *  - I410, I412, I416: 4:4:4
+ *
+ * A file frame is converted to a mapped VA image and back as long as both
+ * have the same chroma subsampling: P010 surfaces take I010 files, Y410
+ * surfaces I410 files and so on, and the bit depths may differ. Files are
+ * tightly packed, planes follow each other. The conversion goes one row at a
+ * time through 16 bit planar rows, the row kernels use the compiler vector
+ * extension where the compiler has the shuffle builtins for it.
+ */
+
+/* Returns the fourcc of a high bit depth format name, 0 for any other name.
+ * <rt_format> gets the VA_RT_FORMAT_* of a surface in that format */
+uint32_t
+vpp_hbd_fourcc(const char *name, uint32_t *rt_format);
+
+/* Whether frames of <file_fourcc> convert to and from <image_fourcc> images */
+bool
+vpp_hbd_supported(uint32_t image_fourcc, uint32_t file_fourcc);
+
+/* Bytes of one <file_fourcc> frame in a file, 0 for other formats */
+size_t
+vpp_hbd_frame_size(uint32_t file_fourcc, uint32_t width, uint32_t height);
+
+/* Convert the file frame <src> to the image <image> mapped at <image_data>.
+ * Returns 0, or -1 if the formats do not fit */
+int
+vpp_hbd_file_to_image(const uint8_t *src, uint32_t file_fourcc,
+                      const VAImage *image, uint8_t *image_data);
+
+/* Convert the image <image> mapped at <image_data> to the file frame <dst>,
+ * which holds vpp_hbd_frame_size() bytes */
+int
+vpp_hbd_image_to_file(const VAImage *image, const uint8_t *image_data,
+                      uint8_t *dst, uint32_t file_fourcc);
+
+#endif /* VPP_HBD_H */
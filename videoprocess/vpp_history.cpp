@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL INTEL AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "vpp_history.h"
+
+int
+vpp_history_init(VPPHistory *h, uint32_t depth, uint32_t num_forward,
+                 uint32_t num_backward, uint32_t frame_count)
+{
+    if (num_forward > VPP_HISTORY_MAX_REFERENCES ||
+        num_backward > VPP_HISTORY_MAX_REFERENCES) {
+        printf("%d forward / %d backward references requested, at most %d are supported\n",
+               num_forward, num_backward, VPP_HISTORY_MAX_REFERENCES);
+        return -1;
+    }
+
+    if (depth + num_forward + num_backward > VPP_HISTORY_MAX_SURFACES) {
+        printf("%d input frames in flight need %d surfaces, at most %d are supported\n",
+               depth, depth + num_forward + num_backward, VPP_HISTORY_MAX_SURFACES);
+        return -1;
+    }
+
+    memset(h, 0, sizeof(*h));
+    h->size = depth + num_forward + num_backward;
+    h->num_forward = num_forward;
+    h->num_backward = num_backward;
+    h->frame_count = frame_count;
+
+    return 0;
+}
+
+int
+vpp_history_advance(VPPHistory *h, uint32_t frame,
+                    int (*load)(uint32_t frame, VASurfaceID surface))
+{
+    uint32_t last = frame + h->num_backward;
+    int ret;
+
+    if (frame >= h->frame_count)
+        return 1;
+
+    if (last >= h->frame_count)
+        last = h->frame_count - 1;
+
+    /* the pipeline never lets the reader get further ahead than the ring
+     * allows, so the surface of frame <loaded> is free again here */
+    for (; h->loaded <= last; h->loaded++) {
+        ret = load(h->loaded, vpp_history_surface(h, h->loaded));
+        if (ret == 1) {
+            /* the input ended early, backward references of the frames
+             * before it repeat the last frame loaded */
+            h->frame_count = h->loaded;
+            return frame >= h->frame_count ? 1 : 0;
+        }
+        if (ret)
+            return ret;
+    }
+
+    return 0;
+}
+
+VASurfaceID
+vpp_history_surface(const VPPHistory *h, uint32_t frame)
+{
+    return h->surfaces[frame % h->size];
+}
+
+void
+vpp_history_references(VPPHistory *h, uint32_t frame)
+{
+    uint32_t i;
+
+    for (i = 0; i < h->num_forward; i++)
+        h->forward[i] = vpp_history_surface(h, frame > i ? frame - i - 1 : 0);
+
+    for (i = 0; i < h->num_backward; i++)
+        h->backward[i] = vpp_history_surface(h, frame + i + 1 < h->frame_count ?
+                                             frame + i + 1 : h->frame_count - 1);
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL INTEL AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef VPP_HISTORY_H
+#define VPP_HISTORY_H
+
+#include <stdint.h>
+#include <va/va.h>
+
+#include "vpp_pipeline.h"
+
+/*
+ * Reference frame history shared by the video process samples.
+ *
+ * Filters like motion adaptive deinterlacing or temporal denoise read past
+ * (forward) and future (backward) input frames next to the current one.
+ * Input frame N lives in surface N % size of a ring, the reader loads
+ * <num_backward> frames ahead of the one it is asked for, and a frame stays
+ * loaded until no frame in flight can refer to it any more. With a pipeline
+ * whose frames in flight show <depth> input frames that takes
+ * depth + num_forward + num_backward surfaces; without references the ring
+ * is the plain per slot input surfaces.
+ *
+ * References outside of the input repeat the first or last frame, so every
+ * submit passes the counts the driver asked for.
+ */
+
+#define VPP_HISTORY_MAX_REFERENCES 8
+#define VPP_HISTORY_MAX_SURFACES (VPP_PIPELINE_MAX_DEPTH + 2 * VPP_HISTORY_MAX_REFERENCES)
+
+typedef struct _VPPHistory {
+    VASurfaceID surfaces[VPP_HISTORY_MAX_SURFACES];
+    uint32_t size;              /* surfaces in the ring */
+    uint32_t num_forward;
+    uint32_t num_backward;
+    uint32_t frame_count;       /* input frames */
+    uint32_t loaded;            /* input frames loaded so far */
+
+    /* references of the frame passed to vpp_history_references, nearest
+     * frame first */
+    VASurfaceID forward[VPP_HISTORY_MAX_REFERENCES];
+    VASurfaceID backward[VPP_HISTORY_MAX_REFERENCES];
+} VPPHistory;
+
+/* Size the ring, the caller creates <history>->size surfaces in
+ * <history>->surfaces afterwards. <depth> is the number of input frames the
+ * frames in flight can span, the pipeline depth unless output frames repeat
+ * or drop input frames. Returns -1 if the ring gets too large */
+int
+vpp_history_init(VPPHistory *history, uint32_t depth, uint32_t num_forward,
+                 uint32_t num_backward, uint32_t frame_count);
+
+/* Make input <frame> and its backward references available, loading the
+ * frames that are not loaded yet with <load>. <load> returns 0 on success,
+ * 1 at the end of the input, which lowers frame_count to the frames loaded,
+ * or < 0 on error. Returns 1 if <frame> is past the end of the input,
+ * otherwise 0 or the first error of <load> */
+int
+vpp_history_advance(VPPHistory *history, uint32_t frame,
+                    int (*load)(uint32_t frame, VASurfaceID surface));
+
+VASurfaceID
+vpp_history_surface(const VPPHistory *history, uint32_t frame);
+
+/* Fill <history>->forward and <history>->backward for input <frame> */
+void
+vpp_history_references(VPPHistory *history, uint32_t frame);
+
+#endif /* VPP_HISTORY_H */
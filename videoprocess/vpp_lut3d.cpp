@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL INTEL AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "vpp_lut3d.h"
+
+/* one RGB triple plus pad, maps to a single SSE or NEON register */
+typedef float v4f __attribute__((vector_size(16)));
+
+int
+vpp_lut3d_load_cube(const char *file_name, VPPLut3D *lut)
+{
+    char line[1024];
+    uint32_t line_no = 0, count = 0, total = 0;
+    FILE *fp;
+    int i;
+
+    memset(lut, 0, sizeof(*lut));
+    for (i = 0; i < 3; i++)
+        lut->domain_max[i] = 1.0f;
+
+    fp = fopen(file_name, "r");
+    if (!fp) {
+        printf("Open cube file %s failed\n", file_name);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+        char *p = line;
+
+        line_no++;
+        while (isspace((unsigned char)*p))
+            p++;
+        if (!*p || *p == '#')
+            continue;
+
+        if (!strncmp(p, "LUT_3D_SIZE", 11)) {
+            if (lut->table || sscanf(p + 11, "%u", &lut->size) != 1 ||
+                lut->size < 2 || lut->size > VPP_LUT3D_MAX_SIZE) {
+                printf("%s:%d: bad LUT_3D_SIZE\n", file_name, line_no);
+                goto fail;
+            }
+            total = lut->size * lut->size * lut->size;
+            if (posix_memalign((void **)&lut->table, sizeof(v4f), total * sizeof(v4f))) {
+                lut->table = NULL;
+                goto fail;
+            }
+        } else if (!strncmp(p, "LUT_1D_SIZE", 11)) {
+            printf("%s:%d: 1D LUTs are not supported\n", file_name, line_no);
+            goto fail;
+        } else if (!strncmp(p, "DOMAIN_MIN", 10)) {
+            if (sscanf(p + 10, "%f %f %f", &lut->domain_min[0], &lut->domain_min[1],
+                       &lut->domain_min[2]) != 3) {
+                printf("%s:%d: bad DOMAIN_MIN\n", file_name, line_no);
+                goto fail;
+            }
+        } else if (!strncmp(p, "DOMAIN_MAX", 10)) {
+            if (sscanf(p + 10, "%f %f %f", &lut->domain_max[0], &lut->domain_max[1],
+                       &lut->domain_max[2]) != 3) {
+                printf("%s:%d: bad DOMAIN_MAX\n", file_name, line_no);
+                goto fail;
+            }
+        } else if (!strncmp(p, "LUT_3D_INPUT_RANGE", 18)) {
+            if (sscanf(p + 18, "%f %f", &lut->domain_min[0], &lut->domain_max[0]) != 2) {
+                printf("%s:%d: bad LUT_3D_INPUT_RANGE\n", file_name, line_no);
+                goto fail;
+            }
+            for (i = 1; i < 3; i++) {
+                lut->domain_min[i] = lut->domain_min[0];
+                lut->domain_max[i] = lut->domain_max[0];
+            }
+        } else if (isalpha((unsigned char)*p)) {
+            /* TITLE and keywords of other tools */
+            continue;
+        } else {
+            float *entry = lut->table + count * 4;
+
+            if (!lut->table || count == total) {
+                printf("%s:%d: %s\n", file_name, line_no,
+                       lut->table ? "more entries than LUT_3D_SIZE^3" : "data before LUT_3D_SIZE");
+                goto fail;
+            }
+            if (sscanf(p, "%f %f %f", &entry[0], &entry[1], &entry[2]) != 3) {
+                printf("%s:%d: bad table entry\n", file_name, line_no);
+                goto fail;
+            }
+            entry[3] = 0.0f;
+            count++;
+        }
+    }
+
+    for (i = 0; i < 3; i++) {
+        if (lut->domain_max[i] <= lut->domain_min[i]) {
+            printf("%s: empty input domain\n", file_name);
+            goto fail;
+        }
+    }
+
+    if (!total || count != total) {
+        printf("%s: %d entries, %d expected\n", file_name, count, total);
+        goto fail;
+    }
+
+    fclose(fp);
+    return 0;
+
+fail:
+    fclose(fp);
+    vpp_lut3d_free(lut);
+    return -1;
+}
+
+void
+vpp_lut3d_free(VPPLut3D *lut)
+{
+    free(lut->table);
+    lut->table = NULL;
+    lut->size = 0;
+}
+
+uint64_t
+vpp_lut3d_hash(uint64_t hash, const void *data, size_t size)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+/* Grid cell of an input value: the table offset along one axis and the
+ * position inside the cell */
+typedef struct _LutCoord {
+    uint32_t offset;
+    float frac;
+} LutCoord;
+
+static inline LutCoord
+lut_coord(const VPPLut3D *lut, int channel, float value, uint32_t step)
+{
+    float max = lut->size - 1;
+    float x = (value - lut->domain_min[channel]) * max /
+              (lut->domain_max[channel] - lut->domain_min[channel]);
+    LutCoord c;
+    uint32_t i;
+
+    if (!(x > 0.0f))
+        x = 0.0f;
+    if (x > max)
+        x = max;
+
+    i = (uint32_t)x;
+    if (i > lut->size - 2)
+        i = lut->size - 2;
+
+    c.offset = i * step;
+    c.frac = x - i;
+    return c;
+}
+
+static inline v4f
+lut_sample(const VPPLut3D *lut, int method, LutCoord r, LutCoord g, LutCoord b)
+{
+    const v4f *t = (const v4f *)lut->table + r.offset + g.offset + b.offset;
+    const uint32_t dr = 1, dg = lut->size, db = lut->size * lut->size;
+    float fr = r.frac, fg = g.frac, fb = b.frac;
+    v4f c000 = t[0], c111 = t[dr + dg + db];
+
+    if (method == VPP_LUT3D_TRILINEAR) {
+        v4f c00 = c000 + (t[dr] - c000) * fr;
+        v4f c10 = t[dg] + (t[dr + dg] - t[dg]) * fr;
+        v4f c01 = t[db] + (t[dr + db] - t[db]) * fr;
+        v4f c11 = t[dg + db] + (c111 - t[dg + db]) * fr;
+        v4f c0 = c00 + (c10 - c00) * fg;
+        v4f c1 = c01 + (c11 - c01) * fg;
+
+        return c0 + (c1 - c0) * fb;
+    }
+
+    /* tetrahedral: the cell is split into six tetrahedra along its main
+     * diagonal, the ordering of the fractions picks one */
+    if (fr > fg) {
+        if (fg > fb)
+            return c000 * (1 - fr) + t[dr] * (fr - fg) + t[dr + dg] * (fg - fb) + c111 * fb;
+        if (fr > fb)
+            return c000 * (1 - fr) + t[dr] * (fr - fb) + t[dr + db] * (fb - fg) + c111 * fg;
+        return c000 * (1 - fb) + t[db] * (fb - fr) + t[dr + db] * (fr - fg) + c111 * fg;
+    }
+
+    if (fb > fg)
+        return c000 * (1 - fb) + t[db] * (fb - fg) + t[dg + db] * (fg - fr) + c111 * fr;
+    if (fb > fr)
+        return c000 * (1 - fg) + t[dg] * (fg - fb) + t[dg + db] * (fb - fr) + c111 * fr;
+    return c000 * (1 - fg) + t[dg] * (fg - fr) + t[dr + dg] * (fr - fb) + c111 * fb;
+}
+
+void
+vpp_lut3d_lookup(const VPPLut3D *lut, int method, const float in[3], float out[3])
+{
+    v4f v = lut_sample(lut, method,
+                       lut_coord(lut, 0, in[0], 1),
+                       lut_coord(lut, 1, in[1], lut->size),
+                       lut_coord(lut, 2, in[2], lut->size * lut->size));
+
+    out[0] = v[0];
+    out[1] = v[1];
+    out[2] = v[2];
+}
+
+size_t
+vpp_lut3d_baked_size(uint32_t lut_size, const uint16_t lut_stride[3])
+{
+    return (size_t)lut_size * lut_stride[1] * lut_stride[2] * 4 * sizeof(uint16_t);
+}
+
+static inline uint16_t
+unorm16(float v)
+{
+    if (!(v > 0.0f))
+        return 0;
+    if (v >= 1.0f)
+        return 0xffff;
+    return (uint16_t)(v * 65535.0f + 0.5f);
+}
+
+void
+vpp_lut3d_bake(const VPPLut3D *lut, uint32_t lut_size, const uint16_t lut_stride[3],
+               uint16_t *out)
+{
+    uint32_t r, g, b;
+    float in[3], v[3];
+
+    /* entries past lut_size on the padded axes stay 0 */
+    memset(out, 0, vpp_lut3d_baked_size(lut_size, lut_stride));
+
+    for (r = 0; r < lut_size; r++) {
+        for (g = 0; g < lut_size; g++) {
+            uint16_t *entry = out + ((size_t)r * lut_stride[1] + g) * lut_stride[2] * 4;
+
+            for (b = 0; b < lut_size; b++, entry += 4) {
+                in[0] = (float)r / (lut_size - 1);
+                in[1] = (float)g / (lut_size - 1);
+                in[2] = (float)b / (lut_size - 1);
+                vpp_lut3d_lookup(lut, VPP_LUT3D_TETRAHEDRAL, in, v);
+
+                entry[0] = unorm16(v[0]);
+                entry[1] = unorm16(v[1]);
+                entry[2] = unorm16(v[2]);
+            }
+        }
+    }
+}
+
+static inline uint8_t
+unorm8(float v)
+{
+    if (!(v > 0.0f))
+        return 0;
+    if (v >= 1.0f)
+        return 0xff;
+    return (uint8_t)(v * 255.0f + 0.5f);
+}
+
+void
+vpp_lut3d_apply_rgb32(const VPPLut3D *lut, int method,
+                      const uint8_t *src, uint32_t src_pitch,
+                      uint8_t *dst, uint32_t dst_pitch,
+                      uint32_t width, uint32_t height,
+                      uint32_t r_offset, uint32_t g_offset, uint32_t b_offset)
+{
+    /* 8 bit input has 256 values per channel, their grid cells are looked
+     * up once instead of per pixel */
+    LutCoord coords[3][256];
+    uint32_t alpha_offset = 6 - r_offset - g_offset - b_offset;
+    uint32_t x, y, i;
+
+    for (i = 0; i < 256; i++) {
+        coords[0][i] = lut_coord(lut, 0, i / 255.0f, 1);
+        coords[1][i] = lut_coord(lut, 1, i / 255.0f, lut->size);
+        coords[2][i] = lut_coord(lut, 2, i / 255.0f, lut->size * lut->size);
+    }
+
+    for (y = 0; y < height; y++) {
+        const uint8_t *s = src + (size_t)y * src_pitch;
+        uint8_t *d = dst + (size_t)y * dst_pitch;
+
+        for (x = 0; x < width; x++, s += 4, d += 4) {
+            v4f v = lut_sample(lut, method,
+                               coords[0][s[r_offset]],
+                               coords[1][s[g_offset]],
+                               coords[2][s[b_offset]]);
+
+            d[r_offset] = unorm8(v[0]);
+            d[g_offset] = unorm8(v[1]);
+            d[b_offset] = unorm8(v[2]);
+            d[alpha_offset] = s[alpha_offset];
+        }
+    }
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL INTEL AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef VPP_LUT3D_H
+#define VPP_LUT3D_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * 3D LUT helpers for vpp3dlut.
+ *
+ * A LUT is loaded from a .cube file (Adobe/Resolve text format) into a
+ * float table and can then be
+ *  - resampled into the 16 bit RGBA layout of a VAProcFilter3DLUT surface:
+ *    <lut_size> points per axis, entry (r, g, b) at
+ *    (r * lut_stride[1] + g) * lut_stride[2] + b, 4 x 16 bit per entry
+ *  - applied on the CPU to 8 bit RGB(A) frames, as a reference for the GPU
+ *    output. The lookups work on 4 float vectors (RGB + pad) with the
+ *    compiler vector extension, one SSE/NEON register per vertex.
+ */
+
+#define VPP_LUT3D_MAX_SIZE 256
+
+enum {
+    VPP_LUT3D_TRILINEAR = 1,
+    VPP_LUT3D_TETRAHEDRAL = 2,
+};
+
+typedef struct _VPPLut3D {
+    uint32_t size;              /* points per axis */
+    float domain_min[3];
+    float domain_max[3];
+    /* size^3 entries of 4 floats, red changes fastest as in the file */
+    float *table;
+} VPPLut3D;
+
+/* Returns 0 on success, -1 with a message on a file it can not use */
+int
+vpp_lut3d_load_cube(const char *file_name, VPPLut3D *lut);
+
+void
+vpp_lut3d_free(VPPLut3D *lut);
+
+/* 64 bit FNV-1a of <size> bytes, chained through <hash> */
+#define VPP_LUT3D_HASH_INIT 0xcbf29ce484222325ULL
+
+uint64_t
+vpp_lut3d_hash(uint64_t hash, const void *data, size_t size);
+
+/* Bytes of a baked LUT for the given driver geometry */
+size_t
+vpp_lut3d_baked_size(uint32_t lut_size, const uint16_t lut_stride[3]);
+
+/* Resample <lut> to <lut_size> points per axis in the driver layout,
+ * <out> holds vpp_lut3d_baked_size() bytes */
+void
+vpp_lut3d_bake(const VPPLut3D *lut, uint32_t lut_size, const uint16_t lut_stride[3],
+               uint16_t *out);
+
+/* Map one normalized RGB triple, <method> is VPP_LUT3D_TRILINEAR or
+ * VPP_LUT3D_TETRAHEDRAL */
+void
+vpp_lut3d_lookup(const VPPLut3D *lut, int method, const float in[3], float out[3]);
+
+/* Apply <lut> to a 32 bit RGB frame. <r_offset>, <g_offset> and <b_offset>
+ * give the byte of each channel in a pixel (RGBA: 0, 1, 2, BGRA: 2, 1, 0),
+ * the fourth byte is copied */
+void
+vpp_lut3d_apply_rgb32(const VPPLut3D *lut, int method,
+                      const uint8_t *src, uint32_t src_pitch,
+                      uint8_t *dst, uint32_t dst_pitch,
+                      uint32_t width, uint32_t height,
+                      uint32_t r_offset, uint32_t g_offset, uint32_t b_offset);
+
+#endif /* VPP_LUT3D_H */
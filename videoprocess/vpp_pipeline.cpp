@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL INTEL AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "vpp_pipeline.h"
+
+/*
+ * The three stages advance through the frames in order, so three counters
+ * describe the whole ring: frames [written, processed) are waiting for the
+ * writer, [processed, read) for the submit stage and the reader may run
+ * ahead until read - written == depth.
+ */
+typedef struct _VPPPipeline {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    uint32_t depth;
+    uint32_t frame_count;       /* lowered by the reader at end of input */
+    const VPPPipelineOps *ops;
+
+    uint32_t read;
+    uint32_t processed;
+    uint32_t written;
+    int error;
+} VPPPipeline;
+
+enum {
+    STAGE_READ,
+    STAGE_PROCESS,
+    STAGE_WRITE,
+};
+
+/* Block until <frame> may enter <stage>. Returns 0 once the pipeline
+ * failed or <frame> is past the end of the input */
+static int
+pipeline_wait(VPPPipeline *p, int stage, uint32_t frame)
+{
+    int ready = 0;
+
+    pthread_mutex_lock(&p->lock);
+    while (!p->error && frame < p->frame_count) {
+        if (stage == STAGE_READ)
+            ready = frame - p->written < p->depth;
+        else if (stage == STAGE_PROCESS)
+            ready = frame < p->read;
+        else
+            ready = frame < p->processed;
+
+        if (ready)
+            break;
+        pthread_cond_wait(&p->cond, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    return ready;
+}
+
+static void
+pipeline_advance(VPPPipeline *p, uint32_t *counter, int error)
+{
+    pthread_mutex_lock(&p->lock);
+    if (error)
+        p->error = 1;
+    else
+        (*counter)++;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void *
+pipeline_reader(void *arg)
+{
+    VPPPipeline *p = (VPPPipeline *)arg;
+    uint32_t frame;
+    int ret;
+
+    for (frame = 0; pipeline_wait(p, STAGE_READ, frame); frame++) {
+        ret = p->ops->read(frame, frame % p->depth);
+        if (ret == 1) {
+            /* end of input, the other stages stop at this frame */
+            pthread_mutex_lock(&p->lock);
+            p->frame_count = frame;
+            pthread_cond_broadcast(&p->cond);
+            pthread_mutex_unlock(&p->lock);
+            break;
+        }
+
+        pipeline_advance(p, &p->read, ret < 0);
+        if (ret < 0)
+            break;
+    }
+
+    return NULL;
+}
+
+static void *
+pipeline_writer(void *arg)
+{
+    VPPPipeline *p = (VPPPipeline *)arg;
+    uint32_t frame;
+    int ret;
+
+    for (frame = 0; pipeline_wait(p, STAGE_WRITE, frame); frame++) {
+        ret = p->ops->write(frame, frame % p->depth);
+        pipeline_advance(p, &p->written, ret < 0);
+        if (ret < 0)
+            break;
+    }
+
+    return NULL;
+}
+
+static int32_t
+pipeline_run_sequential(uint32_t frame_count, const VPPPipelineOps *ops)
+{
+    uint32_t frame;
+    int ret;
+
+    for (frame = 0; frame < frame_count; frame++) {
+        ret = ops->read(frame, 0);
+        if (ret == 1)
+            break;
+        if (ret < 0 ||
+            ops->process(frame, 0) != VA_STATUS_SUCCESS ||
+            ops->write(frame, 0) < 0)
+            return -1;
+    }
+
+    return frame;
+}
+
+int32_t
+vpp_pipeline_run(uint32_t depth, uint32_t frame_count, const VPPPipelineOps *ops)
+{
+    VPPPipeline p;
+    pthread_t reader, writer;
+    uint32_t frame;
+
+    if (depth <= 1)
+        return pipeline_run_sequential(frame_count, ops);
+
+    if (depth > VPP_PIPELINE_MAX_DEPTH)
+        depth = VPP_PIPELINE_MAX_DEPTH;
+
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_cond_init(&p.cond, NULL);
+    p.depth = depth;
+    p.frame_count = frame_count;
+    p.ops = ops;
+    p.read = p.processed = p.written = 0;
+    p.error = 0;
+
+    if (pthread_create(&reader, NULL, pipeline_reader, &p)) {
+        printf("Failed to create the pipeline reader thread\n");
+        return -1;
+    }
+    if (pthread_create(&writer, NULL, pipeline_writer, &p)) {
+        printf("Failed to create the pipeline writer thread\n");
+        pipeline_advance(&p, NULL, 1);
+        pthread_join(reader, NULL);
+        return -1;
+    }
+
+    /* the calling thread is the submit stage */
+    for (frame = 0; pipeline_wait(&p, STAGE_PROCESS, frame); frame++) {
+        VAStatus va_status = ops->process(frame, frame % depth);
+
+        pipeline_advance(&p, &p.processed, va_status != VA_STATUS_SUCCESS);
+        if (va_status != VA_STATUS_SUCCESS)
+            break;
+    }
+
+    pthread_join(reader, NULL);
+    pthread_join(writer, NULL);
+
+    pthread_cond_destroy(&p.cond);
+    pthread_mutex_destroy(&p.lock);
+
+    return p.error ? -1 : (int32_t)p.written;
+}
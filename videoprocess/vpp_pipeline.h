@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL INTEL AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef VPP_PIPELINE_H
+#define VPP_PIPELINE_H
+
+#include <stdint.h>
+#include <va/va.h>
+
+/*
+ * Frame pipeline shared by the video process samples.
+ *
+ * The sample owns <depth> input/output surface pairs ("slots"). Frame N
+ * always uses slot N % depth. With depth > 1 a reader thread uploads frame
+ * N+1 while the calling thread submits frame N and a writer thread stores
+ * frame N-1; a slot is only handed to the reader again once its output was
+ * written. Depth 1 runs read, process and write in sequence on the calling
+ * thread.
+ */
+
+#define VPP_PIPELINE_MAX_DEPTH 16
+
+typedef struct _VPPPipelineOps {
+    /* load <frame> into the input surface of <slot>;
+     * 0 on success, 1 at the end of the input, < 0 on error */
+    int (*read)(uint32_t frame, uint32_t slot);
+    /* submit <frame> from the input to the output surface of <slot> */
+    VAStatus(*process)(uint32_t frame, uint32_t slot);
+    /* store the output surface of <slot>; 0 on success, < 0 on error */
+    int (*write)(uint32_t frame, uint32_t slot);
+} VPPPipelineOps;
+
+/* Returns the number of frames written, or -1 on error */
+int32_t
+vpp_pipeline_run(uint32_t depth, uint32_t frame_count, const VPPPipelineOps *ops);
+
+#endif /* VPP_PIPELINE_H */
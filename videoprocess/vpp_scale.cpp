@@ -0,0 +1,609 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL INTEL AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <va/va.h>
+
+#include "vpp_scale.h"
+
+/* four samples of a row, one SSE or NEON register */
+typedef float v4f __attribute__((vector_size(16)));
+
+/* Where one component lives in a frame: byte <offset> in <plane>, <step>
+ * bytes between samples, and the subsampling of the component */
+typedef struct _ScaleComp {
+    uint8_t plane;
+    uint8_t offset;
+    uint8_t step;
+    uint8_t x_shift;
+    uint8_t y_shift;
+} ScaleComp;
+
+typedef struct _ScaleFormat {
+    uint32_t fourcc;
+    bool rgb;
+    /* Y, U, V or R, G, B, then the alpha or pad byte of 32 bit RGB */
+    uint32_t num_comps;
+    bool alpha;
+    ScaleComp comps[4];
+} ScaleFormat;
+
+static const ScaleFormat scale_formats[] = {
+    { VA_FOURCC_NV12, false, 3, false, { { 0, 0, 1, 0, 0 }, { 1, 0, 2, 1, 1 }, { 1, 1, 2, 1, 1 } } },
+    { VA_FOURCC_I420, false, 3, false, { { 0, 0, 1, 0, 0 }, { 1, 0, 1, 1, 1 }, { 2, 0, 1, 1, 1 } } },
+    { VA_FOURCC_YV12, false, 3, false, { { 0, 0, 1, 0, 0 }, { 2, 0, 1, 1, 1 }, { 1, 0, 1, 1, 1 } } },
+    { VA_FOURCC_YUY2, false, 3, false, { { 0, 0, 2, 0, 0 }, { 0, 1, 4, 1, 0 }, { 0, 3, 4, 1, 0 } } },
+    { VA_FOURCC_UYVY, false, 3, false, { { 0, 1, 2, 0, 0 }, { 0, 0, 4, 1, 0 }, { 0, 2, 4, 1, 0 } } },
+    { VA_FOURCC_RGBA, true, 4, true, { { 0, 0, 4, 0, 0 }, { 0, 1, 4, 0, 0 }, { 0, 2, 4, 0, 0 }, { 0, 3, 4, 0, 0 } } },
+    { VA_FOURCC_RGBX, true, 4, false, { { 0, 0, 4, 0, 0 }, { 0, 1, 4, 0, 0 }, { 0, 2, 4, 0, 0 }, { 0, 3, 4, 0, 0 } } },
+    { VA_FOURCC_BGRA, true, 4, true, { { 0, 2, 4, 0, 0 }, { 0, 1, 4, 0, 0 }, { 0, 0, 4, 0, 0 }, { 0, 3, 4, 0, 0 } } },
+    { VA_FOURCC_BGRX, true, 4, false, { { 0, 2, 4, 0, 0 }, { 0, 1, 4, 0, 0 }, { 0, 0, 4, 0, 0 }, { 0, 3, 4, 0, 0 } } },
+};
+
+/* Filter taps of one axis: output sample i reads <taps> input samples from
+ * start[i] on, weighted by coefs[i * taps ...]. <taps> is a multiple of 4,
+ * the unused taps weigh 0. */
+typedef struct _ScaleAxis {
+    uint32_t src_len;
+    uint32_t dst_len;
+    uint32_t taps;
+    int32_t *start;
+    float *coefs;
+} ScaleAxis;
+
+#define SCALE_MAX_AXES 4
+
+enum {
+    SCALE_CSC_NONE,
+    SCALE_CSC_YUV_TO_RGB,
+    SCALE_CSC_RGB_TO_YUV,
+};
+
+struct _VPPScaler {
+    int filter;
+    const ScaleFormat *src_format;
+    const ScaleFormat *dst_format;
+    uint32_t src_width, src_height;
+    uint32_t dst_width, dst_height;
+
+    int csc;
+    float matrix[3][3];
+    float offset[3];
+
+    /* components before and after scaling, each packed at its own size */
+    float *src_planes[4];
+    float *dst_planes[4];
+    uint32_t src_sizes[4][2];
+    uint32_t dst_sizes[4][2];
+    uint32_t num_scaled;        /* components that go through the filter */
+
+    ScaleAxis axes[SCALE_MAX_AXES];
+    uint32_t num_axes;
+    float *row;                 /* input row with replicated edges */
+    float *tmp;                 /* output of the horizontal pass */
+};
+
+static const ScaleFormat *
+scale_format(uint32_t fourcc)
+{
+    uint32_t i;
+
+    for (i = 0; i < sizeof(scale_formats) / sizeof(scale_formats[0]); i++) {
+        if (scale_formats[i].fourcc == fourcc)
+            return &scale_formats[i];
+    }
+    return NULL;
+}
+
+bool
+vpp_scale_supported(uint32_t fourcc)
+{
+    return scale_format(fourcc) != NULL;
+}
+
+static void
+comp_size(const ScaleComp *comp, uint32_t width, uint32_t height, uint32_t size[2])
+{
+    size[0] = (width + (1 << comp->x_shift) - 1) >> comp->x_shift;
+    size[1] = (height + (1 << comp->y_shift) - 1) >> comp->y_shift;
+}
+
+static float
+filter_support(int filter)
+{
+    return filter == VPP_SCALE_LANCZOS ? 3.0f : filter == VPP_SCALE_BICUBIC ? 2.0f : 1.0f;
+}
+
+static double
+filter_weight(int filter, double x)
+{
+    const double a = -0.5;
+
+    x = fabs(x);
+    switch (filter) {
+    case VPP_SCALE_BICUBIC:
+        if (x < 1)
+            return ((a + 2) * x - (a + 3)) * x * x + 1;
+        if (x < 2)
+            return ((a * x - 5 * a) * x + 8 * a) * x - 4 * a;
+        return 0;
+    case VPP_SCALE_LANCZOS:
+        if (x < 1e-8)
+            return 1;
+        if (x < 3)
+            return 3 * sin(M_PI * x) * sin(M_PI * x / 3) / (M_PI * M_PI * x * x);
+        return 0;
+    default:
+        return x < 1 ? 1 - x : 0;
+    }
+}
+
+/* Taps for <src_len> to <dst_len> samples with centered sample positions.
+ * When scaling down the filter is stretched by the ratio so that every
+ * input sample contributes. */
+static int
+axis_init(ScaleAxis *axis, int filter, uint32_t src_len, uint32_t dst_len)
+{
+    double scale = (double)src_len / dst_len;
+    double stretch = scale > 1 ? scale : 1;
+    double support = filter_support(filter) * stretch;
+    double center, sum;
+    int32_t first, last;
+    uint32_t i, k, n;
+
+    axis->src_len = src_len;
+    axis->dst_len = dst_len;
+    axis->taps = ((uint32_t)ceil(2 * support) + 1 + 3) & ~3;
+    axis->start = (int32_t *)malloc(dst_len * sizeof(int32_t));
+    axis->coefs = (float *)calloc((size_t)dst_len * axis->taps, sizeof(float));
+    if (!axis->start || !axis->coefs)
+        return -1;
+
+    for (i = 0; i < dst_len; i++) {
+        center = (i + 0.5) * scale - 0.5;
+        first = (int32_t)floor(center - support) + 1;
+        last = (int32_t)floor(center + support);
+        n = last - first + 1;
+        if (n > axis->taps)
+            n = axis->taps;
+
+        sum = 0;
+        for (k = 0; k < n; k++)
+            sum += filter_weight(filter, (first + (int32_t)k - center) / stretch);
+        for (k = 0; k < n; k++)
+            axis->coefs[i * axis->taps + k] =
+                (float)(filter_weight(filter, (first + (int32_t)k - center) / stretch) / sum);
+        axis->start[i] = first;
+    }
+    return 0;
+}
+
+static const ScaleAxis *
+scaler_axis(VPPScaler *scaler, uint32_t src_len, uint32_t dst_len)
+{
+    ScaleAxis *axis;
+    uint32_t i;
+
+    for (i = 0; i < scaler->num_axes; i++) {
+        if (scaler->axes[i].src_len == src_len && scaler->axes[i].dst_len == dst_len)
+            return &scaler->axes[i];
+    }
+
+    if (scaler->num_axes == SCALE_MAX_AXES)
+        return NULL;
+    axis = &scaler->axes[scaler->num_axes++];
+    if (axis_init(axis, scaler->filter, src_len, dst_len))
+        return NULL;
+    return axis;
+}
+
+static inline v4f
+load4(const float *p)
+{
+    v4f v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void
+store4(float *p, v4f v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+/* One input row through the horizontal taps into <dst> */
+static void
+scale_row(const ScaleAxis *axis, float *row, const float *src, float *dst)
+{
+    uint32_t pad = axis->taps + 1;
+    uint32_t i, k;
+    const float *coefs, *in;
+    v4f acc;
+
+    for (i = 0; i < pad; i++) {
+        row[i] = src[0];
+        row[pad + axis->src_len + i] = src[axis->src_len - 1];
+    }
+    memcpy(row + pad, src, axis->src_len * sizeof(float));
+
+    for (i = 0; i < axis->dst_len; i++) {
+        coefs = axis->coefs + (size_t)i * axis->taps;
+        in = row + pad + axis->start[i];
+        acc = load4(coefs) * load4(in);
+        for (k = 4; k < axis->taps; k += 4)
+            acc += load4(coefs + k) * load4(in + k);
+        dst[i] = acc[0] + acc[1] + acc[2] + acc[3];
+    }
+}
+
+/* Accumulate <coef> times <src> into <dst> */
+static void
+row_madd(float *dst, const float *src, float coef, uint32_t n, bool first)
+{
+    uint32_t i = 0;
+
+    if (first) {
+        for (; i + 4 <= n; i += 4)
+            store4(dst + i, load4(src + i) * coef);
+        for (; i < n; i++)
+            dst[i] = src[i] * coef;
+    } else {
+        for (; i + 4 <= n; i += 4)
+            store4(dst + i, load4(dst + i) + load4(src + i) * coef);
+        for (; i < n; i++)
+            dst[i] += src[i] * coef;
+    }
+}
+
+static void
+scale_plane(VPPScaler *scaler, const float *src, const uint32_t src_size[2],
+            float *dst, const uint32_t dst_size[2])
+{
+    const ScaleAxis *h, *v;
+    uint32_t x, y, k;
+    int32_t row;
+    bool first;
+
+    if (src_size[0] == dst_size[0] && src_size[1] == dst_size[1]) {
+        memcpy(dst, src, (size_t)src_size[0] * src_size[1] * sizeof(float));
+        return;
+    }
+
+    /* set up by vpp_scaler_create */
+    h = scaler_axis(scaler, src_size[0], dst_size[0]);
+    v = scaler_axis(scaler, src_size[1], dst_size[1]);
+
+    for (y = 0; y < src_size[1]; y++)
+        scale_row(h, scaler->row, src + (size_t)y * src_size[0],
+                  scaler->tmp + (size_t)y * dst_size[0]);
+
+    for (y = 0; y < dst_size[1]; y++) {
+        first = true;
+        for (k = 0; k < v->taps; k++) {
+            float coef = v->coefs[(size_t)y * v->taps + k];
+
+            if (coef == 0)
+                continue;
+            row = v->start[y] + (int32_t)k;
+            row = row < 0 ? 0 : row >= (int32_t)src_size[1] ? src_size[1] - 1 : row;
+            row_madd(dst + (size_t)y * dst_size[0], scaler->tmp + (size_t)row * dst_size[0],
+                     coef, dst_size[0], first);
+            first = false;
+        }
+        if (first) {
+            for (x = 0; x < dst_size[0]; x++)
+                dst[(size_t)y * dst_size[0] + x] = 0;
+        }
+    }
+}
+
+/* In place 3x3 matrix over three planes of <n> samples */
+static void
+planes_csc(const VPPScaler *scaler, float *p0, float *p1, float *p2, size_t n)
+{
+    const float (*m)[3] = scaler->matrix;
+    const float *o = scaler->offset;
+    size_t i = 0;
+    v4f a, b, c;
+    float sa, sb, sc;
+
+    for (; i + 4 <= n; i += 4) {
+        a = load4(p0 + i);
+        b = load4(p1 + i);
+        c = load4(p2 + i);
+        store4(p0 + i, a * m[0][0] + b * m[0][1] + c * m[0][2] + o[0]);
+        store4(p1 + i, a * m[1][0] + b * m[1][1] + c * m[1][2] + o[1]);
+        store4(p2 + i, a * m[2][0] + b * m[2][1] + c * m[2][2] + o[2]);
+    }
+    for (; i < n; i++) {
+        sa = p0[i];
+        sb = p1[i];
+        sc = p2[i];
+        p0[i] = sa * m[0][0] + sb * m[0][1] + sc * m[0][2] + o[0];
+        p1[i] = sa * m[1][0] + sb * m[1][1] + sc * m[1][2] + o[1];
+        p2[i] = sa * m[2][0] + sb * m[2][1] + sc * m[2][2] + o[2];
+    }
+}
+
+/* Y'CbCr weights, then the matrix from the YUV side range to 0..255 RGB or
+ * the other way round */
+static void
+scaler_matrix(VPPScaler *scaler, int matrix, bool full_range)
+{
+    static const float weights[3][2] = {
+        { 0.299f, 0.114f },             /* BT.601 */
+        { 0.2126f, 0.0722f },           /* BT.709 */
+        { 0.2627f, 0.0593f },           /* BT.2020 */
+    };
+    float kr = weights[matrix][0], kb = weights[matrix][1], kg = 1 - kr - kb;
+    float y_scale = full_range ? 1 : 219 / 255.0f;
+    float c_scale = full_range ? 1 : 224 / 255.0f;
+    float y_offset = full_range ? 0 : 16;
+    float (*m)[3] = scaler->matrix;
+    int i;
+
+    if (scaler->csc == SCALE_CSC_YUV_TO_RGB) {
+        float ys = 1 / y_scale, cs = 1 / c_scale;
+
+        m[0][0] = ys;
+        m[0][1] = 0;
+        m[0][2] = 2 * (1 - kr) * cs;
+        m[1][0] = ys;
+        m[1][1] = -2 * kb * (1 - kb) / kg * cs;
+        m[1][2] = -2 * kr * (1 - kr) / kg * cs;
+        m[2][0] = ys;
+        m[2][1] = 2 * (1 - kb) * cs;
+        m[2][2] = 0;
+        for (i = 0; i < 3; i++)
+            scaler->offset[i] = -ys * y_offset - 128 * (m[i][1] + m[i][2]);
+    } else {
+        m[0][0] = kr * y_scale;
+        m[0][1] = kg * y_scale;
+        m[0][2] = kb * y_scale;
+        m[1][0] = -kr / (2 * (1 - kb)) * c_scale;
+        m[1][1] = -kg / (2 * (1 - kb)) * c_scale;
+        m[1][2] = (1 - kb) / (2 * (1 - kb)) * c_scale;
+        m[2][0] = (1 - kr) / (2 * (1 - kr)) * c_scale;
+        m[2][1] = -kg / (2 * (1 - kr)) * c_scale;
+        m[2][2] = -kb / (2 * (1 - kr)) * c_scale;
+        scaler->offset[0] = y_offset;
+        scaler->offset[1] = 128;
+        scaler->offset[2] = 128;
+    }
+}
+
+VPPScaler *
+vpp_scaler_create(int filter, int matrix, bool full_range,
+                  uint32_t src_fourcc, uint32_t src_width, uint32_t src_height,
+                  uint32_t dst_fourcc, uint32_t dst_width, uint32_t dst_height)
+{
+    VPPScaler *scaler;
+    const ScaleAxis *h, *v;
+    uint32_t c, max_row = 1, max_tmp = 1;
+
+    if (!scale_format(src_fourcc) || !scale_format(dst_fourcc)) {
+        printf("CPU reference does not handle format 0x%x to 0x%x\n", src_fourcc, dst_fourcc);
+        return NULL;
+    }
+    if (!src_width || !src_height || !dst_width || !dst_height ||
+        filter < VPP_SCALE_BILINEAR || filter > VPP_SCALE_LANCZOS ||
+        matrix < VPP_SCALE_BT601 || matrix > VPP_SCALE_BT2020) {
+        printf("CPU reference parameters out of range\n");
+        return NULL;
+    }
+
+    scaler = (VPPScaler *)calloc(1, sizeof(*scaler));
+    if (!scaler)
+        return NULL;
+
+    scaler->filter = filter;
+    scaler->src_format = scale_format(src_fourcc);
+    scaler->dst_format = scale_format(dst_fourcc);
+    scaler->src_width = src_width;
+    scaler->src_height = src_height;
+    scaler->dst_width = dst_width;
+    scaler->dst_height = dst_height;
+
+    if (scaler->src_format->rgb == scaler->dst_format->rgb)
+        scaler->csc = SCALE_CSC_NONE;
+    else
+        scaler->csc = scaler->src_format->rgb ? SCALE_CSC_RGB_TO_YUV : SCALE_CSC_YUV_TO_RGB;
+    if (scaler->csc != SCALE_CSC_NONE)
+        scaler_matrix(scaler, matrix, full_range);
+
+    /* alpha is only carried from RGBA to RGBA, otherwise it is opaque */
+    scaler->num_scaled = scaler->src_format->alpha && scaler->dst_format->alpha ? 4 : 3;
+
+    for (c = 0; c < scaler->num_scaled; c++) {
+        /* the matrix needs all three components at one size */
+        if (scaler->csc == SCALE_CSC_RGB_TO_YUV) {
+            scaler->src_sizes[c][0] = src_width;
+            scaler->src_sizes[c][1] = src_height;
+        } else {
+            comp_size(&scaler->src_format->comps[c], src_width, src_height, scaler->src_sizes[c]);
+        }
+        if (scaler->csc == SCALE_CSC_YUV_TO_RGB) {
+            scaler->dst_sizes[c][0] = dst_width;
+            scaler->dst_sizes[c][1] = dst_height;
+        } else {
+            comp_size(&scaler->dst_format->comps[c], dst_width, dst_height, scaler->dst_sizes[c]);
+        }
+
+        scaler->src_planes[c] = (float *)malloc((size_t)scaler->src_sizes[c][0] *
+                                                scaler->src_sizes[c][1] * sizeof(float));
+        scaler->dst_planes[c] = (float *)malloc((size_t)scaler->dst_sizes[c][0] *
+                                                scaler->dst_sizes[c][1] * sizeof(float));
+        if (!scaler->src_planes[c] || !scaler->dst_planes[c])
+            goto error;
+
+        if (scaler->src_sizes[c][0] == scaler->dst_sizes[c][0] &&
+            scaler->src_sizes[c][1] == scaler->dst_sizes[c][1])
+            continue;
+
+        h = scaler_axis(scaler, scaler->src_sizes[c][0], scaler->dst_sizes[c][0]);
+        v = scaler_axis(scaler, scaler->src_sizes[c][1], scaler->dst_sizes[c][1]);
+        if (!h || !v)
+            goto error;
+
+        /* scale_row pads the input row by taps + 1 on both ends */
+        if (h->src_len + 2 * (h->taps + 1) > max_row)
+            max_row = h->src_len + 2 * (h->taps + 1);
+        if (h->dst_len * v->src_len > max_tmp)
+            max_tmp = h->dst_len * v->src_len;
+    }
+
+    scaler->row = (float *)malloc((size_t)max_row * sizeof(float));
+    scaler->tmp = (float *)malloc((size_t)max_tmp * sizeof(float));
+    if (!scaler->row || !scaler->tmp)
+        goto error;
+
+    return scaler;
+
+error:
+    printf("CPU reference out of memory\n");
+    vpp_scaler_destroy(scaler);
+    return NULL;
+}
+
+void
+vpp_scaler_destroy(VPPScaler *scaler)
+{
+    uint32_t i;
+
+    for (i = 0; i < 4; i++) {
+        free(scaler->src_planes[i]);
+        free(scaler->dst_planes[i]);
+    }
+    for (i = 0; i < scaler->num_axes; i++) {
+        free(scaler->axes[i].start);
+        free(scaler->axes[i].coefs);
+    }
+    free(scaler->row);
+    free(scaler->tmp);
+    free(scaler);
+}
+
+static void
+comp_gather(const VPPScaleFrame *frame, const ScaleComp *comp, float *dst,
+            const uint32_t size[2])
+{
+    const uint8_t *src;
+    uint32_t x, y;
+
+    for (y = 0; y < size[1]; y++) {
+        src = frame->planes[comp->plane] + (size_t)y * frame->pitches[comp->plane] + comp->offset;
+        for (x = 0; x < size[0]; x++)
+            dst[x] = src[x * comp->step];
+        dst += size[0];
+    }
+}
+
+static void
+comp_scatter(const VPPScaleFrame *frame, const ScaleComp *comp, const float *src,
+             const uint32_t size[2])
+{
+    uint8_t *dst;
+    uint32_t x, y;
+    float v;
+
+    for (y = 0; y < size[1]; y++) {
+        dst = frame->planes[comp->plane] + (size_t)y * frame->pitches[comp->plane] + comp->offset;
+        /* written so that the clamp becomes min/max instructions */
+        for (x = 0; x < size[0]; x++) {
+            v = src[x] + 0.5f;
+            v = v > 0 ? v : 0;
+            v = v < 255 ? v : 255;
+            dst[x * comp->step] = (uint8_t)(int)v;
+        }
+        src += size[0];
+    }
+}
+
+static void
+comp_fill(const VPPScaleFrame *frame, const ScaleComp *comp, uint8_t value)
+{
+    uint8_t *dst;
+    uint32_t x, y;
+
+    for (y = 0; y < frame->height; y++) {
+        dst = frame->planes[comp->plane] + (size_t)y * frame->pitches[comp->plane] + comp->offset;
+        for (x = 0; x < frame->width; x++)
+            dst[x * comp->step] = value;
+    }
+}
+
+void
+vpp_scaler_run(VPPScaler *scaler, const VPPScaleFrame *src, const VPPScaleFrame *dst)
+{
+    float **in = scaler->src_planes, **out = scaler->dst_planes;
+    uint32_t c;
+
+    for (c = 0; c < scaler->num_scaled; c++)
+        comp_gather(src, &scaler->src_format->comps[c], in[c], scaler->src_sizes[c]);
+
+    if (scaler->csc == SCALE_CSC_RGB_TO_YUV)
+        planes_csc(scaler, in[0], in[1], in[2], (size_t)src->width * src->height);
+
+    for (c = 0; c < scaler->num_scaled; c++)
+        scale_plane(scaler, in[c], scaler->src_sizes[c], out[c], scaler->dst_sizes[c]);
+
+    if (scaler->csc == SCALE_CSC_YUV_TO_RGB)
+        planes_csc(scaler, out[0], out[1], out[2], (size_t)dst->width * dst->height);
+
+    for (c = 0; c < scaler->num_scaled; c++)
+        comp_scatter(dst, &scaler->dst_format->comps[c], out[c], scaler->dst_sizes[c]);
+    if (scaler->dst_format->num_comps > scaler->num_scaled)
+        comp_fill(dst, &scaler->dst_format->comps[3], 255);
+}
+
+void
+vpp_scale_compare(const VPPScaleFrame *a, const VPPScaleFrame *b,
+                  double sq_err[3], uint64_t samples[3])
+{
+    const ScaleFormat *format = scale_format(a->fourcc);
+    const ScaleComp *comp;
+    const uint8_t *pa, *pb;
+    uint32_t c, x, y, size[2];
+    int diff;
+
+    for (c = 0; c < 3; c++) {
+        comp = &format->comps[c];
+        comp_size(comp, a->width, a->height, size);
+        for (y = 0; y < size[1]; y++) {
+            pa = a->planes[comp->plane] + (size_t)y * a->pitches[comp->plane] + comp->offset;
+            pb = b->planes[comp->plane] + (size_t)y * b->pitches[comp->plane] + comp->offset;
+            for (x = 0; x < size[0]; x++) {
+                diff = pa[x * comp->step] - pb[x * comp->step];
+                sq_err[c] += diff * diff;
+            }
+        }
+        samples[c] += (uint64_t)size[0] * size[1];
+    }
+}
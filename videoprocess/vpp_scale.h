@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL INTEL AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef VPP_SCALE_H
+#define VPP_SCALE_H
+
+#include <stdint.h>
+
+/*
+ * CPU reference scaler and color space converter for vppscaling_csc.
+ *
+ * Converts 8 bit frames between NV12, I420, YV12, YUY2, UYVY, RGBA, RGBX,
+ * BGRA and BGRX at any size. Each component is gathered into a float plane,
+ * scaled with a separable filter (horizontal pass into a float row buffer,
+ * then vertical pass), converted with a 3x3 matrix when going between YUV
+ * and RGB, and stored back with rounding. YUV to RGB scales the chroma
+ * straight to the output size, RGB to YUV converts at the input size and
+ * scales the chroma down afterwards. Chroma samples are taken as centered.
+ *
+ * Filter taps and the row buffers are set up once per scaler, the inner
+ * loops work on float vectors of the compiler vector extension.
+ */
+
+enum {
+    VPP_SCALE_BILINEAR = 1,
+    VPP_SCALE_BICUBIC = 2,      /* Catmull-Rom */
+    VPP_SCALE_LANCZOS = 3,      /* 3 lobes */
+};
+
+enum {
+    VPP_SCALE_BT601 = 0,
+    VPP_SCALE_BT709 = 1,
+    VPP_SCALE_BT2020 = 2,
+};
+
+typedef struct _VPPScaleFrame {
+    uint32_t fourcc;
+    uint32_t width;
+    uint32_t height;
+    uint8_t *planes[3];
+    uint32_t pitches[3];
+} VPPScaleFrame;
+
+typedef struct _VPPScaler VPPScaler;
+
+/* Returns true for the formats the scaler reads and writes */
+bool
+vpp_scale_supported(uint32_t fourcc);
+
+/* <full_range> selects 0..255 YUV instead of 16..235/240. Returns NULL
+ * with a message for formats or sizes it does not handle */
+VPPScaler *
+vpp_scaler_create(int filter, int matrix, bool full_range,
+                  uint32_t src_fourcc, uint32_t src_width, uint32_t src_height,
+                  uint32_t dst_fourcc, uint32_t dst_width, uint32_t dst_height);
+
+void
+vpp_scaler_destroy(VPPScaler *scaler);
+
+/* Convert <src> into <dst>, both in the formats and sizes of the scaler */
+void
+vpp_scaler_run(VPPScaler *scaler, const VPPScaleFrame *src, const VPPScaleFrame *dst);
+
+/* Add the squared differences of the color components (Y, U, V or R, G, B,
+ * alpha is skipped) of two frames of the same format and size to <sq_err>
+ * and their sample counts to <samples> */
+void
+vpp_scale_compare(const VPPScaleFrame *a, const VPPScaleFrame *b,
+                  double sq_err[3], uint64_t samples[3]);
+
+#endif /* VPP_SCALE_H */
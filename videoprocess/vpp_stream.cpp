@@ -0,0 +1,383 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL INTEL AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "vpp_stream.h"
+
+/*
+ * Bytes [head, tail) of the ring are valid: for a read stream the thread
+ * appends what read() returned and fread() consumes from head, for a write
+ * stream fwrite() appends and the thread write()s from head. Both counters
+ * only grow, the ring offset is the counter modulo the ring size. Each side
+ * copies outside the lock, as only the consumer touches [head, tail) and
+ * only the producer the rest.
+ */
+typedef struct _VPPStream {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+
+    int fd;
+    int wake[2];        /* read stream: wakes the thread out of poll() */
+    bool writing;
+    uint8_t *ring;
+    uint64_t head;
+    uint64_t tail;
+    bool eof;
+    bool exit;
+    int error;          /* errno of the failed read() or write() */
+} VPPStream;
+
+/* duplicate of the original stdout once reserved, -1 before and once
+ * handed to a stream */
+static int g_stdout_fd = -1;
+static bool g_stdout_reserved = false;
+
+static void *
+stream_reader(void *arg)
+{
+    VPPStream *s = (VPPStream *)arg;
+    struct pollfd fds[2];
+    size_t pos, len;
+    ssize_t n;
+    int err;
+
+    fds[0].fd = s->fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = s->wake[0];
+    fds[1].events = POLLIN;
+
+    pthread_mutex_lock(&s->lock);
+    for (;;) {
+        while (!s->exit && s->tail - s->head == VPP_STREAM_RING_SIZE)
+            pthread_cond_wait(&s->cond, &s->lock);
+        if (s->exit)
+            break;
+
+        pos = s->tail % VPP_STREAM_RING_SIZE;
+        len = VPP_STREAM_RING_SIZE - (s->tail - s->head);
+        if (len > VPP_STREAM_RING_SIZE - pos)
+            len = VPP_STREAM_RING_SIZE - pos;
+        pthread_mutex_unlock(&s->lock);
+
+        /* the producer may keep the pipe open after the sample stopped
+         * reading, so only block where fclose() can interrupt */
+        fds[1].revents = 0;
+        err = 0;
+        n = poll(fds, 2, -1);
+        if (n > 0 && !fds[1].revents)
+            n = read(s->fd, s->ring + pos, len);
+        if (n < 0 && errno != EINTR)
+            err = errno;
+
+        pthread_mutex_lock(&s->lock);
+        if (fds[1].revents)
+            break;
+        if (n > 0)
+            s->tail += n;
+        else if (n == 0)
+            s->eof = true;
+        else
+            s->error = err;
+        pthread_cond_broadcast(&s->cond);
+        if (s->eof || s->error)
+            break;
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    return NULL;
+}
+
+static void *
+stream_writer(void *arg)
+{
+    VPPStream *s = (VPPStream *)arg;
+    size_t pos, len;
+    ssize_t n;
+    int err;
+
+    pthread_mutex_lock(&s->lock);
+    for (;;) {
+        while (!s->exit && s->tail == s->head)
+            pthread_cond_wait(&s->cond, &s->lock);
+        if (s->tail == s->head)
+            break;
+
+        pos = s->head % VPP_STREAM_RING_SIZE;
+        len = s->tail - s->head;
+        if (len > VPP_STREAM_RING_SIZE - pos)
+            len = VPP_STREAM_RING_SIZE - pos;
+        pthread_mutex_unlock(&s->lock);
+
+        n = write(s->fd, s->ring + pos, len);
+        err = n < 0 ? errno : EIO;
+
+        pthread_mutex_lock(&s->lock);
+        if (n > 0) {
+            s->head += n;
+        } else if (err != EINTR) {
+            /* drop the rest, fwrite() and fclose() report the error */
+            s->error = err;
+            s->head = s->tail;
+            pthread_cond_broadcast(&s->cond);
+            break;
+        }
+        pthread_cond_broadcast(&s->cond);
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    return NULL;
+}
+
+static ssize_t
+stream_read(void *cookie, char *buf, size_t size)
+{
+    VPPStream *s = (VPPStream *)cookie;
+    size_t pos, len;
+
+    pthread_mutex_lock(&s->lock);
+    while (s->tail == s->head && !s->eof && !s->error)
+        pthread_cond_wait(&s->cond, &s->lock);
+    if (s->tail == s->head) {
+        pthread_mutex_unlock(&s->lock);
+        if (!s->error)
+            return 0;
+        errno = s->error;
+        return -1;
+    }
+
+    pos = s->head % VPP_STREAM_RING_SIZE;
+    len = s->tail - s->head;
+    pthread_mutex_unlock(&s->lock);
+
+    if (len > VPP_STREAM_RING_SIZE - pos)
+        len = VPP_STREAM_RING_SIZE - pos;
+    if (len > size)
+        len = size;
+    memcpy(buf, s->ring + pos, len);
+
+    pthread_mutex_lock(&s->lock);
+    s->head += len;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+
+    return len;
+}
+
+static ssize_t
+stream_write(void *cookie, const char *buf, size_t size)
+{
+    VPPStream *s = (VPPStream *)cookie;
+    size_t done = 0, pos, len;
+
+    while (done < size) {
+        pthread_mutex_lock(&s->lock);
+        while (s->tail - s->head == VPP_STREAM_RING_SIZE && !s->error)
+            pthread_cond_wait(&s->cond, &s->lock);
+        if (s->error) {
+            pthread_mutex_unlock(&s->lock);
+            errno = s->error;
+            return -1;
+        }
+
+        pos = s->tail % VPP_STREAM_RING_SIZE;
+        len = VPP_STREAM_RING_SIZE - (s->tail - s->head);
+        pthread_mutex_unlock(&s->lock);
+
+        if (len > VPP_STREAM_RING_SIZE - pos)
+            len = VPP_STREAM_RING_SIZE - pos;
+        if (len > size - done)
+            len = size - done;
+        memcpy(s->ring + pos, buf + done, len);
+        done += len;
+
+        pthread_mutex_lock(&s->lock);
+        s->tail += len;
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+    }
+
+    return size;
+}
+
+static void
+stream_free(VPPStream *s)
+{
+    if (s->wake[0] >= 0) {
+        close(s->wake[0]);
+        close(s->wake[1]);
+    }
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->lock);
+    free(s->ring);
+    free(s);
+}
+
+static int
+stream_close(void *cookie)
+{
+    VPPStream *s = (VPPStream *)cookie;
+    int ret = 0;
+
+    pthread_mutex_lock(&s->lock);
+    s->exit = true;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    if (!s->writing && write(s->wake[1], "", 1) < 0)
+        ret = -1;
+
+    pthread_join(s->thread, NULL);
+
+    if (s->writing && s->error) {
+        errno = s->error;
+        ret = -1;
+    }
+    if (close(s->fd) && s->writing)
+        ret = -1;
+    stream_free(s);
+
+    return ret;
+}
+
+static FILE *
+stream_create(int fd, bool writing)
+{
+    cookie_io_functions_t io = { stream_read, stream_write, NULL, stream_close };
+    VPPStream *s;
+    FILE *fp;
+
+    s = (VPPStream *)calloc(1, sizeof(*s));
+    if (!s)
+        return NULL;
+
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    s->fd = fd;
+    s->writing = writing;
+    s->wake[0] = s->wake[1] = -1;
+    s->ring = (uint8_t *)malloc(VPP_STREAM_RING_SIZE);
+    if (!s->ring || (!writing && pipe(s->wake))) {
+        stream_free(s);
+        return NULL;
+    }
+
+    if (pthread_create(&s->thread, NULL, writing ? stream_writer : stream_reader, s)) {
+        stream_free(s);
+        return NULL;
+    }
+
+    fp = fopencookie(s, writing ? "w" : "r", io);
+    if (!fp) {
+        /* stream_close() would close the caller's fd */
+        s->fd = -1;
+        stream_close(s);
+        return NULL;
+    }
+
+    /* the ring already buffers, let fread/fwrite reach it directly */
+    setvbuf(fp, NULL, _IONBF, 0);
+
+    return fp;
+}
+
+int
+vpp_stream_reserve_stdout(void)
+{
+    if (g_stdout_reserved)
+        return 0;
+
+    fflush(stdout);
+    g_stdout_fd = dup(STDOUT_FILENO);
+    if (g_stdout_fd < 0)
+        return -1;
+    if (dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+        close(g_stdout_fd);
+        g_stdout_fd = -1;
+        return -1;
+    }
+    g_stdout_reserved = true;
+
+    return 0;
+}
+
+int
+vpp_stream_is_pipe(const char *name)
+{
+    struct stat st;
+
+    if (!strcmp(name, "-"))
+        return 1;
+
+    /* a file that does not exist yet is created as a regular one */
+    return !stat(name, &st) && !S_ISREG(st.st_mode);
+}
+
+FILE *
+vpp_stream_open(const char *name, const char *mode)
+{
+    bool writing = mode[0] == 'w';
+    struct stat st;
+    FILE *fp;
+    int fd;
+
+    if (strcmp(name, "-")) {
+        if (!vpp_stream_is_pipe(name))
+            return fopen(name, mode);
+        fd = open(name, writing ? O_WRONLY | O_CREAT | O_TRUNC : O_RDONLY, 0644);
+    } else if (writing) {
+        if (vpp_stream_reserve_stdout())
+            return NULL;
+        if (g_stdout_fd < 0) {
+            errno = EBUSY;
+            return NULL;
+        }
+        fd = g_stdout_fd;
+        g_stdout_fd = -1;
+    } else {
+        fd = dup(STDIN_FILENO);
+    }
+    if (fd < 0)
+        return NULL;
+
+    /* "-" redirected from or to a file needs no ring */
+    if (!fstat(fd, &st) && S_ISREG(st.st_mode))
+        fp = fdopen(fd, mode);
+    else
+        fp = stream_create(fd, writing);
+
+    if (!fp)
+        close(fd);
+
+    return fp;
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL INTEL AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef VPP_STREAM_H
+#define VPP_STREAM_H
+
+#include <stdio.h>
+
+/*
+ * Frame file streams shared by the video process samples.
+ *
+ * A SRC/DST file name of "-" selects stdin/stdout, so a sample can sit in a
+ * shell pipeline between a capture process and an encoder. Regular files
+ * are opened with fopen() and stay seekable. Pipes, FIFOs and sockets get a
+ * ring buffer of VPP_STREAM_RING_SIZE bytes that a thread of the stream
+ * fills (read) or drains (write), so the process on the other end of the
+ * pipe runs while the sample waits on the GPU instead of once per fread or
+ * fwrite. fread() returns a short count at the end of the input and the
+ * stream reports feof(). fclose() flushes the ring and stops the thread.
+ *
+ * Frames written to "-" leave through a duplicate of the original stdout
+ * while fd 1 is pointed at stderr, so the printf diagnostics of the sample
+ * do not end up in the frame data. Samples call vpp_stream_reserve_stdout()
+ * right after reading the config, before anything else is printed.
+ */
+
+#define VPP_STREAM_RING_SIZE (8 << 20)
+
+/* Keep the original stdout for vpp_stream_open("-", "w") and send
+ * everything printed from now on to stderr. Returns -1 on error */
+int
+vpp_stream_reserve_stdout(void);
+
+/* <mode> is "r" or "w". Returns NULL on error, with errno set */
+FILE *
+vpp_stream_open(const char *name, const char *mode);
+
+/* Returns 1 if <name> is "-" or not a regular file, i.e. it can neither be
+ * seeked nor mapped */
+int
+vpp_stream_is_pipe(const char *name);
+
+#endif /* VPP_STREAM_H */
@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL INTEL AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "vpp_writer.h"
+
+/*
+ * Buffers [head, head + queued) are waiting for or being written by the
+ * thread, buffer <tail> is the one acquire hands out. It is never touched
+ * by the thread, so it can grow without holding the lock.
+ */
+struct _VPPWriter {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+
+    FILE *fp;
+    uint32_t num_buffers;
+    uint8_t *buffers[VPP_WRITER_MAX_BUFFERS];
+    size_t capacity[VPP_WRITER_MAX_BUFFERS];
+    size_t size[VPP_WRITER_MAX_BUFFERS];
+
+    uint32_t head;
+    uint32_t tail;
+    uint32_t queued;
+    bool exit;
+    int error;
+
+    VPPWriterStats stats;
+};
+
+static double
+elapsed(const struct timeval *start, const struct timeval *end)
+{
+    return (end->tv_sec - start->tv_sec) +
+           (end->tv_usec - start->tv_usec) / 1000000.0;
+}
+
+static void *
+writer_thread(void *arg)
+{
+    VPPWriter *w = (VPPWriter *)arg;
+    struct timeval start_time, end_time;
+    uint8_t *buf;
+    size_t size;
+    int ret;
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (!w->exit && !w->queued)
+            pthread_cond_wait(&w->cond, &w->lock);
+        if (!w->queued)
+            break;
+
+        buf = w->buffers[w->head];
+        size = w->size[w->head];
+        pthread_mutex_unlock(&w->lock);
+
+        /* after a failed write the rest is only drained, so that
+         * acquire never waits forever */
+        ret = 0;
+        if (!w->error) {
+            gettimeofday(&start_time, NULL);
+            ret = fwrite(buf, size, 1, w->fp) == 1 ? 0 : -1;
+            gettimeofday(&end_time, NULL);
+            w->stats.write_time += elapsed(&start_time, &end_time);
+        }
+
+        pthread_mutex_lock(&w->lock);
+        if (ret) {
+            printf("Write of %zu bytes failed\n", size);
+            w->error = 1;
+        } else if (!w->error) {
+            w->stats.bytes += size;
+            w->stats.frames++;
+        }
+        w->head = (w->head + 1) % w->num_buffers;
+        w->queued--;
+        pthread_cond_broadcast(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    return NULL;
+}
+
+VPPWriter *
+vpp_writer_create(FILE *fp, uint32_t num_buffers)
+{
+    VPPWriter *w;
+
+    if (num_buffers < 1 || num_buffers > VPP_WRITER_MAX_BUFFERS) {
+        printf("Writer buffer count %d out of range 1..%d\n",
+               num_buffers, VPP_WRITER_MAX_BUFFERS);
+        return NULL;
+    }
+
+    w = (VPPWriter *)calloc(1, sizeof(*w));
+    if (!w)
+        return NULL;
+
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    w->fp = fp;
+    w->num_buffers = num_buffers;
+    w->stats.num_buffers = num_buffers;
+
+    if (pthread_create(&w->thread, NULL, writer_thread, w)) {
+        pthread_cond_destroy(&w->cond);
+        pthread_mutex_destroy(&w->lock);
+        free(w);
+        return NULL;
+    }
+
+    return w;
+}
+
+uint8_t *
+vpp_writer_acquire(VPPWriter *w, size_t size)
+{
+    struct timeval start_time, end_time;
+    uint8_t *buf;
+    uint32_t tail;
+
+    pthread_mutex_lock(&w->lock);
+    if (w->queued == w->num_buffers) {
+        gettimeofday(&start_time, NULL);
+        while (w->queued == w->num_buffers)
+            pthread_cond_wait(&w->cond, &w->lock);
+        gettimeofday(&end_time, NULL);
+        w->stats.stall_time += elapsed(&start_time, &end_time);
+    }
+    tail = w->tail;
+    pthread_mutex_unlock(&w->lock);
+
+    if (w->capacity[tail] < size) {
+        buf = (uint8_t *)realloc(w->buffers[tail], size);
+        if (!buf)
+            return NULL;
+        w->buffers[tail] = buf;
+        w->capacity[tail] = size;
+    }
+
+    return w->buffers[tail];
+}
+
+int
+vpp_writer_submit(VPPWriter *w, uint8_t *buf, size_t size)
+{
+    int ret;
+
+    pthread_mutex_lock(&w->lock);
+    if (buf != w->buffers[w->tail] || size > w->capacity[w->tail]) {
+        pthread_mutex_unlock(&w->lock);
+        printf("Submitted buffer was not acquired from the writer\n");
+        return -1;
+    }
+
+    w->size[w->tail] = size;
+    w->tail = (w->tail + 1) % w->num_buffers;
+    w->queued++;
+    if (w->queued > w->stats.max_backlog)
+        w->stats.max_backlog = w->queued;
+    ret = w->error ? -1 : 0;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+
+    return ret;
+}
+
+int
+vpp_writer_destroy(VPPWriter *w, VPPWriterStats *stats)
+{
+    uint32_t i;
+    int ret;
+
+    pthread_mutex_lock(&w->lock);
+    w->exit = true;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+
+    if (fflush(w->fp))
+        w->error = 1;
+
+    ret = w->error ? -1 : 0;
+    if (stats)
+        *stats = w->stats;
+
+    for (i = 0; i < w->num_buffers; i++)
+        free(w->buffers[i]);
+    pthread_cond_destroy(&w->cond);
+    pthread_mutex_destroy(&w->lock);
+    free(w);
+
+    return ret;
+}
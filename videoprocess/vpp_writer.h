@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2024 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL INTEL AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef VPP_WRITER_H
+#define VPP_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Asynchronous file writer shared by the video process samples.
+ *
+ * The writer owns a ring of <num_buffers> host buffers. A store function
+ * acquires the next buffer, downloads the output surface into it, releases
+ * the surface and submits the buffer; a thread of the writer then issues one
+ * fwrite() per buffer, in submission order. The caller only blocks when all
+ * buffers are still queued for writing. acquire/submit must be called from
+ * one thread at a time; a buffer that is acquired but never submitted is
+ * handed out again by the next acquire.
+ */
+
+#define VPP_WRITER_MAX_BUFFERS 16
+
+typedef struct _VPPWriter VPPWriter;
+
+typedef struct _VPPWriterStats {
+    uint64_t bytes;
+    uint32_t frames;
+    double write_time;      /* seconds spent in fwrite */
+    double stall_time;      /* seconds acquire waited for a free buffer */
+    uint32_t max_backlog;   /* most buffers queued at once */
+    uint32_t num_buffers;
+} VPPWriterStats;
+
+/* Returns NULL if the writer thread can not be started */
+VPPWriter *
+vpp_writer_create(FILE *fp, uint32_t num_buffers);
+
+/* Returns a buffer of at least <size> bytes, or NULL if it can not be
+ * allocated */
+uint8_t *
+vpp_writer_acquire(VPPWriter *writer, size_t size);
+
+/* Queue the first <size> bytes of the acquired buffer <buf>.
+ * Returns -1 once a write failed */
+int
+vpp_writer_submit(VPPWriter *writer, uint8_t *buf, size_t size);
+
+/* Write out the queued buffers, stop the thread and free the writer.
+ * <stats> may be NULL. Returns -1 if any write failed */
+int
+vpp_writer_destroy(VPPWriter *writer, VPPWriterStats *stats);
+
+#endif /* VPP_WRITER_H */
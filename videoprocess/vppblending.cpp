@@ -32,9 +32,14 @@
 #include <time.h>
 #include <assert.h>
 #include <vector>
+#include <algorithm>
 #include <va/va.h>
 #include <va/va_vpp.h>
 #include "va_display.h"
+#include "vpp_config.h"
+#include "vpp_hbd.h"
+#include "vpp_pipeline.h"
+#include "vpp_stream.h"
 
 #ifndef VA_FOURCC_I420
 #define VA_FOURCC_I420 0x30323449
@@ -64,6 +69,7 @@ typedef struct {
     uint32_t            rt_format;
     uint32_t            file_fourcc;
     VABlendState        blend_state;
+    uint32_t            z_order;    /* layers are composed from low to high */
 } VPP_ImageSrcInfo;
 static uint32_t g_src_count = 1;
 static uint32_t g_frame_count = 0;
@@ -72,9 +78,16 @@ static VADisplay va_dpy = NULL;
 static VAContextID context_id = 0;
 static VAConfigID  config_id = 0;
 
-static std::vector<VASurfaceID> g_in_surface_ids;
-static VASurfaceID g_out_surface_id = VA_INVALID_ID;
-static FILE* g_config_file_fd = NULL;
+/* Every pipeline slot owns one input surface per stream and one output
+ * surface. The pipeline parameter buffers of all layers are created once per
+ * slot, in z-order, and submitted in one vaRenderPicture */
+static std::vector<VASurfaceID> g_in_surface_ids[VPP_PIPELINE_MAX_DEPTH];
+static VASurfaceID g_out_surface_id[VPP_PIPELINE_MAX_DEPTH];
+static std::vector<VABufferID> g_pipeline_param_buf_ids[VPP_PIPELINE_MAX_DEPTH];
+static std::vector<uint32_t> g_layer_order;
+static uint32_t g_pipeline_depth = 1;
+static uint32_t g_sweep_iterations = 0;
+static VPPConfig *g_config = NULL;
 std::vector<FILE*> g_src_file_fds;
 static FILE* g_dst_file_fd = NULL;
 static char g_config_file_name[MAX_LEN];
@@ -88,106 +101,6 @@ static uint32_t g_dst_file_fourcc = VA_FOURCC('Y', 'V', '1', '2');
 static uint32_t g_total_time = 0;
 
 
-static int8_t
-read_value_string(FILE *fp, const char* field_name, char* value)
-{
-    char strLine[MAX_LEN];
-    char* field = NULL;
-    char* str = NULL;
-    uint16_t i;
-
-    if (!fp || !field_name || !value)  {
-        printf("Invalid fuction parameters\n");
-        return -1;
-    }
-
-    rewind(fp);
-
-    while (!feof(fp)) {
-        if (!fgets(strLine, MAX_LEN, fp))
-            continue;
-
-        for (i = 0; i < MAX_LEN && strLine[i]; i++)
-            if (strLine[i] != ' ') break;
-
-        if (i == MAX_LEN || strLine[i] == '#' || strLine[i] == '\n')
-            continue;
-
-        field = strtok(&strLine[i], ":");
-        if (strncmp(field, field_name, strlen(field_name)))
-            continue;
-
-        if (!(str = strtok(NULL, ":")))
-            continue;
-
-        /* skip blank space in string */
-        while (*str == ' ')
-            str++;
-
-        *(str + strlen(str) - 1) = '\0';
-        strcpy(value, str);
-
-        return 0;
-    }
-
-    return -1;
-}
-
-static int8_t
-read_value_uint32(FILE* fp, const char* field_name, uint32_t* value)
-{
-    char str[MAX_LEN];
-
-    if (read_value_string(fp, field_name, str)) {
-        printf("Failed to find integer field: %s", field_name);
-        return -1;
-    }
-
-    *value = (uint32_t)atoi(str);
-    return 0;
-}
-
-static int8_t
-read_value_int16(FILE* fp, const char* field_name, int16_t* value)
-{
-    char str[MAX_LEN];
-
-    if (read_value_string(fp, field_name, str)) {
-        printf("Failed to find integer field: %s", field_name);
-        return -1;
-    }
-
-    *value = (int16_t)atoi(str);
-    return 0;
-}
-
-static int8_t
-read_value_uint16(FILE* fp, const char* field_name, uint16_t* value)
-{
-    char str[MAX_LEN];
-
-    if (read_value_string(fp, field_name, str)) {
-        printf("Failed to find integer field: %s", field_name);
-        return -1;
-    }
-
-    *value = (uint16_t)atoi(str);
-    return 0;
-}
-
-
-static int8_t
-read_value_float(FILE *fp, const char* field_name, float* value)
-{
-    char str[MAX_LEN];
-    if (read_value_string(fp, field_name, str)) {
-        printf("Failed to find float field: %s \n", field_name);
-        return -1;
-    }
-
-    *value = atof(str);
-    return 0;
-}
 
 
 static VAStatus
@@ -247,9 +160,9 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
         y_src = newImageBuffer;
         if (file_fourcc == VA_FOURCC_I420) {
@@ -344,9 +257,9 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
         y_src = newImageBuffer;
         y_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[0]);
@@ -357,67 +270,17 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
             y_src += surface_image.width * 2;
             y_dst += surface_image.pitches[0];
         }
-    } else if ((surface_image.format.fourcc == VA_FOURCC_P010 &&
-                file_fourcc == VA_FOURCC_P010) ||
-               (surface_image.format.fourcc == VA_FOURCC_I010 &&
-                file_fourcc == VA_FOURCC_I010)) {
-        frame_size = surface_image.width * surface_image.height * 3;
+    } else if (vpp_hbd_supported(surface_image.format.fourcc, file_fourcc)) {
+        frame_size = vpp_hbd_frame_size(file_fourcc, surface_image.width, surface_image.height);
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
-
-        y_src = newImageBuffer;
-        y_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[0]);
-
-        /* plane 0, directly copy */
-        for (row = 0; row < surface_image.height; row++) {
-            memcpy(y_dst, y_src, surface_image.width * 2);
-            y_src += surface_image.width * 2;
-            y_dst += surface_image.pitches[0];
-        }
-
-        /* UV plane */
-        if (surface_image.format.fourcc == VA_FOURCC_I010) {
-            assert(file_fourcc == VA_FOURCC_I010);
-
-            u_src = newImageBuffer + surface_image.width * surface_image.height * 2;
-            v_src = newImageBuffer + surface_image.width * surface_image.height * 5 / 2;
-
-            u_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[1]);
-            v_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[2]);
-
-            for (row = 0; row < surface_image.height / 2; row++) {
-                memcpy(u_dst, u_src, surface_image.width);
-                memcpy(v_dst, v_src, surface_image.width);
-
-                u_src += surface_image.width;
-                v_src += surface_image.width;
-
-                u_dst += surface_image.pitches[1];
-                v_dst += surface_image.pitches[2];
-            }
-        } else if (surface_image.format.fourcc == VA_FOURCC_P010) {
-            assert(file_fourcc == VA_FOURCC_P010);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
-            u_src = newImageBuffer + surface_image.width * surface_image.height * 2;
-            v_src = u_src;
-
-            u_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[1]);
-            v_dst = u_dst;
-
-            for (row = 0; row < surface_image.height / 2; row++) {
-                memcpy(u_dst, u_src, surface_image.width * 2);
-
-                u_src += surface_image.width * 2;
-                v_src = u_src;
-
-                u_dst += surface_image.pitches[1];
-                v_dst = u_dst;
-            }
-        }
+        /* 10/12/16 bit frame, repacked to the surface layout */
+        vpp_hbd_file_to_image(newImageBuffer, file_fourcc, &surface_image, (uint8_t *)surface_p);
     }  else if ((surface_image.format.fourcc == VA_FOURCC_RGBA &&
                  file_fourcc == VA_FOURCC_RGBA) ||
                 (surface_image.format.fourcc == VA_FOURCC_RGBX &&
@@ -434,9 +297,9 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
         y_src = newImageBuffer;
         y_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[0]);
@@ -460,7 +323,7 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 /* Store NV12/YV12/I420 surface to yv12 file */
@@ -556,9 +419,9 @@ store_yuv_surface_to_yv12_file(FILE *fp,
         }
 
         /* write frame to file */
-        do {
-            n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
-        } while (n_items != 1);
+        n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     } else {
         printf("Not supported YUV surface fourcc !!! \n");
@@ -573,7 +436,7 @@ store_yuv_surface_to_yv12_file(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -668,9 +531,9 @@ store_yuv_surface_to_i420_file(FILE *fp,
         }
 
         /* write frame to file */
-        do {
-            n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
-        } while (n_items != 1);
+        n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     } else {
         printf("Not supported YUV surface fourcc !!! \n");
@@ -685,7 +548,7 @@ store_yuv_surface_to_i420_file(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -775,9 +638,9 @@ store_yuv_surface_to_nv12_file(FILE *fp,
         }
 
         /* write frame to file */
-        do {
-            n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
-        } while (n_items != 1);
+        n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     } else {
         printf("Not supported YUV surface fourcc !!! \n");
@@ -792,7 +655,7 @@ store_yuv_surface_to_nv12_file(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -838,9 +701,9 @@ store_packed_yuv_surface_to_packed_file(FILE *fp,
         }
 
         /* write frame to file */
-        do {
-            n_items = fwrite(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fwrite(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     } else {
         printf("Not supported YUV surface fourcc !!! \n");
@@ -855,7 +718,7 @@ store_packed_yuv_surface_to_packed_file(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -864,13 +727,7 @@ store_yuv_surface_to_10bit_file(FILE *fp, VASurfaceID surface_id)
     VAStatus va_status;
     VAImage surface_image;
     void *surface_p = NULL;
-    unsigned char *y_src = NULL;
-    unsigned char *u_src = NULL;
-    unsigned char *v_src = NULL;
-    unsigned char *y_dst = NULL;
-    unsigned char *u_dst = NULL;
-    unsigned char *v_dst = NULL;
-    uint32_t row;
+    uint32_t frame_size;
     int32_t n_items;
     unsigned char * newImageBuffer = NULL;
     va_status = vaSyncSurface(va_dpy, surface_id);
@@ -882,62 +739,22 @@ store_yuv_surface_to_10bit_file(FILE *fp, VASurfaceID surface_id)
     va_status = vaMapBuffer(va_dpy, surface_image.buf, &surface_p);
     CHECK_VASTATUS(va_status, "vaMapBuffer");
 
-    /* store the surface to one 10bit file */
-    uint32_t y_size = surface_image.width * surface_image.height * 2;
-    uint32_t u_size = y_size / 4;
-
-    newImageBuffer = (unsigned char*)malloc(y_size * 3);
+    /* store the surface to one 10/12/16 bit file */
+    frame_size = vpp_hbd_frame_size(g_dst_file_fourcc, surface_image.width, surface_image.height);
+    newImageBuffer = (unsigned char*)malloc(frame_size);
     assert(newImageBuffer);
-    y_dst = newImageBuffer;
-
-    y_src = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[0]);
-
-    /* Y plane copy */
-    for (row = 0; row < surface_image.height; row++) {
-        memcpy(y_dst, y_src, surface_image.width * 2);
-        y_src += surface_image.pitches[0];
-        y_dst += surface_image.width * 2;
-    }
-
-    if (surface_image.format.fourcc == VA_FOURCC_I010) {
-        u_dst = newImageBuffer + y_size;
-        v_dst = newImageBuffer + y_size + u_size;
-
-        u_src = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[1]);
-        v_src = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[2]);
 
-        for (row = 0; row < surface_image.height / 2; row++) {
-            memcpy(u_dst, u_src, surface_image.width);
-            memcpy(v_dst, v_src, surface_image.width);
-
-            u_dst += surface_image.width;
-            v_dst += surface_image.width;
-
-            u_src += surface_image.pitches[1];
-            v_src += surface_image.pitches[2];
-        }
-    } else if (surface_image.format.fourcc == VA_FOURCC_P010) {
-        u_dst = newImageBuffer + y_size;
-        v_dst = u_dst;
-
-        u_src = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[1]);
-        v_src = u_src;
-
-        for (row = 0; row < surface_image.height / 2; row++) {
-            memcpy(u_dst, u_src, surface_image.width * 2);
-            u_dst += surface_image.width * 2;
-            u_src += surface_image.pitches[1];
-        }
-    } else {
+    if (vpp_hbd_image_to_file(&surface_image, (uint8_t *)surface_p,
+                              newImageBuffer, g_dst_file_fourcc)) {
         printf("Not supported YUV surface fourcc !!! \n");
         free(newImageBuffer);
         return VA_STATUS_ERROR_INVALID_SURFACE;
     }
 
     /* write frame to file */
-    do {
-        n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
-    } while (n_items != 1);
+    n_items = fwrite(newImageBuffer, frame_size, 1, fp);
+    if (n_items != 1)
+        va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     if (newImageBuffer) {
         free(newImageBuffer);
@@ -947,7 +764,7 @@ store_yuv_surface_to_10bit_file(FILE *fp, VASurfaceID surface_id)
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -984,9 +801,9 @@ store_rgb_surface_to_rgb_file(FILE *fp, VASurfaceID surface_id)
     }
 
     /* write frame to file */
-    do {
-        n_items = fwrite(newImageBuffer, frame_size, 1, fp);
-    } while (n_items != 1);
+    n_items = fwrite(newImageBuffer, frame_size, 1, fp);
+    if (n_items != 1)
+        va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     if (newImageBuffer) {
         free(newImageBuffer);
@@ -996,7 +813,7 @@ store_rgb_surface_to_rgb_file(FILE *fp, VASurfaceID surface_id)
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -1021,10 +838,7 @@ store_yuv_surface_to_file(FILE *fp,
                (g_out_fourcc == VA_FOURCC_UYVY &&
                 g_dst_file_fourcc == VA_FOURCC_UYVY)) {
         return store_packed_yuv_surface_to_packed_file(fp, surface_id);
-    } else if ((g_out_fourcc == VA_FOURCC_I010 &&
-                g_dst_file_fourcc == VA_FOURCC_I010) ||
-               (g_out_fourcc == VA_FOURCC_P010 &&
-                g_dst_file_fourcc == VA_FOURCC_P010)) {
+    } else if (vpp_hbd_supported(g_out_fourcc, g_dst_file_fourcc)) {
         return store_yuv_surface_to_10bit_file(fp, surface_id);
     } else if ((g_out_fourcc == VA_FOURCC_RGBA &&
                 g_dst_file_fourcc == VA_FOURCC_RGBA) ||
@@ -1045,114 +859,165 @@ store_yuv_surface_to_file(FILE *fp,
     }
 }
 
-static VAStatus
-video_frame_process()
+/* Read the layout of every layer once: crop, destination, blending and
+ * z-order. WALL_GRID: <cols>x<rows> places the streams in a grid over the
+ * output instead of the SRC_Dst* rectangles */
+static int8_t
+layout_init()
 {
-    VAStatus va_status;
-    uint32_t i;
-    std::vector<VABufferID> pipeline_param_buf_ids;
-    pipeline_param_buf_ids.resize(g_src_count);
+    uint32_t i, cols = 0, rows = 0;
+    char str[MAX_LEN];
+
+    if (!vpp_config_get_string(g_config, "WALL_GRID", str) &&
+        (sscanf(str, "%ux%u", &cols, &rows) != 2 || !cols || !rows ||
+         cols * rows < g_src_count)) {
+        printf("WALL_GRID: %s must be <cols>x<rows> with room for %d streams\n",
+               str, g_src_count);
+        return -1;
+    }
+
     for (i = 0; i < g_src_count; i++) {
-        VAProcPipelineParameterBuffer pipeline_param;
-        memset(&pipeline_param, 0, sizeof(pipeline_param));
-
-        /* Fill pipeline buffer */
-        char CropLeftX[MAX_LEN];
-        char CropTopY[MAX_LEN];
-        char CropWidth[MAX_LEN];
-        char CropHeight[MAX_LEN];
-        sprintf(CropLeftX, "SRC_CROP_LEFT_X_%d", i + 1);
-        sprintf(CropTopY, "SRC_CROP_TOP_Y_%d", i + 1);
-        sprintf(CropWidth, "SRC_CROP_WIDTH_%d", i + 1);
-        sprintf(CropHeight, "SRC_CROP_HEIGHT_%d", i + 1);
-        read_value_int16(g_config_file_fd, CropLeftX, &g_src_info[i].region_in.x);
-        read_value_int16(g_config_file_fd, CropTopY, &g_src_info[i].region_in.y);
-        read_value_uint16(g_config_file_fd, CropWidth, &g_src_info[i].region_in.width);
-        read_value_uint16(g_config_file_fd, CropHeight, &g_src_info[i].region_in.height);
-        if (g_src_info[i].region_in.width == 0)
-            g_src_info[i].region_in.width = g_src_info[i].yuv_frame_in_width;
-        if (g_src_info[i].region_in.height == 0)
-            g_src_info[i].region_in.height = g_src_info[i].yuv_frame_in_height;
-        char DstLeftX[MAX_LEN];
-        char DstTopY[MAX_LEN];
-        char DstWidth[MAX_LEN];
-        char DstHeight[MAX_LEN];
-        sprintf(DstLeftX, "SRC_DstLeftX_%d", i + 1);
-        sprintf(DstTopY, "SRC_DstTopY_%d", i + 1);
-        sprintf(DstWidth, "SRC_DstWidth_%d", i + 1);
-        sprintf(DstHeight, "SRC_DstHeight_%d", i + 1);
-        read_value_int16(g_config_file_fd, DstLeftX, &g_src_info[i].region_out.x);
-        read_value_int16(g_config_file_fd, DstTopY, &g_src_info[i].region_out.y);
-        read_value_uint16(g_config_file_fd, DstWidth, &g_src_info[i].region_out.width);
-        read_value_uint16(g_config_file_fd, DstHeight, &g_src_info[i].region_out.height);
-        if (g_src_info[i].region_out.width == 0)
-            g_src_info[i].region_out.width = g_src_info[i].yuv_frame_in_width;
-        if (g_src_info[i].region_out.height == 0)
-            g_src_info[i].region_out.height = g_src_info[i].yuv_frame_in_height;
+        VPP_ImageSrcInfo *info = &g_src_info[i];
+        char name[MAX_LEN];
+
+        sprintf(name, "SRC_CROP_LEFT_X_%d", i + 1);
+        vpp_config_get_int16(g_config, name, &info->region_in.x);
+        sprintf(name, "SRC_CROP_TOP_Y_%d", i + 1);
+        vpp_config_get_int16(g_config, name, &info->region_in.y);
+        sprintf(name, "SRC_CROP_WIDTH_%d", i + 1);
+        vpp_config_get_uint16(g_config, name, &info->region_in.width);
+        sprintf(name, "SRC_CROP_HEIGHT_%d", i + 1);
+        vpp_config_get_uint16(g_config, name, &info->region_in.height);
+        if (info->region_in.width == 0)
+            info->region_in.width = info->yuv_frame_in_width;
+        if (info->region_in.height == 0)
+            info->region_in.height = info->yuv_frame_in_height;
+
+        if (cols) {
+            info->region_out.x = (i % cols) * g_out_pic_width / cols;
+            info->region_out.y = (i / cols) * g_out_pic_height / rows;
+            info->region_out.width = g_out_pic_width / cols;
+            info->region_out.height = g_out_pic_height / rows;
+        } else {
+            sprintf(name, "SRC_DstLeftX_%d", i + 1);
+            vpp_config_get_int16(g_config, name, &info->region_out.x);
+            sprintf(name, "SRC_DstTopY_%d", i + 1);
+            vpp_config_get_int16(g_config, name, &info->region_out.y);
+            sprintf(name, "SRC_DstWidth_%d", i + 1);
+            vpp_config_get_uint16(g_config, name, &info->region_out.width);
+            sprintf(name, "SRC_DstHeight_%d", i + 1);
+            vpp_config_get_uint16(g_config, name, &info->region_out.height);
+            if (info->region_out.width == 0)
+                info->region_out.width = info->yuv_frame_in_width;
+            if (info->region_out.height == 0)
+                info->region_out.height = info->yuv_frame_in_height;
+        }
+
+        /* Optional, by default the layers are stacked in the listed order */
+        info->z_order = i;
+        sprintf(name, "SRC_ZOrder_%d", i + 1);
+        if (!vpp_config_get_string(g_config, name, str))
+            info->z_order = (uint32_t)atoi(str);
 
         if (i > 0) {
             uint32_t        composition_blend_flags = 0;
             float           composition_alpha = 0;
             float           compositionLumaMin = 0.0;
             float           compositionLumaMax = 1.0;
-            char BlendFlagsName[MAX_LEN];
-            char AlphaName[MAX_LEN];
-            char LumaMinName[MAX_LEN];
-            char LumaMaxName[MAX_LEN];
-            sprintf(BlendFlagsName, "SRC_CompositionBlendFlags_%d", i + 1);
-            sprintf(AlphaName, "SRC_CompositionAlpha_%d", i + 1);
-            sprintf(LumaMinName, "SRC_compositionLumaMin_%d", i + 1);
-            sprintf(LumaMaxName, "SRC_compositionLumaMax_%d", i + 1);
-            read_value_uint32(g_config_file_fd, BlendFlagsName, &composition_blend_flags);
-            read_value_float(g_config_file_fd, AlphaName, &composition_alpha);
-            read_value_float(g_config_file_fd, LumaMinName, &compositionLumaMin);
-            read_value_float(g_config_file_fd, LumaMaxName, &compositionLumaMax);
+
+            sprintf(name, "SRC_CompositionBlendFlags_%d", i + 1);
+            vpp_config_get_uint32(g_config, name, &composition_blend_flags);
+            sprintf(name, "SRC_CompositionAlpha_%d", i + 1);
+            vpp_config_get_float(g_config, name, &composition_alpha);
+            sprintf(name, "SRC_compositionLumaMin_%d", i + 1);
+            vpp_config_get_float(g_config, name, &compositionLumaMin);
+            sprintf(name, "SRC_compositionLumaMax_%d", i + 1);
+            vpp_config_get_float(g_config, name, &compositionLumaMax);
             if (composition_blend_flags & 0x1)
-                g_src_info[i].blend_state.flags |= VA_BLEND_GLOBAL_ALPHA;
+                info->blend_state.flags |= VA_BLEND_GLOBAL_ALPHA;
             if (composition_blend_flags & 0x2)
-                g_src_info[i].blend_state.flags |= VA_BLEND_PREMULTIPLIED_ALPHA;
+                info->blend_state.flags |= VA_BLEND_PREMULTIPLIED_ALPHA;
             if (composition_blend_flags & 0x4)
-                g_src_info[i].blend_state.flags |= VA_BLEND_LUMA_KEY;
-            g_src_info[i].blend_state.global_alpha = composition_alpha;
-            g_src_info[i].blend_state.min_luma = compositionLumaMin;
-            g_src_info[i].blend_state.max_luma = compositionLumaMax;
-            pipeline_param.blend_state = &g_src_info[i].blend_state;
-
+                info->blend_state.flags |= VA_BLEND_LUMA_KEY;
+            info->blend_state.global_alpha = composition_alpha;
+            info->blend_state.min_luma = compositionLumaMin;
+            info->blend_state.max_luma = compositionLumaMax;
         }
+    }
+
+    g_layer_order.resize(g_src_count);
+    for (i = 0; i < g_src_count; i++)
+        g_layer_order[i] = i;
+    std::stable_sort(g_layer_order.begin(), g_layer_order.end(),
+    [](uint32_t a, uint32_t b) {
+        return g_src_info[a].z_order < g_src_info[b].z_order;
+    });
 
-        if (g_src_count > 1) {
-            pipeline_param.pipeline_flags |= VA_PROC_PIPELINE_FAST;//for showing all sub-layers
-            pipeline_param.filter_flags |= VA_FILTER_SCALING_FAST; //for showing background color
+    return 0;
+}
+
+/* Create the pipeline parameter buffers of every layer and slot once */
+static VAStatus
+vpp_buffers_create()
+{
+    VAStatus va_status = VA_STATUS_SUCCESS;
+    uint32_t slot, layer;
+
+    for (slot = 0; slot < g_pipeline_depth; slot++) {
+        g_pipeline_param_buf_ids[slot].assign(g_src_count, VA_INVALID_ID);
+
+        for (layer = 0; layer < g_src_count; layer++) {
+            uint32_t i = g_layer_order[layer];
+            VAProcPipelineParameterBuffer pipeline_param;
+            memset(&pipeline_param, 0, sizeof(pipeline_param));
+
+            /* the bottom layer is copied, the others are blended on top */
+            if (layer > 0)
+                pipeline_param.blend_state = &g_src_info[i].blend_state;
+
+            if (g_src_count > 1) {
+                pipeline_param.pipeline_flags |= VA_PROC_PIPELINE_FAST;//for showing all sub-layers
+                pipeline_param.filter_flags |= VA_FILTER_SCALING_FAST; //for showing background color
+            }
+            pipeline_param.surface = g_in_surface_ids[slot][i];
+            pipeline_param.surface_region = &g_src_info[i].region_in;
+            pipeline_param.output_region = &g_src_info[i].region_out;
+            pipeline_param.surface_color_standard = VAProcColorStandardBT601;
+            pipeline_param.output_color_standard = VAProcColorStandardBT601;
+
+            va_status = vaCreateBuffer(va_dpy,
+                                       context_id,
+                                       VAProcPipelineParameterBufferType,
+                                       sizeof(pipeline_param),
+                                       1,
+                                       &pipeline_param,
+                                       &g_pipeline_param_buf_ids[slot][layer]);
+            CHECK_VASTATUS(va_status, "vaCreateBuffer");
         }
-        pipeline_param.surface = g_in_surface_ids[i];
-        pipeline_param.surface_region = &g_src_info[i].region_in;
-        pipeline_param.output_region = &g_src_info[i].region_out;
-        pipeline_param.surface_color_standard = VAProcColorStandardBT601;
-        pipeline_param.output_color_standard = VAProcColorStandardBT601;
-
-        va_status = vaCreateBuffer(va_dpy,
-                                   context_id,
-                                   VAProcPipelineParameterBufferType,
-                                   sizeof(pipeline_param),
-                                   1,
-                                   &pipeline_param,
-                                   &pipeline_param_buf_ids[i]);
-        CHECK_VASTATUS(va_status, "vaCreateBuffer");
     }
-    printf("\nStart to process 1 frame, ...\n");
+
+    return va_status;
+}
+
+/* Compose the bottom <num_layers> layers of <slot> in one batch */
+static VAStatus
+video_frame_process(uint32_t slot, uint32_t num_layers)
+{
+    VAStatus va_status;
     struct timespec Pre_time;
     struct timespec Cur_time;
     uint32_t duration = 0;
+
     clock_gettime(CLOCK_MONOTONIC, &Pre_time);
     va_status = vaBeginPicture(va_dpy,
                                context_id,
-                               g_out_surface_id);
+                               g_out_surface_id[slot]);
     CHECK_VASTATUS(va_status, "vaBeginPicture");
 
     va_status = vaRenderPicture(va_dpy,
                                 context_id,
-                                &pipeline_param_buf_ids[0],
-                                g_src_count);
+                                &g_pipeline_param_buf_ids[slot][0],
+                                num_layers);
     CHECK_VASTATUS(va_status, "vaRenderPicture");
 
     va_status = vaEndPicture(va_dpy, context_id);
@@ -1165,13 +1030,8 @@ video_frame_process()
         duration += (Cur_time.tv_nsec + 1000000000 - Pre_time.tv_nsec) / 1000 - 1000000;
     }
 
-    printf("Finish processing, 1 frame processed in: %d us\n", duration);
     g_total_time += duration;
 
-    for (i = 0; i < g_src_count; i++) {
-        if (pipeline_param_buf_ids[i] != VA_INVALID_ID)
-            vaDestroyBuffer(va_dpy, pipeline_param_buf_ids[i]);
-    }
     return va_status;
 }
 
@@ -1179,6 +1039,7 @@ static VAStatus
 vpp_context_create()
 {
     VAStatus va_status = VA_STATUS_SUCCESS;
+    uint32_t slot;
     int32_t j;
 
     /* VA driver initialization */
@@ -1217,14 +1078,17 @@ vpp_context_create()
                                       1);
     CHECK_VASTATUS(va_status, "vaGetConfigAttributes");
     /* Create surface/config/context for VPP pipeline */
-    for (uint32_t i = 0; i < g_src_count; i++) {
-        va_status = create_surface(&g_in_surface_ids[i], g_src_info[i].yuv_frame_in_width, g_src_info[i].yuv_frame_in_height,
-                                   g_src_info[i].src_format, g_src_info[i].rt_format);
-        CHECK_VASTATUS(va_status, "vaCreateSurfaces for input");
+    for (slot = 0; slot < g_pipeline_depth; slot++) {
+        g_in_surface_ids[slot].assign(g_src_count, VA_INVALID_SURFACE);
+        for (uint32_t i = 0; i < g_src_count; i++) {
+            va_status = create_surface(&g_in_surface_ids[slot][i], g_src_info[i].yuv_frame_in_width, g_src_info[i].yuv_frame_in_height,
+                                       g_src_info[i].src_format, g_src_info[i].rt_format);
+            CHECK_VASTATUS(va_status, "vaCreateSurfaces for input");
+        }
+        va_status = create_surface(&g_out_surface_id[slot], g_out_pic_width, g_out_pic_height,
+                                   g_out_fourcc, g_out_format);
+        CHECK_VASTATUS(va_status, "vaCreateSurfaces for output");
     }
-    va_status = create_surface(&g_out_surface_id, g_out_pic_width, g_out_pic_height,
-                               g_out_fourcc, g_out_format);
-    CHECK_VASTATUS(va_status, "vaCreateSurfaces for output");
 
     va_status = vaCreateConfig(va_dpy,
                                VAProfileNone,
@@ -1239,10 +1103,14 @@ vpp_context_create()
                                 g_out_pic_width,
                                 g_out_pic_height,
                                 VA_PROGRESSIVE,
-                                &g_out_surface_id,
-                                1,
+                                g_out_surface_id,
+                                g_pipeline_depth,
                                 &context_id);
     CHECK_VASTATUS(va_status, "vaCreateContext");
+
+    va_status = vpp_buffers_create();
+    CHECK_VASTATUS(va_status, "vpp_buffers_create");
+
     return va_status;
 }
 
@@ -1250,12 +1118,18 @@ static void
 vpp_context_destroy()
 {
     /* Release resource */
-    for (uint32_t j = 0; j < g_src_count; j++) {
-        if (g_in_surface_ids[j] != VA_INVALID_SURFACE)
-            vaDestroySurfaces(va_dpy, &g_in_surface_ids[j], 1);
+    for (uint32_t slot = 0; slot < g_pipeline_depth; slot++) {
+        for (uint32_t j = 0; j < g_pipeline_param_buf_ids[slot].size(); j++) {
+            if (g_pipeline_param_buf_ids[slot][j] != VA_INVALID_ID)
+                vaDestroyBuffer(va_dpy, g_pipeline_param_buf_ids[slot][j]);
+        }
+        for (uint32_t j = 0; j < g_in_surface_ids[slot].size(); j++) {
+            if (g_in_surface_ids[slot][j] != VA_INVALID_SURFACE)
+                vaDestroySurfaces(va_dpy, &g_in_surface_ids[slot][j], 1);
+        }
+        if (g_out_surface_id[slot] != VA_INVALID_SURFACE)
+            vaDestroySurfaces(va_dpy, &g_out_surface_id[slot], 1);
     }
-    if (g_out_surface_id != VA_INVALID_SURFACE)
-        vaDestroySurfaces(va_dpy, &g_out_surface_id, 1);
     vaDestroyContext(va_dpy, context_id);
     vaDestroyConfig(va_dpy, config_id);
 
@@ -1296,6 +1170,8 @@ parse_fourcc_and_format(char *str, uint32_t *fourcc, uint32_t *format)
     } else if (!strcmp(str, "A2B10G10R10")) {
         tfourcc = VA_FOURCC_ABGR;
         tformat = VA_RT_FORMAT_RGB32_10BPP;
+    } else if ((tfourcc = vpp_hbd_fourcc(str, &tformat))) {
+        /* P012, P016, Y210, Y212, Y216, Y410, Y412, Y416 and planar files */
     } else {
         printf("Not supported format: %s! Currently only support following format: %s\n",
                str, "YV12, I420, NV12, YUY2(YUYV), UYVY, P010, I010, RGBA, RGBX, BGRA ,BGRX or ARGB,A2B10G10R10");
@@ -1315,9 +1191,8 @@ static int8_t
 parse_basic_parameters()
 {
     char str[MAX_LEN];
-    read_value_uint32(g_config_file_fd, "SRC_NUMBER", &g_src_count);
+    vpp_config_get_uint32(g_config, "SRC_NUMBER", &g_src_count);
     g_src_info.resize(g_src_count);
-    g_in_surface_ids.resize(g_src_count);
     g_src_file_fds.resize(g_src_count);
     /* Read src frame file information */
     for (uint32_t i = 0; i < g_src_count; i++) {
@@ -1333,30 +1208,99 @@ parse_basic_parameters()
         sprintf(src_frame_format, "SRC_FRAME_FORMAT_%d", i + 1);
         sprintf(src_file_format, "SRC_FILE_FORMAT_%d", i + 1);
 
-        read_value_string(g_config_file_fd, file_name, g_src_info[i].src_file_name);
-        read_value_uint32(g_config_file_fd, src_frame_width, &g_src_info[i].yuv_frame_in_width);
-        read_value_uint32(g_config_file_fd, src_frame_height, &g_src_info[i].yuv_frame_in_height);
-        read_value_string(g_config_file_fd, src_frame_format, str);
+        vpp_config_get_string(g_config, file_name, g_src_info[i].src_file_name);
+        vpp_config_get_uint32(g_config, src_frame_width, &g_src_info[i].yuv_frame_in_width);
+        vpp_config_get_uint32(g_config, src_frame_height, &g_src_info[i].yuv_frame_in_height);
+        vpp_config_get_string(g_config, src_frame_format, str);
         parse_fourcc_and_format(str, &g_src_info[i].src_format, &g_src_info[i].rt_format);
-        read_value_string(g_config_file_fd, src_file_format, str);
+        vpp_config_get_string(g_config, src_file_format, str);
         parse_fourcc_and_format(str, &g_src_info[i].file_fourcc, NULL);
 
     }
     /* Read dst frame file information */
-    read_value_string(g_config_file_fd, "DST_FILE_NAME", g_dst_file_name);
-    read_value_uint32(g_config_file_fd, "DST_FRAME_WIDTH", &g_out_pic_width);
-    read_value_uint32(g_config_file_fd, "DST_FRAME_HEIGHT", &g_out_pic_height);
-    read_value_string(g_config_file_fd, "DST_FRAME_FORMAT", str);
+    vpp_config_get_string(g_config, "DST_FILE_NAME", g_dst_file_name);
+    vpp_config_get_uint32(g_config, "DST_FRAME_WIDTH", &g_out_pic_width);
+    vpp_config_get_uint32(g_config, "DST_FRAME_HEIGHT", &g_out_pic_height);
+    vpp_config_get_string(g_config, "DST_FRAME_FORMAT", str);
     parse_fourcc_and_format(str, &g_out_fourcc, &g_out_format);
 
 
-    read_value_string(g_config_file_fd, "DST_FILE_FORMAT", str);
+    vpp_config_get_string(g_config, "DST_FILE_FORMAT", str);
     parse_fourcc_and_format(str, &g_dst_file_fourcc, NULL);
 
-    read_value_uint32(g_config_file_fd, "FRAME_SUM", &g_frame_count);
+    vpp_config_get_uint32(g_config, "FRAME_SUM", &g_frame_count);
+
+    /* Optional, number of frames in flight between upload, composition and store */
+    if (!vpp_config_get_string(g_config, "PIPELINE_DEPTH", str)) {
+        g_pipeline_depth = (uint32_t)atoi(str);
+        if (g_pipeline_depth < 1 || g_pipeline_depth > VPP_PIPELINE_MAX_DEPTH) {
+            printf("PIPELINE_DEPTH must be in [1, %d]\n", VPP_PIPELINE_MAX_DEPTH);
+            return -1;
+        }
+    }
+
+    /* Optional, compositions per layer count in the fps sweep */
+    if (!vpp_config_get_string(g_config, "LAYER_SWEEP_ITERATIONS", str))
+        g_sweep_iterations = (uint32_t)atoi(str);
+
+    return layout_init();
+}
+
+static int
+pipeline_read(uint32_t /* frame */, uint32_t slot)
+{
+    uint32_t j;
+
+    for (j = 0; j < g_src_count; j++) {
+        if (upload_yuv_frame_to_yuv_surface(g_src_file_fds[j], g_in_surface_ids[slot][j],
+                                            g_src_info[j].file_fourcc) != VA_STATUS_SUCCESS)
+            /* the shortest input ends the pipeline */
+            return feof(g_src_file_fds[j]) ? 1 : -1;
+    }
+
     return 0;
 }
 
+static VAStatus
+pipeline_process(uint32_t /* frame */, uint32_t slot)
+{
+    return video_frame_process(slot, g_src_count);
+}
+
+static int
+pipeline_write(uint32_t /* frame */, uint32_t slot)
+{
+    return store_yuv_surface_to_file(g_dst_file_fd, g_out_surface_id[slot]) ==
+           VA_STATUS_SUCCESS ? 0 : -1;
+}
+
+/* Composition fps of the bottom 1, 2, 4, ... layers of the frame in slot 0 */
+static void
+layer_sweep()
+{
+    struct timespec start_time, end_time;
+    uint32_t num_layers, n;
+    double duration;
+
+    printf("\nComposition fps versus layer count (%d iterations each):\n", g_sweep_iterations);
+    for (num_layers = 1; ; num_layers = std::min(num_layers * 2, g_src_count)) {
+        clock_gettime(CLOCK_MONOTONIC, &start_time);
+        for (n = 0; n < g_sweep_iterations; n++) {
+            video_frame_process(0, num_layers);
+            vaSyncSurface(va_dpy, g_out_surface_id[0]);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end_time);
+
+        duration = (end_time.tv_sec - start_time.tv_sec) +
+                   (end_time.tv_nsec - start_time.tv_nsec) / 1000000000.0;
+        printf("  %3d layers: %10.2f fps, %12.2f layers/s\n", num_layers,
+               g_sweep_iterations / duration, g_sweep_iterations * num_layers / duration);
+
+        if (num_layers == g_src_count)
+            break;
+    }
+}
+
 static void
 print_help()
 {
@@ -1368,6 +1312,8 @@ print_help()
 int32_t main(int32_t argc, char *argv[])
 {
     VAStatus va_status;
+    VPPPipelineOps pipeline_ops = { pipeline_read, pipeline_process, pipeline_write };
+    int32_t frame_count;
     uint32_t i;
 
     if (argc != 2 || !strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")) {
@@ -1379,11 +1325,18 @@ int32_t main(int32_t argc, char *argv[])
     strncpy(g_config_file_name, argv[1], MAX_LEN);
     g_config_file_name[MAX_LEN - 1] = '\0';
 
-    if (NULL == (g_config_file_fd = fopen(g_config_file_name, "r"))) {
+    if (NULL == (g_config = vpp_config_open(g_config_file_name))) {
         printf("Open configure file %s failed!\n", g_config_file_name);
         assert(0);
     }
 
+    /* frames on stdout, diagnostics on stderr */
+    if (vpp_config_has_value(g_config, "DST_FILE_NAME", "-") &&
+        vpp_stream_reserve_stdout()) {
+        printf("Failed to move the diagnostics to stderr\n");
+        assert(0);
+    }
+
     /* Parse basic parameters */
     if (parse_basic_parameters()) {
         printf("Parse parameters in configure file error\n");
@@ -1398,26 +1351,39 @@ int32_t main(int32_t argc, char *argv[])
 
     /* Video frame fetch, process and store */
     for (i = 0; i < g_src_count; i++) {
-        if (NULL == (g_src_file_fds[i] = fopen(g_src_info[i].src_file_name, "r"))) {
+        if (NULL == (g_src_file_fds[i] = vpp_stream_open(g_src_info[i].src_file_name, "r"))) {
             printf("Open SRC_FILE_NAME: %s failed, please specify it in config file: %s !\n",
                    g_src_info[i].src_file_name, g_config_file_name);
             assert(0);
         }
     }
-    if (NULL == (g_dst_file_fd = fopen(g_dst_file_name, "w"))) {
+    if (NULL == (g_dst_file_fd = vpp_stream_open(g_dst_file_name, "w"))) {
         printf("Open DST_FILE_NAME: %s failed, please specify it in config file: %s !\n",
                g_dst_file_name, g_config_file_name);
         assert(0);
     }
 
-    for (i = 0; i < g_frame_count; i ++) {
-        for (unsigned int j = 0; j < g_src_count; j++) {
-            upload_yuv_frame_to_yuv_surface(g_src_file_fds[j], g_in_surface_ids[j], g_src_info[j].file_fourcc);
-        }
-        video_frame_process();
-        store_yuv_surface_to_file(g_dst_file_fd, g_out_surface_id);
+    printf("\nStart to compose %d layers, ...\n", g_src_count);
+    struct timespec start_time, end_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+    frame_count = vpp_pipeline_run(g_pipeline_depth, g_frame_count, &pipeline_ops);
+    if (frame_count < 0) {
+        printf("video frame process failed\n");
+        assert(0);
     }
-    printf("Finish processing, performance: %d frames processed in: %d us, ave time = %d us\n", g_frame_count, g_total_time, g_total_time / g_frame_count);
+
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    double duration = (end_time.tv_sec - start_time.tv_sec) +
+                      (end_time.tv_nsec - start_time.tv_nsec) / 1000000000.0;
+    printf("Finish processing, performance: %d frames processed in: %d us, ave time = %d us\n",
+           frame_count, g_total_time, frame_count ? g_total_time / frame_count : 0);
+    printf("%d layers composed at %.2f fps\n", g_src_count,
+           duration > 0 ? frame_count / duration : 0);
+
+    if (g_sweep_iterations && frame_count > 0)
+        layer_sweep();
+
     for (i = 0; i < g_src_count; i++) {
         if (g_src_file_fds[i] != NULL)
             fclose(g_src_file_fds[i]);
@@ -1425,8 +1391,7 @@ int32_t main(int32_t argc, char *argv[])
     if (g_dst_file_fd != NULL)
         fclose(g_dst_file_fd);
 
-    if (g_config_file_fd != NULL)
-        fclose(g_config_file_fd);
+    vpp_config_close(g_config);
 
     vpp_context_destroy();
 
@@ -31,9 +31,15 @@
 #include <stdint.h>
 #include <time.h>
 #include <assert.h>
+#include <math.h>
 #include <va/va.h>
 #include <va/va_vpp.h>
 #include "va_display.h"
+#include "vpp_chroma.h"
+#include "vpp_config.h"
+#include "vpp_hbd.h"
+#include "vpp_pipeline.h"
+#include "vpp_stream.h"
 
 #ifndef VA_FOURCC_I420
 #define VA_FOURCC_I420 0x30323449
@@ -50,10 +56,10 @@
 static VADisplay va_dpy = NULL;
 static VAContextID context_id = 0;
 static VAConfigID  config_id = 0;
-static VASurfaceID g_in_surface_id = VA_INVALID_ID;
-static VASurfaceID g_out_surface_id = VA_INVALID_ID;
+static VASurfaceID g_in_surface_id[VPP_PIPELINE_MAX_DEPTH];
+static VASurfaceID g_out_surface_id[VPP_PIPELINE_MAX_DEPTH];
 
-static FILE* g_config_file_fd = NULL;
+static VPPConfig *g_config = NULL;
 static FILE* g_src_file_fd = NULL;
 static FILE* g_dst_file_fd = NULL;
 
@@ -74,65 +80,20 @@ static uint32_t g_src_file_fourcc = VA_FOURCC('I', '4', '2', '0');
 static uint32_t g_dst_file_fourcc = VA_FOURCC('Y', 'V', '1', '2');
 
 static uint32_t g_frame_count = 0;
+static uint32_t g_pipeline_depth = 1;
 
-static int8_t
-read_value_string(FILE *fp, const char* field_name, char* value)
-{
-    char strLine[MAX_LEN];
-    char* field = NULL;
-    char* str = NULL;
-    uint16_t i;
-
-    if (!fp || !field_name || !value)  {
-        printf("Invalid fuction parameters\n");
-        return -1;
-    }
-
-    rewind(fp);
-
-    while (!feof(fp)) {
-        if (!fgets(strLine, MAX_LEN, fp))
-            continue;
-
-        for (i = 0; i < MAX_LEN && strLine[i]; i++)
-            if (strLine[i] != ' ') break;
-
-        if (i == MAX_LEN || strLine[i] == '#' || strLine[i] == '\n')
-            continue;
-
-        field = strtok(&strLine[i], ":");
-        if (strncmp(field, field_name, strlen(field_name)))
-            continue;
-
-        if (!(str = strtok(NULL, ":")))
-            continue;
-
-        /* skip blank space in string */
-        while (*str == ' ')
-            str++;
-
-        *(str + strlen(str) - 1) = '\0';
-        strcpy(value, str);
-
-        return 0;
-    }
-
-    return -1;
-}
-
-static int8_t
-read_value_uint32(FILE* fp, const char* field_name, uint32_t* value)
-{
-    char str[MAX_LEN];
-
-    if (read_value_string(fp, field_name, str)) {
-        printf("Failed to find integer field: %s", field_name);
-        return -1;
-    }
+/* IN_CHROMA_SITTING_MODE and DST_CHROMA_SITTING_MODE */
+static uint8_t g_in_chroma_siting = VA_CHROMA_SITING_UNKNOWN;
+static uint8_t g_dst_chroma_siting = VA_CHROMA_SITING_UNKNOWN;
 
-    *value = (uint32_t)atoi(str);
-    return 0;
-}
+/* CPU_REFERENCE, the chroma resampling of every frame on the CPU */
+static VPPChroma *g_cpu_chroma = NULL;
+static uint8_t *g_cpu_src = NULL;
+static uint8_t *g_cpu_dst = NULL;
+static double g_cpu_sq_err[3];
+static uint64_t g_cpu_samples[3];
+static double g_process_time = 0, g_cpu_time = 0;
+static uint32_t g_bench_frames = 0;
 
 static VAStatus
 create_surface(VASurfaceID * p_surface_id,
@@ -191,9 +152,9 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
         y_src = newImageBuffer;
         if (g_src_file_fourcc == VA_FOURCC_I420) {
@@ -288,9 +249,9 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
         y_src = newImageBuffer;
         y_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[0]);
@@ -301,67 +262,17 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
             y_src += surface_image.width * 2;
             y_dst += surface_image.pitches[0];
         }
-    } else if ((surface_image.format.fourcc == VA_FOURCC_P010 &&
-                g_src_file_fourcc == VA_FOURCC_P010) ||
-               (surface_image.format.fourcc == VA_FOURCC_I010 &&
-                g_src_file_fourcc == VA_FOURCC_I010)) {
-        frame_size = surface_image.width * surface_image.height * 3;
+    } else if (vpp_hbd_supported(surface_image.format.fourcc, g_src_file_fourcc)) {
+        frame_size = vpp_hbd_frame_size(g_src_file_fourcc, surface_image.width, surface_image.height);
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
-
-        y_src = newImageBuffer;
-        y_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[0]);
-
-        /* plane 0, directly copy */
-        for (row = 0; row < surface_image.height; row++) {
-            memcpy(y_dst, y_src, surface_image.width * 2);
-            y_src += surface_image.width * 2;
-            y_dst += surface_image.pitches[0];
-        }
-
-        /* UV plane */
-        if (surface_image.format.fourcc == VA_FOURCC_I010) {
-            assert(g_src_file_fourcc == VA_FOURCC_I010);
-
-            u_src = newImageBuffer + surface_image.width * surface_image.height * 2;
-            v_src = newImageBuffer + surface_image.width * surface_image.height * 5 / 2;
-
-            u_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[1]);
-            v_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[2]);
-
-            for (row = 0; row < surface_image.height / 2; row++) {
-                memcpy(u_dst, u_src, surface_image.width);
-                memcpy(v_dst, v_src, surface_image.width);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
-                u_src += surface_image.width;
-                v_src += surface_image.width;
-
-                u_dst += surface_image.pitches[1];
-                v_dst += surface_image.pitches[2];
-            }
-        } else if (surface_image.format.fourcc == VA_FOURCC_P010) {
-            assert(g_src_file_fourcc == VA_FOURCC_P010);
-
-            u_src = newImageBuffer + surface_image.width * surface_image.height * 2;
-            v_src = u_src;
-
-            u_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[1]);
-            v_dst = u_dst;
-
-            for (row = 0; row < surface_image.height / 2; row++) {
-                memcpy(u_dst, u_src, surface_image.width * 2);
-
-                u_src += surface_image.width * 2;
-                v_src = u_src;
-
-                u_dst += surface_image.pitches[1];
-                v_dst = u_dst;
-            }
-        }
+        /* 10/12/16 bit frame, repacked to the surface layout */
+        vpp_hbd_file_to_image(newImageBuffer, g_src_file_fourcc, &surface_image, (uint8_t *)surface_p);
     }  else if ((surface_image.format.fourcc == VA_FOURCC_RGBA &&
                  g_src_file_fourcc == VA_FOURCC_RGBA) ||
                 (surface_image.format.fourcc == VA_FOURCC_RGBX &&
@@ -374,9 +285,9 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
         y_src = newImageBuffer;
         y_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[0]);
@@ -400,7 +311,7 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 /* Store NV12/YV12/I420 surface to yv12 file */
@@ -496,9 +407,9 @@ store_yuv_surface_to_yv12_file(FILE *fp,
         }
 
         /* write frame to file */
-        do {
-            n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
-        } while (n_items != 1);
+        n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     } else {
         printf("Not supported YUV surface fourcc !!! \n");
@@ -513,7 +424,7 @@ store_yuv_surface_to_yv12_file(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -608,9 +519,9 @@ store_yuv_surface_to_i420_file(FILE *fp,
         }
 
         /* write frame to file */
-        do {
-            n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
-        } while (n_items != 1);
+        n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     } else {
         printf("Not supported YUV surface fourcc !!! \n");
@@ -625,7 +536,7 @@ store_yuv_surface_to_i420_file(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -715,9 +626,9 @@ store_yuv_surface_to_nv12_file(FILE *fp,
         }
 
         /* write frame to file */
-        do {
-            n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
-        } while (n_items != 1);
+        n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     } else {
         printf("Not supported YUV surface fourcc !!! \n");
@@ -732,7 +643,7 @@ store_yuv_surface_to_nv12_file(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -778,9 +689,9 @@ store_packed_yuv_surface_to_packed_file(FILE *fp,
         }
 
         /* write frame to file */
-        do {
-            n_items = fwrite(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fwrite(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     } else {
         printf("Not supported YUV surface fourcc !!! \n");
@@ -795,7 +706,7 @@ store_packed_yuv_surface_to_packed_file(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -804,13 +715,7 @@ store_yuv_surface_to_10bit_file(FILE *fp, VASurfaceID surface_id)
     VAStatus va_status;
     VAImage surface_image;
     void *surface_p = NULL;
-    unsigned char *y_src = NULL;
-    unsigned char *u_src = NULL;
-    unsigned char *v_src = NULL;
-    unsigned char *y_dst = NULL;
-    unsigned char *u_dst = NULL;
-    unsigned char *v_dst = NULL;
-    uint32_t row;
+    uint32_t frame_size;
     int32_t n_items;
     unsigned char * newImageBuffer = NULL;
     va_status = vaSyncSurface(va_dpy, surface_id);
@@ -822,62 +727,22 @@ store_yuv_surface_to_10bit_file(FILE *fp, VASurfaceID surface_id)
     va_status = vaMapBuffer(va_dpy, surface_image.buf, &surface_p);
     CHECK_VASTATUS(va_status, "vaMapBuffer");
 
-    /* store the surface to one 10bit file */
-    uint32_t y_size = surface_image.width * surface_image.height * 2;
-    uint32_t u_size = y_size / 4;
-
-    newImageBuffer = (unsigned char*)malloc(y_size * 3);
+    /* store the surface to one 10/12/16 bit file */
+    frame_size = vpp_hbd_frame_size(g_dst_file_fourcc, surface_image.width, surface_image.height);
+    newImageBuffer = (unsigned char*)malloc(frame_size);
     assert(newImageBuffer);
-    y_dst = newImageBuffer;
-
-    y_src = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[0]);
-
-    /* Y plane copy */
-    for (row = 0; row < surface_image.height; row++) {
-        memcpy(y_dst, y_src, surface_image.width * 2);
-        y_src += surface_image.pitches[0];
-        y_dst += surface_image.width * 2;
-    }
-
-    if (surface_image.format.fourcc == VA_FOURCC_I010) {
-        u_dst = newImageBuffer + y_size;
-        v_dst = newImageBuffer + y_size + u_size;
-
-        u_src = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[1]);
-        v_src = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[2]);
-
-        for (row = 0; row < surface_image.height / 2; row++) {
-            memcpy(u_dst, u_src, surface_image.width);
-            memcpy(v_dst, v_src, surface_image.width);
 
-            u_dst += surface_image.width;
-            v_dst += surface_image.width;
-
-            u_src += surface_image.pitches[1];
-            v_src += surface_image.pitches[2];
-        }
-    } else if (surface_image.format.fourcc == VA_FOURCC_P010) {
-        u_dst = newImageBuffer + y_size;
-        v_dst = u_dst;
-
-        u_src = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[1]);
-        v_src = u_src;
-
-        for (row = 0; row < surface_image.height / 2; row++) {
-            memcpy(u_dst, u_src, surface_image.width * 2);
-            u_dst += surface_image.width * 2;
-            u_src += surface_image.pitches[1];
-        }
-    } else {
+    if (vpp_hbd_image_to_file(&surface_image, (uint8_t *)surface_p,
+                              newImageBuffer, g_dst_file_fourcc)) {
         printf("Not supported YUV surface fourcc !!! \n");
         free(newImageBuffer);
         return VA_STATUS_ERROR_INVALID_SURFACE;
     }
 
     /* write frame to file */
-    do {
-        n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
-    } while (n_items != 1);
+    n_items = fwrite(newImageBuffer, frame_size, 1, fp);
+    if (n_items != 1)
+        va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     if (newImageBuffer) {
         free(newImageBuffer);
@@ -887,7 +752,7 @@ store_yuv_surface_to_10bit_file(FILE *fp, VASurfaceID surface_id)
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -924,9 +789,9 @@ store_rgb_surface_to_rgb_file(FILE *fp, VASurfaceID surface_id)
     }
 
     /* write frame to file */
-    do {
-        n_items = fwrite(newImageBuffer, frame_size, 1, fp);
-    } while (n_items != 1);
+    n_items = fwrite(newImageBuffer, frame_size, 1, fp);
+    if (n_items != 1)
+        va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     if (newImageBuffer) {
         free(newImageBuffer);
@@ -936,7 +801,7 @@ store_rgb_surface_to_rgb_file(FILE *fp, VASurfaceID surface_id)
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -961,10 +826,7 @@ store_yuv_surface_to_file(FILE *fp,
                (g_out_fourcc == VA_FOURCC_UYVY &&
                 g_dst_file_fourcc == VA_FOURCC_UYVY)) {
         return store_packed_yuv_surface_to_packed_file(fp, surface_id);
-    } else if ((g_out_fourcc == VA_FOURCC_I010 &&
-                g_dst_file_fourcc == VA_FOURCC_I010) ||
-               (g_out_fourcc == VA_FOURCC_P010 &&
-                g_dst_file_fourcc == VA_FOURCC_P010)) {
+    } else if (vpp_hbd_supported(g_out_fourcc, g_dst_file_fourcc)) {
         return store_yuv_surface_to_10bit_file(fp, surface_id);
     } else if ((g_out_fourcc == VA_FOURCC_RGBA &&
                 g_dst_file_fourcc == VA_FOURCC_RGBA) ||
@@ -994,7 +856,7 @@ chromasitting_param_init(uint8_t *in_chroma_sample_location, uint8_t *dst_chroma
     char     dst_chroma_siting_mode[MAX_LEN];
 
     /* Read filter type */
-    if (read_value_string(g_config_file_fd, "IN_CHROMA_SITTING_MODE", in_chroma_siting_mode)) {
+    if (vpp_config_get_string(g_config, "IN_CHROMA_SITTING_MODE", in_chroma_siting_mode)) {
         printf("Read IN_CHROMA_SITTING_MODE type error !\n");
         assert(0);
     }
@@ -1018,7 +880,7 @@ chromasitting_param_init(uint8_t *in_chroma_sample_location, uint8_t *dst_chroma
     }
     *in_chroma_sample_location = in_sample_location;
 
-    if (read_value_string(g_config_file_fd, "DST_CHROMA_SITTING_MODE", dst_chroma_siting_mode)) {
+    if (vpp_config_get_string(g_config, "DST_CHROMA_SITTING_MODE", dst_chroma_siting_mode)) {
         printf("Read DST_CHROMA_SITTING_MODE type error !\n");
         assert(0);
     }
@@ -1053,9 +915,6 @@ video_frame_process(VASurfaceID in_surface_id,
     VAProcPipelineParameterBuffer pipeline_param;
     VARectangle surface_region, output_region;
     VABufferID pipeline_param_buf_id = VA_INVALID_ID;
-    uint8_t in_chroma_sample_location = VA_CHROMA_SITING_UNKNOWN;
-    uint8_t dst_chroma_sample_location = VA_CHROMA_SITING_UNKNOWN;
-    chromasitting_param_init(&in_chroma_sample_location, &dst_chroma_sample_location);
     /* Fill pipeline buffer */
     surface_region.x = 0;
     surface_region.y = 0;
@@ -1070,8 +929,8 @@ video_frame_process(VASurfaceID in_surface_id,
     pipeline_param.surface = in_surface_id;
     pipeline_param.surface_region = &surface_region;
     pipeline_param.output_region = &output_region;
-    pipeline_param.input_color_properties.chroma_sample_location = in_chroma_sample_location;
-    pipeline_param.output_color_properties.chroma_sample_location = dst_chroma_sample_location;
+    pipeline_param.input_color_properties.chroma_sample_location = g_in_chroma_siting;
+    pipeline_param.output_color_properties.chroma_sample_location = g_dst_chroma_siting;
 
     va_status = vaCreateBuffer(va_dpy,
                                context_id,
@@ -1102,10 +961,160 @@ video_frame_process(VASurfaceID in_surface_id,
     return va_status;
 }
 
+static double
+time_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* Resample the chroma of the input of <out_surface_id> on the CPU and add
+ * the difference to the VPP output up for the PSNR of the run. The input is
+ * copied to system memory first, only the resampling itself is timed. */
+static VAStatus
+cpu_reference(VASurfaceID in_surface_id, VASurfaceID out_surface_id)
+{
+    VAStatus va_status;
+    VAImage in_image, out_image;
+    void *in_p = NULL, *out_p = NULL;
+    VPPChromaFrame src, ref, out;
+    double start;
+
+    va_status = vaDeriveImage(va_dpy, in_surface_id, &in_image);
+    CHECK_VASTATUS(va_status, "vaDeriveImage");
+
+    va_status = vaMapBuffer(va_dpy, in_image.buf, &in_p);
+    CHECK_VASTATUS(va_status, "vaMapBuffer");
+
+    va_status = vaDeriveImage(va_dpy, out_surface_id, &out_image);
+    CHECK_VASTATUS(va_status, "vaDeriveImage");
+
+    va_status = vaMapBuffer(va_dpy, out_image.buf, &out_p);
+    CHECK_VASTATUS(va_status, "vaMapBuffer");
+
+    if (!g_cpu_src)
+        g_cpu_src = (uint8_t *)malloc(in_image.data_size);
+    if (!g_cpu_dst)
+        g_cpu_dst = (uint8_t *)malloc(out_image.data_size);
+    assert(g_cpu_src && g_cpu_dst);
+
+    memcpy(g_cpu_src, in_p, in_image.data_size);
+    vpp_chroma_frame(&src, in_image.format.fourcc, g_in_pic_width, g_in_pic_height,
+                     g_in_chroma_siting, g_cpu_src, in_image.offsets, in_image.pitches);
+    vpp_chroma_frame(&ref, out_image.format.fourcc, g_out_pic_width, g_out_pic_height,
+                     g_dst_chroma_siting, g_cpu_dst, out_image.offsets, out_image.pitches);
+    vpp_chroma_frame(&out, out_image.format.fourcc, g_out_pic_width, g_out_pic_height,
+                     g_dst_chroma_siting, (uint8_t *)out_p, out_image.offsets,
+                     out_image.pitches);
+
+    start = time_ms();
+    vpp_chroma_run(g_cpu_chroma, &src, &ref);
+    g_cpu_time += time_ms() - start;
+
+    vpp_chroma_compare(&ref, &out, g_cpu_sq_err, g_cpu_samples);
+
+    vaUnmapBuffer(va_dpy, out_image.buf);
+    vaDestroyImage(va_dpy, out_image.image_id);
+    vaUnmapBuffer(va_dpy, in_image.buf);
+    vaDestroyImage(va_dpy, in_image.image_id);
+
+    return va_status;
+}
+
+static void
+print_psnr(const char *name, double sq_err, uint64_t samples)
+{
+    if (sq_err > 0)
+        printf(" %s %.2f", name, 10 * log10(255.0 * 255.0 * samples / sq_err));
+    else
+        printf(" %s inf", name);
+}
+
+static void
+print_cpu_reference(int32_t frame_count)
+{
+    printf("VPP: %.3f ms/frame, CPU reference: %.3f ms/frame, PSNR against VPP:",
+           g_process_time / frame_count, g_cpu_time / frame_count);
+    print_psnr("Y", g_cpu_sq_err[0], g_cpu_samples[0]);
+    print_psnr("U", g_cpu_sq_err[1], g_cpu_samples[1]);
+    print_psnr("V", g_cpu_sq_err[2], g_cpu_samples[2]);
+    printf(" dB\n");
+}
+
+/* Planar frame of <subsampling> in <data>, which holds 3 luma planes */
+static void
+bench_frame(VPPChromaFrame *frame, int subsampling, uint8_t siting, uint8_t *data)
+{
+    static const uint32_t fourccs[] = { VA_FOURCC_I420, VA_FOURCC_422H, VA_FOURCC_444P };
+    uint32_t width = g_in_pic_width, height = g_in_pic_height;
+    uint32_t chroma_width = subsampling == VPP_CHROMA_444 ? width : (width + 1) / 2;
+    uint32_t chroma_height = subsampling == VPP_CHROMA_420 ? (height + 1) / 2 : height;
+    uint32_t offsets[3], pitches[3];
+
+    offsets[0] = 0;
+    offsets[1] = width * height;
+    offsets[2] = offsets[1] + chroma_width * chroma_height;
+    pitches[0] = width;
+    pitches[1] = pitches[2] = chroma_width;
+    vpp_chroma_frame(frame, fourccs[subsampling], width, height, siting, data, offsets, pitches);
+}
+
+/* Time the CPU resampler for every change between 4:2:0, 4:2:2 and 4:4:4
+ * at the input size, from the input to the output siting */
+static void
+chroma_bench(uint32_t frames)
+{
+    static const char *names[] = { "4:2:0", "4:2:2", "4:4:4" };
+    size_t size = (size_t)g_in_pic_width * g_in_pic_height * 3;
+    uint8_t *src_data = (uint8_t *)malloc(size);
+    uint8_t *dst_data = (uint8_t *)malloc(size);
+    VPPChromaFrame src, dst;
+    VPPChroma *chroma;
+    double start, time;
+    uint32_t i;
+    int s, d;
+
+    assert(src_data && dst_data);
+    for (i = 0; i < size; i++)
+        src_data[i] = (uint8_t)(i * 7);
+
+    printf("CPU chroma resampling of %d x %d frames, %d frames each:\n",
+           g_in_pic_width, g_in_pic_height, frames);
+    for (s = VPP_CHROMA_420; s <= VPP_CHROMA_444; s++) {
+        for (d = VPP_CHROMA_420; d <= VPP_CHROMA_444; d++) {
+            if (s == d)
+                continue;
+
+            bench_frame(&src, s, g_in_chroma_siting, src_data);
+            bench_frame(&dst, d, g_dst_chroma_siting, dst_data);
+            chroma = vpp_chroma_create(g_in_pic_width, g_in_pic_height, s, g_in_chroma_siting,
+                                       d, g_dst_chroma_siting);
+            assert(chroma);
+
+            /* first run outside of the timing, it faults the buffers in */
+            vpp_chroma_run(chroma, &src, &dst);
+            start = time_ms();
+            for (i = 0; i < frames; i++)
+                vpp_chroma_run(chroma, &src, &dst);
+            time = (time_ms() - start) / frames;
+            vpp_chroma_destroy(chroma);
+
+            printf("    %s -> %s: %.3f ms/frame, %.1f Mpixel/s\n", names[s], names[d], time,
+                   time > 0 ? g_in_pic_width * g_in_pic_height / (time * 1000) : 0);
+        }
+    }
+
+    free(src_data);
+    free(dst_data);
+}
+
 static VAStatus
 vpp_context_create()
 {
     VAStatus va_status = VA_STATUS_SUCCESS;
+    uint32_t slot;
     int32_t j;
 
     /* VA driver initialization */
@@ -1149,13 +1158,15 @@ vpp_context_create()
     }
 
     /* Create surface/config/context for VPP pipeline */
-    va_status = create_surface(&g_in_surface_id, g_in_pic_width, g_in_pic_height,
-                               g_in_fourcc, g_in_format);
-    CHECK_VASTATUS(va_status, "vaCreateSurfaces for input");
-
-    va_status = create_surface(&g_out_surface_id, g_out_pic_width, g_out_pic_height,
-                               g_out_fourcc, g_out_format);
-    CHECK_VASTATUS(va_status, "vaCreateSurfaces for output");
+    for (slot = 0; slot < g_pipeline_depth; slot++) {
+        va_status = create_surface(&g_in_surface_id[slot], g_in_pic_width, g_in_pic_height,
+                                   g_in_fourcc, g_in_format);
+        CHECK_VASTATUS(va_status, "vaCreateSurfaces for input");
+
+        va_status = create_surface(&g_out_surface_id[slot], g_out_pic_width, g_out_pic_height,
+                                   g_out_fourcc, g_out_format);
+        CHECK_VASTATUS(va_status, "vaCreateSurfaces for output");
+    }
 
     va_status = vaCreateConfig(va_dpy,
                                VAProfileNone,
@@ -1170,8 +1181,8 @@ vpp_context_create()
                                 g_out_pic_width,
                                 g_out_pic_height,
                                 VA_PROGRESSIVE,
-                                &g_out_surface_id,
-                                1,
+                                g_out_surface_id,
+                                g_pipeline_depth,
                                 &context_id);
     CHECK_VASTATUS(va_status, "vaCreateContext");
 
@@ -1182,8 +1193,8 @@ static void
 vpp_context_destroy()
 {
     /* Release resource */
-    vaDestroySurfaces(va_dpy, &g_in_surface_id, 1);
-    vaDestroySurfaces(va_dpy, &g_out_surface_id, 1);
+    vaDestroySurfaces(va_dpy, g_in_surface_id, g_pipeline_depth);
+    vaDestroySurfaces(va_dpy, g_out_surface_id, g_pipeline_depth);
     vaDestroyContext(va_dpy, context_id);
     vaDestroyConfig(va_dpy, config_id);
 
@@ -1221,6 +1232,8 @@ parse_fourcc_and_format(char *str, uint32_t *fourcc, uint32_t *format)
         tfourcc = VA_FOURCC_BGRA;
     } else if (!strcmp(str, "BGRX")) {
         tfourcc = VA_FOURCC_BGRX;
+    } else if ((tfourcc = vpp_hbd_fourcc(str, &tformat))) {
+        /* P012, P016, Y210, Y212, Y216, Y410, Y412, Y416 and planar files */
     } else {
         printf("Not supported format: %s! Currently only support following format: %s\n",
                str, "YV12, I420, NV12, YUY2(YUYV), UYVY, P010, I010, RGBA, RGBX, BGRA or BGRX");
@@ -1242,26 +1255,56 @@ parse_basic_parameters()
     char str[MAX_LEN];
 
     /* Read src frame file information */
-    read_value_string(g_config_file_fd, "SRC_FILE_NAME", g_src_file_name);
-    read_value_uint32(g_config_file_fd, "SRC_FRAME_WIDTH", &g_in_pic_width);
-    read_value_uint32(g_config_file_fd, "SRC_FRAME_HEIGHT", &g_in_pic_height);
-    read_value_string(g_config_file_fd, "SRC_FRAME_FORMAT", str);
+    vpp_config_get_string(g_config, "SRC_FILE_NAME", g_src_file_name);
+    vpp_config_get_uint32(g_config, "SRC_FRAME_WIDTH", &g_in_pic_width);
+    vpp_config_get_uint32(g_config, "SRC_FRAME_HEIGHT", &g_in_pic_height);
+    vpp_config_get_string(g_config, "SRC_FRAME_FORMAT", str);
     parse_fourcc_and_format(str, &g_in_fourcc, &g_in_format);
 
     /* Read dst frame file information */
-    read_value_string(g_config_file_fd, "DST_FILE_NAME", g_dst_file_name);
-    read_value_uint32(g_config_file_fd, "DST_FRAME_WIDTH", &g_out_pic_width);
-    read_value_uint32(g_config_file_fd, "DST_FRAME_HEIGHT", &g_out_pic_height);
-    read_value_string(g_config_file_fd, "DST_FRAME_FORMAT", str);
+    vpp_config_get_string(g_config, "DST_FILE_NAME", g_dst_file_name);
+    vpp_config_get_uint32(g_config, "DST_FRAME_WIDTH", &g_out_pic_width);
+    vpp_config_get_uint32(g_config, "DST_FRAME_HEIGHT", &g_out_pic_height);
+    vpp_config_get_string(g_config, "DST_FRAME_FORMAT", str);
     parse_fourcc_and_format(str, &g_out_fourcc, &g_out_format);
 
-    read_value_string(g_config_file_fd, "SRC_FILE_FORMAT", str);
+    vpp_config_get_string(g_config, "SRC_FILE_FORMAT", str);
     parse_fourcc_and_format(str, &g_src_file_fourcc, NULL);
 
-    read_value_string(g_config_file_fd, "DST_FILE_FORMAT", str);
+    vpp_config_get_string(g_config, "DST_FILE_FORMAT", str);
     parse_fourcc_and_format(str, &g_dst_file_fourcc, NULL);
 
-    read_value_uint32(g_config_file_fd, "FRAME_SUM", &g_frame_count);
+    vpp_config_get_uint32(g_config, "FRAME_SUM", &g_frame_count);
+
+    if (chromasitting_param_init(&g_in_chroma_siting, &g_dst_chroma_siting))
+        return -1;
+
+    /* Optional, check every frame against the CPU chroma resampler */
+    if (!vpp_config_get_string(g_config, "CPU_REFERENCE", str) && atoi(str)) {
+        if (vpp_chroma_subsampling(g_in_fourcc) < 0 || vpp_chroma_subsampling(g_out_fourcc) < 0 ||
+            g_in_pic_width != g_out_pic_width || g_in_pic_height != g_out_pic_height)
+            printf("CPU reference only handles 8 bit YUV input and output of the same size, "
+                   "skipped\n");
+        else
+            g_cpu_chroma = vpp_chroma_create(g_in_pic_width, g_in_pic_height,
+                                             vpp_chroma_subsampling(g_in_fourcc),
+                                             g_in_chroma_siting,
+                                             vpp_chroma_subsampling(g_out_fourcc),
+                                             g_dst_chroma_siting);
+    }
+
+    /* Optional, time the CPU resampler over that many frames */
+    if (!vpp_config_get_string(g_config, "CHROMA_BENCH_FRAMES", str))
+        g_bench_frames = (uint32_t)atoi(str);
+
+    /* Optional, number of frames in flight between upload, process and store */
+    if (!vpp_config_get_string(g_config, "PIPELINE_DEPTH", str)) {
+        g_pipeline_depth = (uint32_t)atoi(str);
+        if (g_pipeline_depth < 1 || g_pipeline_depth > VPP_PIPELINE_MAX_DEPTH) {
+            printf("PIPELINE_DEPTH must be in [1, %d]\n", VPP_PIPELINE_MAX_DEPTH);
+            return -1;
+        }
+    }
 
     if (g_in_pic_width != g_out_pic_width ||
         g_in_pic_height != g_out_pic_height)
@@ -1284,10 +1327,50 @@ print_help()
     printf("The configure file process_chromasitting.cfg is used to configure the para.\n");
     printf("You can refer process_chromasitting.cfg.template for each para meaning and create the configure file.\n");
 }
+
+static int
+pipeline_read(uint32_t /* frame */, uint32_t slot)
+{
+    if (upload_yuv_frame_to_yuv_surface(g_src_file_fd, g_in_surface_id[slot]) ==
+        VA_STATUS_SUCCESS)
+        return 0;
+
+    /* a short read at the end of the input ends the pipeline */
+    return feof(g_src_file_fd) ? 1 : -1;
+}
+
+static VAStatus
+pipeline_process(uint32_t /* frame */, uint32_t slot)
+{
+    double start = time_ms();
+    VAStatus va_status;
+
+    va_status = video_frame_process(g_in_surface_id[slot], g_out_surface_id[slot]);
+
+    /* with the reference the process time is measured up to completion */
+    if (g_cpu_chroma && va_status == VA_STATUS_SUCCESS)
+        va_status = vaSyncSurface(va_dpy, g_out_surface_id[slot]);
+    g_process_time += time_ms() - start;
+
+    return va_status;
+}
+
+static int
+pipeline_write(uint32_t /* frame */, uint32_t slot)
+{
+    /* the input of the slot stays loaded until its output is written */
+    if (g_cpu_chroma)
+        cpu_reference(g_in_surface_id[slot], g_out_surface_id[slot]);
+
+    return store_yuv_surface_to_file(g_dst_file_fd, g_out_surface_id[slot]) ==
+           VA_STATUS_SUCCESS ? 0 : -1;
+}
+
 int32_t main(int32_t argc, char *argv[])
 {
     VAStatus va_status;
-    uint32_t i;
+    VPPPipelineOps pipeline_ops = { pipeline_read, pipeline_process, pipeline_write };
+    int32_t frame_count;
 
     if (argc != 2 || !strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")) {
         print_help();
@@ -1298,11 +1381,18 @@ int32_t main(int32_t argc, char *argv[])
     strncpy(g_config_file_name, argv[1], MAX_LEN);
     g_config_file_name[MAX_LEN - 1] = '\0';
 
-    if (NULL == (g_config_file_fd = fopen(g_config_file_name, "r"))) {
+    if (NULL == (g_config = vpp_config_open(g_config_file_name))) {
         printf("Open configure file %s failed!\n", g_config_file_name);
         assert(0);
     }
 
+    /* frames on stdout, diagnostics on stderr */
+    if (vpp_config_has_value(g_config, "DST_FILE_NAME", "-") &&
+        vpp_stream_reserve_stdout()) {
+        printf("Failed to move the diagnostics to stderr\n");
+        assert(0);
+    }
+
     /* Parse basic parameters */
     if (parse_basic_parameters()) {
         printf("Parse parameters in configure file error\n");
@@ -1316,13 +1406,13 @@ int32_t main(int32_t argc, char *argv[])
     }
 
     /* Video frame fetch, process and store */
-    if (NULL == (g_src_file_fd = fopen(g_src_file_name, "r"))) {
+    if (NULL == (g_src_file_fd = vpp_stream_open(g_src_file_name, "r"))) {
         printf("Open SRC_FILE_NAME: %s failed, please specify it in config file: %s !\n",
                g_src_file_name, g_config_file_name);
         assert(0);
     }
 
-    if (NULL == (g_dst_file_fd = fopen(g_dst_file_name, "w"))) {
+    if (NULL == (g_dst_file_fd = vpp_stream_open(g_dst_file_name, "w"))) {
         printf("Open DST_FILE_NAME: %s failed, please specify it in config file: %s !\n",
                g_dst_file_name, g_config_file_name);
         assert(0);
@@ -1334,10 +1424,10 @@ int32_t main(int32_t argc, char *argv[])
     unsigned int duration = 0;
     clock_gettime(CLOCK_MONOTONIC, &Pre_time);
 
-    for (i = 0; i < g_frame_count; i ++) {
-        upload_yuv_frame_to_yuv_surface(g_src_file_fd, g_in_surface_id);
-        video_frame_process(g_in_surface_id, g_out_surface_id);
-        store_yuv_surface_to_file(g_dst_file_fd, g_out_surface_id);
+    frame_count = vpp_pipeline_run(g_pipeline_depth, g_frame_count, &pipeline_ops);
+    if (frame_count < 0) {
+        printf("video frame process failed\n");
+        assert(0);
     }
 
     clock_gettime(CLOCK_MONOTONIC, &Cur_time);
@@ -1349,7 +1439,19 @@ int32_t main(int32_t argc, char *argv[])
     }
 
     printf("Finish processing, performance: \n");
-    printf("%d frames processed in: %d ms, ave time = %d ms\n", g_frame_count, duration, duration / g_frame_count);
+    printf("%d frames processed in: %d ms, ave time = %d ms\n", frame_count, duration,
+           frame_count ? duration / frame_count : 0);
+
+    if (g_cpu_chroma) {
+        if (frame_count)
+            print_cpu_reference(frame_count);
+        vpp_chroma_destroy(g_cpu_chroma);
+        free(g_cpu_src);
+        free(g_cpu_dst);
+    }
+
+    if (g_bench_frames)
+        chroma_bench(g_bench_frames);
 
     if (g_src_file_fd)
         fclose(g_src_file_fd);
@@ -1357,8 +1459,7 @@ int32_t main(int32_t argc, char *argv[])
     if (g_dst_file_fd)
         fclose(g_dst_file_fd);
 
-    if (g_config_file_fd)
-        fclose(g_config_file_fd);
+    vpp_config_close(g_config);
 
     vpp_context_destroy();
 
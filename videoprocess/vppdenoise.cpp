@@ -34,6 +34,10 @@
 #include <va/va.h>
 #include <va/va_vpp.h>
 #include "va_display.h"
+#include "vpp_config.h"
+#include "vpp_history.h"
+#include "vpp_pipeline.h"
+#include "vpp_stream.h"
 
 #ifndef VA_FOURCC_I420
 #define VA_FOURCC_I420 0x30323449
@@ -50,10 +54,12 @@
 static VADisplay va_dpy = NULL;
 static VAContextID context_id = 0;
 static VAConfigID  config_id = 0;
-static VASurfaceID g_in_surface_id = VA_INVALID_ID;
-static VASurfaceID g_out_surface_id = VA_INVALID_ID;
+/* input frame N is in surface N % size, past and future frames stay
+ * loaded for a temporal denoise */
+static VPPHistory g_history;
+static VASurfaceID g_out_surface_id[VPP_PIPELINE_MAX_DEPTH];
 
-static FILE* g_config_file_fd = NULL;
+static VPPConfig *g_config = NULL;
 static FILE* g_src_file_fd = NULL;
 static FILE* g_dst_file_fd = NULL;
 
@@ -74,77 +80,7 @@ static uint32_t g_src_file_fourcc = VA_FOURCC('I', '4', '2', '0');
 static uint32_t g_dst_file_fourcc = VA_FOURCC('Y', 'V', '1', '2');
 
 static uint32_t g_frame_count = 0;
-
-static int8_t
-read_value_string(FILE *fp, const char* field_name, char* value)
-{
-    char strLine[MAX_LEN];
-    char* field = NULL;
-    char* str = NULL;
-    uint16_t i;
-
-    if (!fp || !field_name || !value)  {
-        printf("Invalid fuction parameters\n");
-        return -1;
-    }
-
-    rewind(fp);
-
-    while (!feof(fp)) {
-        if (!fgets(strLine, MAX_LEN, fp))
-            continue;
-
-        for (i = 0; i < MAX_LEN && strLine[i]; i++)
-            if (strLine[i] != ' ') break;
-
-        if (i == MAX_LEN || strLine[i] == '#' || strLine[i] == '\n')
-            continue;
-
-        field = strtok(&strLine[i], ":");
-        if (strncmp(field, field_name, strlen(field_name)))
-            continue;
-
-        if (!(str = strtok(NULL, ":")))
-            continue;
-
-        /* skip blank space in string */
-        while (*str == ' ')
-            str++;
-
-        *(str + strlen(str) - 1) = '\0';
-        strcpy(value, str);
-
-        return 0;
-    }
-
-    return -1;
-}
-
-static int8_t
-read_value_uint32(FILE* fp, const char* field_name, uint32_t* value)
-{
-    char str[MAX_LEN];
-
-    if (read_value_string(fp, field_name, str)) {
-        printf("Failed to find integer field: %s", field_name);
-        return -1;
-    }
-
-    *value = (uint32_t)atoi(str);
-    return 0;
-}
-static int8_t
-read_value_float(FILE *fp, const char* field_name, float* value)
-{
-    char str[MAX_LEN];
-    if (read_value_string(fp, field_name, str)) {
-        printf("Failed to find float field: %s \n", field_name);
-        return -1;
-    }
-
-    *value = atof(str);
-    return 0;
-}
+static uint32_t g_pipeline_depth = 1;
 
 static float
 adjust_to_range(VAProcFilterValueRange *range, float value)
@@ -215,9 +151,9 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
         y_src = newImageBuffer;
         if (g_src_file_fourcc == VA_FOURCC_I420) {
@@ -312,9 +248,9 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
         y_src = newImageBuffer;
         y_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[0]);
@@ -333,9 +269,9 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
         y_src = newImageBuffer;
         y_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[0]);
@@ -398,9 +334,9 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
         y_src = newImageBuffer;
         y_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[0]);
@@ -424,7 +360,7 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 /* Store NV12/YV12/I420 surface to yv12 file */
@@ -520,9 +456,9 @@ store_yuv_surface_to_yv12_file(FILE *fp,
         }
 
         /* write frame to file */
-        do {
-            n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
-        } while (n_items != 1);
+        n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     } else {
         printf("Not supported YUV surface fourcc !!! \n");
@@ -537,7 +473,7 @@ store_yuv_surface_to_yv12_file(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -632,9 +568,9 @@ store_yuv_surface_to_i420_file(FILE *fp,
         }
 
         /* write frame to file */
-        do {
-            n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
-        } while (n_items != 1);
+        n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     } else {
         printf("Not supported YUV surface fourcc !!! \n");
@@ -649,7 +585,7 @@ store_yuv_surface_to_i420_file(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -739,9 +675,9 @@ store_yuv_surface_to_nv12_file(FILE *fp,
         }
 
         /* write frame to file */
-        do {
-            n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
-        } while (n_items != 1);
+        n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     } else {
         printf("Not supported YUV surface fourcc !!! \n");
@@ -756,7 +692,7 @@ store_yuv_surface_to_nv12_file(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -802,9 +738,9 @@ store_packed_yuv_surface_to_packed_file(FILE *fp,
         }
 
         /* write frame to file */
-        do {
-            n_items = fwrite(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fwrite(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     } else {
         printf("Not supported YUV surface fourcc !!! \n");
@@ -819,7 +755,7 @@ store_packed_yuv_surface_to_packed_file(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -899,9 +835,9 @@ store_yuv_surface_to_10bit_file(FILE *fp, VASurfaceID surface_id)
     }
 
     /* write frame to file */
-    do {
-        n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
-    } while (n_items != 1);
+    n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
+    if (n_items != 1)
+        va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     if (newImageBuffer) {
         free(newImageBuffer);
@@ -911,7 +847,7 @@ store_yuv_surface_to_10bit_file(FILE *fp, VASurfaceID surface_id)
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -948,9 +884,9 @@ store_rgb_surface_to_rgb_file(FILE *fp, VASurfaceID surface_id)
     }
 
     /* write frame to file */
-    do {
-        n_items = fwrite(newImageBuffer, frame_size, 1, fp);
-    } while (n_items != 1);
+    n_items = fwrite(newImageBuffer, frame_size, 1, fp);
+    if (n_items != 1)
+        va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     if (newImageBuffer) {
         free(newImageBuffer);
@@ -960,7 +896,7 @@ store_rgb_surface_to_rgb_file(FILE *fp, VASurfaceID surface_id)
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -1006,7 +942,7 @@ store_yuv_surface_to_file(FILE *fp,
 }
 
 static VAStatus
-denoise_filter_init(VABufferID *filter_param_buf_id)
+denoise_filter_init(uint32_t frame, VABufferID *filter_param_buf_id)
 {
     VAStatus va_status = VA_STATUS_SUCCESS;
     VAProcFilterParameterBuffer denoise_param;
@@ -1020,7 +956,7 @@ denoise_filter_init(VABufferID *filter_param_buf_id)
                                            &denoise_caps, &num_denoise_caps);
     CHECK_VASTATUS(va_status, "vaQueryVideoProcFilterCaps");
 
-    if (read_value_float(g_config_file_fd, "DENOISE_INTENSITY", &intensity)) {
+    if (vpp_config_get_float_at(g_config, "DENOISE_INTENSITY", frame, &intensity)) {
         printf("Read denoise intensity failed, use default value");
         intensity = denoise_caps.range.default_value;
     }
@@ -1041,7 +977,7 @@ denoise_filter_init(VABufferID *filter_param_buf_id)
     return va_status;
 }
 static VAStatus
-video_frame_process(VASurfaceID in_surface_id,
+video_frame_process(uint32_t frame,
                     VASurfaceID out_surface_id)
 {
     VAStatus va_status;
@@ -1049,7 +985,7 @@ video_frame_process(VASurfaceID in_surface_id,
     VARectangle surface_region, output_region;
     VABufferID pipeline_param_buf_id = VA_INVALID_ID;
     VABufferID filter_param_buf_id = VA_INVALID_ID;
-    denoise_filter_init(&filter_param_buf_id);
+    denoise_filter_init(frame, &filter_param_buf_id);
     /* Fill pipeline buffer */
     surface_region.x = 0;
     surface_region.y = 0;
@@ -1060,13 +996,19 @@ video_frame_process(VASurfaceID in_surface_id,
     output_region.width = g_out_pic_width;
     output_region.height = g_out_pic_height;
 
+    vpp_history_references(&g_history, frame);
+
     memset(&pipeline_param, 0, sizeof(pipeline_param));
-    pipeline_param.surface = in_surface_id;
+    pipeline_param.surface = vpp_history_surface(&g_history, frame);
     pipeline_param.surface_region = &surface_region;
     pipeline_param.output_region = &output_region;
     pipeline_param.filter_flags = 0;
     pipeline_param.filters      = &filter_param_buf_id;
     pipeline_param.num_filters  = 1;
+    pipeline_param.forward_references = g_history.forward;
+    pipeline_param.num_forward_references = g_history.num_forward;
+    pipeline_param.backward_references = g_history.backward;
+    pipeline_param.num_backward_references = g_history.num_backward;
 
     va_status = vaCreateBuffer(va_dpy,
                                context_id,
@@ -1105,6 +1047,7 @@ vpp_context_create()
 {
     VAStatus va_status = VA_STATUS_SUCCESS;
     uint32_t i;
+    uint32_t slot;
     int32_t j;
 
     /* VA driver initialization */
@@ -1148,13 +1091,11 @@ vpp_context_create()
     }
 
     /* Create surface/config/context for VPP pipeline */
-    va_status = create_surface(&g_in_surface_id, g_in_pic_width, g_in_pic_height,
-                               g_in_fourcc, g_in_format);
-    CHECK_VASTATUS(va_status, "vaCreateSurfaces for input");
-
-    va_status = create_surface(&g_out_surface_id, g_out_pic_width, g_out_pic_height,
-                               g_out_fourcc, g_out_format);
-    CHECK_VASTATUS(va_status, "vaCreateSurfaces for output");
+    for (slot = 0; slot < g_pipeline_depth; slot++) {
+        va_status = create_surface(&g_out_surface_id[slot], g_out_pic_width, g_out_pic_height,
+                                   g_out_fourcc, g_out_format);
+        CHECK_VASTATUS(va_status, "vaCreateSurfaces for output");
+    }
 
     va_status = vaCreateConfig(va_dpy,
                                VAProfileNone,
@@ -1169,8 +1110,8 @@ vpp_context_create()
                                 g_out_pic_width,
                                 g_out_pic_height,
                                 VA_PROGRESSIVE,
-                                &g_out_surface_id,
-                                1,
+                                g_out_surface_id,
+                                g_pipeline_depth,
                                 &context_id);
     CHECK_VASTATUS(va_status, "vaCreateContext");
 
@@ -1193,6 +1134,35 @@ vpp_context_create()
         printf("VPP filter type VAProcFilterNoiseReduction is not supported by driver !\n");
         assert(0);
     }
+
+    /* A temporal denoise reads past and future frames, keep as many input
+     * frames loaded as the driver asks for */
+    VABufferID filter_param_buf_id = VA_INVALID_ID;
+    VAProcPipelineCaps pipeline_caps;
+
+    va_status = denoise_filter_init(0, &filter_param_buf_id);
+    CHECK_VASTATUS(va_status, "denoise_filter_init");
+
+    memset(&pipeline_caps, 0, sizeof(pipeline_caps));
+    va_status = vaQueryVideoProcPipelineCaps(va_dpy, context_id,
+                &filter_param_buf_id, 1, &pipeline_caps);
+    vaDestroyBuffer(va_dpy, filter_param_buf_id);
+    CHECK_VASTATUS(va_status, "vaQueryVideoProcPipelineCaps");
+
+    if (pipeline_caps.num_forward_references || pipeline_caps.num_backward_references)
+        printf("Denoise references %d past and %d future frames\n",
+               pipeline_caps.num_forward_references, pipeline_caps.num_backward_references);
+
+    if (vpp_history_init(&g_history, g_pipeline_depth, pipeline_caps.num_forward_references,
+                         pipeline_caps.num_backward_references, g_frame_count))
+        assert(0);
+
+    for (i = 0; i < g_history.size; i++) {
+        va_status = create_surface(&g_history.surfaces[i], g_in_pic_width, g_in_pic_height,
+                                   g_in_fourcc, g_in_format);
+        CHECK_VASTATUS(va_status, "vaCreateSurfaces for input");
+    }
+
     return va_status;
 }
 
@@ -1200,8 +1170,8 @@ static void
 vpp_context_destroy()
 {
     /* Release resource */
-    vaDestroySurfaces(va_dpy, &g_in_surface_id, 1);
-    vaDestroySurfaces(va_dpy, &g_out_surface_id, 1);
+    vaDestroySurfaces(va_dpy, g_history.surfaces, g_history.size);
+    vaDestroySurfaces(va_dpy, g_out_surface_id, g_pipeline_depth);
     vaDestroyContext(va_dpy, context_id);
     vaDestroyConfig(va_dpy, config_id);
 
@@ -1258,26 +1228,35 @@ parse_basic_parameters()
     char str[MAX_LEN];
 
     /* Read src frame file information */
-    read_value_string(g_config_file_fd, "SRC_FILE_NAME", g_src_file_name);
-    read_value_uint32(g_config_file_fd, "SRC_FRAME_WIDTH", &g_in_pic_width);
-    read_value_uint32(g_config_file_fd, "SRC_FRAME_HEIGHT", &g_in_pic_height);
-    read_value_string(g_config_file_fd, "SRC_FRAME_FORMAT", str);
+    vpp_config_get_string(g_config, "SRC_FILE_NAME", g_src_file_name);
+    vpp_config_get_uint32(g_config, "SRC_FRAME_WIDTH", &g_in_pic_width);
+    vpp_config_get_uint32(g_config, "SRC_FRAME_HEIGHT", &g_in_pic_height);
+    vpp_config_get_string(g_config, "SRC_FRAME_FORMAT", str);
     parse_fourcc_and_format(str, &g_in_fourcc, &g_in_format);
 
     /* Read dst frame file information */
-    read_value_string(g_config_file_fd, "DST_FILE_NAME", g_dst_file_name);
-    read_value_uint32(g_config_file_fd, "DST_FRAME_WIDTH", &g_out_pic_width);
-    read_value_uint32(g_config_file_fd, "DST_FRAME_HEIGHT", &g_out_pic_height);
-    read_value_string(g_config_file_fd, "DST_FRAME_FORMAT", str);
+    vpp_config_get_string(g_config, "DST_FILE_NAME", g_dst_file_name);
+    vpp_config_get_uint32(g_config, "DST_FRAME_WIDTH", &g_out_pic_width);
+    vpp_config_get_uint32(g_config, "DST_FRAME_HEIGHT", &g_out_pic_height);
+    vpp_config_get_string(g_config, "DST_FRAME_FORMAT", str);
     parse_fourcc_and_format(str, &g_out_fourcc, &g_out_format);
 
-    read_value_string(g_config_file_fd, "SRC_FILE_FORMAT", str);
+    vpp_config_get_string(g_config, "SRC_FILE_FORMAT", str);
     parse_fourcc_and_format(str, &g_src_file_fourcc, NULL);
 
-    read_value_string(g_config_file_fd, "DST_FILE_FORMAT", str);
+    vpp_config_get_string(g_config, "DST_FILE_FORMAT", str);
     parse_fourcc_and_format(str, &g_dst_file_fourcc, NULL);
 
-    read_value_uint32(g_config_file_fd, "FRAME_SUM", &g_frame_count);
+    vpp_config_get_uint32(g_config, "FRAME_SUM", &g_frame_count);
+
+    /* Optional, number of frames in flight between upload, process and store */
+    if (!vpp_config_get_string(g_config, "PIPELINE_DEPTH", str)) {
+        g_pipeline_depth = (uint32_t)atoi(str);
+        if (g_pipeline_depth < 1 || g_pipeline_depth > VPP_PIPELINE_MAX_DEPTH) {
+            printf("PIPELINE_DEPTH must be in [1, %d]\n", VPP_PIPELINE_MAX_DEPTH);
+            return -1;
+        }
+    }
 
     if (g_in_pic_width != g_out_pic_width ||
         g_in_pic_height != g_out_pic_height)
@@ -1300,10 +1279,40 @@ print_help()
     printf("The configure file process_denoise.cfg is used to configure the para.\n");
     printf("You can refer process_denoise.cfg.template for each para meaning and create the configure file.\n");
 }
+
+static int
+history_load(uint32_t /* frame */, VASurfaceID surface)
+{
+    if (upload_yuv_frame_to_yuv_surface(g_src_file_fd, surface) == VA_STATUS_SUCCESS)
+        return 0;
+
+    return feof(g_src_file_fd) ? 1 : -1;
+}
+
+static int
+pipeline_read(uint32_t frame, uint32_t /* slot */)
+{
+    return vpp_history_advance(&g_history, frame, history_load);
+}
+
+static VAStatus
+pipeline_process(uint32_t frame, uint32_t slot)
+{
+    return video_frame_process(frame, g_out_surface_id[slot]);
+}
+
+static int
+pipeline_write(uint32_t /* frame */, uint32_t slot)
+{
+    return store_yuv_surface_to_file(g_dst_file_fd, g_out_surface_id[slot]) ==
+           VA_STATUS_SUCCESS ? 0 : -1;
+}
+
 int32_t main(int32_t argc, char *argv[])
 {
     VAStatus va_status;
-    uint32_t i;
+    VPPPipelineOps pipeline_ops = { pipeline_read, pipeline_process, pipeline_write };
+    int32_t frame_count;
 
     if (argc != 2 || !strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")) {
         print_help();
@@ -1314,11 +1323,18 @@ int32_t main(int32_t argc, char *argv[])
     strncpy(g_config_file_name, argv[1], MAX_LEN);
     g_config_file_name[MAX_LEN - 1] = '\0';
 
-    if (NULL == (g_config_file_fd = fopen(g_config_file_name, "r"))) {
+    if (NULL == (g_config = vpp_config_open(g_config_file_name))) {
         printf("Open configure file %s failed!\n", g_config_file_name);
         assert(0);
     }
 
+    /* frames on stdout, diagnostics on stderr */
+    if (vpp_config_has_value(g_config, "DST_FILE_NAME", "-") &&
+        vpp_stream_reserve_stdout()) {
+        printf("Failed to move the diagnostics to stderr\n");
+        assert(0);
+    }
+
     /* Parse basic parameters */
     if (parse_basic_parameters()) {
         printf("Parse parameters in configure file error\n");
@@ -1332,13 +1348,13 @@ int32_t main(int32_t argc, char *argv[])
     }
 
     /* Video frame fetch, process and store */
-    if (NULL == (g_src_file_fd = fopen(g_src_file_name, "r"))) {
+    if (NULL == (g_src_file_fd = vpp_stream_open(g_src_file_name, "r"))) {
         printf("Open SRC_FILE_NAME: %s failed, please specify it in config file: %s !\n",
                g_src_file_name, g_config_file_name);
         assert(0);
     }
 
-    if (NULL == (g_dst_file_fd = fopen(g_dst_file_name, "w"))) {
+    if (NULL == (g_dst_file_fd = vpp_stream_open(g_dst_file_name, "w"))) {
         printf("Open DST_FILE_NAME: %s failed, please specify it in config file: %s !\n",
                g_dst_file_name, g_config_file_name);
         assert(0);
@@ -1350,10 +1366,10 @@ int32_t main(int32_t argc, char *argv[])
     unsigned int duration = 0;
     clock_gettime(CLOCK_MONOTONIC, &Pre_time);
 
-    for (i = 0; i < g_frame_count; i ++) {
-        upload_yuv_frame_to_yuv_surface(g_src_file_fd, g_in_surface_id);
-        video_frame_process(g_in_surface_id, g_out_surface_id);
-        store_yuv_surface_to_file(g_dst_file_fd, g_out_surface_id);
+    frame_count = vpp_pipeline_run(g_pipeline_depth, g_frame_count, &pipeline_ops);
+    if (frame_count < 0) {
+        printf("video frame process failed\n");
+        assert(0);
     }
 
     clock_gettime(CLOCK_MONOTONIC, &Cur_time);
@@ -1364,7 +1380,8 @@ int32_t main(int32_t argc, char *argv[])
         duration += (Cur_time.tv_nsec + 1000000000 - Pre_time.tv_nsec) / 1000000 - 1000;
     }
     printf("Finish processing, performance: \n");
-    printf("%d frames processed in: %d ms, ave time = %d ms\n", g_frame_count, duration, duration / g_frame_count);
+    printf("%d frames processed in: %d ms, ave time = %d ms\n", frame_count, duration,
+           frame_count ? duration / frame_count : 0);
 
     if (g_src_file_fd)
         fclose(g_src_file_fd);
@@ -1372,8 +1389,7 @@ int32_t main(int32_t argc, char *argv[])
     if (g_dst_file_fd)
         fclose(g_dst_file_fd);
 
-    if (g_config_file_fd)
-        fclose(g_config_file_fd);
+    vpp_config_close(g_config);
 
     vpp_context_destroy();
 
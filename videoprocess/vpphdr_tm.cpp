@@ -34,6 +34,10 @@
 #include <va/va.h>
 #include <va/va_vpp.h>
 #include "va_display.h"
+#include "vpp_config.h"
+#include "vpp_hbd.h"
+#include "vpp_pipeline.h"
+#include "vpp_stream.h"
 
 #ifndef VA_FOURCC_I420
 #define VA_FOURCC_I420 0x30323449
@@ -50,10 +54,10 @@
 static VADisplay va_dpy = NULL;
 static VAContextID context_id = 0;
 static VAConfigID  config_id = 0;
-static VASurfaceID g_in_surface_id = VA_INVALID_ID;
-static VASurfaceID g_out_surface_id = VA_INVALID_ID;
+static VASurfaceID g_in_surface_id[VPP_PIPELINE_MAX_DEPTH];
+static VASurfaceID g_out_surface_id[VPP_PIPELINE_MAX_DEPTH];
 
-static FILE* g_config_file_fd = NULL;
+static VPPConfig *g_config = NULL;
 static FILE* g_src_file_fd = NULL;
 static FILE* g_dst_file_fd = NULL;
 
@@ -74,6 +78,7 @@ static uint32_t g_src_file_fourcc = VA_FOURCC('I', '4', '2', '0');
 static uint32_t g_dst_file_fourcc = VA_FOURCC('Y', 'V', '1', '2');
 
 static uint32_t g_frame_count = 1;
+static uint32_t g_pipeline_depth = 1;
 // The maximum display luminace is 1000 nits by default.
 static uint32_t g_in_max_display_luminance = 10000000;
 static uint32_t g_in_min_display_luminance = 100;
@@ -93,63 +98,43 @@ static uint32_t g_out_transfer_characteristic = 16;
 
 static uint32_t g_tm_type = 1;
 
-static int8_t
-read_value_string(FILE *fp, const char* field_name, char* value)
-{
-    char strLine[MAX_LEN];
-    char* field = NULL;
-    char* str = NULL;
-    uint16_t i;
-
-    if (!fp || !field_name || !value)  {
-        printf("Invalid fuction parameters\n");
-        return -1;
-    }
-
-    rewind(fp);
-
-    while (!feof(fp)) {
-        if (!fgets(strLine, MAX_LEN, fp))
-            continue;
-
-        for (i = 0; i < MAX_LEN && strLine[i]; i++)
-            if (strLine[i] != ' ') break;
-
-        if (i == MAX_LEN || strLine[i] == '#' || strLine[i] == '\n')
-            continue;
-
-        field = strtok(&strLine[i], ":");
-        if (strncmp(field, field_name, strlen(field_name)))
-            continue;
-
-        if (!(str = strtok(NULL, ":")))
-            continue;
-
-        /* skip blank space in string */
-        while (*str == ' ')
-            str++;
-
-        *(str + strlen(str) - 1) = '\0';
-        strcpy(value, str);
-
-        return 0;
-    }
-    return -1;
-}
-
-static int8_t
-read_value_uint32(FILE* fp, const char* field_name, uint32_t* value)
+/*
+ * Input HDR10 metadata in effect from <frame> on. HDR10+ content changes it
+ * per scene, so a sidecar file may list one entry per change; it is parsed
+ * once, entries equal to their predecessor are dropped, and the filter
+ * buffer is only re-created when the entry of the processed frame changes.
+ * Without a sidecar the single entry holds the static SRC_* values.
+ */
+typedef struct _HDRMetadataEntry {
+    uint32_t frame;
+    uint32_t max_display_luminance;
+    uint32_t min_display_luminance;
+    uint16_t max_content_luminance;
+    uint16_t pic_average_luminance;
+} HDRMetadataEntry;
+
+static char g_hdr_metadata_file_name[MAX_LEN];
+static HDRMetadataEntry *g_hdr_metadata = NULL;
+static uint32_t g_hdr_metadata_count = 0;
+static bool g_hdr_metadata_dynamic = false;
+static uint32_t g_hdr_metadata_bench_frames = 0;
+
+/* The buffers only point to the metadata, so it has to outlive them */
+static VAHdrMetaDataHDR10 g_in_hdr10_metadata;
+static VAHdrMetaDataHDR10 g_out_hdr10_metadata;
+static VAHdrMetaData g_out_metadata;
+static VABufferID g_filter_param_buf_id = VA_INVALID_ID;
+static uint32_t g_filter_param_entry = 0;
+static uint32_t g_filter_param_updates = 0;
+static double g_filter_param_update_ms = 0;
+
+static double
+time_ms()
 {
-    char str[MAX_LEN];
+    struct timespec ts;
 
-    if (read_value_string(fp, field_name, str)) {
-        printf("Failed to find integer field: %s", field_name);
-        return -1;
-    }
-
-    *value = (uint32_t)atoi(str);
-
-    return 0;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
 }
 
 static VAStatus
@@ -179,34 +164,160 @@ create_surface(VASurfaceID * p_surface_id,
     return va_status;
 }
 
+static bool
+hdr_metadata_equal(const HDRMetadataEntry *a, const HDRMetadataEntry *b)
+{
+    return a->max_display_luminance == b->max_display_luminance &&
+           a->min_display_luminance == b->min_display_luminance &&
+           a->max_content_luminance == b->max_content_luminance &&
+           a->pic_average_luminance == b->pic_average_luminance;
+}
+
+static int
+hdr_metadata_load(const char *file_name)
+{
+    HDRMetadataEntry entry, *entries;
+    uint32_t capacity = 16, count = 0, line_num = 0;
+    uint32_t num_parsed = 0, last_frame = 0;
+    uint32_t max_content, pic_average;
+    char line[MAX_LEN];
+    const char *p;
+    FILE *fp;
+
+    if (NULL == (fp = fopen(file_name, "r"))) {
+        printf("Open HDR metadata file %s failed\n", file_name);
+        return -1;
+    }
+
+    /* frames before the first entry keep the static values */
+    entries = (HDRMetadataEntry *)malloc(capacity * sizeof(*entries));
+    if (!entries) {
+        fclose(fp);
+        return -1;
+    }
+    entries[count++] = g_hdr_metadata[0];
+
+    while (fgets(line, sizeof(line), fp)) {
+        line_num++;
+        for (p = line; *p == ' ' || *p == '\t'; p++);
+        if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0')
+            continue;
+
+        if (sscanf(p, "%u %u %u %u %u", &entry.frame,
+                   &entry.max_display_luminance, &entry.min_display_luminance,
+                   &max_content, &pic_average) != 5 ||
+            max_content > UINT16_MAX || pic_average > UINT16_MAX) {
+            printf("%s:%d: expected <frame> <max display mastering luminance> "
+                   "<min display mastering luminance> <max content light level> "
+                   "<max picture average light level>\n", file_name, line_num);
+            goto error;
+        }
+        entry.max_content_luminance = (uint16_t)max_content;
+        entry.pic_average_luminance = (uint16_t)pic_average;
+
+        if (num_parsed++ && entry.frame <= last_frame) {
+            printf("%s:%d: frame %d does not follow frame %d\n", file_name,
+                   line_num, entry.frame, last_frame);
+            goto error;
+        }
+        last_frame = entry.frame;
+
+        /* an entry for frame 0 replaces the static values */
+        if (entry.frame == 0)
+            count = 0;
+        else if (hdr_metadata_equal(&entry, &entries[count - 1]))
+            continue;
+
+        if (count == capacity) {
+            HDRMetadataEntry *grown;
+
+            capacity *= 2;
+            grown = (HDRMetadataEntry *)realloc(entries, capacity * sizeof(*entries));
+            if (!grown)
+                goto error;
+            entries = grown;
+        }
+        entries[count++] = entry;
+    }
+    fclose(fp);
+
+    free(g_hdr_metadata);
+    g_hdr_metadata = entries;
+    g_hdr_metadata_count = count;
+    g_hdr_metadata_dynamic = true;
+
+    printf("HDR metadata file %s: %d lines, %d distinct entries\n", file_name,
+           line_num, count);
+    return 0;
+
+error:
+    fclose(fp);
+    free(entries);
+    return -1;
+}
+
+/* Entry in effect at <frame>. Frames mostly come in order, so the search
+ * starts at the entry of the last frame. */
+static uint32_t
+hdr_metadata_lookup(uint32_t frame)
+{
+    uint32_t i = g_filter_param_entry;
+
+    if (!g_hdr_metadata_dynamic)
+        return 0;
+
+    if (g_hdr_metadata[i].frame > frame)
+        i = 0;
+    while (i + 1 < g_hdr_metadata_count && g_hdr_metadata[i + 1].frame <= frame)
+        i++;
+
+    return i;
+}
+
 static VAStatus
-hdrtm_filter_init(VABufferID *filter_param_buf_id, uint32_t tm_type)
+hdrtm_filter_update(uint32_t frame)
 {
     VAStatus va_status = VA_STATUS_SUCCESS;
-    VAProcFilterParameterBufferHDRToneMapping hdrtm_param;
-
-    VAHdrMetaDataHDR10 in_hdr10_metadata = {};
+    VAProcFilterParameterBufferHDRToneMapping hdrtm_param = {};
+    const HDRMetadataEntry *entry;
+    uint32_t i = hdr_metadata_lookup(frame);
+    double start_ms;
+
+    if (g_filter_param_buf_id != VA_INVALID_ID && i == g_filter_param_entry)
+        return va_status;
+
+    start_ms = time_ms();
+    if (g_filter_param_buf_id != VA_INVALID_ID) {
+        vaDestroyBuffer(va_dpy, g_filter_param_buf_id);
+        g_filter_param_buf_id = VA_INVALID_ID;
+    }
 
     // The input is HDR content
-    in_hdr10_metadata.max_display_mastering_luminance = g_in_max_display_luminance;
-    in_hdr10_metadata.min_display_mastering_luminance = g_in_min_display_luminance;
-    in_hdr10_metadata.max_content_light_level         = g_in_max_content_luminance;
-    in_hdr10_metadata.max_pic_average_light_level     = g_in_pic_average_luminance;
-    in_hdr10_metadata.display_primaries_x[0] = 8500;
-    in_hdr10_metadata.display_primaries_y[0] = 39850;
-    in_hdr10_metadata.display_primaries_x[1] = 35400;
-    in_hdr10_metadata.display_primaries_y[1] = 14600;
-    in_hdr10_metadata.display_primaries_x[2] = 6550;
-    in_hdr10_metadata.display_primaries_y[2] = 2300;
-    in_hdr10_metadata.white_point_x = 15635;
-    in_hdr10_metadata.white_point_y = 16450;
+    entry = &g_hdr_metadata[i];
+    g_in_hdr10_metadata.max_display_mastering_luminance = entry->max_display_luminance;
+    g_in_hdr10_metadata.min_display_mastering_luminance = entry->min_display_luminance;
+    g_in_hdr10_metadata.max_content_light_level         = entry->max_content_luminance;
+    g_in_hdr10_metadata.max_pic_average_light_level     = entry->pic_average_luminance;
+    g_in_hdr10_metadata.display_primaries_x[0] = 8500;
+    g_in_hdr10_metadata.display_primaries_y[0] = 39850;
+    g_in_hdr10_metadata.display_primaries_x[1] = 35400;
+    g_in_hdr10_metadata.display_primaries_y[1] = 14600;
+    g_in_hdr10_metadata.display_primaries_x[2] = 6550;
+    g_in_hdr10_metadata.display_primaries_y[2] = 2300;
+    g_in_hdr10_metadata.white_point_x = 15635;
+    g_in_hdr10_metadata.white_point_y = 16450;
 
     hdrtm_param.type = VAProcFilterHighDynamicRangeToneMapping;
     hdrtm_param.data.metadata_type = VAProcHighDynamicRangeMetadataHDR10;
-    hdrtm_param.data.metadata = &in_hdr10_metadata;
+    hdrtm_param.data.metadata = &g_in_hdr10_metadata;
     hdrtm_param.data.metadata_size = sizeof(VAHdrMetaDataHDR10);
 
-    va_status = vaCreateBuffer(va_dpy, context_id, VAProcFilterParameterBufferType, sizeof(hdrtm_param), 1, (void *)&hdrtm_param, filter_param_buf_id);
+    va_status = vaCreateBuffer(va_dpy, context_id, VAProcFilterParameterBufferType, sizeof(hdrtm_param), 1, (void *)&hdrtm_param, &g_filter_param_buf_id);
+    CHECK_VASTATUS(va_status, "vaCreateBuffer");
+
+    g_filter_param_entry = i;
+    g_filter_param_updates++;
+    g_filter_param_update_ms += time_ms() - start_ms;
 
     return va_status;
 }
@@ -258,32 +369,17 @@ hdrtm_metadata_init(VAHdrMetaData &out_metadata, uint32_t tm_type, VAHdrMetaData
 }
 
 static VAStatus
-video_frame_process(VASurfaceID in_surface_id,
+video_frame_process(uint32_t frame,
+                    VASurfaceID in_surface_id,
                     VASurfaceID out_surface_id)
 {
     VAStatus va_status;
     VAProcPipelineParameterBuffer pipeline_param = {};
     VARectangle surface_region = {}, output_region = {};
     VABufferID pipeline_param_buf_id = VA_INVALID_ID;
-    VABufferID filter_param_buf_id = VA_INVALID_ID;
-    VAHdrMetaData out_metadata = {};
-
-    /*Query Filter's Caps: The return value will be HDR10 and H2S, H2H, H2E. */
-    VAProcFilterCapHighDynamicRange hdrtm_caps[VAProcHighDynamicRangeMetadataTypeCount];
-    uint32_t num_hdrtm_caps = VAProcHighDynamicRangeMetadataTypeCount;
-    memset(&hdrtm_caps, 0, sizeof(VAProcFilterCapHighDynamicRange)*num_hdrtm_caps);
-    va_status = vaQueryVideoProcFilterCaps(va_dpy, context_id,
-                                           VAProcFilterHighDynamicRangeToneMapping,
-                                           (void *)hdrtm_caps, &num_hdrtm_caps);
-    CHECK_VASTATUS(va_status, "vaQueryVideoProcFilterCaps");
-    printf("vaQueryVideoProcFilterCaps num_hdrtm_caps %d\n", num_hdrtm_caps);
-    for (int i = 0; i < num_hdrtm_caps; ++i)    {
-        printf("vaQueryVideoProcFilterCaps hdrtm_caps[%d]: metadata type %d, flag %d\n", i, hdrtm_caps[i].metadata_type, hdrtm_caps[i].caps_flag);
-    }
 
-    hdrtm_filter_init(&filter_param_buf_id, g_tm_type);
-    VAHdrMetaDataHDR10 out_hdr10_metadata = {};
-    hdrtm_metadata_init(out_metadata, g_tm_type, out_hdr10_metadata);
+    va_status = hdrtm_filter_update(frame);
+    CHECK_VASTATUS(va_status, "hdrtm_filter_update");
 
     /* Fill pipeline buffer */
     surface_region.x = 0;
@@ -300,7 +396,7 @@ video_frame_process(VASurfaceID in_surface_id,
     pipeline_param.surface_region = &surface_region;
     pipeline_param.output_region = &output_region;
     pipeline_param.filter_flags = 0;
-    pipeline_param.filters      = &filter_param_buf_id;
+    pipeline_param.filters      = &g_filter_param_buf_id;
     pipeline_param.num_filters  = 1;
     pipeline_param.surface_color_standard = VAProcColorStandardExplicit;
     pipeline_param.input_color_properties.colour_primaries = g_in_colour_primaries;
@@ -308,7 +404,7 @@ video_frame_process(VASurfaceID in_surface_id,
     pipeline_param.output_color_standard = VAProcColorStandardExplicit;
     pipeline_param.output_color_properties.colour_primaries = g_out_colour_primaries;
     pipeline_param.output_color_properties.transfer_characteristics = g_out_transfer_characteristic;
-    pipeline_param.output_hdr_metadata = &out_metadata;
+    pipeline_param.output_hdr_metadata = &g_out_metadata;
 
     va_status = vaCreateBuffer(va_dpy,
                                context_id,
@@ -333,9 +429,6 @@ video_frame_process(VASurfaceID in_surface_id,
     va_status = vaEndPicture(va_dpy, context_id);
     CHECK_VASTATUS(va_status, "vaEndPicture");
 
-    if (filter_param_buf_id != VA_INVALID_ID)
-        vaDestroyBuffer(va_dpy, filter_param_buf_id);
-
     if (pipeline_param_buf_id != VA_INVALID_ID)
         vaDestroyBuffer(va_dpy, pipeline_param_buf_id);
 
@@ -347,6 +440,7 @@ vpp_context_create()
 {
     VAStatus va_status = VA_STATUS_SUCCESS;
     uint32_t i;
+    uint32_t slot;
     int32_t j;
 
     /* VA driver initialization */
@@ -390,13 +484,15 @@ vpp_context_create()
     }
 
     /* Create surface/config/context for VPP pipeline */
-    va_status = create_surface(&g_in_surface_id, g_in_pic_width, g_in_pic_height,
-                               g_in_fourcc, g_in_format);
-    CHECK_VASTATUS(va_status, "vaCreateSurfaces for input");
-
-    va_status = create_surface(&g_out_surface_id, g_out_pic_width, g_out_pic_height,
-                               g_out_fourcc, g_out_format);
-    CHECK_VASTATUS(va_status, "vaCreateSurfaces for output");
+    for (slot = 0; slot < g_pipeline_depth; slot++) {
+        va_status = create_surface(&g_in_surface_id[slot], g_in_pic_width, g_in_pic_height,
+                                   g_in_fourcc, g_in_format);
+        CHECK_VASTATUS(va_status, "vaCreateSurfaces for input");
+
+        va_status = create_surface(&g_out_surface_id[slot], g_out_pic_width, g_out_pic_height,
+                                   g_out_fourcc, g_out_format);
+        CHECK_VASTATUS(va_status, "vaCreateSurfaces for output");
+    }
 
     va_status = vaCreateConfig(va_dpy,
                                VAProfileNone,
@@ -411,8 +507,8 @@ vpp_context_create()
                                 g_out_pic_width,
                                 g_out_pic_height,
                                 VA_PROGRESSIVE,
-                                &g_out_surface_id,
-                                1,
+                                g_out_surface_id,
+                                g_pipeline_depth,
                                 &context_id);
     CHECK_VASTATUS(va_status, "vaCreateContext");
 
@@ -434,6 +530,22 @@ vpp_context_create()
     if (i == supported_filter_num) {
         printf("VPP filter type VAProcFilterHighDynamicRangeToneMapping is not supported by driver !\n");
     }
+
+    /*Query Filter's Caps: The return value will be HDR10 and H2S, H2H, H2E. */
+    VAProcFilterCapHighDynamicRange hdrtm_caps[VAProcHighDynamicRangeMetadataTypeCount];
+    uint32_t num_hdrtm_caps = VAProcHighDynamicRangeMetadataTypeCount;
+    memset(&hdrtm_caps, 0, sizeof(VAProcFilterCapHighDynamicRange)*num_hdrtm_caps);
+    va_status = vaQueryVideoProcFilterCaps(va_dpy, context_id,
+                                           VAProcFilterHighDynamicRangeToneMapping,
+                                           (void *)hdrtm_caps, &num_hdrtm_caps);
+    CHECK_VASTATUS(va_status, "vaQueryVideoProcFilterCaps");
+    printf("vaQueryVideoProcFilterCaps num_hdrtm_caps %d\n", num_hdrtm_caps);
+    for (int i = 0; i < num_hdrtm_caps; ++i)    {
+        printf("vaQueryVideoProcFilterCaps hdrtm_caps[%d]: metadata type %d, flag %d\n", i, hdrtm_caps[i].metadata_type, hdrtm_caps[i].caps_flag);
+    }
+
+    hdrtm_metadata_init(g_out_metadata, g_tm_type, g_out_hdr10_metadata);
+
     return va_status;
 }
 
@@ -441,8 +553,10 @@ static void
 vpp_context_destroy()
 {
     /* Release resource */
-    vaDestroySurfaces(va_dpy, &g_in_surface_id, 1);
-    vaDestroySurfaces(va_dpy, &g_out_surface_id, 1);
+    if (g_filter_param_buf_id != VA_INVALID_ID)
+        vaDestroyBuffer(va_dpy, g_filter_param_buf_id);
+    vaDestroySurfaces(va_dpy, g_in_surface_id, g_pipeline_depth);
+    vaDestroySurfaces(va_dpy, g_out_surface_id, g_pipeline_depth);
     vaDestroyContext(va_dpy, context_id);
     vaDestroyConfig(va_dpy, config_id);
 
@@ -486,6 +600,8 @@ parse_fourcc_and_format(char *str, uint32_t *fourcc, uint32_t *format)
     } else if (!strcmp(str, "A2RGB10")) {  //A2R10G10B10
         tfourcc = VA_FOURCC_A2R10G10B10;
         printf("parse_fourcc_and_format: ARGB10 format 0x%8x, fourcc 0x%8x\n", tformat, tfourcc);
+    } else if ((tfourcc = vpp_hbd_fourcc(str, &tformat))) {
+        /* P012, P016, Y210, Y212, Y216, Y410, Y412, Y416 and planar files */
     } else {
         printf("Not supported format: %s! Currently only support following format: %s\n",
                str, "YV12, I420, NV12, YUY2(YUYV), UYVY, I010, RGBA, RGBX, BGRA or BGRX");
@@ -510,12 +626,11 @@ bool read_frame_to_surface(FILE *fp, VASurfaceID surface_id)
 
     int i = 0;
 
-    int frame_size = 0, y_size = 0;
+    int frame_size = 0;
 
-    unsigned char *y_src = NULL, *u_src = NULL;
-    unsigned char *y_dst = NULL, *u_dst = NULL;
+    unsigned char *y_src = NULL;
+    unsigned char *y_dst = NULL;
 
-    int bytes_per_pixel = 2;
     size_t n_items;
     void *out_buf = NULL;
     unsigned char *src_buffer = NULL;
@@ -538,32 +653,34 @@ bool read_frame_to_surface(FILE *fp, VASurfaceID surface_id)
 
     switch (va_image.format.fourcc) {
     case VA_FOURCC_P010:
-        frame_size = va_image.width * va_image.height * bytes_per_pixel * 3 / 2;
-        y_size = va_image.width * va_image.height * bytes_per_pixel;
+    case VA_FOURCC_P012:
+    case VA_FOURCC_P016:
+    case VA_FOURCC_I010:
+    case VA_FOURCC_Y210:
+    case VA_FOURCC_Y212:
+    case VA_FOURCC_Y216:
+    case VA_FOURCC_Y410:
+    case VA_FOURCC_Y412:
+    case VA_FOURCC_Y416:
+        if (!vpp_hbd_supported(va_image.format.fourcc, g_src_file_fourcc)) {
+            printf("SRC_FILE_FORMAT 0x%x does not fit the surface\n", g_src_file_fourcc);
+            va_status = VA_STATUS_ERROR_INVALID_IMAGE_FORMAT;
+            break;
+        }
+        frame_size = vpp_hbd_frame_size(g_src_file_fourcc, va_image.width, va_image.height);
 
         src_buffer = (unsigned char*)malloc(frame_size);
         assert(src_buffer);
         n_items = fread(src_buffer, 1, frame_size, fp);
         if (n_items != frame_size) {
-            printf("read file failed on VA_FOURCC_P010\n");
+            if (!feof(fp))
+                printf("read file failed on fourcc 0x%x\n", g_src_file_fourcc);
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
         }
-        y_src = src_buffer;
-        u_src = src_buffer + y_size; // UV offset for P010
 
-        y_dst = (unsigned char*)out_buf + va_image.offsets[0]; // Y plane
-        u_dst = (unsigned char*)out_buf + va_image.offsets[1]; // U offset for P010
-
-        for (i = 0; i < va_image.height; i++) {
-            memcpy(y_dst, y_src, va_image.width * 2);
-            y_dst += va_image.pitches[0];
-            y_src += va_image.width * 2;
-        }
-        for (i = 0; i < va_image.height >> 1; i++)  {
-            memcpy(u_dst, u_src, va_image.width * 2);
-            u_dst += va_image.pitches[1];
-            u_src += va_image.width * 2;
-        }
-        printf("read_frame_to_surface: P010 \n");
+        /* repacked to the surface layout, P010 from I010 files and so on */
+        vpp_hbd_file_to_image(src_buffer, g_src_file_fourcc, &va_image, (uint8_t *)out_buf);
+        printf("read_frame_to_surface: high bit depth YUV \n");
         break;
 
     case VA_RT_FORMAT_RGB32_10BPP:
@@ -575,7 +692,9 @@ bool read_frame_to_surface(FILE *fp, VASurfaceID surface_id)
         assert(src_buffer);
         n_items = fread(src_buffer, 1, frame_size, fp);
         if (n_items != frame_size) {
-            printf("read file failed on VA_RT_FORMAT_RGB32_10BPP or VA_FOURCC_RGBA \n");
+            if (!feof(fp))
+                printf("read file failed on VA_RT_FORMAT_RGB32_10BPP or VA_FOURCC_RGBA \n");
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
         }
         y_src = src_buffer;
         y_dst = (unsigned char*)out_buf + va_image.offsets[0];
@@ -643,16 +762,38 @@ bool write_surface_to_frame(FILE *fp, VASurfaceID surface_id)
 
     switch (va_image.format.fourcc) {
     case VA_FOURCC_P010:
+    case VA_FOURCC_P012:
+    case VA_FOURCC_P016:
+    case VA_FOURCC_I010:
+    case VA_FOURCC_Y210:
+    case VA_FOURCC_Y212:
+    case VA_FOURCC_Y216:
+    case VA_FOURCC_Y410:
+    case VA_FOURCC_Y412:
+    case VA_FOURCC_Y416:
+        if (!vpp_hbd_supported(va_image.format.fourcc, g_dst_file_fourcc)) {
+            printf("DST_FILE_FORMAT 0x%x does not fit the surface\n", g_dst_file_fourcc);
+            va_status = VA_STATUS_ERROR_INVALID_IMAGE_FORMAT;
+            break;
+        }
+        frame_size = vpp_hbd_frame_size(g_dst_file_fourcc, va_image.width, va_image.height);
+        dst_buffer = (unsigned char*)malloc(frame_size);
+        assert(dst_buffer);
+
+        vpp_hbd_image_to_file(&va_image, (uint8_t *)in_buf, dst_buffer, g_dst_file_fourcc);
+        printf("write_surface_to_frame: high bit depth YUV \n");
+        break;
+
     case VA_FOURCC_NV12:
-        bytes_per_pixel = (va_image.format.fourcc == VA_FOURCC_P010) ? 2 : 1;
+        bytes_per_pixel = 1;
         frame_size = va_image.width * va_image.height * bytes_per_pixel * 3 / 2;
         dst_buffer = (unsigned char*)malloc(frame_size);
         assert(dst_buffer);
         y_size = va_image.width * va_image.height * bytes_per_pixel;
         y_dst = dst_buffer;
-        u_dst = dst_buffer + y_size; // UV offset for P010
+        u_dst = dst_buffer + y_size; // UV offset
         y_src = (unsigned char*)in_buf + va_image.offsets[0];
-        u_src = (unsigned char*)in_buf + va_image.offsets[1]; // U offset for P010
+        u_src = (unsigned char*)in_buf + va_image.offsets[1]; // UV offset
         for (i = 0; i < va_image.height; i++)  {
             memcpy(y_dst, y_src, static_cast<size_t>(va_image.width * bytes_per_pixel));
             y_dst += va_image.width * bytes_per_pixel;
@@ -663,7 +804,7 @@ bool write_surface_to_frame(FILE *fp, VASurfaceID surface_id)
             u_dst += va_image.width * bytes_per_pixel;
             u_src += va_image.pitches[1];
         }
-        printf("read_frame_to_surface: P010 \n");
+        printf("write_surface_to_frame: NV12 \n");
         break;
 
     case VA_FOURCC_RGBA:
@@ -678,10 +819,10 @@ bool write_surface_to_frame(FILE *fp, VASurfaceID surface_id)
 
         for (i = 0; i < va_image.height; i++) {
             memcpy(y_dst, y_src, va_image.width * 4);
-            y_dst += va_image.pitches[0];
-            y_src += va_image.width * 4;
+            y_dst += va_image.width * 4;
+            y_src += va_image.pitches[0];
         }
-        printf("read_frame_to_surface: RGBA and A2R10G10B10 \n");
+        printf("write_surface_to_frame: RGBA and A2R10G10B10 \n");
         break;
 
     default: // should not come here
@@ -689,8 +830,8 @@ bool write_surface_to_frame(FILE *fp, VASurfaceID surface_id)
         va_status = VA_STATUS_ERROR_INVALID_IMAGE_FORMAT;
         break;
     }
-    assert(dst_buffer);
-    fwrite(dst_buffer, 1, frame_size, fp);
+    if (dst_buffer)
+        fwrite(dst_buffer, 1, frame_size, fp);
 
     if (dst_buffer)  {
         free(dst_buffer);
@@ -711,47 +852,80 @@ parse_basic_parameters()
     char str[MAX_LEN];
 
     /* Read src frame file information */
-    read_value_string(g_config_file_fd, "SRC_FILE_NAME", g_src_file_name);
-    read_value_uint32(g_config_file_fd, "SRC_FRAME_WIDTH", &g_in_pic_width);
-    read_value_uint32(g_config_file_fd, "SRC_FRAME_HEIGHT", &g_in_pic_height);
-    read_value_string(g_config_file_fd, "SRC_FRAME_FORMAT", str);
+    vpp_config_get_string(g_config, "SRC_FILE_NAME", g_src_file_name);
+    vpp_config_get_uint32(g_config, "SRC_FRAME_WIDTH", &g_in_pic_width);
+    vpp_config_get_uint32(g_config, "SRC_FRAME_HEIGHT", &g_in_pic_height);
+    vpp_config_get_string(g_config, "SRC_FRAME_FORMAT", str);
     parse_fourcc_and_format(str, &g_in_fourcc, &g_in_format);
 
     printf("Input file: %s, width: %d, height: %d, fourcc 0x%x, format 0x%x\n", g_src_file_name, g_in_pic_width, g_in_pic_height, g_in_fourcc, g_in_format);
 
     /* Read dst frame file information */
-    read_value_string(g_config_file_fd, "DST_FILE_NAME", g_dst_file_name);
-    read_value_uint32(g_config_file_fd, "DST_FRAME_WIDTH", &g_out_pic_width);
-    read_value_uint32(g_config_file_fd, "DST_FRAME_HEIGHT", &g_out_pic_height);
-    read_value_string(g_config_file_fd, "DST_FRAME_FORMAT", str);
+    vpp_config_get_string(g_config, "DST_FILE_NAME", g_dst_file_name);
+    vpp_config_get_uint32(g_config, "DST_FRAME_WIDTH", &g_out_pic_width);
+    vpp_config_get_uint32(g_config, "DST_FRAME_HEIGHT", &g_out_pic_height);
+    vpp_config_get_string(g_config, "DST_FRAME_FORMAT", str);
     parse_fourcc_and_format(str, &g_out_fourcc, &g_out_format);
 
     printf("Output file: %s, width: %d, height: %d, fourcc 0x%x, format 0x%x\n", g_dst_file_name, g_out_pic_width, g_out_pic_height, g_out_fourcc, g_out_format);
 
-    read_value_string(g_config_file_fd, "SRC_FILE_FORMAT", str);
-    parse_fourcc_and_format(str, &g_src_file_fourcc, NULL);
+    /* Optional, the files are laid out like the surfaces by default */
+    g_src_file_fourcc = g_in_fourcc;
+    if (!vpp_config_get_string(g_config, "SRC_FILE_FORMAT", str))
+        parse_fourcc_and_format(str, &g_src_file_fourcc, NULL);
 
-    read_value_string(g_config_file_fd, "DST_FILE_FORMAT", str);
-    parse_fourcc_and_format(str, &g_dst_file_fourcc, NULL);
+    g_dst_file_fourcc = g_out_fourcc;
+    if (!vpp_config_get_string(g_config, "DST_FILE_FORMAT", str))
+        parse_fourcc_and_format(str, &g_dst_file_fourcc, NULL);
 
-    read_value_uint32(g_config_file_fd, "FRAME_SUM", &g_frame_count);
+    vpp_config_get_uint32(g_config, "FRAME_SUM", &g_frame_count);
 
-    read_value_uint32(g_config_file_fd, "SRC_MAX_DISPLAY_MASTERING_LUMINANCE", &g_in_max_display_luminance);
-    read_value_uint32(g_config_file_fd, "SRC_MIN_DISPLAY_MASTERING_LUMINANCE", &g_in_min_display_luminance);
-    read_value_uint32(g_config_file_fd, "SRC_MAX_CONTENT_LIGHT_LEVEL",         &g_in_max_content_luminance);
-    read_value_uint32(g_config_file_fd, "SRC_MAX_PICTURE_AVERAGE_LIGHT_LEVEL", &g_in_pic_average_luminance);
+    /* Optional, number of frames in flight between upload, process and store */
+    if (!vpp_config_get_string(g_config, "PIPELINE_DEPTH", str)) {
+        g_pipeline_depth = (uint32_t)atoi(str);
+        if (g_pipeline_depth < 1 || g_pipeline_depth > VPP_PIPELINE_MAX_DEPTH) {
+            printf("PIPELINE_DEPTH must be in [1, %d]\n", VPP_PIPELINE_MAX_DEPTH);
+            return -1;
+        }
+    }
 
-    read_value_uint32(g_config_file_fd, "DST_MAX_DISPLAY_MASTERING_LUMINANCE", &g_out_max_display_luminance);
-    read_value_uint32(g_config_file_fd, "DST_MIN_DISPLAY_MASTERING_LUMINANCE", &g_out_min_display_luminance);
-    read_value_uint32(g_config_file_fd, "DST_MAX_CONTENT_LIGHT_LEVEL",         &g_out_max_content_luminance);
-    read_value_uint32(g_config_file_fd, "DST_MAX_PICTURE_AVERAGE_LIGHT_LEVEL", &g_out_pic_average_luminance);
+    vpp_config_get_uint32(g_config, "SRC_MAX_DISPLAY_MASTERING_LUMINANCE", &g_in_max_display_luminance);
+    vpp_config_get_uint32(g_config, "SRC_MIN_DISPLAY_MASTERING_LUMINANCE", &g_in_min_display_luminance);
+    vpp_config_get_uint32(g_config, "SRC_MAX_CONTENT_LIGHT_LEVEL",         &g_in_max_content_luminance);
+    vpp_config_get_uint32(g_config, "SRC_MAX_PICTURE_AVERAGE_LIGHT_LEVEL", &g_in_pic_average_luminance);
+    if (g_in_max_content_luminance > UINT16_MAX || g_in_pic_average_luminance > UINT16_MAX) {
+        printf("SRC light levels must not exceed %d\n", UINT16_MAX);
+        return -1;
+    }
 
-    read_value_uint32(g_config_file_fd, "SRC_FRAME_COLOUR_PRIMARIES",         &g_in_colour_primaries);
-    read_value_uint32(g_config_file_fd, "SRC_FRAME_TRANSFER_CHARACTERISTICS", &g_in_transfer_characteristic);
-    read_value_uint32(g_config_file_fd, "DST_FRAME_COLOUR_PRIMARIES",         &g_out_colour_primaries);
-    read_value_uint32(g_config_file_fd, "DST_FRAME_TRANSFER_CHARACTERISTICS", &g_out_transfer_characteristic);
+    g_hdr_metadata = (HDRMetadataEntry *)calloc(1, sizeof(*g_hdr_metadata));
+    if (!g_hdr_metadata)
+        return -1;
+    g_hdr_metadata[0].max_display_luminance = g_in_max_display_luminance;
+    g_hdr_metadata[0].min_display_luminance = g_in_min_display_luminance;
+    g_hdr_metadata[0].max_content_luminance = (uint16_t)g_in_max_content_luminance;
+    g_hdr_metadata[0].pic_average_luminance = (uint16_t)g_in_pic_average_luminance;
+    g_hdr_metadata_count = 1;
+
+    /* Optional, per frame input metadata overriding the static values */
+    if (!vpp_config_get_string(g_config, "SRC_HDR_METADATA_FILE", g_hdr_metadata_file_name) &&
+        hdr_metadata_load(g_hdr_metadata_file_name))
+        return -1;
+
+    /* Optional, compare the static and the per frame metadata afterwards */
+    vpp_config_get_uint32(g_config, "HDR_METADATA_BENCH", &g_hdr_metadata_bench_frames);
+
+    vpp_config_get_uint32(g_config, "DST_MAX_DISPLAY_MASTERING_LUMINANCE", &g_out_max_display_luminance);
+    vpp_config_get_uint32(g_config, "DST_MIN_DISPLAY_MASTERING_LUMINANCE", &g_out_min_display_luminance);
+    vpp_config_get_uint32(g_config, "DST_MAX_CONTENT_LIGHT_LEVEL",         &g_out_max_content_luminance);
+    vpp_config_get_uint32(g_config, "DST_MAX_PICTURE_AVERAGE_LIGHT_LEVEL", &g_out_pic_average_luminance);
 
-    read_value_uint32(g_config_file_fd, "TM_TYPE", &g_tm_type);
+    vpp_config_get_uint32(g_config, "SRC_FRAME_COLOUR_PRIMARIES",         &g_in_colour_primaries);
+    vpp_config_get_uint32(g_config, "SRC_FRAME_TRANSFER_CHARACTERISTICS", &g_in_transfer_characteristic);
+    vpp_config_get_uint32(g_config, "DST_FRAME_COLOUR_PRIMARIES",         &g_out_colour_primaries);
+    vpp_config_get_uint32(g_config, "DST_FRAME_TRANSFER_CHARACTERISTICS", &g_out_transfer_characteristic);
+
+    vpp_config_get_uint32(g_config, "TM_TYPE", &g_tm_type);
 
     return 0;
 }
@@ -765,10 +939,70 @@ print_help()
     printf("You can refer process_hdr_tm.cfg.template for each para meaning and create the configure file.\n");
 }
 
+static int
+pipeline_read(uint32_t /* frame */, uint32_t slot)
+{
+    if (read_frame_to_surface(g_src_file_fd, g_in_surface_id[slot]))
+        return 0;
+
+    /* a short read at the end of the input ends the pipeline */
+    return feof(g_src_file_fd) ? 1 : -1;
+}
+
+static VAStatus
+pipeline_process(uint32_t frame, uint32_t slot)
+{
+    return video_frame_process(frame, g_in_surface_id[slot], g_out_surface_id[slot]);
+}
+
+static int
+pipeline_write(uint32_t /* frame */, uint32_t slot)
+{
+    return write_surface_to_frame(g_dst_file_fd, g_out_surface_id[slot]) ? 0 : -1;
+}
+
+/*
+ * Process the last input frame <frames> times with the static metadata and
+ * then with the per frame one, without file IO, to show what the metadata
+ * updates cost.
+ */
+static void
+hdr_metadata_bench(uint32_t frames, uint32_t last_frame)
+{
+    bool dynamic = g_hdr_metadata_dynamic;
+    uint32_t slot = last_frame % g_pipeline_depth;
+    uint32_t pass, frame, updates;
+    double start_ms, total_ms, update_ms;
+    VAStatus va_status;
+
+    for (pass = 0; pass < 2; pass++) {
+        g_hdr_metadata_dynamic = pass ? dynamic : false;
+        if (g_filter_param_buf_id != VA_INVALID_ID) {
+            vaDestroyBuffer(va_dpy, g_filter_param_buf_id);
+            g_filter_param_buf_id = VA_INVALID_ID;
+        }
+        updates = g_filter_param_updates;
+        update_ms = g_filter_param_update_ms;
+
+        start_ms = time_ms();
+        for (frame = 0; frame < frames; frame++) {
+            video_frame_process(frame, g_in_surface_id[slot], g_out_surface_id[slot]);
+            va_status = vaSyncSurface(va_dpy, g_out_surface_id[slot]);
+            CHECK_VASTATUS(va_status, "vaSyncSurface");
+        }
+        total_ms = time_ms() - start_ms;
+
+        printf("%s metadata: %d frames, %.3f ms/frame, %d filter buffers in %.3f ms\n",
+               pass ? "Per frame" : "Static", frames, total_ms / frames,
+               g_filter_param_updates - updates, g_filter_param_update_ms - update_ms);
+    }
+}
+
 int32_t main(int32_t argc, char *argv[])
 {
     VAStatus va_status;
-    uint32_t i;
+    VPPPipelineOps pipeline_ops = { pipeline_read, pipeline_process, pipeline_write };
+    int32_t frame_count;
 
     if (argc != 2 || !strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")) {
         print_help();
@@ -779,11 +1013,18 @@ int32_t main(int32_t argc, char *argv[])
     strncpy(g_config_file_name, argv[1], MAX_LEN);
     g_config_file_name[MAX_LEN - 1] = '\0';
 
-    if (NULL == (g_config_file_fd = fopen(g_config_file_name, "r"))) {
+    if (NULL == (g_config = vpp_config_open(g_config_file_name))) {
         printf("Open configure file %s failed!\n", g_config_file_name);
         assert(0);
     }
 
+    /* frames on stdout, diagnostics on stderr */
+    if (vpp_config_has_value(g_config, "DST_FILE_NAME", "-") &&
+        vpp_stream_reserve_stdout()) {
+        printf("Failed to move the diagnostics to stderr\n");
+        assert(0);
+    }
+
     /* Parse basic parameters */
     if (parse_basic_parameters()) {
         printf("Parse parameters in configure file error\n");
@@ -797,13 +1038,13 @@ int32_t main(int32_t argc, char *argv[])
     }
 
     /* Video frame fetch, process and store */
-    if (NULL == (g_src_file_fd = fopen(g_src_file_name, "r"))) {
+    if (NULL == (g_src_file_fd = vpp_stream_open(g_src_file_name, "r"))) {
         printf("Open SRC_FILE_NAME: %s failed, please specify it in config file: %s !\n",
                g_src_file_name, g_config_file_name);
         assert(0);
     }
 
-    if (NULL == (g_dst_file_fd = fopen(g_dst_file_name, "w"))) {
+    if (NULL == (g_dst_file_fd = vpp_stream_open(g_dst_file_name, "w"))) {
         printf("Open DST_FILE_NAME: %s failed, please specify it in config file: %s !\n",
                g_dst_file_name, g_config_file_name);
         assert(0);
@@ -815,10 +1056,10 @@ int32_t main(int32_t argc, char *argv[])
     unsigned int duration = 0;
     clock_gettime(CLOCK_MONOTONIC, &Pre_time);
 
-    for (i = 0; i < g_frame_count; i ++) {
-        read_frame_to_surface(g_src_file_fd, g_in_surface_id);
-        video_frame_process(g_in_surface_id, g_out_surface_id);
-        write_surface_to_frame(g_dst_file_fd, g_out_surface_id);
+    frame_count = vpp_pipeline_run(g_pipeline_depth, g_frame_count, &pipeline_ops);
+    if (frame_count < 0) {
+        printf("video frame process failed\n");
+        assert(0);
     }
 
     clock_gettime(CLOCK_MONOTONIC, &Cur_time);
@@ -829,7 +1070,13 @@ int32_t main(int32_t argc, char *argv[])
         duration += (Cur_time.tv_nsec + 1000000000 - Pre_time.tv_nsec) / 1000000 - 1000;
     }
     printf("Finish processing, performance: \n");
-    printf("%d frames processed in: %d ms, ave time = %d ms\n", g_frame_count, duration, duration / g_frame_count);
+    printf("%d frames processed in: %d ms, ave time = %d ms\n", frame_count, duration,
+           frame_count ? duration / frame_count : 0);
+    printf("HDR metadata: %d entries, filter buffer created %d times in %.3f ms\n",
+           g_hdr_metadata_count, g_filter_param_updates, g_filter_param_update_ms);
+
+    if (g_hdr_metadata_bench_frames && frame_count)
+        hdr_metadata_bench(g_hdr_metadata_bench_frames, frame_count - 1);
 
     if (g_src_file_fd) {
         fclose(g_src_file_fd);
@@ -841,10 +1088,8 @@ int32_t main(int32_t argc, char *argv[])
         g_dst_file_fd = NULL;
     }
 
-    if (g_config_file_fd) {
-        fclose(g_config_file_fd);
-        g_config_file_fd = NULL;
-    }
+    vpp_config_close(g_config);
+    free(g_hdr_metadata);
 
     vpp_context_destroy();
 
@@ -31,9 +31,16 @@
 #include <stdint.h>
 #include <time.h>
 #include <assert.h>
+#include <math.h>
 #include <va/va.h>
 #include <va/va_vpp.h>
 #include "va_display.h"
+#include "vpp_config.h"
+#include "vpp_contexts.h"
+#include "vpp_hbd.h"
+#include "vpp_pipeline.h"
+#include "vpp_scale.h"
+#include "vpp_stream.h"
 
 #ifndef VA_FOURCC_I420
 #define VA_FOURCC_I420 0x30323449
@@ -50,10 +57,10 @@
 static VADisplay va_dpy = NULL;
 static VAContextID context_id = 0;
 static VAConfigID  config_id = 0;
-static VASurfaceID g_in_surface_id = VA_INVALID_ID;
-static VASurfaceID g_out_surface_id = VA_INVALID_ID;
+static VASurfaceID g_in_surface_id[VPP_PIPELINE_MAX_DEPTH];
+static VASurfaceID g_out_surface_id[VPP_PIPELINE_MAX_DEPTH];
 
-static FILE* g_config_file_fd = NULL;
+static VPPConfig *g_config = NULL;
 static FILE* g_src_file_fd = NULL;
 static FILE* g_dst_file_fd = NULL;
 
@@ -74,65 +81,22 @@ static uint32_t g_src_file_fourcc = VA_FOURCC('I', '4', '2', '0');
 static uint32_t g_dst_file_fourcc = VA_FOURCC('Y', 'V', '1', '2');
 
 static uint32_t g_frame_count = 0;
-
-static int8_t
-read_value_string(FILE *fp, const char* field_name, char* value)
-{
-    char strLine[MAX_LEN];
-    char* field = NULL;
-    char* str = NULL;
-    uint16_t i;
-
-    if (!fp || !field_name || !value)  {
-        printf("Invalid fuction parameters\n");
-        return -1;
-    }
-
-    rewind(fp);
-
-    while (!feof(fp)) {
-        if (!fgets(strLine, MAX_LEN, fp))
-            continue;
-
-        for (i = 0; i < MAX_LEN && strLine[i]; i++)
-            if (strLine[i] != ' ') break;
-
-        if (i == MAX_LEN || strLine[i] == '#' || strLine[i] == '\n')
-            continue;
-
-        field = strtok(&strLine[i], ":");
-        if (strncmp(field, field_name, strlen(field_name)))
-            continue;
-
-        if (!(str = strtok(NULL, ":")))
-            continue;
-
-        /* skip blank space in string */
-        while (*str == ' ')
-            str++;
-
-        *(str + strlen(str) - 1) = '\0';
-        strcpy(value, str);
-
-        return 0;
-    }
-
-    return -1;
-}
-
-static int8_t
-read_value_uint32(FILE* fp, const char* field_name, uint32_t* value)
-{
-    char str[MAX_LEN];
-
-    if (read_value_string(fp, field_name, str)) {
-        printf("Failed to find integer field: %s", field_name);
-        return -1;
-    }
-
-    *value = (uint32_t)atoi(str);
-    return 0;
-}
+static uint32_t g_pipeline_depth = 1;
+
+/* Optional color standard of the YUV side, passed to VPP and the reference */
+static int g_csc_matrix = VPP_SCALE_BT601;
+static bool g_csc_matrix_set = false;
+static bool g_csc_full_range = false;
+static bool g_csc_range_set = false;
+
+/* Optional CPU reference run on every frame, see vpp_scale.h */
+static int g_cpu_filter = 0;
+static VPPScaler *g_cpu_scaler = NULL;
+static uint8_t *g_cpu_src = NULL;
+static uint8_t *g_cpu_dst = NULL;
+static double g_cpu_sq_err[3];
+static uint64_t g_cpu_samples[3];
+static double g_upload_time = 0, g_process_time = 0, g_download_time = 0, g_cpu_time = 0;
 
 static VAStatus
 create_surface(VASurfaceID * p_surface_id,
@@ -191,9 +155,9 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
         y_src = newImageBuffer;
         if (g_src_file_fourcc == VA_FOURCC_I420) {
@@ -288,9 +252,9 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
         y_src = newImageBuffer;
         y_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[0]);
@@ -301,67 +265,17 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
             y_src += surface_image.width * 2;
             y_dst += surface_image.pitches[0];
         }
-    } else if ((surface_image.format.fourcc == VA_FOURCC_P010 &&
-                g_src_file_fourcc == VA_FOURCC_P010) ||
-               (surface_image.format.fourcc == VA_FOURCC_I010 &&
-                g_src_file_fourcc == VA_FOURCC_I010)) {
-        frame_size = surface_image.width * surface_image.height * 3;
+    } else if (vpp_hbd_supported(surface_image.format.fourcc, g_src_file_fourcc)) {
+        frame_size = vpp_hbd_frame_size(g_src_file_fourcc, surface_image.width, surface_image.height);
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
-
-        y_src = newImageBuffer;
-        y_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[0]);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
-        /* plane 0, directly copy */
-        for (row = 0; row < surface_image.height; row++) {
-            memcpy(y_dst, y_src, surface_image.width * 2);
-            y_src += surface_image.width * 2;
-            y_dst += surface_image.pitches[0];
-        }
-
-        /* UV plane */
-        if (surface_image.format.fourcc == VA_FOURCC_I010) {
-            assert(g_src_file_fourcc == VA_FOURCC_I010);
-
-            u_src = newImageBuffer + surface_image.width * surface_image.height * 2;
-            v_src = newImageBuffer + surface_image.width * surface_image.height * 5 / 2;
-
-            u_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[1]);
-            v_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[2]);
-
-            for (row = 0; row < surface_image.height / 2; row++) {
-                memcpy(u_dst, u_src, surface_image.width);
-                memcpy(v_dst, v_src, surface_image.width);
-
-                u_src += surface_image.width;
-                v_src += surface_image.width;
-
-                u_dst += surface_image.pitches[1];
-                v_dst += surface_image.pitches[2];
-            }
-        } else if (surface_image.format.fourcc == VA_FOURCC_P010) {
-            assert(g_src_file_fourcc == VA_FOURCC_P010);
-
-            u_src = newImageBuffer + surface_image.width * surface_image.height * 2;
-            v_src = u_src;
-
-            u_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[1]);
-            v_dst = u_dst;
-
-            for (row = 0; row < surface_image.height / 2; row++) {
-                memcpy(u_dst, u_src, surface_image.width * 2);
-
-                u_src += surface_image.width * 2;
-                v_src = u_src;
-
-                u_dst += surface_image.pitches[1];
-                v_dst = u_dst;
-            }
-        }
+        /* 10/12/16 bit frame, repacked to the surface layout */
+        vpp_hbd_file_to_image(newImageBuffer, g_src_file_fourcc, &surface_image, (uint8_t *)surface_p);
     }  else if ((surface_image.format.fourcc == VA_FOURCC_RGBA &&
                  g_src_file_fourcc == VA_FOURCC_RGBA) ||
                 (surface_image.format.fourcc == VA_FOURCC_RGBX &&
@@ -374,9 +288,9 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
         y_src = newImageBuffer;
         y_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[0]);
@@ -400,7 +314,7 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 /* Store NV12/YV12/I420 surface to yv12 file */
@@ -496,9 +410,9 @@ store_yuv_surface_to_yv12_file(FILE *fp,
         }
 
         /* write frame to file */
-        do {
-            n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
-        } while (n_items != 1);
+        n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     } else {
         printf("Not supported YUV surface fourcc !!! \n");
@@ -513,7 +427,7 @@ store_yuv_surface_to_yv12_file(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -608,9 +522,9 @@ store_yuv_surface_to_i420_file(FILE *fp,
         }
 
         /* write frame to file */
-        do {
-            n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
-        } while (n_items != 1);
+        n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     } else {
         printf("Not supported YUV surface fourcc !!! \n");
@@ -625,7 +539,7 @@ store_yuv_surface_to_i420_file(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -715,9 +629,9 @@ store_yuv_surface_to_nv12_file(FILE *fp,
         }
 
         /* write frame to file */
-        do {
-            n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
-        } while (n_items != 1);
+        n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     } else {
         printf("Not supported YUV surface fourcc !!! \n");
@@ -732,7 +646,7 @@ store_yuv_surface_to_nv12_file(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -778,9 +692,9 @@ store_packed_yuv_surface_to_packed_file(FILE *fp,
         }
 
         /* write frame to file */
-        do {
-            n_items = fwrite(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fwrite(newImageBuffer, frame_size, 1, fp);
+        if (n_items != 1)
+            va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     } else {
         printf("Not supported YUV surface fourcc !!! \n");
@@ -795,7 +709,7 @@ store_packed_yuv_surface_to_packed_file(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -804,13 +718,7 @@ store_yuv_surface_to_10bit_file(FILE *fp, VASurfaceID surface_id)
     VAStatus va_status;
     VAImage surface_image;
     void *surface_p = NULL;
-    unsigned char *y_src = NULL;
-    unsigned char *u_src = NULL;
-    unsigned char *v_src = NULL;
-    unsigned char *y_dst = NULL;
-    unsigned char *u_dst = NULL;
-    unsigned char *v_dst = NULL;
-    uint32_t row;
+    uint32_t frame_size;
     int32_t n_items;
     unsigned char * newImageBuffer = NULL;
     va_status = vaSyncSurface(va_dpy, surface_id);
@@ -822,62 +730,22 @@ store_yuv_surface_to_10bit_file(FILE *fp, VASurfaceID surface_id)
     va_status = vaMapBuffer(va_dpy, surface_image.buf, &surface_p);
     CHECK_VASTATUS(va_status, "vaMapBuffer");
 
-    /* store the surface to one 10bit file */
-    uint32_t y_size = surface_image.width * surface_image.height * 2;
-    uint32_t u_size = y_size / 4;
-
-    newImageBuffer = (unsigned char*)malloc(y_size * 3);
+    /* store the surface to one 10/12/16 bit file */
+    frame_size = vpp_hbd_frame_size(g_dst_file_fourcc, surface_image.width, surface_image.height);
+    newImageBuffer = (unsigned char*)malloc(frame_size);
     assert(newImageBuffer);
-    y_dst = newImageBuffer;
-
-    y_src = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[0]);
-
-    /* Y plane copy */
-    for (row = 0; row < surface_image.height; row++) {
-        memcpy(y_dst, y_src, surface_image.width * 2);
-        y_src += surface_image.pitches[0];
-        y_dst += surface_image.width * 2;
-    }
-
-    if (surface_image.format.fourcc == VA_FOURCC_I010) {
-        u_dst = newImageBuffer + y_size;
-        v_dst = newImageBuffer + y_size + u_size;
 
-        u_src = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[1]);
-        v_src = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[2]);
-
-        for (row = 0; row < surface_image.height / 2; row++) {
-            memcpy(u_dst, u_src, surface_image.width);
-            memcpy(v_dst, v_src, surface_image.width);
-
-            u_dst += surface_image.width;
-            v_dst += surface_image.width;
-
-            u_src += surface_image.pitches[1];
-            v_src += surface_image.pitches[2];
-        }
-    } else if (surface_image.format.fourcc == VA_FOURCC_P010) {
-        u_dst = newImageBuffer + y_size;
-        v_dst = u_dst;
-
-        u_src = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[1]);
-        v_src = u_src;
-
-        for (row = 0; row < surface_image.height / 2; row++) {
-            memcpy(u_dst, u_src, surface_image.width * 2);
-            u_dst += surface_image.width * 2;
-            u_src += surface_image.pitches[1];
-        }
-    } else {
+    if (vpp_hbd_image_to_file(&surface_image, (uint8_t *)surface_p,
+                              newImageBuffer, g_dst_file_fourcc)) {
         printf("Not supported YUV surface fourcc !!! \n");
         free(newImageBuffer);
         return VA_STATUS_ERROR_INVALID_SURFACE;
     }
 
     /* write frame to file */
-    do {
-        n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
-    } while (n_items != 1);
+    n_items = fwrite(newImageBuffer, frame_size, 1, fp);
+    if (n_items != 1)
+        va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     if (newImageBuffer) {
         free(newImageBuffer);
@@ -887,7 +755,7 @@ store_yuv_surface_to_10bit_file(FILE *fp, VASurfaceID surface_id)
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -924,9 +792,9 @@ store_rgb_surface_to_rgb_file(FILE *fp, VASurfaceID surface_id)
     }
 
     /* write frame to file */
-    do {
-        n_items = fwrite(newImageBuffer, frame_size, 1, fp);
-    } while (n_items != 1);
+    n_items = fwrite(newImageBuffer, frame_size, 1, fp);
+    if (n_items != 1)
+        va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     if (newImageBuffer) {
         free(newImageBuffer);
@@ -936,7 +804,7 @@ store_rgb_surface_to_rgb_file(FILE *fp, VASurfaceID surface_id)
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -961,10 +829,7 @@ store_yuv_surface_to_file(FILE *fp,
                (g_out_fourcc == VA_FOURCC_UYVY &&
                 g_dst_file_fourcc == VA_FOURCC_UYVY)) {
         return store_packed_yuv_surface_to_packed_file(fp, surface_id);
-    } else if ((g_out_fourcc == VA_FOURCC_I010 &&
-                g_dst_file_fourcc == VA_FOURCC_I010) ||
-               (g_out_fourcc == VA_FOURCC_P010 &&
-                g_dst_file_fourcc == VA_FOURCC_P010)) {
+    } else if (vpp_hbd_supported(g_out_fourcc, g_dst_file_fourcc)) {
         return store_yuv_surface_to_10bit_file(fp, surface_id);
     } else if ((g_out_fourcc == VA_FOURCC_RGBA &&
                 g_dst_file_fourcc == VA_FOURCC_RGBA) ||
@@ -981,6 +846,129 @@ store_yuv_surface_to_file(FILE *fp,
     }
 }
 
+static bool
+is_rgb_fourcc(uint32_t fourcc)
+{
+    return fourcc == VA_FOURCC_RGBA || fourcc == VA_FOURCC_RGBX ||
+           fourcc == VA_FOURCC_BGRA || fourcc == VA_FOURCC_BGRX;
+}
+
+static VAProcColorStandardType
+va_color_standard(int matrix)
+{
+    if (matrix == VPP_SCALE_BT709)
+        return VAProcColorStandardBT709;
+    if (matrix == VPP_SCALE_BT2020)
+        return VAProcColorStandardBT2020;
+    return VAProcColorStandardBT601;
+}
+
+static double
+time_ms()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* Frame description of a mapped image or a copy of it */
+static void
+cpu_frame(VPPScaleFrame *frame, const VAImage *image, uint8_t *data,
+          uint32_t width, uint32_t height)
+{
+    uint32_t i;
+
+    memset(frame, 0, sizeof(*frame));
+    frame->fourcc = image->format.fourcc;
+    frame->width = width;
+    frame->height = height;
+    for (i = 0; i < image->num_planes && i < 3; i++) {
+        frame->planes[i] = data + image->offsets[i];
+        frame->pitches[i] = image->pitches[i];
+    }
+}
+
+/* Run the CPU reference on the input of <out_surface_id> and add the
+ * difference to the VPP output up for the PSNR of the run. The input is
+ * copied to system memory first, only the conversion itself is timed. */
+static VAStatus
+cpu_reference(VASurfaceID in_surface_id, VASurfaceID out_surface_id)
+{
+    VAStatus va_status;
+    VAImage in_image, out_image;
+    void *in_p = NULL, *out_p = NULL;
+    VPPScaleFrame src, ref, out;
+    double start;
+
+    va_status = vaDeriveImage(va_dpy, in_surface_id, &in_image);
+    CHECK_VASTATUS(va_status, "vaDeriveImage");
+
+    va_status = vaMapBuffer(va_dpy, in_image.buf, &in_p);
+    CHECK_VASTATUS(va_status, "vaMapBuffer");
+
+    va_status = vaDeriveImage(va_dpy, out_surface_id, &out_image);
+    CHECK_VASTATUS(va_status, "vaDeriveImage");
+
+    va_status = vaMapBuffer(va_dpy, out_image.buf, &out_p);
+    CHECK_VASTATUS(va_status, "vaMapBuffer");
+
+    if (!g_cpu_src)
+        g_cpu_src = (uint8_t *)malloc(in_image.data_size);
+    if (!g_cpu_dst)
+        g_cpu_dst = (uint8_t *)malloc(out_image.data_size);
+    assert(g_cpu_src && g_cpu_dst);
+
+    memcpy(g_cpu_src, in_p, in_image.data_size);
+    cpu_frame(&src, &in_image, g_cpu_src, g_in_pic_width, g_in_pic_height);
+    cpu_frame(&ref, &out_image, g_cpu_dst, g_out_pic_width, g_out_pic_height);
+    cpu_frame(&out, &out_image, (uint8_t *)out_p, g_out_pic_width, g_out_pic_height);
+
+    start = time_ms();
+    vpp_scaler_run(g_cpu_scaler, &src, &ref);
+    g_cpu_time += time_ms() - start;
+
+    vpp_scale_compare(&ref, &out, g_cpu_sq_err, g_cpu_samples);
+
+    vaUnmapBuffer(va_dpy, out_image.buf);
+    vaDestroyImage(va_dpy, out_image.image_id);
+    vaUnmapBuffer(va_dpy, in_image.buf);
+    vaDestroyImage(va_dpy, in_image.image_id);
+
+    return va_status;
+}
+
+static void
+print_psnr(const char *name, double sq_err, uint64_t samples)
+{
+    if (sq_err > 0)
+        printf(" %s %.2f", name, 10 * log10(255.0 * 255.0 * samples / sq_err));
+    else
+        printf(" %s inf", name);
+}
+
+static void
+print_cpu_reference(int32_t frame_count)
+{
+    static const char *filters[] = { "", "bilinear", "bicubic", "lanczos" };
+    bool rgb = is_rgb_fourcc(g_out_fourcc);
+    double vpp_time = g_upload_time + g_process_time + g_download_time;
+    int i;
+
+    printf("VPP: upload %.3f, process %.3f, download %.3f ms/frame\n",
+           g_upload_time / frame_count, g_process_time / frame_count,
+           g_download_time / frame_count);
+    printf("CPU reference (%s): %.3f ms/frame, PSNR against VPP:", filters[g_cpu_filter],
+           g_cpu_time / frame_count);
+    for (i = 0; i < 3; i++)
+        print_psnr(rgb ? (i == 0 ? "R" : i == 1 ? "G" : "B") : (i == 0 ? "Y" : i == 1 ? "U" : "V"),
+                   g_cpu_sq_err[i], g_cpu_samples[i]);
+    printf(" dB\n");
+    if (g_cpu_time > 0)
+        printf("VPP is %.2fx as fast as the CPU, %.2fx with upload and download\n",
+               g_cpu_time / g_process_time, g_cpu_time / vpp_time);
+}
+
 static VAStatus
 video_frame_process(VASurfaceID in_surface_id,
                     VASurfaceID out_surface_id)
@@ -1004,6 +992,22 @@ video_frame_process(VASurfaceID in_surface_id,
     pipeline_param.surface_region = &surface_region;
     pipeline_param.output_region = &output_region;
 
+    /* RGB stays at the driver default (sRGB, full range) */
+    if (!is_rgb_fourcc(g_in_fourcc)) {
+        if (g_csc_matrix_set)
+            pipeline_param.surface_color_standard = va_color_standard(g_csc_matrix);
+        if (g_csc_range_set)
+            pipeline_param.input_color_properties.color_range =
+                g_csc_full_range ? VA_SOURCE_RANGE_FULL : VA_SOURCE_RANGE_REDUCED;
+    }
+    if (!is_rgb_fourcc(g_out_fourcc)) {
+        if (g_csc_matrix_set)
+            pipeline_param.output_color_standard = va_color_standard(g_csc_matrix);
+        if (g_csc_range_set)
+            pipeline_param.output_color_properties.color_range =
+                g_csc_full_range ? VA_SOURCE_RANGE_FULL : VA_SOURCE_RANGE_REDUCED;
+    }
+
     va_status = vaCreateBuffer(va_dpy,
                                context_id,
                                VAProcPipelineParameterBufferType,
@@ -1037,6 +1041,7 @@ static VAStatus
 vpp_context_create()
 {
     VAStatus va_status = VA_STATUS_SUCCESS;
+    uint32_t slot;
     int32_t j;
 
     /* VA driver initialization */
@@ -1080,13 +1085,15 @@ vpp_context_create()
     }
 
     /* Create surface/config/context for VPP pipeline */
-    va_status = create_surface(&g_in_surface_id, g_in_pic_width, g_in_pic_height,
-                               g_in_fourcc, g_in_format);
-    CHECK_VASTATUS(va_status, "vaCreateSurfaces for input");
-
-    va_status = create_surface(&g_out_surface_id, g_out_pic_width, g_out_pic_height,
-                               g_out_fourcc, g_out_format);
-    CHECK_VASTATUS(va_status, "vaCreateSurfaces for output");
+    for (slot = 0; slot < g_pipeline_depth; slot++) {
+        va_status = create_surface(&g_in_surface_id[slot], g_in_pic_width, g_in_pic_height,
+                                   g_in_fourcc, g_in_format);
+        CHECK_VASTATUS(va_status, "vaCreateSurfaces for input");
+
+        va_status = create_surface(&g_out_surface_id[slot], g_out_pic_width, g_out_pic_height,
+                                   g_out_fourcc, g_out_format);
+        CHECK_VASTATUS(va_status, "vaCreateSurfaces for output");
+    }
 
     va_status = vaCreateConfig(va_dpy,
                                VAProfileNone,
@@ -1101,8 +1108,8 @@ vpp_context_create()
                                 g_out_pic_width,
                                 g_out_pic_height,
                                 VA_PROGRESSIVE,
-                                &g_out_surface_id,
-                                1,
+                                g_out_surface_id,
+                                g_pipeline_depth,
                                 &context_id);
     CHECK_VASTATUS(va_status, "vaCreateContext");
     return va_status;
@@ -1112,8 +1119,8 @@ static void
 vpp_context_destroy()
 {
     /* Release resource */
-    vaDestroySurfaces(va_dpy, &g_in_surface_id, 1);
-    vaDestroySurfaces(va_dpy, &g_out_surface_id, 1);
+    vaDestroySurfaces(va_dpy, g_in_surface_id, g_pipeline_depth);
+    vaDestroySurfaces(va_dpy, g_out_surface_id, g_pipeline_depth);
     vaDestroyContext(va_dpy, context_id);
     vaDestroyConfig(va_dpy, config_id);
 
@@ -1149,6 +1156,8 @@ parse_fourcc_and_format(char *str, uint32_t *fourcc, uint32_t *format)
         tfourcc = VA_FOURCC_BGRA;
     } else if (!strcmp(str, "BGRX")) {
         tfourcc = VA_FOURCC_BGRX;
+    } else if ((tfourcc = vpp_hbd_fourcc(str, &tformat))) {
+        /* P012, P016, Y210, Y212, Y216, Y410, Y412, Y416 and planar files */
     } else {
         printf("Not supported format: %s! Currently only support following format: %s\n",
                str, "YV12, I420, NV12, YUY2(YUYV), UYVY, P010, I010, RGBA, RGBX, BGRA or BGRX");
@@ -1170,26 +1179,74 @@ parse_basic_parameters()
     char str[MAX_LEN];
 
     /* Read src frame file information */
-    read_value_string(g_config_file_fd, "SRC_FILE_NAME", g_src_file_name);
-    read_value_uint32(g_config_file_fd, "SRC_FRAME_WIDTH", &g_in_pic_width);
-    read_value_uint32(g_config_file_fd, "SRC_FRAME_HEIGHT", &g_in_pic_height);
-    read_value_string(g_config_file_fd, "SRC_FRAME_FORMAT", str);
+    vpp_config_get_string(g_config, "SRC_FILE_NAME", g_src_file_name);
+    vpp_config_get_uint32(g_config, "SRC_FRAME_WIDTH", &g_in_pic_width);
+    vpp_config_get_uint32(g_config, "SRC_FRAME_HEIGHT", &g_in_pic_height);
+    vpp_config_get_string(g_config, "SRC_FRAME_FORMAT", str);
     parse_fourcc_and_format(str, &g_in_fourcc, &g_in_format);
 
     /* Read dst frame file information */
-    read_value_string(g_config_file_fd, "DST_FILE_NAME", g_dst_file_name);
-    read_value_uint32(g_config_file_fd, "DST_FRAME_WIDTH", &g_out_pic_width);
-    read_value_uint32(g_config_file_fd, "DST_FRAME_HEIGHT", &g_out_pic_height);
-    read_value_string(g_config_file_fd, "DST_FRAME_FORMAT", str);
+    vpp_config_get_string(g_config, "DST_FILE_NAME", g_dst_file_name);
+    vpp_config_get_uint32(g_config, "DST_FRAME_WIDTH", &g_out_pic_width);
+    vpp_config_get_uint32(g_config, "DST_FRAME_HEIGHT", &g_out_pic_height);
+    vpp_config_get_string(g_config, "DST_FRAME_FORMAT", str);
     parse_fourcc_and_format(str, &g_out_fourcc, &g_out_format);
 
-    read_value_string(g_config_file_fd, "SRC_FILE_FORMAT", str);
+    vpp_config_get_string(g_config, "SRC_FILE_FORMAT", str);
     parse_fourcc_and_format(str, &g_src_file_fourcc, NULL);
 
-    read_value_string(g_config_file_fd, "DST_FILE_FORMAT", str);
+    vpp_config_get_string(g_config, "DST_FILE_FORMAT", str);
     parse_fourcc_and_format(str, &g_dst_file_fourcc, NULL);
 
-    read_value_uint32(g_config_file_fd, "FRAME_SUM", &g_frame_count);
+    vpp_config_get_uint32(g_config, "FRAME_SUM", &g_frame_count);
+
+    /* Optional, number of frames in flight between upload, process and store */
+    if (!vpp_config_get_string(g_config, "PIPELINE_DEPTH", str)) {
+        g_pipeline_depth = (uint32_t)atoi(str);
+        if (g_pipeline_depth < 1 || g_pipeline_depth > VPP_PIPELINE_MAX_DEPTH) {
+            printf("PIPELINE_DEPTH must be in [1, %d]\n", VPP_PIPELINE_MAX_DEPTH);
+            return -1;
+        }
+    }
+
+    /* Optional, color standard and range of the YUV side */
+    if (!vpp_config_get_string(g_config, "CSC_MATRIX", str)) {
+        if (!strcmp(str, "BT601"))
+            g_csc_matrix = VPP_SCALE_BT601;
+        else if (!strcmp(str, "BT709"))
+            g_csc_matrix = VPP_SCALE_BT709;
+        else if (!strcmp(str, "BT2020"))
+            g_csc_matrix = VPP_SCALE_BT2020;
+        else {
+            printf("CSC_MATRIX must be BT601, BT709 or BT2020\n");
+            return -1;
+        }
+        g_csc_matrix_set = true;
+    }
+
+    if (!vpp_config_get_string(g_config, "CSC_RANGE", str)) {
+        if (!strcmp(str, "FULL"))
+            g_csc_full_range = true;
+        else if (strcmp(str, "LIMITED")) {
+            printf("CSC_RANGE must be LIMITED or FULL\n");
+            return -1;
+        }
+        g_csc_range_set = true;
+    }
+
+    /* Optional, check every frame against the CPU scaler */
+    if (!vpp_config_get_string(g_config, "CPU_REFERENCE", str)) {
+        if (!strcmp(str, "BILINEAR"))
+            g_cpu_filter = VPP_SCALE_BILINEAR;
+        else if (!strcmp(str, "BICUBIC"))
+            g_cpu_filter = VPP_SCALE_BICUBIC;
+        else if (!strcmp(str, "LANCZOS"))
+            g_cpu_filter = VPP_SCALE_LANCZOS;
+        else {
+            printf("CPU_REFERENCE must be BILINEAR, BICUBIC or LANCZOS\n");
+            return -1;
+        }
+    }
 
     if (g_in_pic_width != g_out_pic_width ||
         g_in_pic_height != g_out_pic_height)
@@ -1208,33 +1265,101 @@ static void
 print_help()
 {
     printf("The app is used to test the scaling and csc feature.\n");
-    printf("Cmd Usage: ./vppscaling_csc process_scaling_csc.cfg\n");
+    printf("Cmd Usage: ./vppscaling_csc [--contexts N] process_scaling_csc.cfg\n");
     printf("The configure file process_scaling_csc.cfg is used to configure the para.\n");
     printf("You can refer process_scaling_csc.cfg.template for each para meaning and create the configure file.\n");
+    printf("--contexts N runs N VPP contexts (1~%d) at once over disjoint frame ranges, context n\n"
+           "writes DST_FILE_NAME.n, and reports the aggregate fps.\n", VPP_CONTEXTS_MAX);
 }
-int32_t main(int32_t argc, char *argv[])
+
+/* Each op runs on one thread, so each adds up its own time */
+static int
+pipeline_read(uint32_t /* frame */, uint32_t slot)
 {
+    double start = time_ms();
     VAStatus va_status;
-    uint32_t i;
 
-    if (argc != 2 || !strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")) {
-        print_help();
-        return -1;
-    }
+    va_status = upload_yuv_frame_to_yuv_surface(g_src_file_fd, g_in_surface_id[slot]);
+    g_upload_time += time_ms() - start;
 
-    /* Parse the configure file for video process*/
-    strncpy(g_config_file_name, argv[1], MAX_LEN);
-    g_config_file_name[MAX_LEN - 1] = '\0';
+    if (va_status == VA_STATUS_SUCCESS)
+        return 0;
 
-    if (NULL == (g_config_file_fd = fopen(g_config_file_name, "r"))) {
-        printf("Open configure file %s failed!\n", g_config_file_name);
-        assert(0);
+    /* a short read at the end of the input ends the pipeline */
+    return feof(g_src_file_fd) ? 1 : -1;
+}
+
+static VAStatus
+pipeline_process(uint32_t /* frame */, uint32_t slot)
+{
+    double start = time_ms();
+    VAStatus va_status;
+
+    va_status = video_frame_process(g_in_surface_id[slot], g_out_surface_id[slot]);
+
+    /* with the reference the process time is measured up to completion */
+    if (g_cpu_scaler && va_status == VA_STATUS_SUCCESS)
+        va_status = vaSyncSurface(va_dpy, g_out_surface_id[slot]);
+    g_process_time += time_ms() - start;
+
+    return va_status;
+}
+
+static int
+pipeline_write(uint32_t /* frame */, uint32_t slot)
+{
+    double start;
+    VAStatus va_status;
+
+    /* the input of the slot stays loaded until its output is written */
+    if (g_cpu_scaler)
+        cpu_reference(g_in_surface_id[slot], g_out_surface_id[slot]);
+
+    start = time_ms();
+    va_status = store_yuv_surface_to_file(g_dst_file_fd, g_out_surface_id[slot]);
+    g_download_time += time_ms() - start;
+
+    return va_status == VA_STATUS_SUCCESS ? 0 : -1;
+}
+
+/* Bytes of one SRC_FILE_FORMAT frame, 0 if unknown */
+static size_t
+src_file_frame_size()
+{
+    size_t luma = (size_t)g_in_pic_width * g_in_pic_height;
+
+    switch (g_src_file_fourcc) {
+    case VA_FOURCC_YV12:
+    case VA_FOURCC_I420:
+    case VA_FOURCC_NV12:
+        return luma * 3 / 2;
+    case VA_FOURCC_YUY2:
+    case VA_FOURCC_UYVY:
+        return luma * 2;
+    case VA_FOURCC_RGBA:
+    case VA_FOURCC_RGBX:
+    case VA_FOURCC_BGRA:
+    case VA_FOURCC_BGRX:
+        return luma * 4;
+    default:
+        return vpp_hbd_frame_size(g_src_file_fourcc, g_in_pic_width, g_in_pic_height);
     }
+}
 
-    /* Parse basic parameters */
-    if (parse_basic_parameters()) {
-        printf("Parse parameters in configure file error\n");
-        assert(0);
+/* One VPP context over the input frames of <range>. With more than one
+ * context each writes DST_FILE_NAME.<index> */
+static int32_t
+context_run(const VPPContextRange *range)
+{
+    VAStatus va_status;
+    VPPPipelineOps pipeline_ops = { pipeline_read, pipeline_process, pipeline_write };
+    int32_t frame_count;
+
+    if (range->count > 1) {
+        size_t len = strlen(g_dst_file_name);
+
+        g_frame_count = range->frame_count;
+        snprintf(g_dst_file_name + len, MAX_LEN - len, ".%d", range->index);
     }
 
     va_status = vpp_context_create();
@@ -1243,29 +1368,51 @@ int32_t main(int32_t argc, char *argv[])
         assert(0);
     }
 
+    if (g_cpu_filter) {
+        if (!vpp_scale_supported(g_in_fourcc) || !vpp_scale_supported(g_out_fourcc))
+            printf("CPU reference only handles 8 bit YUV and RGB surfaces, skipped\n");
+        else
+            g_cpu_scaler = vpp_scaler_create(g_cpu_filter, g_csc_matrix, g_csc_full_range,
+                                             g_in_fourcc, g_in_pic_width, g_in_pic_height,
+                                             g_out_fourcc, g_out_pic_width, g_out_pic_height);
+    }
+
     /* Video frame fetch, process and store */
-    if (NULL == (g_src_file_fd = fopen(g_src_file_name, "r"))) {
+    if (NULL == (g_src_file_fd = vpp_stream_open(g_src_file_name, "r"))) {
         printf("Open SRC_FILE_NAME: %s failed, please specify it in config file: %s !\n",
                g_src_file_name, g_config_file_name);
         assert(0);
     }
 
-    if (NULL == (g_dst_file_fd = fopen(g_dst_file_name, "w"))) {
+    if (range->first_frame) {
+        size_t frame_size = src_file_frame_size();
+
+        if (!frame_size ||
+            fseeko(g_src_file_fd, (off_t)frame_size * range->first_frame, SEEK_SET)) {
+            printf("Context %d can not seek to input frame %d\n", range->index,
+                   range->first_frame);
+            return -1;
+        }
+    }
+
+    if (NULL == (g_dst_file_fd = vpp_stream_open(g_dst_file_name, "w"))) {
         printf("Open DST_FILE_NAME: %s failed, please specify it in config file: %s !\n",
                g_dst_file_name, g_config_file_name);
         assert(0);
     }
 
+    vpp_contexts_ready();
+
     printf("\nStart to process, ...\n");
     struct timespec Pre_time;
     struct timespec Cur_time;
     unsigned int duration = 0;
     clock_gettime(CLOCK_MONOTONIC, &Pre_time);
 
-    for (i = 0; i < g_frame_count; i ++) {
-        upload_yuv_frame_to_yuv_surface(g_src_file_fd, g_in_surface_id);
-        video_frame_process(g_in_surface_id, g_out_surface_id);
-        store_yuv_surface_to_file(g_dst_file_fd, g_out_surface_id);
+    frame_count = vpp_pipeline_run(g_pipeline_depth, g_frame_count, &pipeline_ops);
+    if (frame_count < 0) {
+        printf("video frame process failed\n");
+        assert(0);
     }
 
     clock_gettime(CLOCK_MONOTONIC, &Cur_time);
@@ -1277,7 +1424,16 @@ int32_t main(int32_t argc, char *argv[])
     }
 
     printf("Finish processing, performance: \n");
-    printf("%d frames processed in: %d ms, ave time = %d ms\n", g_frame_count, duration, duration / g_frame_count);
+    printf("%d frames processed in: %d ms, ave time = %d ms\n", frame_count, duration,
+           frame_count ? duration / frame_count : 0);
+
+    if (g_cpu_scaler) {
+        if (frame_count)
+            print_cpu_reference(frame_count);
+        vpp_scaler_destroy(g_cpu_scaler);
+        free(g_cpu_src);
+        free(g_cpu_dst);
+    }
 
     if (g_src_file_fd)
         fclose(g_src_file_fd);
@@ -1285,10 +1441,56 @@ int32_t main(int32_t argc, char *argv[])
     if (g_dst_file_fd)
         fclose(g_dst_file_fd);
 
-    if (g_config_file_fd)
-        fclose(g_config_file_fd);
-
     vpp_context_destroy();
 
+    return frame_count;
+}
+
+int32_t main(int32_t argc, char *argv[])
+{
+    int contexts;
+
+    contexts = vpp_contexts_parse_args(&argc, argv);
+    if (contexts < 0 || argc != 2 || !strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")) {
+        print_help();
+        return -1;
+    }
+
+    /* Parse the configure file for video process*/
+    strncpy(g_config_file_name, argv[1], MAX_LEN);
+    g_config_file_name[MAX_LEN - 1] = '\0';
+
+    if (NULL == (g_config = vpp_config_open(g_config_file_name))) {
+        printf("Open configure file %s failed!\n", g_config_file_name);
+        assert(0);
+    }
+
+    /* frames on stdout, diagnostics on stderr */
+    if (vpp_config_has_value(g_config, "DST_FILE_NAME", "-") &&
+        vpp_stream_reserve_stdout()) {
+        printf("Failed to move the diagnostics to stderr\n");
+        assert(0);
+    }
+
+    /* Parse basic parameters */
+    if (parse_basic_parameters()) {
+        printf("Parse parameters in configure file error\n");
+        assert(0);
+    }
+
+    /* each context seeks to its share of the input and writes its own files */
+    if (contexts > 1 && (vpp_stream_is_pipe(g_src_file_name) ||
+                         vpp_config_has_value(g_config, "DST_FILE_NAME", "-"))) {
+        printf("--contexts needs a regular SRC_FILE_NAME and no DST_FILE_NAME on stdout\n");
+        return -1;
+    }
+
+    if (vpp_contexts_run(contexts, g_frame_count, context_run)) {
+        printf("video frame process failed\n");
+        assert(0);
+    }
+
+    vpp_config_close(g_config);
+
     return 0;
 }
@@ -26,6 +26,8 @@
  * also support  UserPtr 16 alignment as NV12/YV12/YUY2 input
  * support none (0, 0) top/left in render target as RGB/YV12 output
  * support none (0, 0) top/left input crop
+ * also support a ROI batch mode, resizing per frame lists of crops into tiles
+ * of an atlas output surface
  * Usage: ./vppscaling_n_out_usrptr process_scaling_n_out_usrptr.cfg
  */
 
@@ -38,6 +40,10 @@
 #include <va/va.h>
 #include <va/va_vpp.h>
 #include "va_display.h"
+#include "vpp_config.h"
+#include "vpp_dmabuf.h"
+#include "vpp_file_input.h"
+#include "vpp_stream.h"
 #if 0
 #include <va/va_x11.h>
 #endif
@@ -67,6 +73,8 @@ typedef struct {
     void                *pBuf;
     uint8_t             *pUserBase;
     uintptr_t           ptrb;
+    VPPDmaBuf           dmabuf;
+    VASurfaceAttribExternalBuffers layout;  /* CPU and DMABUF surfaces */
 } VPP_ImageInfo;
 
 
@@ -79,7 +87,7 @@ static VAConfigID  config_id = 0;
 static VASurfaceID g_in_surface_id = VA_INVALID_ID;
 static VASurfaceID *g_out_surface_ids = NULL;
 
-static FILE* g_config_file_fd = NULL;
+static VPPConfig *g_config = NULL;
 static char g_config_file_name[MAX_LEN];
 static VPP_ImageInfo    g_src_info;
 static VPP_ImageInfo    *g_dst_info = NULL;
@@ -88,93 +96,36 @@ static uint32_t g_frame_count = 0;
 static uint32_t g_dst_count = 1;
 static uint32_t g_scale_again = 0;
 
+/* 0 off, 1 read frames straight into the user pointer surface, 2 also
+ * allow wrapping the mapped file as the surface */
+static uint32_t g_src_zero_copy = 0;
+static VPPFileInput g_src_input;
+/* the driver refused to wrap the mapping, frames are copied out of it */
+static bool g_src_map_rejected = false;
 
-static int8_t
-read_value_string(FILE *fp, const char* field_name, char* value)
-{
-    char strLine[MAX_LEN];
-    char* field = NULL;
-    char* str = NULL;
-    uint16_t i;
-
-    if (!fp || !field_name || !value)  {
-        printf("Invalid fuction parameters\n");
-        return -1;
-    }
-
-    rewind(fp);
-
-    while (!feof(fp)) {
-        if (!fgets(strLine, MAX_LEN, fp))
-            continue;
-
-        for (i = 0; i < MAX_LEN && strLine[i]; i++)
-            if (strLine[i] != ' ') break;
-
-        if (i == MAX_LEN || strLine[i] == '#' || strLine[i] == '\n')
-            continue;
-
-        field = strtok(&strLine[i], ":");
-        if (strncmp(field, field_name, strlen(field_name)))
-            continue;
-
-        if (!(str = strtok(NULL, ":")))
-            continue;
-
-        /* skip blank space in string */
-        while (*str == ' ')
-            str++;
-
-        *(str + strlen(str) - 1) = '\0';
-        strcpy(value, str);
-
-        return 0;
-    }
-
-    return -1;
-}
-
-static int8_t
-read_value_uint32(FILE* fp, const char* field_name, uint32_t* value)
-{
-    char str[MAX_LEN];
-
-    if (read_value_string(fp, field_name, str)) {
-        printf("Failed to find integer field: %s", field_name);
-        return -1;
-    }
-
-    *value = (uint32_t)atoi(str);
-    return 0;
-}
-
-static int8_t
-read_value_int16(FILE* fp, const char* field_name, int16_t* value)
-{
-    char str[MAX_LEN];
-
-    if (read_value_string(fp, field_name, str)) {
-        printf("Failed to find integer field: %s", field_name);
-        return -1;
-    }
-
-    *value = (int16_t)atoi(str);
-    return 0;
-}
-
-static int8_t
-read_value_uint16(FILE* fp, const char* field_name, uint16_t* value)
-{
-    char str[MAX_LEN];
+/*
+ * ROI batch mode: the crops of all frames are read once from ROI_FILE into
+ * g_roi_rects, the crops of frame N are g_roi_rects[g_roi_first[N]] up to
+ * g_roi_first[N + 1]. They are resized to ROI_WIDTH x ROI_HEIGHT tiles of the
+ * first output surface, an atlas page. A page is composed by a single
+ * vaBeginPicture/vaEndPicture: the VA API does not say whether a background
+ * color with zero alpha keeps what earlier submissions wrote, so a page
+ * holds at most ROI_BATCH_SIZE tiles. A page is stored when it is full or
+ * the frame is done.
+ */
+#define ROI_MAX_BATCH_SIZE 64
 
-    if (read_value_string(fp, field_name, str)) {
-        printf("Failed to find integer field: %s", field_name);
-        return -1;
-    }
+static char g_roi_file_name[MAX_LEN];
+static VARectangle *g_roi_rects = NULL;
+static uint32_t *g_roi_first = NULL;
+static uint32_t g_roi_width = 0;
+static uint32_t g_roi_height = 0;
+static uint32_t g_roi_batch_size = 16;
+static FILE *g_roi_index_fd = NULL;
+static uint32_t g_roi_pages = 0;
+static uint32_t g_roi_submissions = 0;
+static uint64_t g_roi_crops = 0;
 
-    *value = (uint16_t)atoi(str);
-    return 0;
-}
 
 
 static VAStatus
@@ -198,7 +149,8 @@ create_surface(VPP_ImageInfo &img_info, VASurfaceID * p_surface_id)
                                      1);
         CHECK_VASTATUS(va_status, "vaCreateSurfaces");
 
-    } else if (img_info.memtype == VA_SURFACE_ATTRIB_MEM_TYPE_USER_PTR) {
+    } else if (img_info.memtype == VA_SURFACE_ATTRIB_MEM_TYPE_USER_PTR ||
+               img_info.memtype == VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2) {
         VASurfaceAttrib surfaceAttrib[3];
         VASurfaceAttribExternalBuffers extBuffer;
         uint32_t base_addr_align = 0x1000;
@@ -265,6 +217,24 @@ create_surface(VPP_ImageInfo &img_info, VASurfaceID * p_surface_id)
         default:
             break;
         }
+        extBuffer.pixel_format = img_info.fourcc;
+        extBuffer.width = img_info.pic_width;
+        extBuffer.height = img_info.pic_height;
+        img_info.layout = extBuffer;
+
+        if (img_info.memtype == VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2) {
+            /* same linear layout, handed over as a udmabuf dma-buf */
+            if (vpp_dmabuf_alloc(size, &img_info.dmabuf))
+                return VA_STATUS_ERROR_ALLOCATION_FAILED;
+            img_info.pUserBase = img_info.dmabuf.ptr;
+            extBuffer.data_size = img_info.dmabuf.size;
+
+            va_status = vpp_dmabuf_create_surface(va_dpy, &img_info.dmabuf, img_info.rtformat,
+                                                  &extBuffer, p_surface_id);
+            CHECK_VASTATUS(va_status, "vpp_dmabuf_create_surface");
+            return va_status;
+        }
+
         img_info.pBuf = malloc(size + base_addr_align);
         img_info.pUserBase = (uint8_t*)((((uint64_t)(img_info.pBuf) + base_addr_align - 1) / base_addr_align) * base_addr_align);
 
@@ -284,6 +254,78 @@ create_surface(VPP_ImageInfo &img_info, VASurfaceID * p_surface_id)
 }
 
 
+/* Wrap <ptr>, a frame of <frame_size> bytes in the layout of <img_info>, as
+ * a new user pointer surface */
+static VAStatus
+wrap_user_frame(VPP_ImageInfo &img_info, uint8_t *ptr, size_t frame_size,
+                VASurfaceID *p_surface_id)
+{
+    VASurfaceAttribExternalBuffers extBuffer = img_info.layout;
+    VASurfaceAttrib surfaceAttrib[3];
+    uintptr_t buffer = (uintptr_t)ptr;
+
+    surfaceAttrib[0].flags = VA_SURFACE_ATTRIB_SETTABLE;
+    surfaceAttrib[0].type = VASurfaceAttribPixelFormat;
+    surfaceAttrib[0].value.type = VAGenericValueTypeInteger;
+    surfaceAttrib[0].value.value.i = img_info.fourcc;
+
+    surfaceAttrib[1].flags = VA_SURFACE_ATTRIB_SETTABLE;
+    surfaceAttrib[1].type = VASurfaceAttribMemoryType;
+    surfaceAttrib[1].value.type = VAGenericValueTypeInteger;
+    surfaceAttrib[1].value.value.i = VA_SURFACE_ATTRIB_MEM_TYPE_USER_PTR;
+
+    surfaceAttrib[2].flags = VA_SURFACE_ATTRIB_SETTABLE;
+    surfaceAttrib[2].type = VASurfaceAttribExternalBufferDescriptor;
+    surfaceAttrib[2].value.type = VAGenericValueTypePointer;
+    surfaceAttrib[2].value.value.p = (void *)&extBuffer;
+
+    /* the mapping ends with the file, do not claim the padding rows */
+    extBuffer.data_size = frame_size;
+    extBuffer.num_buffers = 1;
+    extBuffer.buffers = &buffer;
+
+    return vaCreateSurfaces(va_dpy, img_info.rtformat, img_info.pic_width, img_info.pic_height,
+                            p_surface_id, 1, surfaceAttrib, 3);
+}
+
+/* Zero copy upload of frame <frame>: either wrap the mapped file as the
+ * input surface or read the frame straight into the surface memory */
+static VAStatus
+upload_frame_zero_copy(uint32_t frame)
+{
+    VAStatus va_status;
+    uint8_t *ptr;
+
+    va_status = vaSyncSurface(va_dpy, g_in_surface_id);
+    CHECK_VASTATUS(va_status, "vaSyncSurface");
+
+    if (g_src_input.mode == VPP_FILE_INPUT_MMAP) {
+        if (!(ptr = vpp_file_input_frame(&g_src_input, frame)))
+            return VA_STATUS_ERROR_OPERATION_FAILED;
+
+        if (!g_src_map_rejected) {
+            vaDestroySurfaces(va_dpy, &g_in_surface_id, 1);
+            va_status = wrap_user_frame(g_src_info, ptr, g_src_input.frame_size, &g_in_surface_id);
+            if (va_status == VA_STATUS_SUCCESS)
+                return va_status;
+
+            printf("Wrapping the mapped input failed: %s, copying frames instead\n",
+                   vaErrorStr(va_status));
+            g_src_map_rejected = true;
+            va_status = wrap_user_frame(g_src_info, g_src_info.pUserBase, g_src_input.frame_size,
+                                        &g_in_surface_id);
+            CHECK_VASTATUS(va_status, "vaCreateSurfaces");
+        }
+        memcpy(g_src_info.pUserBase, ptr, g_src_input.frame_size);
+        return VA_STATUS_SUCCESS;
+    }
+
+    if (vpp_file_input_read(&g_src_input, frame, g_src_info.pUserBase))
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+
+    return VA_STATUS_SUCCESS;
+}
+
 /* Load yuv frame to NV12/YUY2/YV12/ARGB surface*/
 static VAStatus
 upload_yuv_frame_to_yuv_surface(FILE *fp,
@@ -299,7 +341,7 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
     unsigned char *v_dst = NULL;
     void *surface_p = NULL;
     uint32_t frame_size, row;
-    size_t n_items;
+    size_t n_items = 0;
     unsigned char * newImageBuffer = NULL;
     va_status = vaSyncSurface(va_dpy, surface_id);
     CHECK_VASTATUS(va_status, "vaSyncSurface");
@@ -315,9 +357,7 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
 
         y_src = newImageBuffer;
         u_src = newImageBuffer + surface_image.width * surface_image.height;
@@ -342,9 +382,7 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
 
         y_src = newImageBuffer;
         y_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[0]);
@@ -360,9 +398,7 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
 
         y_src = newImageBuffer;
         v_src = newImageBuffer + surface_image.width * surface_image.height;
@@ -389,9 +425,7 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
         newImageBuffer = (unsigned char*)malloc(frame_size);
         assert(newImageBuffer);
 
-        do {
-            n_items = fread(newImageBuffer, frame_size, 1, fp);
-        } while (n_items != 1);
+        n_items = fread(newImageBuffer, frame_size, 1, fp);
 
         y_src = newImageBuffer;
         y_dst = (unsigned char *)((unsigned char*)surface_p + surface_image.offsets[0]);
@@ -413,7 +447,7 @@ upload_yuv_frame_to_yuv_surface(FILE *fp,
     CHECK_VASTATUS(va_status, "vaUnmapBuffer");
     va_status = vaDestroyImage(va_dpy, surface_image.image_id);
     CHECK_VASTATUS(va_status, "vaDestroyImage");
-    return VA_STATUS_SUCCESS;
+    return n_items == 1 ? VA_STATUS_SUCCESS : VA_STATUS_ERROR_OPERATION_FAILED;
 }
 
 static VAStatus
@@ -463,9 +497,7 @@ store_yuv_surface_to_nv12_file(FILE *fp,
         u_src += surface_image.pitches[1];
     }
     /* write frame to file */
-    do {
-        n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
-    } while (n_items != 1);
+    n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
 
     if (newImageBuffer) {
         free(newImageBuffer);
@@ -477,7 +509,7 @@ store_yuv_surface_to_nv12_file(FILE *fp,
     va_status = vaDestroyImage(va_dpy, surface_image.image_id);
     CHECK_VASTATUS(va_status, "vaDestroyImage");
 
-    return VA_STATUS_SUCCESS;
+    return n_items == 1 ? VA_STATUS_SUCCESS : VA_STATUS_ERROR_OPERATION_FAILED;
 }
 
 static VAStatus
@@ -516,9 +548,7 @@ store_packed_yuv_surface_to_yuy2_file(FILE *fp,
     }
 
     /* write frame to file */
-    do {
-        n_items = fwrite(newImageBuffer, frame_size, 1, fp);
-    } while (n_items != 1);
+    n_items = fwrite(newImageBuffer, frame_size, 1, fp);
 
     if (newImageBuffer) {
         free(newImageBuffer);
@@ -530,7 +560,7 @@ store_packed_yuv_surface_to_yuy2_file(FILE *fp,
     va_status = vaDestroyImage(va_dpy, surface_image.image_id);
     CHECK_VASTATUS(va_status, "vaDestroyImage");
 
-    return VA_STATUS_SUCCESS;
+    return n_items == 1 ? VA_STATUS_SUCCESS : VA_STATUS_ERROR_OPERATION_FAILED;
 }
 
 /* Store YV12 surface to yv12 file */
@@ -584,9 +614,9 @@ store_yuv_surface_to_yv12_file(FILE *fp,
         u_src += surface_image.pitches[2];
     }
     /* write frame to file */
-    do {
-        n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
-    } while (n_items != 1);
+    n_items = fwrite(newImageBuffer, y_size * 3 / 2, 1, fp);
+    if (n_items != 1)
+        va_status = VA_STATUS_ERROR_OPERATION_FAILED;
     if (newImageBuffer) {
         free(newImageBuffer);
         newImageBuffer = NULL;
@@ -595,7 +625,7 @@ store_yuv_surface_to_yv12_file(FILE *fp,
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 
@@ -631,9 +661,9 @@ store_rgb_surface_to_rgb_file(FILE *fp, VASurfaceID surface_id)
     }
 
     /* write frame to file */
-    do {
-        n_items = fwrite(newImageBuffer, frame_size, 1, fp);
-    } while (n_items != 1);
+    n_items = fwrite(newImageBuffer, frame_size, 1, fp);
+    if (n_items != 1)
+        va_status = VA_STATUS_ERROR_OPERATION_FAILED;
 
     if (newImageBuffer) {
         free(newImageBuffer);
@@ -643,7 +673,7 @@ store_rgb_surface_to_rgb_file(FILE *fp, VASurfaceID surface_id)
     vaUnmapBuffer(va_dpy, surface_image.buf);
     vaDestroyImage(va_dpy, surface_image.image_id);
 
-    return VA_STATUS_SUCCESS;
+    return va_status;
 }
 
 static VAStatus
@@ -680,7 +710,7 @@ video_frame_process(VASurfaceID in_surface_id,
         pipeline_param.num_additional_outputs = g_dst_count - 1;
     }
     uint32_t input_crop = 0;
-    read_value_uint32(g_config_file_fd, "SRC_SURFACE_CROP", &input_crop);
+    vpp_config_get_uint32(g_config, "SRC_SURFACE_CROP", &input_crop);
     if (input_crop == 0) {
         surface_region.x = 0;
         surface_region.y = 0;
@@ -688,14 +718,14 @@ video_frame_process(VASurfaceID in_surface_id,
         surface_region.height = g_src_info.pic_height;
     } else {
         //do the input crop
-        read_value_int16(g_config_file_fd, "SRC_CROP_LEFT_X", &surface_region.x);
-        read_value_int16(g_config_file_fd, "SRC_CROP_TOP_Y", &surface_region.y);
-        read_value_uint16(g_config_file_fd, "SRC_CROP_WIDTH", &surface_region.width);
-        read_value_uint16(g_config_file_fd, "SRC_CROP_HEIGHT", &surface_region.height);
+        vpp_config_get_int16(g_config, "SRC_CROP_LEFT_X", &surface_region.x);
+        vpp_config_get_int16(g_config, "SRC_CROP_TOP_Y", &surface_region.y);
+        vpp_config_get_uint16(g_config, "SRC_CROP_WIDTH", &surface_region.width);
+        vpp_config_get_uint16(g_config, "SRC_CROP_HEIGHT", &surface_region.height);
     }
 
     uint32_t output_crop = 0;
-    read_value_uint32(g_config_file_fd, "DST_SURFACE_CROP", &output_crop);
+    vpp_config_get_uint32(g_config, "DST_SURFACE_CROP", &output_crop);
     if (output_crop == 0) {
         output_region.x = 0;
         output_region.y = 0;
@@ -703,10 +733,10 @@ video_frame_process(VASurfaceID in_surface_id,
         output_region.height = g_dst_info[0].pic_height;
     } else {
         //do the output crop
-        read_value_int16(g_config_file_fd, "DST_CROP_LEFT_X", &output_region.x);
-        read_value_int16(g_config_file_fd, "DST_CROP_TOP_Y", &output_region.y);
-        read_value_uint16(g_config_file_fd, "DST_CROP_WIDTH", &output_region.width);
-        read_value_uint16(g_config_file_fd, "DST_CROP_HEIGHT", &output_region.height);
+        vpp_config_get_int16(g_config, "DST_CROP_LEFT_X", &output_region.x);
+        vpp_config_get_int16(g_config, "DST_CROP_TOP_Y", &output_region.y);
+        vpp_config_get_uint16(g_config, "DST_CROP_WIDTH", &output_region.width);
+        vpp_config_get_uint16(g_config, "DST_CROP_HEIGHT", &output_region.height);
     }
     pipeline_param.surface_region = &surface_region;
     pipeline_param.output_region = &output_region;
@@ -766,6 +796,215 @@ video_frame_process(VASurfaceID in_surface_id,
     return va_status;
 }
 
+static int
+roi_load(const char *file_name)
+{
+    uint32_t frame, last_frame = 0, count = 0, capacity = 256, line_num = 0, i;
+    uint32_t *frames;
+    int x, y, w, h;
+    char line[MAX_LEN];
+    const char *p;
+    FILE *fp;
+
+    if (NULL == (fp = fopen(file_name, "r"))) {
+        printf("Open ROI_FILE %s failed\n", file_name);
+        return -1;
+    }
+
+    frames = (uint32_t *)malloc(capacity * sizeof(uint32_t));
+    g_roi_rects = (VARectangle *)malloc(capacity * sizeof(VARectangle));
+    g_roi_first = (uint32_t *)calloc(g_frame_count + 1, sizeof(uint32_t));
+    if (!frames || !g_roi_rects || !g_roi_first)
+        goto error;
+
+    while (fgets(line, sizeof(line), fp)) {
+        line_num++;
+        for (p = line; *p == ' ' || *p == '\t'; p++);
+        if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0')
+            continue;
+
+        if (sscanf(p, "%u %d %d %d %d", &frame, &x, &y, &w, &h) != 5) {
+            printf("%s:%d: expected <frame> <x> <y> <width> <height>\n", file_name, line_num);
+            goto error;
+        }
+        if (frame < last_frame) {
+            printf("%s:%d: frame %d after frame %d\n", file_name, line_num, frame, last_frame);
+            goto error;
+        }
+        last_frame = frame;
+
+        /* clip to the frame, crops outside of it are dropped */
+        if (x < 0) {
+            w += x;
+            x = 0;
+        }
+        if (y < 0) {
+            h += y;
+            y = 0;
+        }
+        if (x + w > (int)g_src_info.pic_width)
+            w = (int)g_src_info.pic_width - x;
+        if (y + h > (int)g_src_info.pic_height)
+            h = (int)g_src_info.pic_height - y;
+        if (frame >= g_frame_count || w <= 0 || h <= 0)
+            continue;
+
+        if (count == capacity) {
+            uint32_t *grown_frames;
+            VARectangle *grown_rects;
+
+            capacity *= 2;
+            grown_frames = (uint32_t *)realloc(frames, capacity * sizeof(uint32_t));
+            if (!grown_frames)
+                goto error;
+            frames = grown_frames;
+            grown_rects = (VARectangle *)realloc(g_roi_rects, capacity * sizeof(VARectangle));
+            if (!grown_rects)
+                goto error;
+            g_roi_rects = grown_rects;
+        }
+        frames[count] = frame;
+        g_roi_rects[count].x = (int16_t)x;
+        g_roi_rects[count].y = (int16_t)y;
+        g_roi_rects[count].width = (uint16_t)w;
+        g_roi_rects[count].height = (uint16_t)h;
+        count++;
+    }
+    fclose(fp);
+
+    /* crops are sorted by frame, count them and turn the counts into starts */
+    for (i = 0; i < count; i++)
+        g_roi_first[frames[i] + 1]++;
+    for (i = 0; i < g_frame_count; i++)
+        g_roi_first[i + 1] += g_roi_first[i];
+    free(frames);
+
+    printf("ROI file %s: %d crops in %d frames\n", file_name, count, g_frame_count);
+    return 0;
+
+error:
+    fclose(fp);
+    free(frames);
+    VPP_FREE(g_roi_rects);
+    VPP_FREE(g_roi_first);
+    return -1;
+}
+
+/* Compose the <count> crops of one atlas page, the rest of the page is
+ * filled with black */
+static VAStatus
+roi_submit(VASurfaceID in_surface_id, VASurfaceID atlas_surface_id,
+           const VARectangle *crops, uint32_t count)
+{
+    VAStatus va_status, end_status;
+    VAProcPipelineParameterBuffer pipeline_param;
+    VABufferID buf_ids[ROI_MAX_BATCH_SIZE];
+    VARectangle tiles[ROI_MAX_BATCH_SIZE];
+    uint32_t columns = g_dst_info[0].pic_width / g_roi_width;
+    uint32_t i;
+
+    for (i = 0; i < count; i++) {
+        tiles[i].x = (int16_t)(i % columns * g_roi_width);
+        tiles[i].y = (int16_t)(i / columns * g_roi_height);
+        tiles[i].width = (uint16_t)g_roi_width;
+        tiles[i].height = (uint16_t)g_roi_height;
+
+        memset(&pipeline_param, 0, sizeof(pipeline_param));
+        pipeline_param.surface = in_surface_id;
+        pipeline_param.surface_region = &crops[i];
+        pipeline_param.output_region = &tiles[i];
+        pipeline_param.output_background_color = 0xff000000;
+        va_status = vaCreateBuffer(va_dpy,
+                                   context_id,
+                                   VAProcPipelineParameterBufferType,
+                                   sizeof(pipeline_param),
+                                   1,
+                                   &pipeline_param,
+                                   &buf_ids[i]);
+        CHECK_VASTATUS(va_status, "vaCreateBuffer");
+    }
+
+    va_status = vaBeginPicture(va_dpy, context_id, atlas_surface_id);
+    CHECK_VASTATUS(va_status, "vaBeginPicture");
+
+    /* the picture is ended even if rendering failed so that the context
+     * is usable again, the first error is returned */
+    va_status = vaRenderPicture(va_dpy, context_id, buf_ids, count);
+    end_status = vaEndPicture(va_dpy, context_id);
+    if (va_status == VA_STATUS_SUCCESS)
+        va_status = end_status;
+
+    for (i = 0; i < count; i++)
+        vaDestroyBuffer(va_dpy, buf_ids[i]);
+
+    g_roi_submissions++;
+    return va_status;
+}
+
+static VAStatus
+roi_store_page(uint32_t frame, uint32_t first_crop, uint32_t num_tiles)
+{
+    VAStatus va_status;
+    uint32_t i;
+
+    va_status = vaSyncSurface(va_dpy, g_out_surface_ids[0]);
+    CHECK_VASTATUS(va_status, "vaSyncSurface");
+
+    va_status = store_yuv_surface_to_file(g_dst_info[0].file_fd, g_out_surface_ids[0],
+                                          g_dst_info[0].fourcc);
+
+    if (g_roi_index_fd) {
+        for (i = 0; i < num_tiles; i++) {
+            const VARectangle *crop = &g_roi_rects[first_crop + i];
+
+            fprintf(g_roi_index_fd, "%d %d %d %d %d %d %d\n", g_roi_pages, i, frame,
+                    crop->x, crop->y, crop->width, crop->height);
+        }
+    }
+    g_roi_pages++;
+
+    return va_status;
+}
+
+/* Resize all crops of <frame> into as many atlas pages as they need, one
+ * submission per page */
+static VAStatus
+roi_frame_process(uint32_t frame)
+{
+    VAStatus va_status = VA_STATUS_SUCCESS;
+    uint32_t grid_size = (g_dst_info[0].pic_width / g_roi_width) *
+                         (g_dst_info[0].pic_height / g_roi_height);
+    uint32_t first = g_roi_first[frame], end = g_roi_first[frame + 1];
+    uint32_t page_first = first, count;
+
+    while (page_first < end) {
+        count = end - page_first;
+        if (count > grid_size)
+            count = grid_size;
+        if (count > g_roi_batch_size)
+            count = g_roi_batch_size;
+
+        va_status = roi_submit(g_in_surface_id, g_out_surface_ids[0],
+                               &g_roi_rects[page_first], count);
+        if (va_status != VA_STATUS_SUCCESS && count > 1) {
+            /* not every driver composes several layers in one call */
+            printf("Batch of %d crops failed (%s), falling back to one crop per page\n",
+                   count, vaErrorStr(va_status));
+            g_roi_batch_size = 1;
+            continue;
+        }
+        CHECK_VASTATUS(va_status, "roi_submit");
+        g_roi_crops += count;
+
+        va_status = roi_store_page(frame, page_first, count);
+        if (va_status != VA_STATUS_SUCCESS)
+            break;
+        page_first += count;
+    }
+
+    return va_status;
+}
+
 static VAStatus
 vpp_context_create()
 {
@@ -847,10 +1086,12 @@ vpp_context_destroy()
     va_status = vaDestroySurfaces(va_dpy, &g_in_surface_id, 1);
     CHECK_VASTATUS(va_status, "vaDestroySurfaces");
     VPP_FREE(g_src_info.pBuf);
+    vpp_dmabuf_free(&g_src_info.dmabuf);
     for (uint32_t index = 0; index < g_dst_count; index++) {
         vaDestroySurfaces(va_dpy, &g_out_surface_ids[index], 1);
         CHECK_VASTATUS(va_status, "vaDestroySurfaces");
         VPP_FREE(g_dst_info[index].pBuf);
+        vpp_dmabuf_free(&g_dst_info[index].dmabuf);
     }
     VPP_FREE(g_dst_info);
     VPP_FREE(g_out_surface_ids);
@@ -905,9 +1146,11 @@ parse_memtype_format(char *str, uint32_t *dst_memtype)
         tmemtype = VA_SURFACE_ATTRIB_MEM_TYPE_VA;
     } else if (!strcmp(str, "CPU")) {
         tmemtype = VA_SURFACE_ATTRIB_MEM_TYPE_USER_PTR;
+    } else if (!strcmp(str, "DMABUF")) {
+        tmemtype = VA_SURFACE_ATTRIB_MEM_TYPE_DRM_PRIME_2;
     } else {
         printf("Not supported format: %s! Currently only support following format: %s\n",
-               str, "VA,CPU");
+               str, "VA,CPU,DMABUF");
         assert(0);
     }
     if (dst_memtype)
@@ -922,22 +1165,24 @@ parse_basic_parameters()
     char str[MAX_LEN];
 
     /* Read src frame file information */
-    read_value_string(g_config_file_fd, "SRC_FILE_NAME", g_src_info.file_name);
-    read_value_uint32(g_config_file_fd, "SRC_FRAME_WIDTH", &g_src_info.pic_width);
-    read_value_uint32(g_config_file_fd, "SRC_FRAME_HEIGHT", &g_src_info.pic_height);
-    read_value_string(g_config_file_fd, "SRC_FRAME_FORMAT", str);
+    vpp_config_get_string(g_config, "SRC_FILE_NAME", g_src_info.file_name);
+    vpp_config_get_uint32(g_config, "SRC_FRAME_WIDTH", &g_src_info.pic_width);
+    vpp_config_get_uint32(g_config, "SRC_FRAME_HEIGHT", &g_src_info.pic_height);
+    vpp_config_get_string(g_config, "SRC_FRAME_FORMAT", str);
     parse_fourcc_and_format(str, &g_src_info.fourcc, &g_src_info.rtformat);
-    read_value_string(g_config_file_fd, "SRC_SURFACE_MEMORY_TYPE", str);
+    vpp_config_get_string(g_config, "SRC_SURFACE_MEMORY_TYPE", str);
     parse_memtype_format(str, &g_src_info.memtype);
-    read_value_uint32(g_config_file_fd, "SRC_SURFACE_CPU_ALIGN_MODE", &g_src_info.align_mode);
+    vpp_config_get_uint32(g_config, "SRC_SURFACE_CPU_ALIGN_MODE", &g_src_info.align_mode);
+    g_src_info.dmabuf.fd = g_src_info.dmabuf.memfd = -1;
 
-    read_value_uint32(g_config_file_fd, "2ND_SCALE", &g_scale_again);
+    vpp_config_get_uint32(g_config, "2ND_SCALE", &g_scale_again);
 
     /* Read dst frame file information */
-    read_value_uint32(g_config_file_fd, "DST_NUMBER", &g_dst_count);
+    vpp_config_get_uint32(g_config, "DST_NUMBER", &g_dst_count);
     g_out_surface_ids = (VASurfaceID*)malloc(g_dst_count * sizeof(VASurfaceID));
-    g_dst_info = (VPP_ImageInfo *)malloc(g_dst_count * sizeof(VPP_ImageInfo));
+    g_dst_info = (VPP_ImageInfo *)calloc(g_dst_count, sizeof(VPP_ImageInfo));
     for (uint32_t i = 0; i < g_dst_count; i++) {
+        g_dst_info[i].dmabuf.fd = g_dst_info[i].dmabuf.memfd = -1;
         char dst_file_name[MAX_LEN];
         char dst_frame_width[MAX_LEN];
         char dst_frame_height[MAX_LEN];
@@ -950,16 +1195,47 @@ parse_basic_parameters()
         sprintf(dst_frame_format, "DST_FRAME_FORMAT_%d", i + 1);
         sprintf(dst_memtype, "DST_SURFACE_MEMORY_TYPE_%d", i + 1);
         sprintf(dst_align_mode, "DST_SURFACE_CPU_ALIGN_MODE_%d", i + 1);
-        read_value_string(g_config_file_fd, dst_file_name, g_dst_info[i].file_name);
-        read_value_uint32(g_config_file_fd, dst_frame_width, &g_dst_info[i].pic_width);
-        read_value_uint32(g_config_file_fd, dst_frame_height, &g_dst_info[i].pic_height);
-        read_value_string(g_config_file_fd, dst_frame_format, str);
+        vpp_config_get_string(g_config, dst_file_name, g_dst_info[i].file_name);
+        vpp_config_get_uint32(g_config, dst_frame_width, &g_dst_info[i].pic_width);
+        vpp_config_get_uint32(g_config, dst_frame_height, &g_dst_info[i].pic_height);
+        vpp_config_get_string(g_config, dst_frame_format, str);
         parse_fourcc_and_format(str, &g_dst_info[i].fourcc, &g_dst_info[i].rtformat);
-        read_value_string(g_config_file_fd, dst_memtype, str);
+        vpp_config_get_string(g_config, dst_memtype, str);
         parse_memtype_format(str, &g_dst_info[i].memtype);
-        read_value_uint32(g_config_file_fd, dst_align_mode, &g_dst_info[i].align_mode);
+        vpp_config_get_uint32(g_config, dst_align_mode, &g_dst_info[i].align_mode);
+    }
+    vpp_config_get_uint32(g_config, "FRAME_SUM", &g_frame_count);
+    if (vpp_config_get_uint32(g_config, "SRC_ZERO_COPY", &g_src_zero_copy))
+        g_src_zero_copy = 0;
+
+    /* Optional, ROI batch mode into the first output */
+    if (!vpp_config_get_string(g_config, "ROI_FILE", g_roi_file_name)) {
+        vpp_config_get_uint32(g_config, "ROI_WIDTH", &g_roi_width);
+        vpp_config_get_uint32(g_config, "ROI_HEIGHT", &g_roi_height);
+        vpp_config_get_uint32(g_config, "ROI_BATCH_SIZE", &g_roi_batch_size);
+        if (g_dst_count != 1 || g_scale_again) {
+            printf("ROI_FILE needs DST_NUMBER 1 and no 2ND_SCALE\n");
+            return -1;
+        }
+        if (!g_roi_width || !g_roi_height ||
+            g_roi_width > g_dst_info[0].pic_width || g_roi_height > g_dst_info[0].pic_height) {
+            printf("ROI_WIDTH x ROI_HEIGHT must fit into the %d x %d output\n",
+                   g_dst_info[0].pic_width, g_dst_info[0].pic_height);
+            return -1;
+        }
+        if (g_roi_batch_size < 1 || g_roi_batch_size > ROI_MAX_BATCH_SIZE) {
+            printf("ROI_BATCH_SIZE must be in [1, %d]\n", ROI_MAX_BATCH_SIZE);
+            return -1;
+        }
+        if (roi_load(g_roi_file_name))
+            return -1;
+
+        if (!vpp_config_get_string(g_config, "ROI_INDEX_FILE", str) &&
+            NULL == (g_roi_index_fd = fopen(str, "w"))) {
+            printf("Open ROI_INDEX_FILE %s failed\n", str);
+            return -1;
+        }
     }
-    read_value_uint32(g_config_file_fd, "FRAME_SUM", &g_frame_count);
     return 0;
 }
 
@@ -987,11 +1263,18 @@ int32_t main(int32_t argc, char *argv[])
     strncpy(g_config_file_name, argv[1], MAX_LEN);
     g_config_file_name[MAX_LEN - 1] = '\0';
 
-    if (NULL == (g_config_file_fd = fopen(g_config_file_name, "r"))) {
+    if (NULL == (g_config = vpp_config_open(g_config_file_name))) {
         printf("Open configure file %s failed!\n", g_config_file_name);
         assert(0);
     }
 
+    /* frames on stdout, diagnostics on stderr */
+    if (vpp_config_has_value(g_config, "DST_FILE_NAME", "-") &&
+        vpp_stream_reserve_stdout()) {
+        printf("Failed to move the diagnostics to stderr\n");
+        assert(0);
+    }
+
     /* Parse basic parameters */
     if (parse_basic_parameters()) {
         printf("Parse parameters in configure file error\n");
@@ -1004,14 +1287,36 @@ int32_t main(int32_t argc, char *argv[])
         assert(0);
     }
 
+    g_src_input.fd = -1;
+    if (g_src_zero_copy) {
+        if (g_src_info.memtype != VA_SURFACE_ATTRIB_MEM_TYPE_USER_PTR ||
+            !vpp_file_input_layout_matches(&g_src_info.layout)) {
+            printf("Zero copy input needs a CPU source surface without pitch padding, disabled\n");
+            g_src_zero_copy = 0;
+        } else if (vpp_stream_is_pipe(g_src_info.file_name)) {
+            printf("Zero copy input needs a regular SRC_FILE_NAME, disabled\n");
+            g_src_zero_copy = 0;
+        } else if (vpp_file_input_open(g_src_info.file_name,
+                                       vpp_file_input_frame_size(g_src_info.fourcc,
+                                                                 g_src_info.pic_width,
+                                                                 g_src_info.pic_height),
+                                       g_src_zero_copy > 1, &g_src_input)) {
+            printf("Open SRC_FILE_NAME: %s failed, please specify it in config file: %s !\n",
+                   g_src_info.file_name, g_config_file_name);
+            assert(0);
+        } else {
+            printf("Zero copy input via %s\n", vpp_file_input_mode_name(g_src_input.mode));
+        }
+    }
+
     /* Video frame fetch, process and store */
-    if (NULL == (g_src_info.file_fd = fopen(g_src_info.file_name, "r"))) {
+    if (!g_src_zero_copy && NULL == (g_src_info.file_fd = vpp_stream_open(g_src_info.file_name, "r"))) {
         printf("Open SRC_FILE_NAME: %s failed, please specify it in config file: %s !\n",
                g_src_info.file_name, g_config_file_name);
         assert(0);
     }
     for (uint32_t index = 0; index < g_dst_count; index++) {
-        if (NULL == (g_dst_info[index].file_fd = fopen(g_dst_info[index].file_name, "w"))) {
+        if (NULL == (g_dst_info[index].file_fd = vpp_stream_open(g_dst_info[index].file_name, "w"))) {
             printf("Open DST_FILE_NAME: %s failed, please specify it in config file: %s !\n",
                    g_dst_info[index].file_name, g_config_file_name);
             assert(0);
@@ -1025,7 +1330,21 @@ int32_t main(int32_t argc, char *argv[])
     clock_gettime(CLOCK_MONOTONIC, &Pre_time);
 
     for (i = 0; i < g_frame_count; i ++) {
-        upload_yuv_frame_to_yuv_surface(g_src_info.file_fd, g_in_surface_id);
+        if (!g_src_zero_copy) {
+            if (upload_yuv_frame_to_yuv_surface(g_src_info.file_fd, g_in_surface_id) != VA_STATUS_SUCCESS) {
+                if (!feof(g_src_info.file_fd))
+                    printf("Read frame %d from %s failed\n", i, g_src_info.file_name);
+                break;
+            }
+        } else if (upload_frame_zero_copy(i) != VA_STATUS_SUCCESS) {
+            printf("Read frame %d from %s failed\n", i, g_src_info.file_name);
+            break;
+        }
+        if (g_roi_rects) {
+            if (roi_frame_process(i) != VA_STATUS_SUCCESS)
+                break;
+            continue;
+        }
         video_frame_process(g_in_surface_id, g_out_surface_ids);
         //first sync surface to check the process ready
         va_status = vaSyncSurface(va_dpy, g_out_surface_ids[g_dst_count - 1]);
@@ -1044,7 +1363,17 @@ int32_t main(int32_t argc, char *argv[])
     }
 
     printf("Finish processing, performance: \n");
-    printf("%d frames processed in: %d ms, ave time = %d ms\n", g_frame_count, duration, duration / g_frame_count);
+    printf("%d frames processed in: %d ms, ave time = %d ms\n", i, duration, i ? duration / i : 0);
+    if (g_roi_rects) {
+        printf("%llu crops in %d submissions (%.1f per submission) and %d atlas pages, %.0f crops/s\n",
+               (unsigned long long)g_roi_crops, g_roi_submissions,
+               g_roi_submissions ? (double)g_roi_crops / g_roi_submissions : 0.0, g_roi_pages,
+               duration ? g_roi_crops * 1000.0 / duration : 0.0);
+        if (g_roi_index_fd)
+            fclose(g_roi_index_fd);
+        VPP_FREE(g_roi_rects);
+        VPP_FREE(g_roi_first);
+    }
 
     if (g_src_info.file_fd)
         fclose(g_src_info.file_fd);
@@ -1052,10 +1381,11 @@ int32_t main(int32_t argc, char *argv[])
         if (g_dst_info[index].file_fd)
             fclose(g_dst_info[index].file_fd);
     }
-    if (g_config_file_fd)
-        fclose(g_config_file_fd);
+    vpp_config_close(g_config);
 
     vpp_context_destroy();
+    /* after the surface wrapping the mapping is gone */
+    vpp_file_input_close(&g_src_input);
 
     return 0;
 }